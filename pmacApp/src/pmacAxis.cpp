@@ -91,10 +91,19 @@ pmacAxis::pmacAxis(pmacController *pC, int axisNo)
   amp_enabled_prev_ = 0;
   fatal_following_ = 0;
   encoder_axis_ = 0;
+  positionHandle_ = -1;
+  followingErrorHandle_ = -1;
+  ixx24Handle_ = -1;
+  statusHandle_ = -1;
+  encoderHandle_ = -1;
+  encoderHandleAxis_ = 0;
   limitsCheckDisable_ = 0;
   nowTimeSecs_ = 0.0;
   lastTimeSecs_ = 0.0;
   printNextError_ = false;
+  statusParsed_ = false;
+  pollIdle_ = false;
+  epicsTimeGetCurrent(&lastBusyTime_);
   moving_ = false;
   connected_ = true;
   initialised_ = false;
@@ -150,13 +159,13 @@ void pmacAxis::initialSetup(int axisNo) {
       char var[16];
       // Request position readback
       sprintf(var, "#%dP", axisNo);
-      pC_->monitorPMACVariable(pmacMessageBroker::PMAC_FAST_READ, var);
+      pC_->monitorPMACVariable(pmacMessageBroker::PMAC_FAST_READ, var, &positionHandle_);
       // Request following error readback
       sprintf(var, "#%dF", axisNo);
-      pC_->monitorPMACVariable(pmacMessageBroker::PMAC_FAST_READ, var);
+      pC_->monitorPMACVariable(pmacMessageBroker::PMAC_FAST_READ, var, &followingErrorHandle_);
       // Request ixx24 readback
       sprintf(var, "i%d24", axisNo);
-      pC_->monitorPMACVariable(pmacMessageBroker::PMAC_FAST_READ, var);
+      pC_->monitorPMACVariable(pmacMessageBroker::PMAC_FAST_READ, var, &ixx24Handle_);
 
       // Setup any specific hardware status items
       pC_->pHardware_->setupAxisStatus(axisNo);
@@ -167,7 +176,7 @@ void pmacAxis::initialSetup(int axisNo) {
 
       // Request status readback
       sprintf(var, "#%d?", axisNo);
-      pC_->monitorPMACVariable(pmacMessageBroker::PMAC_FAST_READ, var);
+      pC_->monitorPMACVariable(pmacMessageBroker::PMAC_FAST_READ, var, &statusHandle_);
 
       pC_->registerForCallbacks(this, pmacMessageBroker::PMAC_FAST_READ);
     }
@@ -571,14 +580,14 @@ asynStatus pmacAxis::stop(double acceleration) {
   deferredMove_ = 0;
 
   debug(DEBUG_TRACE, functionName, "Axis Stop command", command);
-  status = pC_->axisWriteRead(command, response);
+  status = pC_->axisWriteRead(command, response, true);
 
   // Also abort the CS so that stopping a real motor will stop CS motion
   // This needs to be separate command for some reason
   if(assignedCS_) {
     sprintf(command, "&%dA Q7%d=Q8%d", assignedCS_, axisNo_, axisNo_);
   }
-  pC_->axisWriteRead(command, response);
+  pC_->axisWriteRead(command, response, true);
 
   return status;
 }
@@ -676,12 +685,12 @@ asynStatus pmacAxis::getAxisStatus(pmacCommandStore *sPtr) {
     int cmdStatus = 0;;
     double position = 0;
     double enc_position = 0;
-    int nvals = 0;
     int axisProblemFlag = 0;
     int limitsDisabledBit = 0;
     bool printErrors = true;
     char key[16];
-    std::string value = "";
+    int valueHandle = -1;
+    epicsInt64 ixx24 = 0;
     int retStatus = asynSuccess;
 
     static const char *functionName = "getAxisStatus";
@@ -703,40 +712,52 @@ asynStatus pmacAxis::getAxisStatus(pmacCommandStore *sPtr) {
             printErrors = 1;
         }
 
-        // Parse the axis status
+        // Parse the axis status, unless none of its values have changed since
+        // the last successful parse
         axisStatus axStatus;
-        retStatus = pC_->pHardware_->parseAxisStatus(axisNo_, sPtr, axStatus);
-        status_ = axStatus;
+        if (statusParsed_ && !pC_->pHardware_->axisStatusChanged(axisNo_, sPtr)) {
+            axStatus = status_;
+        } else {
+            retStatus = pC_->pHardware_->parseAxisStatus(axisNo_, sPtr, axStatus);
+            status_ = axStatus;
+            statusParsed_ = (retStatus == asynSuccess);
+        }
 
         setIntegerParam(pC_->PMAC_C_AxisBits01_, axStatus.status16Bit1_);
         setIntegerParam(pC_->PMAC_C_AxisBits02_, axStatus.status16Bit2_);
         setIntegerParam(pC_->PMAC_C_AxisBits03_, axStatus.status16Bit3_);
 
         // Parse the position
-        sprintf(key, "#%dP", axisNo_);
-        value = sPtr->readValue(key);
-        nvals = sscanf(value.c_str(), "%lf", &position);
-        if (nvals != 1) {
+        if (!sPtr->readDouble(positionHandle_, position)) {
             asynPrint(pC_->pasynUserSelf, ASYN_TRACE_ERROR,
                       "%s: Failed to parse position. Key: %s  Value: %s\n",
-                      functionName, key, value.c_str());
+                      functionName, sPtr->readKey(positionHandle_).c_str(),
+                      sPtr->readValue(positionHandle_).c_str());
             retStatus |= asynError;
         }
 
         // Parse the following error or encoder channel
         if (encoder_axis_ != 0) {
-            sprintf(key, "#%dP", encoder_axis_);
+            // The encoder position is monitored by the encoder axis itself, so
+            // look up its handle once the encoder axis has registered it
+            if (encoderHandleAxis_ != encoder_axis_) {
+                sprintf(key, "#%dP", encoder_axis_);
+                encoderHandle_ = sPtr->findHandle(key);
+                if (encoderHandle_ >= 0) {
+                    encoderHandleAxis_ = encoder_axis_;
+                }
+            }
+            valueHandle = encoderHandle_;
         } else {
             // Encoder position comes back on this axis - note we initially read
             // the following error into the encoder position variable
-            sprintf(key, "#%dF", axisNo_);
+            valueHandle = followingErrorHandle_;
         }
-        value = sPtr->readValue(key);
-        nvals = sscanf(value.c_str(), "%lf", &enc_position);
-        if (nvals != 1) {
+        if (!sPtr->readDouble(valueHandle, enc_position)) {
             asynPrint(pC_->pasynUserSelf, ASYN_TRACE_ERROR,
                       "%s: Failed to parse following error. Key: %s  Value: %s\n",
-                      functionName, key, value.c_str());
+                      functionName, sPtr->readKey(valueHandle).c_str(),
+                      sPtr->readValue(valueHandle).c_str());
             retStatus |= asynError;
         }
 
@@ -842,10 +863,8 @@ asynStatus pmacAxis::getAxisStatus(pmacCommandStore *sPtr) {
                 // Check we haven't intentially disabled limits for homing.
                 if (!limitsDisabled_) {
                     // Parse ixx24
-                    sprintf(key, "i%d24", axisNo_);
-                    value = sPtr->readValue(key);
-                    sscanf(value.c_str(), "$%x", &limitsDisabledBit);
-                    limitsDisabledBit = ((0x20000 & limitsDisabledBit) >> 17);
+                    sPtr->readHex(ixx24Handle_, ixx24);
+                    limitsDisabledBit = (int) ((0x20000 & ixx24) >> 17);
                     if (limitsDisabledBit) {
                         axisProblemFlag = 1;
                         if (printErrors) {
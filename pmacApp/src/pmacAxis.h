@@ -117,6 +117,13 @@ private:
     int amp_enabled_prev_;
     int fatal_following_;
     int encoder_axis_;
+    // Handles of the fast store values read by getAxisStatus
+    int positionHandle_;
+    int followingErrorHandle_;
+    int ixx24Handle_;
+    int statusHandle_;
+    int encoderHandle_;
+    int encoderHandleAxis_;
     int limitsCheckDisable_;
     epicsTimeStamp nowTime_;
     epicsFloat64 nowTimeSecs_;
@@ -124,6 +131,12 @@ private:
     bool printNextError_;
     bool moving_; // only valid within poll time - used as a hint for validating deferred coordinated moves
     axisStatus status_;
+    // True once status_ holds a successful parse of the current status values
+    bool statusParsed_;
+    // True while the fast store values of this axis are polled at the idle
+    // rate, and the last time that the axis was busy
+    bool pollIdle_;
+    epicsTimeStamp lastBusyTime_;
 
     bool connected_; // Current connection status of the hardware
     bool initialised_; // We need to keep a record of this in case the software starts up without a connection
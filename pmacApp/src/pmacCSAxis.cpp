@@ -23,6 +23,7 @@ pmacCSAxis::pmacCSAxis(pmacCSController *pController, int axisNo)
           pC_(pController) {
   //Initialize non-static data members
   deferredMove_ = 0;
+  positionHandle_ = -1;
   scale_ = 10000;
   position_ = 0.0;
   previous_position_ = 0.0;
@@ -41,7 +42,7 @@ pmacCSAxis::pmacCSAxis(pmacCSController *pController, int axisNo)
       char var[16];
       // Request position readback
       sprintf(var, "&%dQ8%d", pC_->getCSNumber(), axisNo_);
-      pC_->monitorPMACVariable(pmacMessageBroker::PMAC_FAST_READ, var);
+      pC_->monitorPMACVariable(pmacMessageBroker::PMAC_FAST_READ, var, &positionHandle_);
 
       // Register for callbacks
       pC_->registerForCallbacks(this, pmacMessageBroker::PMAC_FAST_READ);
@@ -76,7 +77,7 @@ void pmacCSAxis::goodConnection() {
       char var[16];
       // Request position readback
       sprintf(var, "&%dQ8%d", pC_->getCSNumber(), axisNo_);
-      pC_->monitorPMACVariable(pmacMessageBroker::PMAC_FAST_READ, var);
+      pC_->monitorPMACVariable(pmacMessageBroker::PMAC_FAST_READ, var, &positionHandle_);
 
       // Register for callbacks
       pC_->registerForCallbacks(this, pmacMessageBroker::PMAC_FAST_READ);
@@ -271,7 +272,7 @@ asynStatus pmacCSAxis::stop(double acceleration) {
   debug(DEBUG_TRACE, functionName, "CS Stop command", command);
 
   if (connected_){
-    status = pC_->axisWriteRead(command, response);
+    status = pC_->axisWriteRead(command, response, true);
   } else {
     debug(DEBUG_ERROR, functionName, "Cannot stop CS axis, connection lost");
     status = asynError;
@@ -315,11 +316,8 @@ void pmacCSAxis::callback(pmacCommandStore *sPtr, int type) {
  */
 asynStatus pmacCSAxis::getAxisStatus(pmacCommandStore *sPtr) {
   double position = 0;
-  int nvals = 0;
   int axisProblemFlag = 0;
   bool printErrors = true;
-  char key[16];
-  std::string value;
   int homeSignal = 0;
   int direction = 0;
   int mappedAxis = 0;
@@ -361,13 +359,11 @@ asynStatus pmacCSAxis::getAxisStatus(pmacCommandStore *sPtr) {
   }
 
   // Parse the position
-  sprintf(key, "&%dQ8%d", pC_->getCSNumber(), axisNo_);
-  value = sPtr->readValue(key);
-  nvals = sscanf(value.c_str(), "%lf", &position);
-  if (nvals != 1) {
+  if (!sPtr->readDouble(positionHandle_, position)) {
     asynPrint(pC_->pasynUserSelf, ASYN_TRACE_ERROR,
               "%s: Failed to parse position. Key: %s  Value: %s\n",
-              functionName, key, value.c_str());
+              functionName, sPtr->readKey(positionHandle_).c_str(),
+              sPtr->readValue(positionHandle_).c_str());
     retStatus |= asynError;
   }
 
@@ -55,6 +55,8 @@ private:
     asynStatus getAxisStatus(pmacCommandStore *sPtr);
 
     int deferredMove_;
+    // Handle of the readback position in the fast store
+    int positionHandle_;
     int motorPosChanged_;
     char deferredCommand_[128];
     int scale_;
@@ -166,6 +166,8 @@ pmacCSController::pmacCSController(const char *portName, const char *controllerP
   status_[0] = 0;
   status_[1] = 0;
   status_[2] = 0;
+  // Not done until the first status has been read
+  memset(&cStatus_, 0, sizeof(cStatus_));
 
   setIntegerParam(profileBuild_, 0);
 
@@ -480,6 +482,12 @@ void pmacCSController::callback(pmacCommandStore *sPtr, int type) {
   static const char *functionName = "callback";
   debug(DEBUG_TRACE, functionName, "Coordinate system status callback");
 
+  // The status and Q variables are parsed only from the store, so there is
+  // nothing new to parse unless a value has changed since the last update
+  if (!sPtr->anyDirty()) {
+    return;
+  }
+
   if(type == pmacMessageBroker::PMAC_PRE_FAST_READ) {
     // Parse the status
     ((pmacController *) pC_)->pHardware_->parseCSStatus(csNumber_, sPtr, cStatus_);
@@ -514,7 +522,7 @@ asynStatus pmacCSController::immediateWriteRead(const char *command, char *respo
   return status;
 }
 
-asynStatus pmacCSController::axisWriteRead(const char *command, char *response) {
+asynStatus pmacCSController::axisWriteRead(const char *command, char *response, bool priority) {
   static const char *functionName = "axisWriteRead";
   asynStatus status = asynSuccess;
 
@@ -525,7 +533,7 @@ asynStatus pmacCSController::axisWriteRead(const char *command, char *response)
 
   // Send the write/read demand to the PMAC controller
   if (status == asynSuccess) {
-    ((pmacController *) pC_)->axisWriteRead(command, response);
+    ((pmacController *) pC_)->axisWriteRead(command, response, priority);
   }
 
   return status;
@@ -561,9 +569,9 @@ asynStatus pmacCSController::registerForCallbacks(pmacCallbackInterface *cbPtr,
 }
 
 
-asynStatus pmacCSController::monitorPMACVariable(int poll_speed, const char *var) {
+asynStatus pmacCSController::monitorPMACVariable(int poll_speed, const char *var, int *handle) {
   // Simply forward the request to the main controller
-  return ((pmacController *) pC_)->monitorPMACVariable(poll_speed, var);
+  return ((pmacController *) pC_)->monitorPMACVariable(poll_speed, var, handle);
 }
 
 asynStatus pmacCSController::tScanCheckForErrors() {
@@ -72,7 +72,7 @@ public:
     std::string getCSAccTimeCmd(double time);
     void callback(pmacCommandStore *sPtr, int type);
     asynStatus immediateWriteRead(const char *command, char *response);
-    asynStatus axisWriteRead(const char *command, char *response);
+    asynStatus axisWriteRead(const char *command, char *response, bool priority=false);
     pmacCSAxis *getAxis(asynUser *pasynUser);
     pmacCSAxis *getAxis(int axisNo);
     pmacAxis *getRawAxis(int axisNo);
@@ -81,7 +81,8 @@ public:
     asynStatus registerForCallbacks(pmacCallbackInterface *cbPtr, int type);
 
     // Add PMAC variable/status item to monitor
-    asynStatus monitorPMACVariable(int poll_speed, const char *var);
+    asynStatus monitorPMACVariable(int poll_speed, const char *var, int *handle = NULL);
+
     asynStatus tScanCheckForErrors();
     std::string tScanGetErrorMessage();
     asynStatus tScanCheckProgramRunning(int *running);
@@ -0,0 +1,91 @@
+/*
+ * pmacCommandBuilder.cpp
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "pmacCommandBuilder.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+pmacCommandBuilder::pmacCommandBuilder() :
+        length_(0),
+        maxLength_(PMAC_MAX_LINE_LENGTH),
+        overflowed_(false) {
+  command_[0] = 0;
+}
+
+pmacCommandBuilder::~pmacCommandBuilder() {
+}
+
+/**
+ * Set the longest line that can be built, which is capped at
+ * PMAC_MAX_LINE_LENGTH.
+ *
+ * @param maxLength Maximum number of characters in the line.
+ */
+void pmacCommandBuilder::setMaxLength(int maxLength) {
+  if (maxLength < 0 || maxLength > PMAC_MAX_LINE_LENGTH) {
+    maxLength = PMAC_MAX_LINE_LENGTH;
+  }
+  maxLength_ = maxLength;
+}
+
+/**
+ * Empty the line and clear any overflow, ready to build a new one.
+ */
+void pmacCommandBuilder::clear() {
+  command_[0] = 0;
+  length_ = 0;
+  overflowed_ = false;
+}
+
+/**
+ * Append printf style formatted text to the end of the line.  If the text
+ * does not fit the line is left as it was and the overflow is remembered,
+ * after which every append fails until the line is cleared.
+ *
+ * @param format printf style format of the text.
+ * @return asynStatus
+ */
+asynStatus pmacCommandBuilder::append(const char *format, ...) {
+  va_list pvar;
+  int written = 0;
+
+  if (overflowed_) {
+    return asynError;
+  }
+
+  va_start(pvar, format);
+  written = vsnprintf(command_ + length_, maxLength_ - length_ + 1, format, pvar);
+  va_end(pvar);
+
+  if (written < 0 || written > maxLength_ - length_) {
+    command_[length_] = 0;
+    overflowed_ = true;
+    return asynError;
+  }
+  length_ += written;
+  return asynSuccess;
+}
+
+/**
+ * @return The line built so far.
+ */
+const char *pmacCommandBuilder::getCommand() {
+  return command_;
+}
+
+/**
+ * @return The number of characters in the line.
+ */
+int pmacCommandBuilder::getLength() {
+  return length_;
+}
+
+/**
+ * @return true if an append did not fit since the line was last cleared.
+ */
+bool pmacCommandBuilder::hasOverflowed() {
+  return overflowed_;
+}
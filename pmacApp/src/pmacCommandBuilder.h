@@ -0,0 +1,46 @@
+/*
+ * pmacCommandBuilder.h
+ *
+ *  Created on: 17 Oct 2026
+ *
+ * Builds a command line for the PMAC by appending values to it.  The length
+ * is tracked so that each append costs the same however long the line already
+ * is.  A line is never truncated: an append that would take it past the
+ * maximum line length fails, and the builder remembers the overflow so that
+ * the line is not sent.
+ */
+
+#ifndef PMACAPP_SRC_PMACCOMMANDBUILDER_H_
+#define PMACAPP_SRC_PMACCOMMANDBUILDER_H_
+
+#include "asynDriver.h"
+
+// Longest line that the buffers along the link to the PMAC can hold
+#define PMAC_MAX_LINE_LENGTH 1023
+
+class pmacCommandBuilder {
+public:
+    pmacCommandBuilder();
+
+    virtual ~pmacCommandBuilder();
+
+    void setMaxLength(int maxLength);
+
+    void clear();
+
+    asynStatus append(const char *format, ...);
+
+    const char *getCommand();
+
+    int getLength();
+
+    bool hasOverflowed();
+
+private:
+    char command_[PMAC_MAX_LINE_LENGTH + 1];
+    int length_;
+    int maxLength_;
+    bool overflowed_;
+};
+
+#endif /* PMACAPP_SRC_PMACCOMMANDBUILDER_H_ */
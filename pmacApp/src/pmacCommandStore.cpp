@@ -7,15 +7,38 @@
 
 #include "pmacCommandStore.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <map>
+#include <set>
 
-#define PMAC_MAX_REQUESTS 40
+// Shortest run of consecutive variables that is requested using range syntax
+#define PMAC_MIN_RANGE 3
+// Request and reply byte budgets for each command string.  The reply budget
+// keeps each reply within a single Ethernet packet and the broker read buffer
+#define PMAC_DEFAULT_REQUEST_BUDGET 250
+#define PMAC_DEFAULT_REPLY_BUDGET 1000
+// Predicted reply size (including the <CR>) for a variable not yet read
+#define PMAC_DEFAULT_REPLY_SIZE 25
 
 pmacCommandStore::pmacCommandStore() :
         pmacDebugger("pmacCommandStore"),
-        qtyCmdStrings(0) {
+        firstLowPriorityCmd_(0),
+        decimation_(1),
+        decimationCounter_(0),
+        updateComplete_(true),
+        firstIdleCmd_(0),
+        idleDecimation_(1),
+        idleCounter_(0),
+        idlePolled_(true),
+        qtyCmdStrings(0),
+        rangeQueries_(false),
+        requestBudget_(PMAC_DEFAULT_REQUEST_BUDGET),
+        replyBudget_(PMAC_DEFAULT_REPLY_BUDGET),
+        repackRequired_(false) {
   int index = 0;
-  for (index = 0; index < 100; index++) {
+  for (index = 0; index < PMAC_MAX_CMD_STRINGS; index++) {
     strcpy(commandString[index], "");
   }
 }
@@ -24,14 +47,55 @@ pmacCommandStore::~pmacCommandStore() {
 
 }
 
+/**
+ * Add a key to the store.  The returned handle is the slot holding the value
+ * of the key and remains valid until the key is deleted, so that consumers
+ * can read the value each poll without building or hashing the key.
+ *
+ * @param key The PMAC variable to request.
+ * @return The handle for the key (the existing handle if already stored).
+ */
 int pmacCommandStore::addItem(const std::string &key) {
-  this->store.insert(key, "");
+  static const pmacParsedValue emptyValue = {0, 0, 0.0, 0};
+  int slot = 0;
+  if (this->store.hasKey(key)) {
+    slot = this->store.lookup(key);
+  } else {
+    if (freeSlots_.size() > 0) {
+      slot = freeSlots_.back();
+      freeSlots_.pop_back();
+      slotKeys_[slot] = key;
+      slotValues_[slot] = "";
+      slotParsed_[slot] = emptyValue;
+      slotReplySizes_[slot] = 0;
+      slotLowPriority_[slot] = false;
+      slotIdle_[slot] = false;
+    } else {
+      slot = (int) slotKeys_.size();
+      slotKeys_.push_back(key);
+      slotValues_.push_back("");
+      slotParsed_.push_back(emptyValue);
+      slotReplySizes_.push_back(0);
+      slotLowPriority_.push_back(false);
+      slotIdle_.push_back(false);
+      slotDirty_.push_back(false);
+    }
+    this->store.insert(key, slot);
+  }
+  // A new consumer of an existing key must see its current value
+  markDirty(slot);
   this->buildCommandString();
-  return 0;
+  return slot;
 }
 
 int pmacCommandStore::deleteItem(const std::string &key) {
-  this->store.remove(key);
+  if (this->store.hasKey(key)) {
+    int slot = this->store.remove(key);
+    slotKeys_[slot] = "";
+    slotValues_[slot] = "";
+    slotParsed_[slot].status = 0;
+    freeSlots_.push_back(slot);
+  }
   this->buildCommandString();
   return 0;
 }
@@ -41,9 +105,115 @@ bool pmacCommandStore::checkForItem(const std::string &key) {
 }
 
 std::string pmacCommandStore::readValue(const std::string &key) {
+  if (!this->store.hasKey(key)) {
+    return "";
+  }
+  return slotValues_[this->store.lookup(key)];
+}
+
+/**
+ * Find the handle of a key already in the store.
+ *
+ * @param key The PMAC variable.
+ * @return The handle for the key, or -1 if the key is not in the store.
+ */
+int pmacCommandStore::findHandle(const std::string &key) {
+  if (!this->store.hasKey(key)) {
+    return -1;
+  }
   return this->store.lookup(key);
 }
 
+/**
+ * Read the latest value for a handle returned by addItem or findHandle.
+ * The reference is valid until the next update of the store.
+ *
+ * @param handle The handle of the key.
+ * @return The value, or an empty string for an invalid handle.
+ */
+const std::string &pmacCommandStore::readValue(int handle) {
+  static const std::string empty;
+  if (handle < 0 || handle >= (int) slotValues_.size()) {
+    return empty;
+  }
+  return slotValues_[handle];
+}
+
+/**
+ * Read the key that a handle refers to, for use in diagnostic messages.
+ *
+ * @param handle The handle of the key.
+ * @return The key, or an empty string for an invalid handle.
+ */
+const std::string &pmacCommandStore::readKey(int handle) {
+  static const std::string empty;
+  if (handle < 0 || handle >= (int) slotKeys_.size()) {
+    return empty;
+  }
+  return slotKeys_[handle];
+}
+
+/**
+ * Read which typed forms of a value parsed successfully.
+ *
+ * @param handle The handle of the key.
+ * @return Combination of the PMAC_PARSED_ flags, 0 for an invalid handle.
+ */
+int pmacCommandStore::readParseStatus(int handle) {
+  if (handle < 0 || handle >= (int) slotParsed_.size()) {
+    return 0;
+  }
+  return slotParsed_[handle].status;
+}
+
+/**
+ * Read a value parsed as a decimal integer.
+ *
+ * @param handle The handle of the key.
+ * @param value Set to the integer, or 0 if the value did not parse.
+ * @return True if the value parsed as an integer.
+ */
+bool pmacCommandStore::readInteger(int handle, epicsInt64 &value) {
+  value = 0;
+  if ((readParseStatus(handle) & PMAC_PARSED_INTEGER) == 0) {
+    return false;
+  }
+  value = slotParsed_[handle].integer;
+  return true;
+}
+
+/**
+ * Read a value parsed as a double.
+ *
+ * @param handle The handle of the key.
+ * @param value Set to the double, or 0.0 if the value did not parse.
+ * @return True if the value parsed as a double.
+ */
+bool pmacCommandStore::readDouble(int handle, double &value) {
+  value = 0.0;
+  if ((readParseStatus(handle) & PMAC_PARSED_DOUBLE) == 0) {
+    return false;
+  }
+  value = slotParsed_[handle].real;
+  return true;
+}
+
+/**
+ * Read a value parsed as a PMAC hex bitfield ($ prefixed).
+ *
+ * @param handle The handle of the key.
+ * @param value Set to the bitfield, or 0 if the value did not parse.
+ * @return True if the value parsed as a hex bitfield.
+ */
+bool pmacCommandStore::readHex(int handle, epicsInt64 &value) {
+  value = 0;
+  if ((readParseStatus(handle) & PMAC_PARSED_HEX) == 0) {
+    return false;
+  }
+  value = slotParsed_[handle].hex;
+  return true;
+}
+
 int pmacCommandStore::size() {
   return this->store.count();
 }
@@ -63,103 +233,636 @@ int pmacCommandStore::countCommandStrings() {
   return qtyCmdStrings;
 }
 
-int pmacCommandStore::updateReply(const std::string &cmd, const std::string &reply) {
-  static const char *functionName = "updateReply";
+/**
+ * The number of command strings to read on this update.  When decimation is
+ * set the low priority command strings, which always come last, are only
+ * included on every decimation_ updates.  The idle command strings before
+ * them are only read every idleDecimation_ updates, see isCommandStringPolled.
+ * Call once per update.
+ *
+ * @return The number of command strings to send, starting from index 0.
+ */
+int pmacCommandStore::countPolledCommandStrings() {
+  idlePolled_ = true;
+  if (idleDecimation_ > 1 && firstIdleCmd_ < firstLowPriorityCmd_) {
+    idleCounter_ = (idleCounter_ + 1) % idleDecimation_;
+    idlePolled_ = (idleCounter_ == 0);
+  }
+  if (decimation_ > 1 && firstLowPriorityCmd_ < qtyCmdStrings) {
+    decimationCounter_ = (decimationCounter_ + 1) % decimation_;
+    if (decimationCounter_ != 0) {
+      updateComplete_ = false;
+      return firstLowPriorityCmd_;
+    }
+  }
+  updateComplete_ = true;
+  return qtyCmdStrings;
+}
 
-  std::string keys = cmd;
-  std::string data = reply;
+/**
+ * @return true if the last update read every command string, including any
+ * low priority command strings.
+ */
+bool pmacCommandStore::readUpdateComplete() {
+  return updateComplete_;
+}
 
-  int status = 0;
-  int running = 1;
-  while (data.find("\r") != std::string::npos && running == 1) {
-    std::string val = data.substr(0, data.find("\r"));
-    data = data.substr(data.find("\r") + 1);
-    if (keys.find(" ") != std::string::npos) {
-      std::string key = keys.substr(0, keys.find(" "));
-      debug(DEBUG_VARIABLE, functionName, "KEY  ", key);
-      debug(DEBUG_VARIABLE, functionName, "VALUE", val);
-      keys = keys.substr(keys.find(" ") + 1);
-      if (this->store.hasKey(key)) {
-        this->store.insert(key, val);
-      }
-    } else {
-      std::string key = keys;
-      debug(DEBUG_VARIABLE, functionName, "KEY  ", key);
-      debug(DEBUG_VARIABLE, functionName, "VALUE", val);
-      if (this->store.hasKey(key)) {
-        this->store.insert(key, val);
+/**
+ * @param index The index of a command string.
+ * @return false if the command string holds only idle variables and this
+ * update (see countPolledCommandStrings) leaves them out.
+ */
+bool pmacCommandStore::isCommandStringPolled(int index) {
+  return idlePolled_ || index < firstIdleCmd_ || index >= firstLowPriorityCmd_;
+}
+
+/**
+ * Mark a variable as idle, for example the status of an axis that is not
+ * moving.  Idle variables are packed into their own command strings, read
+ * only every idleDecimation_ updates (see setIdleDecimation).
+ *
+ * Changing the idle set does not repack the command strings at once, the
+ * repack is made once by the next updateCommandStrings however many
+ * variables have changed, so that an axis marked busy is read on the next
+ * update.  Keys, handles and learned reply sizes are unaffected.
+ *
+ * @param handle The handle of the key.
+ * @param idle True to mark the variable as idle.
+ * @return 0 on success, -1 for an invalid handle.
+ */
+int pmacCommandStore::setIdle(int handle, bool idle) {
+  if (handle < 0 || handle >= (int) slotKeys_.size() || slotKeys_[handle].empty()) {
+    return -1;
+  }
+  if (slotIdle_[handle] != idle) {
+    slotIdle_[handle] = idle;
+    repackRequired_ = true;
+  }
+  return 0;
+}
+
+/**
+ * Read the idle command strings only once every factor updates.
+ *
+ * @param factor The idle decimation factor, 1 reads idle variables on every update.
+ */
+void pmacCommandStore::setIdleDecimation(int factor) {
+  idleDecimation_ = factor < 1 ? 1 : factor;
+  idleCounter_ = 0;
+}
+
+int pmacCommandStore::readIdleDecimation() {
+  return idleDecimation_;
+}
+
+/**
+ * @return The number of variables currently marked as idle.
+ */
+int pmacCommandStore::countIdle() {
+  int count = 0;
+  for (size_t slot = 0; slot < slotIdle_.size(); slot++) {
+    if (slotIdle_[slot] && !slotKeys_[slot].empty()) {
+      count++;
+    }
+  }
+  return count;
+}
+
+/**
+ * Mark a variable as low priority.  Low priority variables are packed into
+ * their own command strings so that they can be read less often than the
+ * rest of the store when it is over its time budget (see setDecimation).
+ *
+ * @param handle The handle of the key.
+ * @param lowPriority True to mark the variable as low priority.
+ * @return 0 on success, -1 for an invalid handle.
+ */
+int pmacCommandStore::setLowPriority(int handle, bool lowPriority) {
+  if (handle < 0 || handle >= (int) slotKeys_.size() || slotKeys_[handle].empty()) {
+    return -1;
+  }
+  if (slotLowPriority_[handle] != lowPriority) {
+    slotLowPriority_[handle] = lowPriority;
+    this->buildCommandString();
+  }
+  return 0;
+}
+
+/**
+ * Read the low priority command strings only once every factor updates.
+ *
+ * @param factor The decimation factor, 1 reads every command string on
+ * every update.
+ */
+void pmacCommandStore::setDecimation(int factor) {
+  decimation_ = factor < 1 ? 1 : factor;
+  decimationCounter_ = 0;
+}
+
+int pmacCommandStore::readDecimation() {
+  return decimation_;
+}
+
+/**
+ * @return A space separated list of the low priority variables.
+ */
+std::string pmacCommandStore::getLowPriorityList() {
+  std::string result;
+  for (size_t slot = 0; slot < slotKeys_.size(); slot++) {
+    if (slotLowPriority_[slot] && !slotKeys_[slot].empty()) {
+      if (!result.empty()) {
+        result += " ";
       }
-      running = 0;
+      result += slotKeys_[slot];
     }
   }
+  return result;
+}
 
-  /*
+/**
+ * Update the store with the reply to a command string.  If the command string
+ * is one of the store's own command strings then the pre-resolved slots are
+ * used, otherwise the keys are taken from the command string itself.
+ *
+ * @param cmd The command string that was sent.
+ * @param reply The reply from the PMAC, one <CR> terminated value per key.
+ * @return 0
+ */
+int pmacCommandStore::updateReply(const std::string &cmd, const std::string &reply) {
+  static const char *functionName = "updateReply";
+  std::vector<std::string> keys;
   std::string data = reply;
-  // We need to loop over the reply string splitting each data item by \r
-  std::string key = this->store.firstKey();
-  if (key == ""){
-    // No data items in the store
-    running = 0;
+  size_t keyIndex = 0;
+
+  for (int index = 0; index < qtyCmdStrings; index++) {
+    const char *storedCmd = commandString[index] + strspn(commandString[index], " ");
+    if (cmd == storedCmd) {
+      return updateReply(index, reply.c_str());
+    }
   }
-  while (data.find("\r") != std::string::npos && running == 1){
+
+  // Range requests (M5000..5031) expand into one key per reply value
+  expandKeys(cmd, keys);
+
+  while (data.find("\r") != std::string::npos && keyIndex < keys.size()) {
     std::string val = data.substr(0, data.find("\r"));
-    data = data.substr(data.find("\r")+1);
-//    printf("Key: %s   value: %s\n", key.c_str(), val.c_str());
-    this->store.insert(key, val);
-    if (this->store.hasNextKey()){
-      key = this->store.nextKey();
-    } else {
-      running = 0;
+    data = data.substr(data.find("\r") + 1);
+    const std::string &key = keys[keyIndex];
+    debug(DEBUG_VARIABLE, functionName, "KEY  ", key);
+    debug(DEBUG_VARIABLE, functionName, "VALUE", val);
+    if (this->store.hasKey(key)) {
+      setSlotValue(this->store.lookup(key), val.c_str(), (int) val.length());
     }
+    keyIndex++;
   }
-  if (data.find("\r") != std::string::npos){
-    // Too many data items
-    debug(DEBUG_ERROR, functionName, "Too many data items supplied");
-    status = -1;
-  } else {
-    if (running == 1){
-      // Not enough data items
-      debug(DEBUG_ERROR, functionName, "Not enough data items supplied");
-      status = -1;
+  return 0;
+}
+
+/**
+ * Update the store with the reply to one of its own command strings.  The
+ * reply is split in place and each value is copied straight into its slot,
+ * so once the slot strings have grown to fit their values no memory is
+ * allocated.
+ *
+ * @param index The index of the command string that was sent.
+ * @param reply The reply from the PMAC, one <CR> terminated value per key.
+ * @return 0 on success, -1 for an invalid index.
+ */
+int pmacCommandStore::updateReply(int index, const char *reply) {
+  static const char *functionName = "updateReply";
+  const char *start = reply;
+  const char *end = NULL;
+  size_t slotIndex = 0;
+  int length = 0;
+  bool trace = (getLevel() & DEBUG_VARIABLE) > 0;
+
+  if (index < 0 || index >= qtyCmdStrings) {
+    return -1;
+  }
+  const std::vector<int> &slots = commandSlots_[index];
+  while (slotIndex < slots.size() && (end = strchr(start, '\r')) != NULL) {
+    int slot = slots[slotIndex];
+    length = (int) (end - start);
+    setSlotValue(slot, start, length);
+    if (trace) {
+      debug(DEBUG_VARIABLE, functionName, "KEY  ", slotKeys_[slot]);
+      debug(DEBUG_VARIABLE, functionName, "VALUE", slotValues_[slot]);
     }
+    start = end + 1;
+    slotIndex++;
+  }
+  return 0;
+}
+
+/**
+ * @param handle The handle of the key.
+ * @return true if the value of the key has changed (or the key was added)
+ * since the dirty set was last cleared.  An invalid handle is reported as
+ * dirty so that a consumer which has not resolved its handle yet still reads.
+ */
+bool pmacCommandStore::isDirty(int handle) {
+  if (handle < 0 || handle >= (int) slotDirty_.size()) {
+    return true;
+  }
+  return slotDirty_[handle];
+}
+
+/**
+ * @return true if any value has changed since the dirty set was last cleared.
+ */
+bool pmacCommandStore::anyDirty() {
+  return !dirtySlots_.empty();
+}
+
+/**
+ * @return The handles of the values that have changed since the dirty set
+ * was last cleared, in the order they changed.
+ */
+const std::vector<int> &pmacCommandStore::readDirtySlots() {
+  return dirtySlots_;
+}
+
+/**
+ * Clear the dirty set.  Called by the broker once the callbacks for an
+ * update have been made, so each callback sees the changes since the last.
+ */
+void pmacCommandStore::clearDirty() {
+  for (size_t index = 0; index < dirtySlots_.size(); index++) {
+    slotDirty_[dirtySlots_[index]] = false;
+  }
+  dirtySlots_.clear();
+}
+
+void pmacCommandStore::markDirty(int slot) {
+  if (!slotDirty_[slot]) {
+    slotDirty_[slot] = true;
+    dirtySlots_.push_back(slot);
+  }
+}
+
+/**
+ * Store a reply value in its slot and record its reply size.  The typed forms
+ * of the value are only parsed again when the text has changed, which also
+ * adds the slot to the dirty set.
+ *
+ * @param slot The slot to update.
+ * @param value The reply value (not necessarily null terminated).
+ * @param length The length of the reply value.
+ */
+void pmacCommandStore::setSlotValue(int slot, const char *value, int length) {
+  if (slotValues_[slot].compare(0, std::string::npos, value, length) != 0) {
+    slotValues_[slot].assign(value, length);
+    parseSlotValue(slot);
+    markDirty(slot);
+  }
+  if (length + 1 > slotReplySizes_[slot]) {
+    slotReplySizes_[slot] = length + 1;
+    repackRequired_ = true;
+  }
+}
+
+/**
+ * Parse the text of a slot into its integer, double and hex forms.  The rules
+ * match the sscanf formats "%d", "%lf" and "$%x" used by the consumers.
+ *
+ * @param slot The slot to parse.
+ */
+void pmacCommandStore::parseSlotValue(int slot) {
+  const char *text = slotValues_[slot].c_str();
+  char *end = NULL;
+  pmacParsedValue &parsed = slotParsed_[slot];
 
+  parsed.status = 0;
+  parsed.integer = strtoll(text, &end, 10);
+  if (end != text) {
+    parsed.status |= PMAC_PARSED_INTEGER;
+  }
+  parsed.real = strtod(text, &end);
+  if (end != text) {
+    parsed.status |= PMAC_PARSED_DOUBLE;
+  }
+  parsed.hex = 0;
+  if (text[0] == '$') {
+    parsed.hex = strtoll(text + 1, &end, 16);
+    if (end != text + 1) {
+      parsed.status |= PMAC_PARSED_HEX;
+    }
   }
-  this->unlock();
-  */
-  return status;
 }
 
 void pmacCommandStore::report() {
   std::string key = this->store.firstKey();
-  printf("[%s] => %s\n", key.c_str(), this->store.lookup(key).c_str());
+  printf("[%s] => %s\n", key.c_str(), this->readValue(key).c_str());
   while (this->store.hasNextKey()) {
     key = this->store.nextKey();
-    printf("[%s] => %s\n", key.c_str(), this->store.lookup(key).c_str());
+    printf("[%s] => %s\n", key.c_str(), this->readValue(key).c_str());
+  }
+}
+
+/**
+ * Enable requesting runs of consecutive variables with the PMAC range syntax.
+ * When enabled, keys such as M5000, M5001 ... M5031 are requested as
+ * M5000..5031 and updateReply expands the reply back into the individual keys.
+ *
+ * @param enable True to use range requests.
+ */
+void pmacCommandStore::setRangeQueries(bool enable) {
+  rangeQueries_ = enable;
+  this->buildCommandString();
+}
+
+/**
+ * Set the maximum number of bytes in each command string and the maximum
+ * number of bytes that the reply to each command string is predicted to use.
+ *
+ * @param requestBytes Request budget (1 to PMAC_MAX_CMD_LENGTH - 1).
+ * @param replyBytes Predicted reply budget.
+ * @return 0 on success, -1 if either budget is out of range.
+ */
+int pmacCommandStore::setBudget(int requestBytes, int replyBytes) {
+  static const char *functionName = "setBudget";
+  if (requestBytes < 1 || requestBytes >= PMAC_MAX_CMD_LENGTH || replyBytes < 1) {
+    debug(DEBUG_ERROR, functionName, "Invalid command string budget");
+    return -1;
+  }
+  requestBudget_ = requestBytes;
+  replyBudget_ = replyBytes;
+  this->buildCommandString();
+  return 0;
+}
+
+/**
+ * Repack the command strings if the learned reply sizes mean that the
+ * current packing is no longer accurate.  This must not be called part way
+ * through reading the command strings.
+ */
+void pmacCommandStore::updateCommandStrings() {
+  if (repackRequired_) {
+    this->buildCommandString();
+  }
+}
+
+int pmacCommandStore::predictReplySize(const std::string &key) {
+  if (this->store.hasKey(key)) {
+    int size = slotReplySizes_[this->store.lookup(key)];
+    if (size > 0) {
+      return size;
+    }
+  }
+  return PMAC_DEFAULT_REPLY_SIZE;
+}
+
+/**
+ * Resolve the slot for each reply value of a command string.
+ *
+ * @param index The index of the command string.
+ */
+void pmacCommandStore::resolveCommandSlots(int index) {
+  std::vector<std::string> keys;
+  commandSlots_[index].clear();
+  expandKeys(commandString[index], keys);
+  for (size_t key = 0; key < keys.size(); key++) {
+    // Every key in our own command strings is in the store
+    commandSlots_[index].push_back(this->store.lookup(keys[key]));
   }
 }
 
 void pmacCommandStore::buildCommandString() {
-  char curStr[1024];  //NSCL/FRIB
-  int index = 0;
+  std::vector<std::string> keys;
+  std::vector<std::string> idleKeys;
+  std::vector<std::string> lowPriorityKeys;
+  std::string key;
+  int slot = 0;
+
   qtyCmdStrings = 0;
-  // Fill up command string buffers, MAX_VALS in each
-  std::string key = this->store.firstKey();
-  sprintf(commandString[qtyCmdStrings], " %s", key.c_str());
-  index++;
-  while (this->store.hasNextKey()) {
+  firstIdleCmd_ = 0;
+  firstLowPriorityCmd_ = 0;
+  repackRequired_ = false;
+  if (this->store.count() == 0) {
+    return;
+  }
+
+  // Take a copy of the keys, idle keys are packed after all of the others
+  // followed by the low priority keys
+  key = this->store.firstKey();
+  while (true) {
+    slot = this->store.lookup(key);
+    if (slotLowPriority_[slot]) {
+      lowPriorityKeys.push_back(key);
+    } else if (slotIdle_[slot]) {
+      idleKeys.push_back(key);
+    } else {
+      keys.push_back(key);
+    }
+    if (!this->store.hasNextKey()) {
+      break;
+    }
     key = this->store.nextKey();
-    strcpy(curStr, commandString[qtyCmdStrings]);
-    sprintf(commandString[qtyCmdStrings], "%s %s", curStr, key.c_str());
-    index++;
-    if (index == PMAC_MAX_REQUESTS) {
-      // Move onto next buffer
-      index = 0;
-      qtyCmdStrings++;
-      strcpy(commandString[qtyCmdStrings], "");
+  }
+  packCommandStrings(keys);
+  firstIdleCmd_ = qtyCmdStrings;
+  packCommandStrings(idleKeys);
+  firstLowPriorityCmd_ = qtyCmdStrings;
+  packCommandStrings(lowPriorityKeys);
+}
+
+/**
+ * Pack a set of keys into command strings, appending them after any command
+ * strings already built.
+ *
+ * @param keys The keys to pack.
+ */
+void pmacCommandStore::packCommandStrings(const std::vector<std::string> &keys) {
+  std::map<std::string, std::set<long> > rangeKeys;
+  std::string cmd = "";
+  std::string prefix;
+  int cmdReplyBytes = 0;
+  long number = 0;
+  char numStr[48];
+
+  // Group any keys that can be part of a range by prefix
+  if (rangeQueries_) {
+    for (size_t index = 0; index < keys.size(); index++) {
+      if (splitRangeKey(keys[index], prefix, number)) {
+        rangeKeys[prefix].insert(number);
+      }
+    }
+  }
+
+  // Fill up command string buffers to the request and predicted reply budgets
+  for (size_t index = 0; index < keys.size(); index++) {
+    if (rangeQueries_ && splitRangeKey(keys[index], prefix, number)) {
+      std::set<long> &numbers = rangeKeys[prefix];
+      if (numbers.count(number) == 0) {
+        // Already requested as part of an earlier run
+        continue;
+      }
+      long first = number;
+      long last = number;
+      while (numbers.count(first - 1) > 0) {
+        first--;
+      }
+      while (numbers.count(last + 1) > 0) {
+        last++;
+      }
+      for (long val = first; val <= last; val++) {
+        numbers.erase(val);
+      }
+      if (last - first + 1 < PMAC_MIN_RANGE) {
+        for (long val = first; val <= last; val++) {
+          sprintf(numStr, "%ld", val);
+          appendRequest(prefix + numStr, predictReplySize(prefix + numStr), cmd, cmdReplyBytes);
+        }
+      } else {
+        // Split the run wherever it would exceed the reply budget of the
+        // current command string
+        while (first <= last) {
+          long end = first;
+          sprintf(numStr, "%ld", first);
+          int replyBytes = predictReplySize(prefix + numStr);
+          if (cmdReplyBytes > 0 && cmdReplyBytes + replyBytes > replyBudget_) {
+            storeCommandString(cmd, cmdReplyBytes);
+          }
+          while (end < last) {
+            sprintf(numStr, "%ld", end + 1);
+            int nextBytes = predictReplySize(prefix + numStr);
+            if (cmdReplyBytes + replyBytes + nextBytes > replyBudget_) {
+              break;
+            }
+            replyBytes += nextBytes;
+            end++;
+          }
+          if (end == first) {
+            sprintf(numStr, "%ld", first);
+          } else {
+            snprintf(numStr, sizeof(numStr), "%ld..%ld", first, end);
+          }
+          appendRequest(prefix + numStr, replyBytes, cmd, cmdReplyBytes);
+          first = end + 1;
+        }
+      }
+    } else {
+      appendRequest(keys[index], predictReplySize(keys[index]), cmd, cmdReplyBytes);
+    }
+  }
+  // Finally store the last command string
+  storeCommandString(cmd, cmdReplyBytes);
+}
+
+/**
+ * Add a request to the command string being built, moving on to the next
+ * command string buffer if the request would take it past either budget.
+ *
+ * @param request The variable or range of variables to request.
+ * @param replyBytes The predicted number of reply bytes for the request.
+ * @param cmd The command string being built.
+ * @param cmdReplyBytes The predicted number of reply bytes for cmd.
+ */
+void pmacCommandStore::appendRequest(const std::string &request, int replyBytes,
+                                     std::string &cmd, int &cmdReplyBytes) {
+  if (cmd.length() + 1 + request.length() > (size_t) requestBudget_ ||
+      cmdReplyBytes + replyBytes > replyBudget_) {
+    // Move onto next buffer
+    storeCommandString(cmd, cmdReplyBytes);
+  }
+  cmd += " " + request;
+  cmdReplyBytes += replyBytes;
+}
+
+/**
+ * Copy a completed command string into the next command string buffer and
+ * reset the command string being built.
+ */
+void pmacCommandStore::storeCommandString(std::string &cmd, int &cmdReplyBytes) {
+  static const char *functionName = "storeCommandString";
+  if (cmd.length() == 0) {
+    return;
+  }
+  if (qtyCmdStrings < PMAC_MAX_CMD_STRINGS) {
+    strncpy(commandString[qtyCmdStrings], cmd.c_str(), PMAC_MAX_CMD_LENGTH - 1);
+    commandString[qtyCmdStrings][PMAC_MAX_CMD_LENGTH - 1] = '\0';
+    resolveCommandSlots(qtyCmdStrings);
+    qtyCmdStrings++;
+  } else {
+    debug(DEBUG_ERROR, functionName, "Too many command strings, dropped", cmd);
+  }
+  cmd = "";
+  cmdReplyBytes = 0;
+}
+
+/**
+ * Split a key into a prefix and variable number if it can be requested as
+ * part of a range, e.g. M5000 => "M", 5000 and &2Q81 => "&2Q", 81.
+ *
+ * @param key The key to split.
+ * @param prefix Set to the variable prefix.
+ * @param number Set to the variable number.
+ * @return true if the key is an I, M, P or Q variable.
+ */
+bool pmacCommandStore::splitRangeKey(const std::string &key, std::string &prefix,
+                                     long &number) {
+  size_t pos = 0;
+
+  // Optional coordinate system prefix for Q variables
+  if (pos < key.length() && key[pos] == '&') {
+    pos++;
+    while (pos < key.length() && isdigit(key[pos])) {
+      pos++;
+    }
+  }
+  if (pos >= key.length() || strchr("IiMmPpQq", key[pos]) == NULL) {
+    return false;
+  }
+  pos++;
+  // The number must round trip exactly, so no leading zeros
+  if (pos >= key.length() || key.length() - pos > 9 ||
+      (key[pos] == '0' && key.length() - pos > 1)) {
+    return false;
+  }
+  for (size_t index = pos; index < key.length(); index++) {
+    if (!isdigit(key[index])) {
+      return false;
+    }
+  }
+  prefix = key.substr(0, pos);
+  number = atol(key.c_str() + pos);
+  return true;
+}
+
+/**
+ * Convert a command string into the list of keys that the reply values
+ * correspond to, expanding any range requests.
+ *
+ * @param cmd The command string sent to the PMAC.
+ * @param keys Populated with one key per expected reply value.
+ */
+void pmacCommandStore::expandKeys(const std::string &cmd, std::vector<std::string> &keys) {
+  size_t start = cmd.find_first_not_of(" ");
+  size_t end = 0;
+  size_t range = 0;
+  char numStr[32];
+
+  while (start != std::string::npos) {
+    end = cmd.find(" ", start);
+    if (end == std::string::npos) {
+      end = cmd.length();
+    }
+    std::string token = cmd.substr(start, end - start);
+    range = token.find("..");
+    if (range == std::string::npos) {
+      keys.push_back(token);
+    } else {
+      size_t digits = token.find_last_not_of("0123456789", range - 1) + 1;
+      std::string prefix = token.substr(0, digits);
+      long first = atol(token.c_str() + digits);
+      long last = atol(token.c_str() + range + 2);
+      for (long val = first; val <= last; val++) {
+        sprintf(numStr, "%ld", val);
+        keys.push_back(prefix + numStr);
+      }
     }
+    start = cmd.find_first_not_of(" ", end);
   }
-  // Finally +1 to command strings
-  qtyCmdStrings++;
 }
 
 std::string pmacCommandStore::getVariablesList(
@@ -172,7 +875,7 @@ std::string pmacCommandStore::getVariablesList(
 
   do {
     if (key.find(substring) != std::string::npos) {
-      value = this->store.lookup(key);
+      value = this->readValue(key);
       // don't report on zero value variables
       if (value != "0") {
         epicsSnprintf(tmp, sizeof(tmp), "%s=%s ", key.c_str(), value.c_str());
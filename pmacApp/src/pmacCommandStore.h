@@ -11,8 +11,25 @@
 #include "epicsTypes.h"
 #include "epicsMutex.h"
 #include "epicsStdio.h"
-#include "StringHashtable.h"
+#include "IntegerHashtable.h"
 #include "pmacDebugger.h"
+#include <vector>
+
+#define PMAC_MAX_CMD_STRINGS 100
+#define PMAC_MAX_CMD_LENGTH 1024
+
+// Parse status flags recording which typed forms of a value are valid
+#define PMAC_PARSED_INTEGER 0x1
+#define PMAC_PARSED_DOUBLE 0x2
+#define PMAC_PARSED_HEX 0x4
+
+// A value parsed once when its reply arrives
+struct pmacParsedValue {
+    epicsInt64 integer;
+    epicsInt64 hex;
+    double real;
+    int status;
+};
 
 class pmacCommandStore : public pmacDebugger {
 public:
@@ -28,16 +45,68 @@ public:
 
     std::string readValue(const std::string &key);
 
+    int findHandle(const std::string &key);
+
+    const std::string &readValue(int handle);
+
+    const std::string &readKey(int handle);
+
+    int readParseStatus(int handle);
+
+    bool readInteger(int handle, epicsInt64 &value);
+
+    bool readDouble(int handle, double &value);
+
+    bool readHex(int handle, epicsInt64 &value);
+
     int size();
 
     std::string readCommandString(int index);
 
     int countCommandStrings();
 
+    int countPolledCommandStrings();
+
+    bool readUpdateComplete();
+
+    int setLowPriority(int handle, bool lowPriority);
+
+    void setDecimation(int factor);
+
+    int readDecimation();
+
+    std::string getLowPriorityList();
+
+    bool isCommandStringPolled(int index);
+
+    int setIdle(int handle, bool idle);
+
+    void setIdleDecimation(int factor);
+
+    int readIdleDecimation();
+
+    int countIdle();
+
     int updateReply(const std::string &cmd, const std::string &reply);
 
+    bool isDirty(int handle);
+
+    bool anyDirty();
+
+    const std::vector<int> &readDirtySlots();
+
+    void clearDirty();
+
+    int updateReply(int index, const char *reply);
+
     void report();
 
+    void setRangeQueries(bool enable);
+
+    int setBudget(int requestBytes, int replyBytes);
+
+    void updateCommandStrings();
+
     std::string getVariablesList(
             const std::string & substring,
             const std::string & remove=std::string());
@@ -45,9 +114,62 @@ public:
 private:
     void buildCommandString();
 
-    StringHashtable store;
-    char commandString[100][1024];
+    void packCommandStrings(const std::vector<std::string> &keys);
+
+    void appendRequest(const std::string &request, int replyBytes, std::string &cmd,
+                       int &cmdReplyBytes);
+
+    void storeCommandString(std::string &cmd, int &cmdReplyBytes);
+
+    int predictReplySize(const std::string &key);
+
+    void resolveCommandSlots(int index);
+
+    void setSlotValue(int slot, const char *value, int length);
+
+    void parseSlotValue(int slot);
+
+    void markDirty(int slot);
+
+    static bool splitRangeKey(const std::string &key, std::string &prefix, long &number);
+
+    static void expandKeys(const std::string &cmd, std::vector<std::string> &keys);
+
+    // Maps each key to the slot holding its value.  Slots are fixed when the
+    // key is added so that replies can be parsed without any lookups
+    IntegerHashtable store;
+    std::vector<std::string> slotKeys_;
+    std::vector<std::string> slotValues_;
+    std::vector<pmacParsedValue> slotParsed_;
+    // Largest reply (in bytes, including the <CR>) seen for each slot
+    std::vector<int> slotReplySizes_;
+    std::vector<int> freeSlots_;
+    // Low priority slots are packed into the last command strings, from
+    // firstLowPriorityCmd_, which are only read every decimation_ updates
+    std::vector<bool> slotLowPriority_;
+    int firstLowPriorityCmd_;
+    int decimation_;
+    int decimationCounter_;
+    bool updateComplete_;
+    // Idle slots are packed between the normal and low priority slots, from
+    // firstIdleCmd_, and are only read every idleDecimation_ updates
+    std::vector<bool> slotIdle_;
+    int firstIdleCmd_;
+    int idleDecimation_;
+    int idleCounter_;
+    bool idlePolled_;
+    // Slots whose value has changed since the last callbacks, as flags for
+    // lookup by handle and as a list so clearing costs only the changes
+    std::vector<bool> slotDirty_;
+    std::vector<int> dirtySlots_;
+    char commandString[PMAC_MAX_CMD_STRINGS][PMAC_MAX_CMD_LENGTH];
+    // The slot for each reply value of each command string
+    std::vector<int> commandSlots_[PMAC_MAX_CMD_STRINGS];
     int qtyCmdStrings;
+    bool rangeQueries_;
+    int requestBudget_;
+    int replyBudget_;
+    bool repackRequired_;
 };
 
 #endif /* PMACAPP_SRC_PMACCOMMANDSTORE_H_ */
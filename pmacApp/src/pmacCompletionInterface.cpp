@@ -0,0 +1,13 @@
+/*
+ * pmacCompletionInterface.cpp
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "pmacCompletionInterface.h"
+
+pmacCompletionInterface::pmacCompletionInterface() {
+}
+
+pmacCompletionInterface::~pmacCompletionInterface() {
+}
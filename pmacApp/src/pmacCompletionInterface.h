@@ -0,0 +1,26 @@
+/*
+ * pmacCompletionInterface.h
+ *
+ *  Created on: 17 Oct 2026
+ *
+ * Interface notified by the message broker when a command queued with
+ * pmacMessageBroker::submitWriteRead has been sent and its reply read.
+ */
+
+#ifndef PMACAPP_SRC_PMACCOMPLETIONINTERFACE_H_
+#define PMACAPP_SRC_PMACCOMPLETIONINTERFACE_H_
+
+#include "asynDriver.h"
+
+class pmacCompletionInterface {
+public:
+    pmacCompletionInterface();
+
+    virtual ~pmacCompletionInterface();
+
+    // Called from the broker's submit thread, so must not wait on the broker
+    // or on any port driver lock held while submitting
+    virtual void completed(const char *command, const char *response, asynStatus status) = 0;
+};
+
+#endif /* PMACAPP_SRC_PMACCOMPLETIONINTERFACE_H_ */
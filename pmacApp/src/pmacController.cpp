@@ -42,6 +42,15 @@ using std::dec;
 
 static const char *driverName = "pmacController";
 
+// Names used in the histogram parameters, indexed by the broker store type
+// (then PMAC_IMMEDIATE_STATS and PMAC_PRIORITY_STATS), metric and summary
+static const char *histogramCategories[PMAC_STATS_CATEGORIES] = {"SLOW", "MEDIUM", "FAST",
+                                                                 "PREFAST", "IMMEDIATE",
+                                                                 "PRIORITY"};
+static const char *histogramMetrics[PMAC_STATS_METRICS] = {"RTT", "REQ_BYTES", "REPLY_BYTES",
+                                                           "LATENCY"};
+static const char *histogramSummaries[PMAC_HISTOGRAM_SUMMARIES] = {"P50", "P90", "P99", "MAX"};
+
 const epicsUInt32 pmacController::PMAC_MAXBUF_ = PMAC_MAXBUF;
 const epicsFloat64 pmacController::PMAC_TIMEOUT_ = 2.0;
 const epicsUInt32 pmacController::PMAC_FEEDRATE_LIM_ = 100;
@@ -151,6 +160,7 @@ pmacController::pmacController(const char *portName, const char *lowLevelPortNam
   pHardware_ = NULL;
   connected_ = 0;
   initialised_ = 0;
+  reprimeRequired_ = false;
   cid_ = 0;
   cpu_ = "";
   parameterIndex_ = 0;
@@ -166,12 +176,18 @@ pmacController::pmacController(const char *portName, const char *lowLevelPortNam
   feedRatePoll_ = false;
   movingPollPeriod_ = movingPollPeriod;
   idlePollPeriod_ = idlePollPeriod;
+  pollOverBudgetCount_ = 0;
+  pollUnderBudgetCount_ = 0;
+  idleAxisDecimation_ = 1;
+  epicsTimeGetCurrent(&lastDemandTime_);
   pvtTimeMode_ = 0;
   profileInitialized_ = false;
+  profileCapacity_ = 0;
   profileBuilt_ = false;
   appendAvailable_ = false;
   tScanShortScan_ = false;
   tScanExecuting_ = 0;
+  tScanFillDuration_ = 0.0;
   tScanCSNo_ = 0;
   tScanAxisMask_ = 0;
   tScanPointCtr_ = 0;
@@ -182,14 +198,26 @@ pmacController::pmacController(const char *portName, const char *lowLevelPortNam
   tScanPmacBufferAddressA_ = 0;
   tScanPmacBufferAddressB_ = 0;
   tScanPmacBufferSize_ = 0;
-  tScanPositions_ = NULL;
-  tScanVelocities_ = NULL;
+  eguProfilePositions_ = NULL;
+  eguProfileVelocities_ = NULL;
+  profileUser_ = NULL;
+  profileVelMode_ = NULL;
   tScanPmacProgVersion_ = 0.0;
   i8_ = 0;
   i7002_ = 0;
   csResetAllDemands = false;
   csCount = 0;
-
+  for (index = 0; index < PMAC_MEDIUM_PLCS; index++) {
+    plcHandles_[index] = -1;
+  }
+  for (index = 0; index < PMAC_MEDIUM_PROGS; index++) {
+    progHandles_[index] = -1;
+  }
+  for (index = 0; index < PMAC_MEDIUM_GPIO_BITS; index++) {
+    gpioOutputHandles_[index] = -1;
+    gpioInputHandles_[index] = -1;
+  }
+  gpioHandlesValid_ = false;
 
   // Create the message broker
   pBroker_ = new pmacMessageBroker(this->pasynUserSelf);
@@ -197,11 +225,7 @@ pmacController::pmacController(const char *portName, const char *lowLevelPortNam
   // Create the hashtable for storing port to CS number mappings
   pPortToCs_ = new IntegerHashtable();
 
-  // Create the parameter hashtables
-  pIntParams_ = new IntegerHashtable();
-  pHexParams_ = new IntegerHashtable();
-  pDoubleParams_ = new IntegerHashtable();
-  pStringParams_ = new IntegerHashtable();
+  // Create the write parameter hashtable
   pWriteParams_ = new StringHashtable();
 
   pAxes_ = (pmacAxis **) (asynMotorController::pAxes_);
@@ -286,7 +310,12 @@ asynStatus pmacController::checkConnection() {
 
   if (status == asynSuccess) {
     connected_ = connected;  //must be before initialSetup() call
-    if (connected && newConnection)  initialSetup();  //config new gpascii session
+    if (connected && newConnection) {
+      //config new gpascii session
+      if (initialSetup() == asynSuccess) {
+        reprimeRequired_ = true;
+      }
+    }
     debug(DEBUG_VARIABLE, functionName, "Connection status", connected_);
   } else {
     connected_ = false;
@@ -392,6 +421,7 @@ void pmacController::createAsynParams(void) {
   createParam(PMAC_C_DebugCmdString, asynParamInt32, &PMAC_C_DebugCmd_);
   createParam(PMAC_C_DisablePollingString, asynParamInt32, &PMAC_C_DisablePolling_);
   createParam(PMAC_C_FastUpdateTimeString, asynParamFloat64, &PMAC_C_FastUpdateTime_);
+  createParam(PMAC_C_PollDecimationString, asynParamInt32, &PMAC_C_PollDecimation_);
   createParam(PMAC_C_LastParamString, asynParamInt32, &PMAC_C_LastParam_);
   createParam(PMAC_C_CpuNumCoresString, asynParamInt32,&PMAC_C_CpuNumCores_);
   createParam(PMAC_C_CpuUsage0String, asynParamFloat64, &PMAC_C_CpuUsage0_);
@@ -486,6 +516,17 @@ void pmacController::createAsynParams(void) {
   createParam(PMAC_C_AveBytesWrittenString, asynParamInt32, &PMAC_C_AveBytesWritten_);
   createParam(PMAC_C_AveBytesReadString, asynParamInt32, &PMAC_C_AveBytesRead_);
   createParam(PMAC_C_AveTimeString, asynParamInt32, &PMAC_C_AveTime_);
+  createParam(PMAC_C_SubmitFailuresString, asynParamInt32, &PMAC_C_SubmitFailures_);
+  for (int category = 0; category < PMAC_STATS_CATEGORIES; category++) {
+    for (int metric = 0; metric < PMAC_STATS_METRICS; metric++) {
+      for (int summary = 0; summary < PMAC_HISTOGRAM_SUMMARIES; summary++) {
+        char histogramString[64];
+        sprintf(histogramString, PMAC_C_HistogramString, histogramCategories[category],
+                histogramMetrics[metric], histogramSummaries[summary]);
+        createParam(histogramString, asynParamInt32, &PMAC_C_Histogram_[category][metric][summary]);
+      }
+    }
+  }
   createParam(PMAC_C_FastStoreString, asynParamInt32, &PMAC_C_FastStore_);
   createParam(PMAC_C_MediumStoreString, asynParamInt32, &PMAC_C_MediumStore_);
   createParam(PMAC_C_SlowStoreString, asynParamInt32, &PMAC_C_SlowStore_);
@@ -517,6 +558,7 @@ void pmacController::initAsynParams(void) {
   paramStatus = ((setIntegerParam(PMAC_C_FeedRateCS_, 0) == asynSuccess) && paramStatus);
   paramStatus = ((setIntegerParam(PMAC_C_FeedRateLimit_, 100) == asynSuccess) && paramStatus);
   paramStatus = ((setDoubleParam(PMAC_C_FastUpdateTime_, 0.0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(PMAC_C_PollDecimation_, 1) == asynSuccess) && paramStatus);
   paramStatus = ((setIntegerParam(PMAC_C_AxisReadonly_, 0) == asynSuccess) && paramStatus);
   paramStatus = ((setIntegerParam(PMAC_C_CoordSysGroup_, 0) == asynSuccess) && paramStatus);
   for (int axis = 0; axis < numAxes_; axis++) {
@@ -560,6 +602,15 @@ void pmacController::initAsynParams(void) {
   paramStatus = ((setIntegerParam(PMAC_C_AveBytesWritten_, 0) == asynSuccess) && paramStatus);
   paramStatus = ((setIntegerParam(PMAC_C_AveBytesRead_, 0) == asynSuccess) && paramStatus);
   paramStatus = ((setIntegerParam(PMAC_C_AveTime_, 0) == asynSuccess) && paramStatus);
+  paramStatus = ((setIntegerParam(PMAC_C_SubmitFailures_, 0) == asynSuccess) && paramStatus);
+  for (int category = 0; category < PMAC_STATS_CATEGORIES; category++) {
+    for (int metric = 0; metric < PMAC_STATS_METRICS; metric++) {
+      for (int summary = 0; summary < PMAC_HISTOGRAM_SUMMARIES; summary++) {
+        paramStatus = ((setIntegerParam(PMAC_C_Histogram_[category][metric][summary], 0) ==
+                        asynSuccess) && paramStatus);
+      }
+    }
+  }
   paramStatus = ((setIntegerParam(PMAC_C_FastStore_, 0) == asynSuccess) && paramStatus);
   paramStatus = ((setIntegerParam(PMAC_C_MediumStore_, 0) == asynSuccess) && paramStatus);
   paramStatus = ((setIntegerParam(PMAC_C_SlowStore_, 0) == asynSuccess) && paramStatus);
@@ -591,10 +642,7 @@ void pmacController::pollAllNow(void) {
 
   debug(DEBUG_FLOW, functionName);
   // Force updates of each loop
-  pBroker_->updateVariables(pmacMessageBroker::PMAC_PRE_FAST_READ);
-  pBroker_->updateVariables(pmacMessageBroker::PMAC_FAST_READ);
-  pBroker_->updateVariables(pmacMessageBroker::PMAC_MEDIUM_READ);
-  pBroker_->updateVariables(pmacMessageBroker::PMAC_SLOW_READ);
+  pBroker_->updateAllVariables();
 
 }
 
@@ -654,23 +702,24 @@ void pmacController::setupBrokerVariables(void) {
   pBroker_->addReadVariable(pmacMessageBroker::PMAC_SLOW_READ, PMAC_PVT_TIME_MODE);
 
 
-  // CPU Calculation requires a set of I and M variables
-  pBroker_->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, PMAC_CPU_PHASE_INTR);
-  pBroker_->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, PMAC_CPU_PHASE_TIME);
-  pBroker_->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, PMAC_CPU_SERVO_TIME);
-  pBroker_->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, PMAC_CPU_RTI_TIME);
+  // CPU Calculation requires a set of I and M variables.  The fast ones are
+  // only used for the CPU load so they are low priority, see checkPollBudget
+  monitorLowPriorityVariable(PMAC_CPU_PHASE_INTR);
+  monitorLowPriorityVariable(PMAC_CPU_PHASE_TIME);
+  monitorLowPriorityVariable(PMAC_CPU_SERVO_TIME);
+  monitorLowPriorityVariable(PMAC_CPU_RTI_TIME);
   pBroker_->addReadVariable(pmacMessageBroker::PMAC_SLOW_READ, PMAC_CPU_I8);
   pBroker_->addReadVariable(pmacMessageBroker::PMAC_SLOW_READ, PMAC_CPU_I7002);
 
   if(cid_ == PMAC_CID_POWER_){
-    pBroker_->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, PPMAC_CPU_FPHASE_TIME);
-    pBroker_->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, PPMAC_CPU_FSERVO_TIME);
-    pBroker_->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, PPMAC_CPU_PHASED_TIME);
-    pBroker_->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, PPMAC_CPU_SERVOD_TIME);
-    pBroker_->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, PPMAC_CPU_RTID_TIME);
-    pBroker_->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, PPMAC_CPU_BGD_TIME);
-    pBroker_->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, PPMAC_CPU_FRTI_TIME);
-    pBroker_->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, PPMAC_CPU_FBG_TIME);
+    monitorLowPriorityVariable(PPMAC_CPU_FPHASE_TIME);
+    monitorLowPriorityVariable(PPMAC_CPU_FSERVO_TIME);
+    monitorLowPriorityVariable(PPMAC_CPU_PHASED_TIME);
+    monitorLowPriorityVariable(PPMAC_CPU_SERVOD_TIME);
+    monitorLowPriorityVariable(PPMAC_CPU_RTID_TIME);
+    monitorLowPriorityVariable(PPMAC_CPU_BGD_TIME);
+    monitorLowPriorityVariable(PPMAC_CPU_FRTI_TIME);
+    monitorLowPriorityVariable(PPMAC_CPU_FBG_TIME);
   }
 
   // Add the PMAC M variables required for trajectory scanning
@@ -681,18 +730,23 @@ void pmacController::setupBrokerVariables(void) {
   pBroker_->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, PMAC_TRAJ_TOTAL_POINTS);
 
   // Medium readout of the PLC program status (same for both Geobrick and VME)
-  for (plcNo = 0; plcNo < 32; plcNo++) {
+  for (plcNo = 0; plcNo < PMAC_MEDIUM_PLCS; plcNo++) {
     sprintf(cmd, "M%d", (plcNo + 5000));
-    pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd);
+    pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd, &plcHandles_[plcNo]);
   }
 
   // Medium readout of the motion program status (same for both Geobrick and VME)
-  for (progNo = 0; progNo < 16; progNo++) {
+  for (progNo = 0; progNo < PMAC_MEDIUM_PROGS; progNo++) {
     sprintf(cmd, "M%d", ((progNo * 100) + 5180));
-    pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd);
+    pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd, &progHandles_[progNo]);
   }
 
-  // Medium readout of the GPIO status bits
+  // Medium readout of the GPIO status bits, handles are stored by bit number
+  for (gpioNo = 0; gpioNo < PMAC_MEDIUM_GPIO_BITS; gpioNo++) {
+    gpioOutputHandles_[gpioNo] = -1;
+    gpioInputHandles_[gpioNo] = -1;
+  }
+  gpioHandlesValid_ = true;
   switch (cid_) {
     case PMAC_CID_GEOBRICK_:
     case PMAC_CID_CLIPPER_:
@@ -700,12 +754,14 @@ void pmacController::setupBrokerVariables(void) {
       // Outputs
       for (gpioNo = 0; gpioNo < 8; gpioNo++) {
         sprintf(cmd, "M%d", (gpioNo + 32));
-        pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd);
+        pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd,
+                                  &gpioOutputHandles_[gpioNo]);
       }
       // Inputs
       for (gpioNo = 0; gpioNo < 16; gpioNo++) {
         sprintf(cmd, "M%d", gpioNo);
-        pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd);
+        pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd,
+                                  &gpioInputHandles_[gpioNo]);
       }
       break;
 
@@ -713,21 +769,26 @@ void pmacController::setupBrokerVariables(void) {
       // Outputs
       for (gpioNo = 0; gpioNo < 8; gpioNo++) {
         sprintf(cmd, "M%d", (gpioNo + 7716));
-        pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd);
+        pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd,
+                                  &gpioOutputHandles_[gpioNo + 8]);
         sprintf(cmd, "M%d", (gpioNo + 7740));
-        pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd);
+        pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd,
+                                  &gpioOutputHandles_[gpioNo]);
       }
       // Inputs
       for (gpioNo = 0; gpioNo < 8; gpioNo++) {
         sprintf(cmd, "M%d", (gpioNo + 7616));
-        pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd);
+        pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd,
+                                  &gpioInputHandles_[gpioNo + 8]);
         sprintf(cmd, "M%d", (gpioNo + 7640));
-        pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd);
+        pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, cmd,
+                                  &gpioInputHandles_[gpioNo]);
       }
       break;
 
     default:
       // As we couldn't read the cid from the PMAC we don't know which m-vars to read
+      gpioHandlesValid_ = false;
       debug(DEBUG_ERROR, functionName, "Unable to set GPIO M-vars, unknown Card ID");
   }
 
@@ -746,6 +807,18 @@ void pmacController::setupBrokerVariables(void) {
   pBroker_->registerForUpdates(this, pmacMessageBroker::PMAC_SLOW_READ);
 }
 
+/**
+ * Add a variable to the fast store that may be read less often when the fast
+ * update is over its time budget.
+ *
+ * @param variable The PMAC variable to read.
+ */
+void pmacController::monitorLowPriorityVariable(const char *variable) {
+  int handle = -1;
+  pBroker_->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, variable, &handle);
+  pBroker_->setLowPriority(pmacMessageBroker::PMAC_FAST_READ, handle);
+}
+
 void pmacController::registerForLock(asynPortDriver *controller) {
   pBroker_->registerForLocks(controller);
 }
@@ -784,6 +857,84 @@ void pmacController::setDebugLevel(int level, int axis, int csNo) {
   }
 }
 
+/**
+ * Set the number of command strings that the broker keeps in flight when
+ * polling the PMAC.
+ *
+ * @param depth Number of command strings to write before reading the first reply.
+ */
+asynStatus pmacController::setPipelineDepth(int depth) {
+  printf("Setting PMAC poll pipeline depth to %d\n", depth);
+  return pBroker_->setPipelineDepth(depth);
+}
+
+/**
+ * Set the byte budgets used to pack polled variables into command strings.
+ *
+ * @param requestBytes Maximum length of each command string.
+ * @param replyBytes Maximum predicted length of each reply.
+ */
+asynStatus pmacController::setCommandBudget(int requestBytes, int replyBytes) {
+  printf("Setting PMAC command budget to %d request bytes, %d reply bytes\n",
+         requestBytes, replyBytes);
+  return pBroker_->setCommandBudget(requestBytes, replyBytes);
+}
+
+/**
+ * Poll the fast store variables of axes that are not in use (not moving, no
+ * recent demand and no coordinate system program or trajectory scan
+ * running) only once every polls fast updates.
+ *
+ * @param polls The idle axis decimation factor, 1 polls every axis on every update.
+ */
+asynStatus pmacController::setIdleAxisDecimation(int polls) {
+  if (polls < 1) {
+    polls = 1;
+  }
+  printf("Setting PMAC idle axis poll decimation to %d\n", polls);
+  lock();
+  idleAxisDecimation_ = polls;
+  pBroker_->setIdleDecimation(pmacMessageBroker::PMAC_FAST_READ, polls);
+  this->updateIdleAxes();
+  unlock();
+  return asynSuccess;
+}
+
+/**
+ * Give one of the broker's connection lanes its own low level port.  Only
+ * supported on a Power PMAC, which accepts several concurrent sessions.
+ * @param lane - POLL, COMMAND or TRAJECTORY.
+ * @param port - Name of the low level asyn port for the lane.
+ * @param addr - Address on the low level port.
+ */
+asynStatus pmacController::setConnectionPort(const char *lane, const char *port, int addr) {
+  asynStatus status = asynSuccess;
+  int laneIndex = -1;
+  static const char *functionName = "setConnectionPort";
+
+  if (strcmp(lane, "POLL") == 0) {
+    laneIndex = pmacMessageBroker::PMAC_POLL_LANE;
+  } else if (strcmp(lane, "COMMAND") == 0) {
+    laneIndex = pmacMessageBroker::PMAC_COMMAND_LANE;
+  } else if (strcmp(lane, "TRAJECTORY") == 0) {
+    laneIndex = pmacMessageBroker::PMAC_TRAJECTORY_LANE;
+  } else {
+    debug(DEBUG_ERROR, functionName, "Unknown connection lane (POLL, COMMAND or TRAJECTORY)", lane);
+    return asynError;
+  }
+  if (cid_ != PMAC_CID_POWER_) {
+    debug(DEBUG_ERROR, functionName, "Separate connection lanes require a Power PMAC", lane);
+    return asynError;
+  }
+
+  printf("Connecting PMAC %s lane to port %s\n", lane, port);
+  status = pBroker_->connectLane(laneIndex, port, addr);
+  if (status != asynSuccess) {
+    debug(DEBUG_ERROR, functionName, "Failed to connect lane to port", port);
+  }
+  return status;
+}
+
 asynStatus
 pmacController::drvUserCreate(asynUser *pasynUser, const char *drvInfo, const char **pptypeName,
                               size_t *psize) {
@@ -829,35 +980,24 @@ pmacController::drvUserCreate(asynUser *pasynUser, const char *drvInfo, const ch
       this->processDrvInfo(rawPmacVariable, pmacVariable);
 
       debug(DEBUG_VARIABLE, functionName, "Creating new parameter", pmacVariable);
+      pmacVariableParam variableParam;
+      int storeType = -1;
+      variableParam.handle = -1;
+      variableParam.param = -1;
+      variableParam.type = drvInfo[6];
       // Check for I, D or S in drvInfo[6]
       switch (drvInfo[6]) {
         case 'I':
-          // Create the parameter
-          createParam(drvInfo, asynParamInt32, &(this->parameters[parameterIndex_]));
-          setIntegerParam(this->parameters[parameterIndex_], 0);
-          // Add variable to integer parameter hashtable
-          this->pIntParams_->insert(pmacVariable, this->parameters[parameterIndex_]);
-          parameterIndex_++;
-          break;
         case 'H':
           // Create the parameter
           createParam(drvInfo, asynParamInt32, &(this->parameters[parameterIndex_]));
           setIntegerParam(this->parameters[parameterIndex_], 0);
-          // Add variable to integer parameter hashtable
-          this->pHexParams_->insert(pmacVariable, this->parameters[parameterIndex_]);
-          parameterIndex_++;
           break;
         case 'D':
           createParam(drvInfo, asynParamFloat64, &(this->parameters[parameterIndex_]));
-          // Add variable to double parameter hashtable
-          this->pDoubleParams_->insert(pmacVariable, this->parameters[parameterIndex_]);
-          parameterIndex_++;
           break;
         case 'S':
           createParam(drvInfo, asynParamOctet, &(this->parameters[parameterIndex_]));
-          // Add variable to string parameter hashtable
-          this->pStringParams_->insert(pmacVariable, this->parameters[parameterIndex_]);
-          parameterIndex_++;
           break;
         default:
           asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
@@ -867,16 +1007,18 @@ pmacController::drvUserCreate(asynUser *pasynUser, const char *drvInfo, const ch
       }
 
       if (status == asynSuccess) {
+        variableParam.param = this->parameters[parameterIndex_];
+        parameterIndex_++;
         // Check for F, M or S in drvInfo[7]
         switch (drvInfo[7]) {
           case 'F':
-            this->pBroker_->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, pmacVariable);
+            storeType = pmacMessageBroker::PMAC_FAST_READ;
             break;
           case 'M':
-            this->pBroker_->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, pmacVariable);
+            storeType = pmacMessageBroker::PMAC_MEDIUM_READ;
             break;
           case 'S':
-            this->pBroker_->addReadVariable(pmacMessageBroker::PMAC_SLOW_READ, pmacVariable);
+            storeType = pmacMessageBroker::PMAC_SLOW_READ;
             break;
           default:
             asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
@@ -886,6 +1028,10 @@ pmacController::drvUserCreate(asynUser *pasynUser, const char *drvInfo, const ch
         }
 
         if (status == asynSuccess) {
+          // Index the parameter by the store it is read from, with the handle
+          // resolved now so that the callback needs no lookups
+          this->pBroker_->addReadVariable(storeType, pmacVariable, &variableParam.handle);
+          variableParams_[storeType].push_back(variableParam);
           this->pWriteParams_->insert(drvInfo, pmacVariable);
         }
       }
@@ -1036,97 +1182,61 @@ void pmacController::callback(pmacCommandStore *sPtr, int type) {
     this->slowUpdate(sPtr);
   }
 
-  lock();
-  // Loop over parameter list and search for values
-  // Check for integer params
-  std::string key = this->pIntParams_->firstKey();
-  if (key != "") {
-    if (sPtr->checkForItem(key)) {
-      int val = 0;
-      sscanf(sPtr->readValue(key).c_str(), "%d", &val);
-      debug(DEBUG_VARIABLE, functionName, "Found key  ", key.c_str());
-      debug(DEBUG_VARIABLE, functionName, "      value", val);
-      setIntegerParam(this->pIntParams_->lookup(key), val);
-    }
-    while (this->pIntParams_->hasNextKey()) {
-      key = this->pIntParams_->nextKey();
-      if (sPtr->checkForItem(key)) {
-        int val = 0;
-        sscanf(sPtr->readValue(key).c_str(), "%d", &val);
-        debug(DEBUG_VARIABLE, functionName, "Found key  ", key.c_str());
-        debug(DEBUG_VARIABLE, functionName, "      value", val);
-        setIntegerParam(this->pIntParams_->lookup(key), val);
-      }
-    }
-  }
-
-  // Check for hex integer params
-  key = this->pHexParams_->firstKey();
-  if (key != "") {
-    if (sPtr->checkForItem(key)) {
-      int val = 0;
-      sscanf(sPtr->readValue(key).c_str(), "$%x", &val);
-      debug(DEBUG_VARIABLE, functionName, "Found key  ", key.c_str());
-      debug(DEBUG_VARIABLE, functionName, "      value", val);
-      setIntegerParam(this->pHexParams_->lookup(key), val);
-    }
-    while (this->pHexParams_->hasNextKey()) {
-      key = this->pHexParams_->nextKey();
-      if (sPtr->checkForItem(key)) {
-        int val = 0;
-        sscanf(sPtr->readValue(key).c_str(), "$%x", &val);
-        debug(DEBUG_VARIABLE, functionName, "Found key  ", key.c_str());
-        debug(DEBUG_VARIABLE, functionName, "      value", val);
-        setIntegerParam(this->pHexParams_->lookup(key), val);
-      }
-    }
+  // Set the PMAC variable parameters read from this store whose values have
+  // changed since the last update, the store has already parsed each value
+  // into its typed forms
+  if (type >= 0 && type < PMAC_STORE_TYPES && sPtr->anyDirty()) {
+    lock();
+    this->updateVariableParams(sPtr, variableParams_[type]);
+    unlock();
   }
+  callParamCallbacks();
+}
 
-  // Check for double params
-  key = this->pDoubleParams_->firstKey();
-  if (key != "") {
-    if (sPtr->checkForItem(key)) {
-      double val = 0;
-      sscanf(sPtr->readValue(key).c_str(), "%lf", &val);
-      debug(DEBUG_VARIABLE, functionName, "Found key  ", key.c_str());
-      debug(DEBUG_VARIABLE, functionName, "      value", val);
-      setDoubleParam(this->pDoubleParams_->lookup(key), val);
-    }
-    while (this->pDoubleParams_->hasNextKey()) {
-      key = this->pDoubleParams_->nextKey();
-      if (sPtr->checkForItem(key)) {
-        double val = 0;
-        sscanf(sPtr->readValue(key).c_str(), "%lf", &val);
-        debug(DEBUG_VARIABLE, functionName, "Found key  ", key.c_str());
-        debug(DEBUG_VARIABLE, functionName, "      value", val);
-        setDoubleParam(this->pDoubleParams_->lookup(key), val);
-      }
+/**
+ * Set the PMAC_Vxx_ parameters read from a store from their latest values.
+ * Only the parameters whose values have changed since the last update are set.
+ *
+ * @param sPtr The store holding the values.
+ * @param params The parameters read from the store.
+ */
+void pmacController::updateVariableParams(pmacCommandStore *sPtr,
+                                          const std::vector<pmacVariableParam> &params) {
+  static const char *functionName = "updateVariableParams";
+  epicsInt64 intVal = 0;
+  double doubleVal = 0.0;
+  char stringVal[MAX_STRING_SIZE];
+
+  for (size_t index = 0; index < params.size(); index++) {
+    const pmacVariableParam &variable = params[index];
+    if (!sPtr->isDirty(variable.handle)) {
+      continue;
     }
-  }
-
-  // Check for string params
-  key = this->pStringParams_->firstKey();
-  if (key != "") {
-    if (sPtr->checkForItem(key)) {
-      char val[MAX_STRING_SIZE];
-      sscanf(sPtr->readValue(key).c_str(), "%s", val);
-      debug(DEBUG_VARIABLE, functionName, "Found key  ", key.c_str());
-      debug(DEBUG_VARIABLE, functionName, "      value", (char *) val);
-      setStringParam(this->pStringParams_->lookup(key), val);
-    }
-    while (this->pStringParams_->hasNextKey()) {
-      key = this->pStringParams_->nextKey();
-      if (sPtr->checkForItem(key)) {
-        char val[MAX_STRING_SIZE];
-        sscanf(sPtr->readValue(key).c_str(), "%s", val);
-        debug(DEBUG_VARIABLE, functionName, "Found key  ", key.c_str());
-        debug(DEBUG_VARIABLE, functionName, "      value", (char *) val);
-        setStringParam(this->pDoubleParams_->lookup(key), val);
-      }
+    debug(DEBUG_VARIABLE, functionName, "Found key  ", sPtr->readKey(variable.handle));
+    switch (variable.type) {
+      case 'I':
+        sPtr->readInteger(variable.handle, intVal);
+        debug(DEBUG_VARIABLE, functionName, "      value", (int) intVal);
+        setIntegerParam(variable.param, (int) intVal);
+        break;
+      case 'H':
+        sPtr->readHex(variable.handle, intVal);
+        debug(DEBUG_VARIABLE, functionName, "      value", (int) intVal);
+        setIntegerParam(variable.param, (int) intVal);
+        break;
+      case 'D':
+        sPtr->readDouble(variable.handle, doubleVal);
+        debug(DEBUG_VARIABLE, functionName, "      value", doubleVal);
+        setDoubleParam(variable.param, doubleVal);
+        break;
+      case 'S':
+        stringVal[0] = '\0';
+        sscanf(sPtr->readValue(variable.handle).c_str(), "%39s", stringVal);
+        debug(DEBUG_VARIABLE, functionName, "      value", (char *) stringVal);
+        setStringParam(variable.param, stringVal);
+        break;
     }
   }
-  unlock();
-  callParamCallbacks();
 }
 
 asynStatus pmacController::slowUpdate(pmacCommandStore *sPtr) {
@@ -1138,13 +1248,15 @@ asynStatus pmacController::slowUpdate(pmacCommandStore *sPtr) {
   std::string value;
   debug(DEBUG_FLOW, functionName);
 
-  // read in the combined variables values.
-  value = sPtr->getVariablesList("I");
-  setStringParam(PMAC_I_Variables_, value.c_str());
-  value = sPtr->getVariablesList("P");
-  setStringParam(PMAC_P_Variables_, value.c_str());
-  value = sPtr->getVariablesList("M");
-  setStringParam(PMAC_M_Variables_, value.c_str());
+  // read in the combined variables values, only rebuilt when one has changed
+  if (sPtr->anyDirty()) {
+    value = sPtr->getVariablesList("I");
+    setStringParam(PMAC_I_Variables_, value.c_str());
+    value = sPtr->getVariablesList("P");
+    setStringParam(PMAC_P_Variables_, value.c_str());
+    value = sPtr->getVariablesList("M");
+    setStringParam(PMAC_M_Variables_, value.c_str());
+  }
 
   // Read the length of avaialable trajectory buffers
   trajPtr = sPtr->readValue(PMAC_TRAJ_BUFFER_LENGTH);
@@ -1278,6 +1390,36 @@ asynStatus pmacController::slowUpdate(pmacCommandStore *sPtr) {
   return status;
 }
 
+/**
+ * Read a single bit status variable from a store by its handle.
+ *
+ * @param sPtr The store holding the variable.
+ * @param handle The handle of the variable returned when it was monitored.
+ * @param description Description of the variable used in error messages.
+ * @param bit Set to the value of the variable.
+ * @return asynStatus
+ */
+asynStatus pmacController::readMonitoredBit(pmacCommandStore *sPtr, int handle,
+                                            const char *description, int *bit) {
+  static const char *functionName = "readMonitoredBit";
+  const std::string &value = sPtr->readValue(handle);
+  if (value == "") {
+    debugf(DEBUG_VARIABLE, functionName, "Problem reading %s %s", description,
+           sPtr->readKey(handle).c_str());
+    return asynError;
+  }
+  epicsInt64 parsed = 0;
+  if (!sPtr->readInteger(handle, parsed)) {
+    debugf(DEBUG_VARIABLE, functionName, "Error reading %s %s", description,
+           sPtr->readKey(handle).c_str());
+    debug(DEBUG_VARIABLE, functionName, "    response", value);
+    *bit = 0;
+    return asynError;
+  }
+  *bit = (int) parsed;
+  return asynSuccess;
+}
+
 asynStatus pmacController::mediumUpdate(pmacCommandStore *sPtr) {
   asynStatus status = asynSuccess;
   int nvals = 0;
@@ -1285,16 +1427,13 @@ asynStatus pmacController::mediumUpdate(pmacCommandStore *sPtr) {
   int plcBit = 0;
   int plcBits00 = 0;
   int plcBits01 = 0;
-  std::string plcString = "";
   int gpio = 0;
   int gpioBit = 0;
   int gpioOutputs = 0;
   int gpioInputs = 0;
-  std::string gpioString = "";
   int prog = 0;
   int progBit = 0;
   int progBits = 0;
-  std::string progString = "";
   int axisCs = 0;
   char command[8];
   double feedrate = 0.0;
@@ -1320,170 +1459,47 @@ asynStatus pmacController::mediumUpdate(pmacCommandStore *sPtr) {
   }
 
   // Read the PLC program status variables
-  for (plc = 0; plc < 32; plc++) {
-    sprintf(command, "M%d", (plc + 5000));
-    plcString = sPtr->readValue(command);
-    if (plcString == "") {
-      debug(DEBUG_VARIABLE, functionName, "Problem reading PLC program status", command);
+  for (plc = 0; plc < PMAC_MEDIUM_PLCS; plc++) {
+    if (readMonitoredBit(sPtr, plcHandles_[plc], "PLC program status", &plcBit) != asynSuccess) {
       status = asynError;
     } else {
-      nvals = sscanf(plcString.c_str(), "%d", &plcBit);
-      if (nvals != 1) {
-        debug(DEBUG_VARIABLE, functionName, "Error reading PLC program status", command);
-        debug(DEBUG_VARIABLE, functionName, "    nvals", nvals);
-        debug(DEBUG_VARIABLE, functionName, "    response", plcString);
-        status = asynError;
+      if (plc < 16) {
+        plcBits00 += plcBit << plc;
       } else {
-        if (plc < 16) {
-          plcBits00 += plcBit << plc;
-        } else {
-          plcBits01 += plcBit << (plc - 16);
-        }
+        plcBits01 += plcBit << (plc - 16);
       }
     }
   }
 
-  // Read the GPIO status variables
-  switch (cid_) {
-    case PMAC_CID_GEOBRICK_:
-    case PMAC_CID_CLIPPER_:
-    case PMAC_CID_POWER_:
-      // Outputs
-      for (gpio = 0; gpio < 8; gpio++) {
-        sprintf(command, "M%d", (gpio + 32));
-        gpioString = sPtr->readValue(command);
-        if (gpioString == "") {
-          debug(DEBUG_VARIABLE, functionName, "Problem reading GPIO status", command);
-          status = asynError;
-        } else {
-          nvals = sscanf(gpioString.c_str(), "%d", &gpioBit);
-          if (nvals != 1) {
-            debug(DEBUG_VARIABLE, functionName, "Error reading GPIO status", command);
-            debug(DEBUG_VARIABLE, functionName, "    nvals", nvals);
-            debug(DEBUG_VARIABLE, functionName, "    response", gpioString);
-            status = asynError;
-          } else {
-            gpioOutputs += gpioBit << gpio;
-          }
-        }
-      }
-      // Inputs
-      for (gpio = 0; gpio < 16; gpio++) {
-        sprintf(command, "M%d", gpio);
-        gpioString = sPtr->readValue(command);
-        if (gpioString == "") {
-          debug(DEBUG_VARIABLE, functionName, "Problem reading GPIO status", command);
-          status = asynError;
-        } else {
-          nvals = sscanf(gpioString.c_str(), "%d", &gpioBit);
-          if (nvals != 1) {
-            debug(DEBUG_VARIABLE, functionName, "Error reading GPIO status", command);
-            debug(DEBUG_VARIABLE, functionName, "    nvals", nvals);
-            debug(DEBUG_VARIABLE, functionName, "    response", gpioString);
-            status = asynError;
-          } else {
-            gpioInputs += gpioBit << gpio;
-          }
-        }
-      }
-      break;
-
-    case PMAC_CID_PMAC_:
-      // Outputs
-      for (gpio = 0; gpio < 8; gpio++) {
-        sprintf(command, "M%d", (gpio + 7716));
-        gpioString = sPtr->readValue(command);
-        if (gpioString == "") {
-          debug(DEBUG_VARIABLE, functionName, "Problem reading GPIO status", command);
-          status = asynError;
-        } else {
-          nvals = sscanf(gpioString.c_str(), "%d", &gpioBit);
-          if (nvals != 1) {
-            debug(DEBUG_VARIABLE, functionName, "Error reading GPIO status", command);
-            debug(DEBUG_VARIABLE, functionName, "    nvals", nvals);
-            debug(DEBUG_VARIABLE, functionName, "    response", gpioString);
-            status = asynError;
-          } else {
-            gpioOutputs += gpioBit << (gpio + 8);
-          }
-        }
-        sprintf(command, "M%d", (gpio + 7740));
-        gpioString = sPtr->readValue(command);
-        if (gpioString == "") {
-          debug(DEBUG_VARIABLE, functionName, "Problem reading GPIO status", command);
+  // Read the GPIO status variables, only the bits set up for this card ID are monitored
+  if (gpioHandlesValid_) {
+    for (gpio = 0; gpio < PMAC_MEDIUM_GPIO_BITS; gpio++) {
+      if (gpioOutputHandles_[gpio] >= 0) {
+        if (readMonitoredBit(sPtr, gpioOutputHandles_[gpio], "GPIO status", &gpioBit) != asynSuccess) {
           status = asynError;
         } else {
-          nvals = sscanf(gpioString.c_str(), "%d", &gpioBit);
-          if (nvals != 1) {
-            debug(DEBUG_VARIABLE, functionName, "Error reading GPIO status", command);
-            debug(DEBUG_VARIABLE, functionName, "    nvals", nvals);
-            debug(DEBUG_VARIABLE, functionName, "    response", gpioString);
-            status = asynError;
-          } else {
-            gpioOutputs += gpioBit << gpio;
-          }
+          gpioOutputs += gpioBit << gpio;
         }
       }
-      // Inputs
-      for (gpio = 0; gpio < 8; gpio++) {
-        sprintf(command, "M%d", (gpio + 7616));
-        gpioString = sPtr->readValue(command);
-        if (gpioString == "") {
-          debug(DEBUG_VARIABLE, functionName, "Problem reading GPIO status", command);
-          status = asynError;
-        } else {
-          nvals = sscanf(gpioString.c_str(), "%d", &gpioBit);
-          if (nvals != 1) {
-            debug(DEBUG_VARIABLE, functionName, "Error reading GPIO status", command);
-            debug(DEBUG_VARIABLE, functionName, "    nvals", nvals);
-            debug(DEBUG_VARIABLE, functionName, "    response", gpioString);
-            status = asynError;
-          } else {
-            gpioInputs += gpioBit << (gpio + 8);
-          }
-        }
-        sprintf(command, "M%d", (gpio + 7640));
-        gpioString = sPtr->readValue(command);
-        if (gpioString == "") {
-          debug(DEBUG_VARIABLE, functionName, "Problem reading GPIO status", command);
+      if (gpioInputHandles_[gpio] >= 0) {
+        if (readMonitoredBit(sPtr, gpioInputHandles_[gpio], "GPIO status", &gpioBit) != asynSuccess) {
           status = asynError;
         } else {
-          nvals = sscanf(gpioString.c_str(), "%d", &gpioBit);
-          if (nvals != 1) {
-            debug(DEBUG_VARIABLE, functionName, "Error reading GPIO status", command);
-            debug(DEBUG_VARIABLE, functionName, "    nvals", nvals);
-            debug(DEBUG_VARIABLE, functionName, "    response", gpioString);
-            status = asynError;
-          } else {
-            gpioInputs += gpioBit << gpio;
-          }
+          gpioInputs += gpioBit << gpio;
         }
       }
-      break;
-
-    default:
-      // As we couldn't read the cid from the PMAC we don't know which m-vars to read
-      debug(DEBUG_ERROR, functionName, "Unable to read GPIO M-vars, unknown Card ID");
-
+    }
+  } else {
+    // As we couldn't read the cid from the PMAC we don't know which m-vars to read
+    debug(DEBUG_ERROR, functionName, "Unable to read GPIO M-vars, unknown Card ID");
   }
 
   // Read the motion program status variables
-  for (prog = 0; prog < 16; prog++) {
-    sprintf(command, "M%d", ((prog * 100) + 5180));
-    progString = sPtr->readValue(command);
-    if (progString == "") {
-      debug(DEBUG_VARIABLE, functionName, "Problem reading motion program status", command);
+  for (prog = 0; prog < PMAC_MEDIUM_PROGS; prog++) {
+    if (readMonitoredBit(sPtr, progHandles_[prog], "motion program status", &progBit) != asynSuccess) {
       status = asynError;
     } else {
-      nvals = sscanf(progString.c_str(), "%d", &progBit);
-      if (nvals != 1) {
-        debug(DEBUG_VARIABLE, functionName, "Error reading motion program status", command);
-        debug(DEBUG_VARIABLE, functionName, "    nvals", nvals);
-        debug(DEBUG_VARIABLE, functionName, "    response", progString);
-        status = asynError;
-      } else {
-        progBits += progBit << prog;
-      }
+      progBits += progBit << prog;
     }
   }
 
@@ -1966,25 +1982,103 @@ asynStatus pmacController::parseDoubleVariable(const std::string &command,
   return status;
 }
 
-asynStatus pmacController::immediateWriteRead(const char *command, char *response) {
+asynStatus pmacController::immediateWriteRead(const char *command, char *response, int lane) {
   asynStatus status = asynSuccess;
   static const char *functionName = "immediateWriteRead";
   this->startTimer(DEBUG_TIMING, functionName);
-  status = this->lowLevelWriteRead(command, response);
+  status = this->lowLevelWriteRead(command, response, lane);
   this->stopTimer(DEBUG_TIMING, functionName, "PMAC write/read time");
   return status;
 }
 
-asynStatus pmacController::axisWriteRead(const char *command, char *response) {
+/**
+ * Write/read a stop, kill or abort command on the broker's priority lane,
+ * ahead of any queued poll traffic.
+ * @param command - String command to send.
+ * @param response - String response back.
+ */
+asynStatus pmacController::priorityWriteRead(const char *command, char *response) {
+  asynStatus status = asynSuccess;
+  static const char *functionName = "priorityWriteRead";
+
+  debug(DEBUG_FLOW, functionName);
+
+  // Check if we are connected, if not then do not continue
+  if (connected_ != 0) {
+    status = pBroker_->priorityWriteRead(command, response);
+    if (status == asynSuccess) {
+      status = this->updateStatistics();
+    }
+  } else {
+    strcpy(response, "");
+    status = asynError;
+    // there is (most likely) a conection issue
+    connected_ = false;
+  }
+  return status;
+}
+
+/**
+ * Queue a command on the broker without waiting for the reply, for writes
+ * whose reply is not needed.  The put completes once the command is queued,
+ * before the PMAC has seen it, so a write that later fails is not reported to
+ * the record; it is logged by completed and counted in PMAC_C_SUBMIT_FAILURES.
+ * @param command - String command to send.
+ */
+asynStatus pmacController::submitWriteRead(const char *command) {
+  asynStatus status = asynSuccess;
+  static const char *functionName = "submitWriteRead";
+
+  debug(DEBUG_FLOW, functionName);
+
+  // Check if we are connected, if not then do not continue
+  if (connected_ != 0) {
+    status = pBroker_->submitWriteRead(command, this);
+  } else {
+    status = asynError;
+    // there is (most likely) a conection issue
+    connected_ = false;
+  }
+  return status;
+}
+
+/**
+ * Completion of a command queued by submitWriteRead.  Called from the broker's
+ * submit thread without the controller lock, so only logs failures; the
+ * broker counts them for updateStatistics to publish.
+ * @param command - String command that was sent.
+ * @param response - String response back.
+ * @param status - Status of the write/read.
+ */
+void pmacController::completed(const char *command, const char *response, asynStatus status) {
+  static const char *functionName = "completed";
+
+  if (status != asynSuccess) {
+    debug(DEBUG_ERROR, functionName, "Submitted command failed", command);
+  }
+}
+
+asynStatus pmacController::axisWriteRead(const char *command, char *response, bool priority) {
   int readonly = 0;
   asynStatus status = asynSuccess;
   static const char *functionName = "axisWriteRead";
   // Here we need to check if we are in axis readonly mode
   getIntegerParam(PMAC_C_AxisReadonly_, &readonly);
   if (readonly == 0) {
+    epicsTimeGetCurrent(&lastDemandTime_);
     this->startTimer(DEBUG_TIMING, functionName);
-    status = this->lowLevelWriteRead(command, response);
+    if (priority) {
+      status = this->priorityWriteRead(command, response);
+    } else {
+      status = this->lowLevelWriteRead(command, response);
+    }
     this->stopTimer(DEBUG_TIMING, functionName, "PMAC write/read time");
+    // Any other axis demand brings the idle axes back to the full poll rate
+    // at once; this waits for the broker so is only done once the demand has
+    // been sent, and a stop leaves it to the next poll
+    if (!priority) {
+      this->updateIdleAxes();
+    }
   } else {
     debug(DEBUG_TRACE, functionName, "Axis command not sent (readonly mode)", command);
   }
@@ -1995,8 +2089,9 @@ asynStatus pmacController::axisWriteRead(const char *command, char *response) {
  * Wrapper for asynOctetSyncIO write/read functions.
  * @param command - String command to send.
  * @response response - String response back.
+ * @param lane - Broker connection lane to send the command on.
  */
-asynStatus pmacController::lowLevelWriteRead(const char *command, char *response) {
+asynStatus pmacController::lowLevelWriteRead(const char *command, char *response, int lane) {
   asynStatus status = asynSuccess;
   static const char *functionName = "lowLevelWriteRead";
 
@@ -2004,7 +2099,7 @@ asynStatus pmacController::lowLevelWriteRead(const char *command, char *response
 
   // Check if we are connected, if not then do not continue
   if (connected_ != 0) {
-    status = pBroker_->immediateWriteRead(command, response);
+    status = pBroker_->immediateWriteRead(command, response, true, lane);
     if (status == asynSuccess) {
       status = this->updateStatistics();
     }
@@ -2023,6 +2118,31 @@ void pmacController::report(FILE *fp, int level) {
 
   fprintf(fp, "pmac motor driver %s, numAxes=%d, moving poll period=%f, idle poll period=%f\n",
           this->portName, numAxes_, movingPollPeriod_, idlePollPeriod_);
+  fprintf(fp, "  low priority fast variables read every %d polls: %s\n",
+          pBroker_->readDecimation(pmacMessageBroker::PMAC_FAST_READ),
+          pBroker_->readLowPriorityList(pmacMessageBroker::PMAC_FAST_READ).c_str());
+  fprintf(fp, "  idle axes read every %d polls, %d idle fast variables\n", idleAxisDecimation_,
+          pBroker_->readIdleCount(pmacMessageBroker::PMAC_FAST_READ));
+  fprintf(fp, "  trajectory write bandwidth %.0f bytes/s\n", pBroker_->readTrajectoryBandwidth());
+  static const char *laneNames[] = {"POLL", "COMMAND", "TRAJECTORY"};
+  for (int lane = 0; lane < PMAC_CONNECTION_LANES; lane++) {
+    double timeout = 0.0, srtt = 0.0, rttvar = 0.0;
+    double history[PMAC_TIMEOUT_HISTORY];
+    int timeouts = 0;
+    pBroker_->readTimeouts(lane, &timeout, &srtt, &rttvar, &timeouts);
+    fprintf(fp, "  %s lane timeout %.3f s (srtt %.4f s, rttvar %.4f s), %d timeouts\n",
+            laneNames[lane], timeout, srtt, rttvar, timeouts);
+    if (level > 0) {
+      int count = pBroker_->readTimeoutHistory(lane, history, PMAC_TIMEOUT_HISTORY);
+      if (count > 0) {
+        fprintf(fp, "    recent timeouts (s):");
+        for (int index = 0; index < count; index++) {
+          fprintf(fp, " %.3f", history[index]);
+        }
+        fprintf(fp, "\n");
+      }
+    }
+  }
 
   if (level > 0) {
     for (axis = 0; axis < numAxes_; axis++) {
@@ -2226,10 +2346,12 @@ asynStatus pmacController::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
       lowLevelWriteRead(command, response);
     }
   } else if (pWriteParams_->hasKey(*name)) {
-    // This is an integer write of a parameter, so send the immediate write/read
+    // This is a double write of a parameter, so queue the write without
+    // waiting for the reply (and without repeating it below)
     sprintf(command, "%s=%.12f", pWriteParams_->lookup(*name).c_str(), value);
     debug(DEBUG_VARIABLE, functionName, "Command sent to PMAC", command);
-    status = (this->immediateWriteRead(command, response) == asynSuccess) && status;
+    status = (this->submitWriteRead(command) == asynSuccess) && status;
+    command[0] = 0;
   }
 
   if (command[0] != 0 && status) {
@@ -2267,50 +2389,47 @@ pmacController::writeFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size
     return asynSuccess;
   }
 
-  if (!profileInitialized_) {
-    // Initialise the trajectory scan interface pointers
-    debug(DEBUG_TRACE, functionName, "Initialising CS trajectory scan interface");
-    status = this->initializeProfile(PMAC_MAX_TRAJECTORY_POINTS);
-  }
+  // Make sure the trajectory scan interface can hold the array
+  status = this->initializeProfile(nElements);
 
   if (status == asynSuccess) {
     profileInitialized_ = true;
     if (function == PMAC_C_ProfilePositionsA_) {
-      memcpy(eguProfilePositions_[0], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfilePositions_, 0, value, nElements);
     } else if (function == PMAC_C_ProfilePositionsB_) {
-      memcpy(eguProfilePositions_[1], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfilePositions_, 1, value, nElements);
     } else if (function == PMAC_C_ProfilePositionsC_) {
-      memcpy(eguProfilePositions_[2], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfilePositions_, 2, value, nElements);
     } else if (function == PMAC_C_ProfilePositionsU_) {
-      memcpy(eguProfilePositions_[3], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfilePositions_, 3, value, nElements);
     } else if (function == PMAC_C_ProfilePositionsV_) {
-      memcpy(eguProfilePositions_[4], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfilePositions_, 4, value, nElements);
     } else if (function == PMAC_C_ProfilePositionsW_) {
-      memcpy(eguProfilePositions_[5], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfilePositions_, 5, value, nElements);
     } else if (function == PMAC_C_ProfilePositionsX_) {
-      memcpy(eguProfilePositions_[6], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfilePositions_, 6, value, nElements);
     } else if (function == PMAC_C_ProfilePositionsY_) {
-      memcpy(eguProfilePositions_[7], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfilePositions_, 7, value, nElements);
     } else if (function == PMAC_C_ProfilePositionsZ_) {
-      memcpy(eguProfilePositions_[8], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfilePositions_, 8, value, nElements);
     } else if (function == PMAC_C_ProfileVelocitiesA_) {
-      memcpy(eguProfileVelocities_[0], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfileVelocities_, 0, value, nElements);
     } else if (function == PMAC_C_ProfileVelocitiesB_) {
-      memcpy(eguProfileVelocities_[1], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfileVelocities_, 1, value, nElements);
     } else if (function == PMAC_C_ProfileVelocitiesC_) {
-      memcpy(eguProfileVelocities_[2], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfileVelocities_, 2, value, nElements);
     } else if (function == PMAC_C_ProfileVelocitiesU_) {
-      memcpy(eguProfileVelocities_[3], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfileVelocities_, 3, value, nElements);
     } else if (function == PMAC_C_ProfileVelocitiesV_) {
-      memcpy(eguProfileVelocities_[4], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfileVelocities_, 4, value, nElements);
     } else if (function == PMAC_C_ProfileVelocitiesW_) {
-      memcpy(eguProfileVelocities_[5], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfileVelocities_, 5, value, nElements);
     } else if (function == PMAC_C_ProfileVelocitiesX_) {
-      memcpy(eguProfileVelocities_[6], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfileVelocities_, 6, value, nElements);
     } else if (function == PMAC_C_ProfileVelocitiesY_) {
-      memcpy(eguProfileVelocities_[7], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfileVelocities_, 7, value, nElements);
     } else if (function == PMAC_C_ProfileVelocitiesZ_) {
-      memcpy(eguProfileVelocities_[8], value, nElements * sizeof(double));
+      status = this->setProfileAxisArray(eguProfileVelocities_, 8, value, nElements);
     } else if (function == PMAC_C_CompTable0_W) {
       compTableIndex=0;
     } else if (function == PMAC_C_CompTable1_W) {
@@ -2384,11 +2503,8 @@ pmacController::writeInt32Array(asynUser *pasynUser, epicsInt32 *value, size_t n
     return asynSuccess;
   }
 
-  if (!profileInitialized_) {
-    // Initialise the trajectory scan interface pointers
-    debug(DEBUG_FLOW, functionName, "Initialising trajectory scan interface");
-    status = this->initializeProfile(PMAC_MAX_TRAJECTORY_POINTS);
-  }
+  // Make sure the trajectory scan interface can hold the array
+  status = this->initializeProfile(nElements);
 
   if (status == asynSuccess) {
     profileInitialized_ = true;
@@ -2510,18 +2626,18 @@ asynStatus pmacController::writeInt32(asynUser *pasynUser, epicsInt32 value) {
   } else if (function == PMAC_C_StopAll_) {
     // Send the abort all command to the PMAC immediately
     if (cid_ == PMAC_CID_POWER_) {
-      status = (this->immediateWriteRead("&*abort", response) == asynSuccess) && status;
+      status = (this->priorityWriteRead("&*abort", response) == asynSuccess) && status;
     } else {
-      status = (this->immediateWriteRead("\x01", response) == asynSuccess) && status;
+      status = (this->priorityWriteRead("\x01", response) == asynSuccess) && status;
     }
     // Force all CS demands to refresh
     csResetAllDemands = true;
   } else if (function == PMAC_C_KillAll_) {
     // Send the kill all command to the PMAC immediately
     if (cid_ == PMAC_CID_POWER_) {
-      status = (this->immediateWriteRead("#*k", response) == asynSuccess) && status;
+      status = (this->priorityWriteRead("#*k", response) == asynSuccess) && status;
     } else {
-      status = (this->immediateWriteRead("\x0b", response) == asynSuccess) && status;
+      status = (this->priorityWriteRead("\x0b", response) == asynSuccess) && status;
     }
     // Force all CS demands to refresh
     csResetAllDemands = true;
@@ -2546,10 +2662,11 @@ asynStatus pmacController::writeInt32(asynUser *pasynUser, epicsInt32 value) {
     updateCsAssignmentParameters();
     copyCsReadbackToDemand(false);
   } else if (pWriteParams_->hasKey(*name)) {
-    // This is an integer write of a parameter, so send the immediate write/read
+    // This is an integer write of a parameter, so queue the write without
+    // waiting for the reply
     sprintf(command, "%s=%d", pWriteParams_->lookup(*name).c_str(), value);
     debug(DEBUG_VARIABLE, functionName, "Command sent to PMAC", command);
-    status = (this->immediateWriteRead(command, response) == asynSuccess) && status;
+    status = (this->submitWriteRead(command) == asynSuccess) && status;
   } else if (function == PMAC_C_KillAxis_) {
     // call stop so that this kill can stop CS moves too
     // this is to get around unexpected behaviour that kill does not stop real axes
@@ -2558,7 +2675,7 @@ asynStatus pmacController::writeInt32(asynUser *pasynUser, epicsInt32 value) {
     // pAxis->stop(0);
     // Send the kill command to the PMAC immediately
     sprintf(command, "#%dk", pAxis->axisNo_);
-    status = (this->immediateWriteRead(command, response) == asynSuccess) && status;
+    status = (this->priorityWriteRead(command, response) == asynSuccess) && status;
   } else if (function == PMAC_C_ReportFast_) {
     status = (this->pBroker_->report(pmacMessageBroker::PMAC_FAST_READ) == asynSuccess) && status;
   } else if (function == PMAC_C_ReportMedium_) {
@@ -2686,32 +2803,38 @@ asynStatus pmacController::poll() {
   debug(DEBUG_FLOW, functionName);
   epicsTimeGetCurrent(&nowTime_);
 
-  // First check the connection
+  // First check the connection, which does not wait for the PMAC
   this->checkConnection();
 
   if (connected_ != 0 && initialised_ != 0) {
     // Always call for a fast update
     epicsTimeToStrftime(tBuff, 32, "%Y/%m/%d %H:%M:%S.%03f", &nowTime_);
     debug(DEBUG_TIMING, functionName, "Fast update has been called", tBuff);
-    pBroker_->updateVariables(pmacMessageBroker::PMAC_FAST_READ);
+    // Move axes between the full and idle poll rates before the update
+    this->updateIdleAxes();
+    // The poller holds our lock, release it while the broker talks to the PMAC so
+    // that parameter writes are not held up by the exchange.  The broker takes
+    // the lock back for the callbacks
+    unlock();
+    if (reprimeRequired_) {
+      // Bring every cached value up to date in one sweep after (re)connecting
+      reprimeRequired_ = false;
+      pBroker_->updateAllVariables();
+    } else {
+      pBroker_->updateVariables(pmacMessageBroker::PMAC_FAST_READ);
+    }
+    lock();
     this->updateStatistics();
+    this->updateHistograms();
     setDoubleParam(PMAC_C_FastUpdateTime_, pBroker_->readUpdateTime());
-    if (epicsTimeDiffInSeconds(&nowTime_, &lastMediumTime_) >= PMAC_MEDIUM_LOOP_TIME / 1000.0) {
-      epicsTimeAddSeconds(&lastMediumTime_, PMAC_MEDIUM_LOOP_TIME / 1000.0);
-      debug(DEBUG_TIMING, functionName, "Medium update has been called", tBuff);
-      // Check if we are connected
-      if (connected_ != 0 && initialised_ != 0) {
-        pBroker_->updateVariables(pmacMessageBroker::PMAC_MEDIUM_READ);
-      }
-    }
-    if (epicsTimeDiffInSeconds(&nowTime_, &lastSlowTime_) >= PMAC_SLOW_LOOP_TIME / 1000.0) {
-      epicsTimeAddSeconds(&lastSlowTime_, PMAC_SLOW_LOOP_TIME / 1000.0);
-      debug(DEBUG_TIMING, functionName, "Slow update has been called", tBuff);
-      // Check if we are connected
-      if (connected_ != 0 && initialised_ != 0) {
-        pBroker_->updateVariables(pmacMessageBroker::PMAC_SLOW_READ);
-      }
-    }
+    this->checkPollBudget();
+    // The medium and slow stores are read a slice at a time, spread over
+    // the fast polls of their loop period
+    debug(DEBUG_TIMING, functionName, "Medium and slow slices have been called", tBuff);
+    this->updateSlicedStore(pmacMessageBroker::PMAC_MEDIUM_READ, PMAC_MEDIUM_LOOP_TIME,
+                            &lastMediumTime_);
+    this->updateSlicedStore(pmacMessageBroker::PMAC_SLOW_READ, PMAC_SLOW_LOOP_TIME,
+                            &lastSlowTime_);
   } else {
     // When there is no connection, set the problem flag
     lock();
@@ -2723,57 +2846,149 @@ asynStatus pmacController::poll() {
   return asynSuccess;
 }
 
+/**
+ * Grow an array of trajectory scan points, keeping its contents.  The new
+ * points are zeroed.
+ * @param array The array to grow, NULL to allocate a new one.
+ * @param elementSize Size of each point.
+ * @param oldPoints Current size of the array.
+ * @param newPoints Required size of the array.
+ * @return asynStatus, the array is left unchanged on failure.
+ */
+static asynStatus growProfileArray(void **array, size_t elementSize, size_t oldPoints,
+                                   size_t newPoints) {
+  void *grown = realloc(*array, elementSize * newPoints);
+  if (grown == NULL) {
+    return asynError;
+  }
+  memset((char *) grown + elementSize * oldPoints, 0, elementSize * (newPoints - oldPoints));
+  *array = grown;
+  return asynSuccess;
+}
+
+/**
+ * Make sure the trajectory scan arrays can hold a number of points.  The
+ * arrays start empty and grow to the largest batch of points written or
+ * built, rather than to the size of the whole scan, and the arrays of each
+ * axis are only allocated once the axis is used.
+ * @param maxPoints Number of points required.
+ * @return asynStatus
+ */
 asynStatus pmacController::initializeProfile(size_t maxPoints) {
+  asynStatus status = asynSuccess;
   static const char *functionName = "initializeProfile";
 
   debug(DEBUG_FLOW, functionName);
-  debug(DEBUG_VARIABLE, functionName, "maxPoints", (int) maxPoints);
 
-  // Allocate the pointers
-  tScanPositions_ = (double **) malloc(sizeof(double *) * PMAC_MAX_CS_AXES);
-  // Now allocate each position array
-  for (int axis = 0; axis < PMAC_MAX_CS_AXES; axis++) {
-    tScanPositions_[axis] = (double *) malloc(sizeof(double) * maxPoints);
+  if (eguProfilePositions_ != NULL && maxPoints <= profileCapacity_) {
+    return asynSuccess;
   }
-
-  // Allocate the pointers
-  eguProfilePositions_ = (double **) malloc(sizeof(double *) * PMAC_MAX_CS_AXES);
-  // Now allocate each position array
-  for (int axis = 0; axis < PMAC_MAX_CS_AXES; axis++) {
-    eguProfilePositions_[axis] = (double *) malloc(sizeof(double) * maxPoints);
+  debug(DEBUG_VARIABLE, functionName, "maxPoints", (int) maxPoints);
+  if (maxPoints > PMAC_MAX_TRAJECTORY_POINTS) {
+    debug(DEBUG_ERROR, functionName, "Too many trajectory points", (int) maxPoints);
+    return asynError;
   }
 
   // Allocate the pointers
-  tScanVelocities_ = (double **)malloc(sizeof(double *) * PMAC_MAX_CS_AXES);
-  // Now allocate each position array
-  for (int axis = 0; axis < PMAC_MAX_CS_AXES; axis++) {
-    tScanVelocities_[axis] = (double *)malloc(sizeof(double) * maxPoints);
+  if (eguProfilePositions_ == NULL) {
+    eguProfilePositions_ = (double **) calloc(PMAC_MAX_CS_AXES, sizeof(double *));
+    eguProfileVelocities_ = (double **) calloc(PMAC_MAX_CS_AXES, sizeof(double *));
+    if (!eguProfilePositions_ || !eguProfileVelocities_) {
+      debug(DEBUG_ERROR, functionName, "Unable to allocate memory for the trajectory points");
+      free(eguProfilePositions_);
+      free(eguProfileVelocities_);
+      eguProfilePositions_ = NULL;
+      eguProfileVelocities_ = NULL;
+      return asynError;
+    }
   }
 
-  // Allocate the pointers
-  eguProfileVelocities_ = (double **) malloc(sizeof(double *) * PMAC_MAX_CS_AXES);
-  // Now allocate each velocity array
-  for (int axis = 0; axis < PMAC_MAX_CS_AXES; axis++) {
-    eguProfileVelocities_[axis] = (double *) malloc(sizeof(double) * maxPoints);
+  // The velocity calculation reads one point beyond the last point built, so
+  // each array has a spare point at the end
+  size_t oldPoints = profileCapacity_ > 0 ? profileCapacity_ + 1 : 0;
+  size_t newPoints = maxPoints + 1;
+
+  // Grow the arrays of the axes already in use
+  double **arrays[] = {eguProfilePositions_, eguProfileVelocities_};
+  for (int table = 0; table < 2; table++) {
+    for (int axis = 0; axis < PMAC_MAX_CS_AXES; axis++) {
+      if (status == asynSuccess && arrays[table][axis] != NULL) {
+        status = growProfileArray((void **) &arrays[table][axis], sizeof(double), oldPoints,
+                                  newPoints);
+      }
+    }
   }
 
-  // Allocate memory required for user buffer
-  if (profileUser_) {
-    free(profileUser_);
+  // Grow the user and velocity mode buffers
+  if (status == asynSuccess) {
+    status = growProfileArray((void **) &profileUser_, sizeof(int), oldPoints, newPoints);
   }
-  profileUser_ = (int *) malloc(sizeof(int) * maxPoints);
-  // Allocate memory required for velocity mode buffer
-  if (profileVelMode_) {
-    free(profileVelMode_);
+  if (status == asynSuccess) {
+    status = growProfileArray((void **) &profileVelMode_, sizeof(int), oldPoints, newPoints);
+  }
+
+  // The super class allocates new arrays, so keep the times already written
+  if (status == asynSuccess) {
+    double *times = profileTimes_;
+    profileTimes_ = NULL;
+    asynMotorController::initializeProfile(newPoints);
+    if (profileTimes_ == NULL) {
+      profileTimes_ = times;
+      status = asynError;
+    } else if (times != NULL) {
+      memcpy(profileTimes_, times, oldPoints * sizeof(double));
+      free(times);
+    }
   }
-  profileVelMode_ = (int *) malloc(sizeof(int) * maxPoints);
 
-  // Finally call super class
-  return asynMotorController::initializeProfile(maxPoints);
+  if (status == asynSuccess) {
+    profileCapacity_ = maxPoints;
+  } else {
+    debug(DEBUG_ERROR, functionName, "Unable to allocate memory for the trajectory points");
+  }
+  return status;
 }
 
-asynStatus pmacController::buildProfile() {
-  asynStatus status = asynSuccess;
+/**
+ * Allocate the trajectory scan arrays of an axis that is included in a scan.
+ * Positions and velocities that have not been written are zero.
+ * @param axis The CS axis (0 based).
+ * @return asynStatus
+ */
+asynStatus pmacController::allocateProfileAxis(int axis) {
+  asynStatus status = asynSuccess;
+  double **arrays[] = {eguProfilePositions_, eguProfileVelocities_};
+
+  for (int table = 0; table < 2; table++) {
+    if (status == asynSuccess && arrays[table][axis] == NULL) {
+      status = growProfileArray((void **) &arrays[table][axis], sizeof(double), 0,
+                                profileCapacity_ + 1);
+    }
+  }
+  return status;
+}
+
+/**
+ * Copy the positions or velocities written to an axis array record.
+ * @param arrays eguProfilePositions_ or eguProfileVelocities_.
+ * @param axis The CS axis (0 based).
+ * @param value The values written.
+ * @param nElements Number of values written.
+ * @return asynStatus
+ */
+asynStatus pmacController::setProfileAxisArray(double **arrays, int axis, epicsFloat64 *value,
+                                               size_t nElements) {
+  if (arrays[axis] == NULL &&
+      growProfileArray((void **) &arrays[axis], sizeof(double), 0, profileCapacity_ + 1) !=
+      asynSuccess) {
+    return asynError;
+  }
+  memcpy(arrays[axis], value, nElements * sizeof(double));
+  return asynSuccess;
+}
+
+asynStatus pmacController::buildProfile() {
+  asynStatus status = asynSuccess;
   int csNo = 0;
   int csPort = 0;
   std::string csPortName;
@@ -2835,18 +3050,16 @@ asynStatus pmacController::buildProfile(int csNo) {
   this->setBuildStatus(PROFILE_BUILD_BUSY, PROFILE_STATUS_UNDEFINED, "Building profile");
   callParamCallbacks();
 
-  // First check to see if we need to initialise memory
-  if (!profileInitialized_) {
-    // Initialise the trajectory scan interface pointers
-    status = this->initializeProfile(PMAC_MAX_TRAJECTORY_POINTS);
-    if (status == asynSuccess) {
-      profileInitialized_ = true;
-    } else {
-      debug(DEBUG_ERROR, functionName, "Failed to allocate memory on controller");
-      // Set the status to failure
-      this->setBuildStatus(PROFILE_BUILD_DONE, PROFILE_STATUS_FAILURE,
-                           "Failed to allocate memory on controller");
-    }
+  // First check to see if we need to initialise memory for the points to build
+  getIntegerParam(PMAC_C_ProfileNumBuild_, &numPointsToBuild);
+  status = this->initializeProfile(numPointsToBuild);
+  if (status == asynSuccess) {
+    profileInitialized_ = true;
+  } else {
+    debug(DEBUG_ERROR, functionName, "Failed to allocate memory on controller");
+    // Set the status to failure
+    this->setBuildStatus(PROFILE_BUILD_DONE, PROFILE_STATUS_FAILURE,
+                         "Failed to allocate memory on controller");
   }
 
   // Important to check the type of hardware and the memory locations
@@ -2970,41 +3183,30 @@ asynStatus pmacController::buildProfile(int csNo) {
       // 1 to 9 axes (0 is error) 111111111 => 1 .. 511
       status = this->tScanIncludedAxes(&axisMask);
       tScanAxisMask_ = axisMask;
-      //Check if each axis from the coordinate system is involved in this trajectory scan
-      for (int index = 0; index < PMAC_MAX_CS_AXES; index++) {
-        if ((1 << index & axisMask) > 0) {
-          if (status == asynSuccess) {
-            // If the axis is going to be included then copy the position array into local
-            // storage ready for the trajectory execution
-            status = this->tScanBuildProfileArray(tScanPositions_[index], tScanVelocities_[index], profileTimes_, index, numPointsToBuild);
-            if (status != asynSuccess) {
-              // Set the status to failure
-              this->setBuildStatus(PROFILE_BUILD_DONE, PROFILE_STATUS_FAILURE,
-                                   "Failed to build profile positions");
-            }
-          }
-        }
-      }
     }
   }
 
   if (status == asynSuccess) {
-    // Initialise the trajectory store
-    status = pTrajectory_->initialise(numPoints);
+    // Initialise the trajectory store, only the axes in the scan are stored
+    status = pTrajectory_->initialise(numPoints, tScanAxisMask_);
+    if (status != asynSuccess) {
+      // Set the status to failure
+      this->setBuildStatus(PROFILE_BUILD_DONE, PROFILE_STATUS_FAILURE,
+                           "Failed to build trajectory object");
+    }
+  }
 
-    if (status == asynSuccess) {
-      // Set the trajectory store initial values
-      status = pTrajectory_->append(tScanPositions_, tScanVelocities_, profileTimes_, profileUser_,
-                                    numPointsToBuild);
-      setIntegerParam(PMAC_C_ProfileBuiltPoints_, pTrajectory_->getNoOfValidPoints());
-      // Set the scan size to be equal to the number of built points
-      tScanNumPoints_ = pTrajectory_->getNoOfValidPoints();
-
-      if (status != asynSuccess) {
-        // Set the status to failure
-        this->setBuildStatus(PROFILE_BUILD_DONE, PROFILE_STATUS_FAILURE,
-                             "Failed to build trajectory object");
-      }
+  if (status == asynSuccess) {
+    // Convert the positions of each axis in the scan straight into the trajectory store
+    status = this->tScanAppendPoints(numPointsToBuild);
+    setIntegerParam(PMAC_C_ProfileBuiltPoints_, pTrajectory_->getNoOfValidPoints());
+    // Set the scan size to be equal to the number of built points
+    tScanNumPoints_ = pTrajectory_->getNoOfValidPoints();
+
+    if (status != asynSuccess) {
+      // Set the status to failure
+      this->setBuildStatus(PROFILE_BUILD_DONE, PROFILE_STATUS_FAILURE,
+                           "Failed to build profile positions");
     }
   }
 
@@ -3053,25 +3255,11 @@ asynStatus pmacController::appendToProfile() {
   if (appendAvailable_) {
     // Read in the number of points to append
     getIntegerParam(PMAC_C_ProfileNumBuild_, &numPointsToBuild);
-    //Check if each axis from the coordinate system is involved in this trajectory scan
-    for (int index = 0; index < PMAC_MAX_CS_AXES; index++) {
-      if ((1 << index & tScanAxisMask_) > 0) {
-        if (status == asynSuccess) {
-          // If the axis is going to be included then copy the position array into local
-          // storage ready for the trajectory execution
-          status = this->tScanBuildProfileArray(tScanPositions_[index], tScanVelocities_[index], profileTimes_, index, numPointsToBuild);
-          if (status != asynSuccess) {
-            // Set the status to failure
-            this->setAppendStatus(PROFILE_BUILD_DONE, PROFILE_STATUS_FAILURE,
-                                  "Failed to compile profile position and velocities");
-          }
-        }
-      }
+    status = this->initializeProfile(numPointsToBuild);
+    // Convert the positions of each axis in the scan straight into the trajectory store
+    if (status == asynSuccess) {
+      status = this->tScanAppendPoints(numPointsToBuild);
     }
-    // Append the points to the store
-
-    status = pTrajectory_->append(tScanPositions_, tScanVelocities_, profileTimes_, profileUser_,
-                                  numPointsToBuild);
     setIntegerParam(PMAC_C_ProfileBuiltPoints_, pTrajectory_->getNoOfValidPoints());
     // Set the scan size to be equal to the number of built points
     tScanNumPoints_ = pTrajectory_->getNoOfValidPoints();
@@ -3278,7 +3466,7 @@ asynStatus pmacController::abortProfile() {
 
   // Send an immediate abort signal to the PMAC
   sprintf(cmd, "%s=1", PMAC_TRAJ_ABORT);
-  status = this->immediateWriteRead(cmd, response);
+  status = this->priorityWriteRead(cmd, response);
 
   // Set the status P variable to idle in case the motion program cannot
   sprintf(cmd, "%s=%d", PMAC_TRAJ_STATUS, PMAC_TRAJ_STATUS_FINISHED);
@@ -3337,6 +3525,10 @@ void pmacController::trajectoryTask() {
     if (!tScanExecuting_) {
       // Set the append flag to false
       appendAvailable_ = false;
+      // Free the points of the finished scan, unless a new one has been built
+      if (!profileBuilt_) {
+        pTrajectory_->release();
+      }
       // Reset any of our own errors
       epicsErrorDetect = 0;
       // Reset the execute parameter for caput callback
@@ -3583,10 +3775,14 @@ asynStatus pmacController::sendTrajectoryDemands(int buffer) {
   int nBuffers = 0;
   int epicsBufferPtr = 0;
   int writeAddress = 0;
-  double posValue = 0.0;
-  double velValue = 0.0;
   int userValue = 0;
   int timeValue = 0;
+  int fillPoints = 0;
+  pmacTrajectorySlice slice;
+  // 2 commands (positions and velocities) per axis, plus time and user commands
+  pmacCommandBuilder cmd[2*PMAC_MAX_CS_AXES+2];
+  double headroom = -1.0;
+  double fillDuration = 0.0;
   char response[1024];
   char cstr[1024];
   const char *functionName = "sendTrajectoryDemands";
@@ -3595,6 +3791,11 @@ asynStatus pmacController::sendTrajectoryDemands(int buffer) {
 
   debug(DEBUG_FLOW, functionName);
   startTimer(DEBUG_TIMING, functionName);
+  slice.first = 0;
+  slice.count = 0;
+  for (int index = 0; index < 2*PMAC_MAX_CS_AXES+2; index++) {
+    cmd[index].setMaxLength(pHardware_->getMaxCommandLength());
+  }
 
   // Calculate how many axes are included in this trajectory scan
   nAxes = 0;
@@ -3612,8 +3813,20 @@ asynStatus pmacController::sendTrajectoryDemands(int buffer) {
   debug(DEBUG_VARIABLE, functionName, "tScanPointCtr_", tScanPointCtr_);
   debug(DEBUG_VARIABLE, functionName, "tScanNumPoints_", tScanNumPoints_);
 
-  // Supress the status reading within the message broker
-  pBroker_->supressStatusReads();
+  // Share the link between this fill and the status reads.  Once the scan is
+  // running the PMAC needs the new points when it finishes the half buffer
+  // written by the last fill, less the time taken to notice the buffer switch
+  fillPoints = tScanNumPoints_ - tScanPointCtr_;
+  if (fillPoints > tScanPmacBufferSize_) {
+    fillPoints = tScanPmacBufferSize_;
+  }
+  if (tScanExecuting_) {
+    headroom = tScanFillDuration_ - movingPollPeriod_;
+    if (headroom < 0.0) {
+      headroom = 0.0;
+    }
+  }
+  pBroker_->startTrajectoryFill(fillPoints, headroom, PMAC_FILL_STATUS_POLLS * movingPollPeriod_);
 
   // Check the number of points we have, if greater than the buffer size
   // then fill the buffer, else fill up to the number of points
@@ -3631,16 +3844,15 @@ asynStatus pmacController::sendTrajectoryDemands(int buffer) {
     // Offset the write address by the epics buffer pointer
     writeAddress += epicsBufferPtr;
 
-    // Count how many buffers to fill
-    char cmd[2*PMAC_MAX_CS_AXES+2][1024];  // 2 buffers (positions and velocities) per axis, plus time and user buffers
     // cmd[18,19] are reserved for the user and time values
-    pHardware_->startTrajectoryTimePointsCmd(cmd[2*PMAC_MAX_CS_AXES], cmd[2*PMAC_MAX_CS_AXES+1], writeAddress);
+    pHardware_->startTrajectoryTimePointsCmd(&cmd[2*PMAC_MAX_CS_AXES], &cmd[2*PMAC_MAX_CS_AXES+1],
+                                             writeAddress);
 
     posCmd = true;
     // cmd[0..8] are reserved for axis positions
     for (int index = 0; index < PMAC_MAX_CS_AXES; index++) {
       if ((1 << index & tScanAxisMask_) > 0) {
-        pHardware_->startAxisPointsCmd(cmd[index], index, writeAddress, tScanPmacBufferSize_,
+        pHardware_->startAxisPointsCmd(&cmd[index], index, writeAddress, tScanPmacBufferSize_,
                                        posCmd);
       }
     }
@@ -3648,72 +3860,112 @@ asynStatus pmacController::sendTrajectoryDemands(int buffer) {
     // cmd[9..17] are reserved for axis velocities
     for (int index = PMAC_MAX_CS_AXES; index < (2*PMAC_MAX_CS_AXES); index++) {
       if ((1 << (index-PMAC_MAX_CS_AXES) & tScanAxisMask_) > 0) {
-        pHardware_->startAxisPointsCmd(cmd[index], index, writeAddress, tScanPmacBufferSize_,
+        pHardware_->startAxisPointsCmd(&cmd[index], index, writeAddress, tScanPmacBufferSize_,
                                        posCmd);
       }
     }
 
+    // The points added to this write only count as filled once every line
+    // of the write has been sent
     int bufferCount = 0;
+    double writeDuration = 0.0;
     firstVal = true;
-    while ((bufferCount < nBuffers) && (epicsBufferPtr < tScanPmacBufferSize_) &&
-           (tScanPointCtr_ < tScanNumPoints_)) {
-      // Create the velmode/user/time memory writes:
-      // First 4 bits are for user buffer %01X
-      // Next 24 bits are for delta times %06X
-      if (status == asynSuccess) {
-        status = pTrajectory_->getUserMode(tScanPointCtr_, &userValue);
-      }
-      if (status == asynSuccess) {
-        status = pTrajectory_->getTime(tScanPointCtr_, &timeValue);
+    while ((bufferCount < nBuffers) && (epicsBufferPtr + bufferCount < tScanPmacBufferSize_) &&
+           (tScanPointCtr_ + bufferCount < tScanNumPoints_) && status == asynSuccess) {
+      int pointCtr = tScanPointCtr_ + bufferCount;
+      // Read the points straight from the trajectory store, a slice at a time
+      if (pointCtr >= slice.first + slice.count) {
+        status = pTrajectory_->getSlice(pointCtr, tScanNumPoints_ - pointCtr, &slice);
       }
       if (status == asynSuccess) {
-        pHardware_->addTrajectoryTimePointCmd(cmd[2*PMAC_MAX_CS_AXES], cmd[2*PMAC_MAX_CS_AXES+1],
-                                              userValue, timeValue, firstVal);
-        for (int index = 0; index < PMAC_MAX_CS_AXES; index++) {
+        // Add the run of points in this slice that fit in this write
+        int point = pointCtr - slice.first;
+        int count = slice.first + slice.count - pointCtr;
+        if (count > nBuffers - bufferCount) {
+          count = nBuffers - bufferCount;
+        }
+        if (count > tScanPmacBufferSize_ - epicsBufferPtr - bufferCount) {
+          count = tScanPmacBufferSize_ - epicsBufferPtr - bufferCount;
+        }
+        // Create the velmode/user/time memory writes:
+        // First 4 bits are for user buffer %01X
+        // Next 24 bits are for delta times %06X
+        for (int index = 0; index < count; index++) {
+          userValue = slice.user[point + index];
+          timeValue = slice.times[point + index];
+          // Times are in microseconds
+          writeDuration += timeValue / 1000000.0;
+          pHardware_->addTrajectoryTimePointCmd(&cmd[2*PMAC_MAX_CS_AXES],
+                                                &cmd[2*PMAC_MAX_CS_AXES+1],
+                                                userValue, timeValue, firstVal && index == 0);
+        }
+        for (int index = 0; index < PMAC_MAX_CS_AXES && status == asynSuccess; index++) {
           if ((1 << index & tScanAxisMask_) > 0) {
-            status = pTrajectory_->getPosition(index, tScanPointCtr_, &posValue);
-            pHardware_->addAxisPointCmd(cmd[index], index, posValue, tScanPmacBufferSize_,
-                                        firstVal);
-            status = pTrajectory_->getVelocity(index, tScanPointCtr_, &velValue);
-            pHardware_->addAxisPointCmd(cmd[index+PMAC_MAX_CS_AXES], (index+PMAC_MAX_CS_AXES), velValue, tScanPmacBufferSize_,
-                                        firstVal);
+            status = pHardware_->addAxisPointsCmd(&cmd[index], index,
+                                                  &slice.positions[index][point], count,
+                                                  tScanPmacBufferSize_, firstVal);
+            if (status == asynSuccess) {
+              status = pHardware_->addAxisPointsCmd(&cmd[index+PMAC_MAX_CS_AXES],
+                                                    (index+PMAC_MAX_CS_AXES),
+                                                    &slice.velocities[index][point], count,
+                                                    tScanPmacBufferSize_, firstVal);
+            }
+            if (status != asynSuccess) {
+              debugf(DEBUG_ERROR, functionName, "Invalid demand for axis %d near point %d",
+                     index, pointCtr);
+            }
           }
         }
+
+        // Increment the buffer count
+        bufferCount += count;
+        firstVal = false;
       }
+    }
 
-      // Increment the scan point counter
-      tScanPointCtr_++;
-      // Increment the buffer count
-      bufferCount++;
-      // Increment the epicsBufferPtr
-      epicsBufferPtr++;
-      firstVal = false;
+    // A write that does not fit on one line is an error, it is never truncated
+    for (int index = 0; index < 2*PMAC_MAX_CS_AXES+2 && status == asynSuccess; index++) {
+      if (cmd[index].hasOverflowed()) {
+        debugf(DEBUG_ERROR, functionName, "Trajectory command %d exceeds %d characters", index,
+               pHardware_->getMaxCommandLength());
+        status = asynError;
+      }
     }
 
     if (status == asynSuccess) {
       // First send the times/user buffer
-      for (int index = 2*PMAC_MAX_CS_AXES; index <= 2*PMAC_MAX_CS_AXES+1; index++)
+      for (int index = 2*PMAC_MAX_CS_AXES; index <= 2*PMAC_MAX_CS_AXES+1 && status == asynSuccess;
+           index++)
       {
-        sprintf(cstr, "%s", cmd[index]);
-        debug(DEBUG_VARIABLE, functionName, "Command", cstr);
-        status = this->immediateWriteRead(cstr, response);
+        debug(DEBUG_VARIABLE, functionName, "Command", cmd[index].getCommand());
+        status = this->immediateWriteRead(cmd[index].getCommand(), response,
+                                          pmacMessageBroker::PMAC_TRAJECTORY_LANE);
       }
       // Now send the axis positions
-      for (int index = 0; index < PMAC_MAX_CS_AXES; index++) {
+      for (int index = 0; index < PMAC_MAX_CS_AXES && status == asynSuccess; index++) {
         if ((1 << index & tScanAxisMask_) > 0) {
-          sprintf(cstr, "%s", cmd[index]);
-          debug(DEBUG_VARIABLE, functionName, "Command", cstr);
-          status = this->immediateWriteRead(cstr, response);
+          debug(DEBUG_VARIABLE, functionName, "Command", cmd[index].getCommand());
+          status = this->immediateWriteRead(cmd[index].getCommand(), response,
+                                            pmacMessageBroker::PMAC_TRAJECTORY_LANE);
         }
       }
       // And the axis velocities
-      for (int index = PMAC_MAX_CS_AXES; index < (2*PMAC_MAX_CS_AXES); index++) {
+      for (int index = PMAC_MAX_CS_AXES; index < (2*PMAC_MAX_CS_AXES) && status == asynSuccess;
+           index++) {
         if ((1 << (index-PMAC_MAX_CS_AXES) & tScanAxisMask_) > 0) {
-          sprintf(cstr, "%s", cmd[index]);
-          debug(DEBUG_VARIABLE, functionName, "Command", cstr);
-          status = this->immediateWriteRead(cstr, response);
+          debug(DEBUG_VARIABLE, functionName, "Command", cmd[index].getCommand());
+          status = this->immediateWriteRead(cmd[index].getCommand(), response,
+                                            pmacMessageBroker::PMAC_TRAJECTORY_LANE);
         }
       }
+    }
+
+    if (status == asynSuccess) {
+      // Increment the scan point counter and the epicsBufferPtr
+      tScanPointCtr_ += bufferCount;
+      epicsBufferPtr += bufferCount;
+      fillDuration += writeDuration;
+      pBroker_->trajectoryPointsWritten(bufferCount);
 
       // Set the parameter according to the filled points
       if (buffer == PMAC_TRAJ_BUFFER_A) {
@@ -3727,20 +3979,23 @@ asynStatus pmacController::sendTrajectoryDemands(int buffer) {
     }
   }
 
-  // Finally send the current buffer pointer to the PMAC
-  if (buffer == PMAC_TRAJ_BUFFER_A) {
-    sprintf(cstr, "%s=%d", PMAC_TRAJ_BUFF_FILL_A, epicsBufferPtr);
-  } else if (buffer == PMAC_TRAJ_BUFFER_B) {
-    sprintf(cstr, "%s=%d", PMAC_TRAJ_BUFF_FILL_B, epicsBufferPtr);
+  // Finally send the current buffer pointer to the PMAC.  A failed fill
+  // sends no buffer pointer, so the PMAC never runs points that were not
+  // all written
+  if (status == asynSuccess) {
+    if (buffer == PMAC_TRAJ_BUFFER_A) {
+      sprintf(cstr, "%s=%d", PMAC_TRAJ_BUFF_FILL_A, epicsBufferPtr);
+    } else {
+      sprintf(cstr, "%s=%d", PMAC_TRAJ_BUFF_FILL_B, epicsBufferPtr);
+    }
+    debug(DEBUG_TRACE, functionName, "Command", cstr);
+    status = this->immediateWriteRead(cstr, response, pmacMessageBroker::PMAC_TRAJECTORY_LANE);
   } else {
-    debug(DEBUG_ERROR, functionName, "Out of range buffer pointer", buffer);
-    status = asynError;
+    debug(DEBUG_ERROR, functionName, "Trajectory fill failed, buffer pointer not sent", buffer);
   }
-  debug(DEBUG_TRACE, functionName, "Command", cstr);
-  status = this->immediateWriteRead(cstr, response);
 
-  // Reinstate the status reading within the message broker
-  pBroker_->reinstateStatusReads();
+  pBroker_->endTrajectoryFill();
+  tScanFillDuration_ = fillDuration;
 
   stopTimer(DEBUG_TIMING, functionName, "Time taken to send trajectory demand");
 
@@ -3777,6 +4032,9 @@ asynStatus pmacController::updateStatistics() {
   setIntegerParam(PMAC_C_MsgBytesWritten_, lastMsgBytesWritten);
   setIntegerParam(PMAC_C_MsgBytesRead_, lastMsgBytesRead);
   setIntegerParam(PMAC_C_MsgTime_, lastMsgTime);
+  // Queued writes have already completed their puts, so failures are only
+  // reported here
+  setIntegerParam(PMAC_C_SubmitFailures_, pBroker_->readSubmitFailures());
   getIntegerParam(PMAC_C_MaxBytesWritten_, &maxBytesWritten);
   if (lastMsgBytesWritten > maxBytesWritten) {
     setIntegerParam(PMAC_C_MaxBytesWritten_, lastMsgBytesWritten);
@@ -3799,6 +4057,227 @@ asynStatus pmacController::updateStatistics() {
   return status;
 }
 
+/**
+ * Publish the median, 90th and 99th percentiles and the maximum of each of the
+ * broker message histograms.  Called once per fast poll rather than after
+ * every command, callbacks are only made for summaries that have changed.
+ */
+asynStatus pmacController::updateHistograms() {
+  asynStatus status = asynSuccess;
+  int values[PMAC_HISTOGRAM_SUMMARIES];
+  static const char *functionName = "updateHistograms";
+
+  debug(DEBUG_FLOW, functionName);
+
+  for (int category = 0; category < PMAC_STATS_CATEGORIES; category++) {
+    for (int metric = 0; metric < PMAC_STATS_METRICS; metric++) {
+      if (pBroker_->readHistogram(category, metric, &values[0], &values[1], &values[2],
+                                  &values[3]) != asynSuccess) {
+        status = asynError;
+        continue;
+      }
+      for (int summary = 0; summary < PMAC_HISTOGRAM_SUMMARIES; summary++) {
+        setIntegerParam(PMAC_C_Histogram_[category][metric][summary], values[summary]);
+      }
+    }
+  }
+  callParamCallbacks();
+
+  return status;
+}
+
+/**
+ * Read the next slice of the medium or slow store.  Each loop period starts a
+ * new pass through the store, and enough of the store is read on each poll
+ * that the pass completes by the last poll of the period, so every variable
+ * is still refreshed once per period but no one poll reads the whole store.
+ * Must be called with the lock held, which is released while the broker
+ * talks to the PMAC.
+ *
+ * @param type The store (PMAC_MEDIUM_READ or PMAC_SLOW_READ).
+ * @param loopTime The loop period of the store in ms.
+ * @param passStart The start time of the current pass.
+ */
+void pmacController::updateSlicedStore(int type, double loopTime, epicsTimeStamp *passStart) {
+  double loopSecs = loopTime / 1000.0;
+  double pollSecs = anyAxisMoving() ? movingPollPeriod_ : idlePollPeriod_;
+  bool newPass = false;
+  double elapsed = epicsTimeDiffInSeconds(&nowTime_, passStart);
+
+  if (elapsed >= loopSecs) {
+    epicsTimeAddSeconds(passStart, loopSecs);
+    elapsed -= loopSecs;
+    if (elapsed >= loopSecs) {
+      // Polling stopped for more than a period (e.g. disconnected), start afresh
+      *passStart = nowTime_;
+      elapsed = 0.0;
+    }
+    newPass = true;
+  }
+  unlock();
+  pBroker_->updateVariablesSlice(type, (elapsed + pollSecs) / loopSecs, newPass);
+  lock();
+}
+
+/**
+ * Compare the time taken by the last fast update with the current poll
+ * period.  If the fast update is persistently over budget the low priority
+ * fast variables are only read about once per medium loop, so that the poller
+ * does not run back to back and starve writes.  They are read on every poll
+ * again once a complete fast update fits comfortably within the period.
+ * Must be called with the lock held.
+ */
+void pmacController::checkPollBudget() {
+  double period = 1000.0 * (anyAxisMoving() ? movingPollPeriod_ : idlePollPeriod_);
+  double updateTime = pBroker_->readUpdateTime();
+  int decimation = pBroker_->readDecimation(pmacMessageBroker::PMAC_FAST_READ);
+  static const char *functionName = "checkPollBudget";
+
+  if (period <= 0.0) {
+    return;
+  }
+  if (decimation == 1) {
+    if (updateTime > period * PMAC_POLL_BUDGET_HIGH) {
+      pollOverBudgetCount_++;
+    } else {
+      pollOverBudgetCount_ = 0;
+    }
+    if (pollOverBudgetCount_ >= PMAC_POLL_BUDGET_CYCLES) {
+      pollOverBudgetCount_ = 0;
+      pollUnderBudgetCount_ = 0;
+      decimation = (int) ceil(PMAC_MEDIUM_LOOP_TIME / period);
+      if (decimation < 2) {
+        decimation = 2;
+      }
+      pBroker_->setDecimation(pmacMessageBroker::PMAC_FAST_READ, decimation);
+      // A routine response to load, reported on POLL_DECIMATION_RBV
+      debugf(DEBUG_TRACE, functionName,
+             "Fast update %.1f ms over budget of %.1f ms, reading every %d polls: %s",
+             updateTime, period, decimation,
+             pBroker_->readLowPriorityList(pmacMessageBroker::PMAC_FAST_READ).c_str());
+      setIntegerParam(PMAC_C_PollDecimation_, decimation);
+      callParamCallbacks();
+    }
+  } else if (pBroker_->readUpdateComplete(pmacMessageBroker::PMAC_FAST_READ)) {
+    // Only an update that read the low priority variables shows the full cost
+    if (updateTime < period * PMAC_POLL_BUDGET_LOW) {
+      pollUnderBudgetCount_++;
+    } else {
+      pollUnderBudgetCount_ = 0;
+    }
+    if (pollUnderBudgetCount_ >= PMAC_POLL_BUDGET_CYCLES) {
+      pollUnderBudgetCount_ = 0;
+      pBroker_->setDecimation(pmacMessageBroker::PMAC_FAST_READ, 1);
+      debugf(DEBUG_TRACE, functionName,
+             "Fast update %.1f ms within budget of %.1f ms, reading every poll: %s",
+             updateTime, period,
+             pBroker_->readLowPriorityList(pmacMessageBroker::PMAC_FAST_READ).c_str());
+      setIntegerParam(PMAC_C_PollDecimation_, 1);
+      callParamCallbacks();
+    }
+  }
+}
+
+/**
+ * @return true if any real axis was moving when it was last polled.
+ */
+bool pmacController::anyAxisMoving() {
+  pmacAxis *pAxis = NULL;
+  for (int axis = 0; axis < numAxes_; axis++) {
+    pAxis = getAxis(axis);
+    if (pAxis && pAxis->moving_) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @return true if any coordinate system is running a program or is not in
+ * position, as read by the last pre-fast update.
+ */
+bool pmacController::anyCSBusy() {
+  for (int csNo = 0; csNo < PMAC_MAX_CS; csNo++) {
+    if (pCSControllers_[csNo] != NULL) {
+      csStatus cStatus = pCSControllers_[csNo]->getStatus();
+      if (cStatus.running_ || !cStatus.done_) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/**
+ * Move each real axis between the full and the idle fast poll rate.  An axis
+ * is busy, and is polled at the full rate, while it is moving or has a
+ * deferred move, while any coordinate system or trajectory scan is running,
+ * and for PMAC_IDLE_AXIS_DELAY seconds after it stopped or any axis demand
+ * was sent.  The axis providing the encoder of a busy axis is also busy.
+ * Only axes that change rate are passed to the broker, and the store repacks
+ * its command strings once on the next update.  Must be called with the lock
+ * held.
+ */
+void pmacController::updateIdleAxes() {
+  epicsTimeStamp now;
+  pmacAxis *pAxis = NULL;
+  std::vector<bool> busy(numAxes_, true);
+  std::vector<int> handles;
+  bool allBusy = false;
+  static const char *functionName = "updateIdleAxes";
+
+  epicsTimeGetCurrent(&now);
+  allBusy = idleAxisDecimation_ <= 1 || tScanExecuting_ || movesDeferred_ != 0 ||
+            epicsTimeDiffInSeconds(&now, &lastDemandTime_) < PMAC_IDLE_AXIS_DELAY ||
+            anyCSBusy();
+
+  for (int axis = 1; axis < numAxes_; axis++) {
+    pAxis = getAxis(axis);
+    if (pAxis == NULL || !pAxis->initialised_) {
+      continue;
+    }
+    if (allBusy || pAxis->moving_ || pAxis->deferredMove_) {
+      pAxis->lastBusyTime_ = now;
+    } else {
+      busy[axis] = epicsTimeDiffInSeconds(&now, &pAxis->lastBusyTime_) < PMAC_IDLE_AXIS_DELAY;
+    }
+  }
+  for (int axis = 1; axis < numAxes_; axis++) {
+    pAxis = getAxis(axis);
+    if (pAxis != NULL && busy[axis] && pAxis->encoder_axis_ > 0 &&
+        pAxis->encoder_axis_ < numAxes_) {
+      busy[pAxis->encoder_axis_] = true;
+    }
+  }
+
+  for (int axis = 1; axis < numAxes_; axis++) {
+    pAxis = getAxis(axis);
+    if (pAxis == NULL || !pAxis->initialised_ || pAxis->pollIdle_ == !busy[axis]) {
+      continue;
+    }
+    pAxis->pollIdle_ = !busy[axis];
+    handles.clear();
+    handles.push_back(pAxis->positionHandle_);
+    handles.push_back(pAxis->followingErrorHandle_);
+    handles.push_back(pAxis->ixx24Handle_);
+    handles.push_back(pAxis->statusHandle_);
+    pBroker_->setIdle(pmacMessageBroker::PMAC_FAST_READ, &handles[0], (int) handles.size(),
+                      pAxis->pollIdle_);
+    debugf(DEBUG_TRACE, functionName, "Axis %d polled at the %s rate", axis,
+           pAxis->pollIdle_ ? "idle" : "full");
+  }
+}
+
+/**
+ * Clear the broker message histograms, the summaries are updated on the next
+ * fast poll.
+ */
+asynStatus pmacController::resetHistograms() {
+  printf("Resetting PMAC message histograms\n");
+  pBroker_->resetHistograms();
+  return asynSuccess;
+}
+
 /**
  * Disable the check in the axis poller that reads ix24 to check if hardware limits
  * are disabled. By default this is enabled for safety reasons. It sets the motor
@@ -3943,8 +4422,8 @@ asynStatus pmacController::registerForCallbacks(pmacCallbackInterface *cbPtr, in
   return pBroker_->registerForUpdates(cbPtr, type);
 }
 
-asynStatus pmacController::monitorPMACVariable(int poll_speed, const char *var) {
-  return pBroker_->addReadVariable(poll_speed, var);
+asynStatus pmacController::monitorPMACVariable(int poll_speed, const char *var, int *handle) {
+  return pBroker_->addReadVariable(poll_speed, var, handle);
 }
 
 asynStatus pmacController::registerCS(pmacCSController *csPtr, const char *portName, int csNo) {
@@ -4500,127 +4979,105 @@ asynStatus pmacController::copyCsReadbackToDemand(bool manual)
   return status;
 }
 
-asynStatus pmacController::tScanBuildProfileArray(double *positions, double *velocities, double *times, int axis, int numPoints) {
+/**
+ * Convert a batch of points from the profile arrays straight into the free
+ * space of the trajectory store, and make them valid.  Positions are converted
+ * from EGU to counts with the resolution and offset of each CS axis, and
+ * velocities are either converted or calculated from the positions.
+ * @param numPoints Number of points in the batch.
+ * @return asynStatus
+ */
+asynStatus pmacController::tScanAppendPoints(int numPoints) {
   asynStatus status = asynSuccess;
-  int index = 0;
+  pmacTrajectorySlice slice;
+  int offset = 0;
   int csEnum = 0;
   int calculateVel = 1;
-  double resolution = 1.0;
-  double offset = 0.0;
-  static const char *functionName = "tScanBuildProfileArray";
+  double resolution[PMAC_MAX_CS_AXES];
+  double csOffset[PMAC_MAX_CS_AXES];
+  double previousPosition[PMAC_MAX_CS_AXES];
+  double previousVelocity[PMAC_MAX_CS_AXES];
+  static const char *functionName = "tScanAppendPoints";
 
-  debug(DEBUG_TRACE, functionName, "Called for axis", axis);
-
-  if (axis < 0 || axis > 8) {
-    debug(DEBUG_ERROR, functionName, "Invalid axis number", axis);
-    status = asynError;
-  }
+  debug(DEBUG_TRACE, functionName, "Called for points", numPoints);
 
   // Determine which CS we currently are using for trajectory scans
   getIntegerParam(PMAC_C_TrajCSPort_, &csEnum);
   getIntegerParam(PMAC_C_TrajCalcVel_, &calculateVel);
 
-  // ask the CS for its axis resolution (axis no.s of CS are 1 based)
-  resolution = pCSControllers_[csEnum]->getAxisResolution(axis + 1);
-  offset = pCSControllers_[csEnum]->getAxisOffset(axis + 1);
+  if (calculateVel != PMAC_TRAJ_VELOCITY_PROVIDED &&
+      calculateVel != PMAC_TRAJ_VELOCITY_CALCULATED) {
+    debug(DEBUG_ERROR, functionName, "Invalid velocity assignment option", calculateVel);
+    status = asynError;
+  }
 
-  if (status == asynSuccess) {
-    debug(DEBUG_VARIABLE, functionName, "Resolution", resolution);
-    debug(DEBUG_VARIABLE, functionName, "Offset", offset);
-
-    // Now loop over the points, applying offset and resolution to positions and store
-    for (index = 0; index < numPoints; index++) {
-      positions[index] = (eguProfilePositions_[axis][index] - offset) / resolution;
-    }
-    // Iterates over points, applying resolution to velocities or calculating from velocity mode
-    for (index = 0; index < numPoints; index++) {
-      if(calculateVel == PMAC_TRAJ_VELOCITY_PROVIDED){
-        velocities[index] = (eguProfileVelocities_[axis][index]) / resolution;
-      } else if(calculateVel == PMAC_TRAJ_VELOCITY_CALCULATED){
-        status = this->tScanCalculateVelocityArray(positions, velocities, times, index);
-      } else {
-        debug(DEBUG_ERROR, functionName, "Invalid velocity assignment option", calculateVel);
-        status = asynError;
+  for (int axis = 0; axis < PMAC_MAX_CS_AXES && status == asynSuccess; axis++) {
+    if ((1 << axis & tScanAxisMask_) > 0) {
+      status = this->allocateProfileAxis(axis);
+      if (status == asynSuccess) {
+        // ask the CS for its axis resolution (axis no.s of CS are 1 based)
+        resolution[axis] = pCSControllers_[csEnum]->getAxisResolution(axis + 1);
+        csOffset[axis] = pCSControllers_[csEnum]->getAxisOffset(axis + 1);
+        debug(DEBUG_VARIABLE, functionName, "Resolution", resolution[axis]);
+        debug(DEBUG_VARIABLE, functionName, "Offset", csOffset[axis]);
+        // Velocities are calculated in EGU from the point before, which for an
+        // append is the last point already in the store
+        previousPosition[axis] = eguProfilePositions_[axis][0];
+        previousVelocity[axis] = 0.0;
+        int last = pTrajectory_->getNoOfValidPoints() - 1;
+        if (last >= 0 && pTrajectory_->getSlice(last, 1, &slice) == asynSuccess) {
+          previousPosition[axis] = slice.positions[axis][0] * resolution[axis] + csOffset[axis];
+          previousVelocity[axis] = slice.velocities[axis][0] * resolution[axis];
+        }
       }
     }
   }
 
-  return status;
-}
-
-asynStatus pmacController::tScanCalculateVelocityArray(double *positions, double *velocities, double *times, int index) {
-  asynStatus status = asynSuccess;
-  static const char *functionName = "tScanCalculateVelocityArray";
-
-  double inverse_deltaTime = 0;
-  double deltaPos = 0.0;
-
-  debug(DEBUG_TRACE, functionName, "Called for index", index);
-
-  switch(profileVelMode_[index]) {
-    // Average Previous -> Next
-    case 0:
-      if(times[index] <=  0 && times[index+1] <= 0) {
-        debugf(DEBUG_ERROR, functionName, "Invalid times (%d and %d) at points %d and %d",
-               times[index],times[index+1], index, (index+1));
-        status = asynError;
-        break;
-      }
-      inverse_deltaTime = 1000000 / (times[index]+times[index+1]);
-      deltaPos = positions[index+1] - positions[index-1];
-      velocities[index] = inverse_deltaTime * deltaPos;
-      break;
-
-    // Real Previous -> Current
-    case 1:
-    if(times[index] <=  0) {
-        debugf(DEBUG_ERROR, functionName, "Invalid time (%d) at point %d",
-               times[index],index);
-        status = asynError;
-        break;
-      }
-      inverse_deltaTime = 1000000 / (times[index]);
-      deltaPos = positions[index] - positions[index-1];
-      velocities[index] = 2.0 * inverse_deltaTime * deltaPos - velocities[index-1];
-      break;
-
-    // Average Previous -> Current
-    case 2:
-      if(times[index] <=  0) {
-        debugf(DEBUG_ERROR, functionName, "Invalid time (%d) at point %d",
-               times[index], index);
-        status = asynError;
-        break;
-      }
-      inverse_deltaTime = 1000000 / (times[index]);
-      deltaPos = positions[index] - positions[index-1];
-      velocities[index] = inverse_deltaTime * deltaPos;
-      break;
-
-    // Zero
-    case 3:
-      velocities[index] = 0.0;
+  while (offset < numPoints && status == asynSuccess) {
+    status = pTrajectory_->getAppendSlice(offset, numPoints - offset, &slice);
+    if (status != asynSuccess) {
       break;
-
-    // Average Current -> Next
-    case 4:
-      if(times[index+1] <= 0) {
-        debugf(DEBUG_ERROR, functionName, "Invalid time (%d) at point %d",
-               times[index+1], (index+1));
-        status = asynError;
-        break;
+    }
+    for (int index = 0; index < slice.count; index++) {
+      slice.times[index] = (int) (profileTimes_[offset + index]);
+    }
+    memcpy(slice.user, &profileUser_[offset], slice.count * sizeof(int));
+
+    for (int axis = 0; axis < PMAC_MAX_CS_AXES && status == asynSuccess; axis++) {
+      if ((1 << axis & tScanAxisMask_) > 0) {
+        const double *egu = &eguProfilePositions_[axis][offset];
+        double *velocities = slice.velocities[axis];
+
+        // Apply offset and resolution to the positions
+        pmacTrajectory::convertToCounts(egu, slice.count, csOffset[axis], resolution[axis],
+                                        slice.positions[axis]);
+        // Apply resolution to the velocities or calculate them from the velocity mode
+        if (calculateVel == PMAC_TRAJ_VELOCITY_PROVIDED) {
+          pmacTrajectory::convertToCounts(&eguProfileVelocities_[axis][offset], slice.count, 0.0,
+                                          resolution[axis], velocities);
+        } else {
+          // Calculated in EGU straight into the store and then scaled in place
+          status = pTrajectory_->calculateVelocities(egu, &profileTimes_[offset],
+                                                     &profileVelMode_[offset], slice.count,
+                                                     previousPosition[axis],
+                                                     previousVelocity[axis], velocities, offset);
+          if (status == asynSuccess) {
+            previousPosition[axis] = egu[slice.count - 1];
+            previousVelocity[axis] = velocities[slice.count - 1];
+            pmacTrajectory::convertToCounts(velocities, slice.count, 0.0, resolution[axis],
+                                            velocities);
+          }
+        }
       }
-      inverse_deltaTime = 1000000 / (times[index+1]);
-      deltaPos = positions[index+1] - positions[index];
-      velocities[index] = inverse_deltaTime * deltaPos;
-      break;
+    }
+    offset += slice.count;
+  }
 
-    default:
-      debugf(DEBUG_ERROR, functionName, "Invalid velocity mode (%d) at point %d",
-             profileVelMode_[index], index);
-      status = asynError;
-      break;
+  // Check the times and user values and make the points valid
+  if (status == asynSuccess) {
+    status = pTrajectory_->commit(numPoints);
   }
+
   return status;
 }
 
@@ -4904,6 +5361,122 @@ asynStatus pmacNoCsVelocity(const char *controller) {
   return asynSuccess;
 }
 
+/**
+ * Sets the number of poll command strings that are written to the PMAC before
+ * the first reply is read back.
+ *
+ * @param controller The Asyn port name for the PMAC controller.
+ * @param depth The number of command strings in flight (1 disables pipelining).
+ *
+ */
+asynStatus pmacSetPipelineDepth(const char *controller, int depth) {
+  pmacController *pC;
+  static const char *functionName = "pmacSetPipelineDepth";
+
+  pC = (pmacController *) findAsynPortDriver(controller);
+  if (!pC) {
+    printf("%s:%s: Error port %s not found\n", driverName, functionName, controller);
+    return asynError;
+  }
+
+  return pC->setPipelineDepth(depth);
+}
+
+/**
+ * Sets the budgets used to pack the polled variables into command strings.
+ * Each command string is limited to requestBytes characters and to a reply
+ * that is predicted (from previous polls) to be at most replyBytes long.
+ *
+ * @param controller The Asyn port name for the PMAC controller.
+ * @param requestBytes Maximum length of each command string.
+ * @param replyBytes Maximum predicted length of each reply.
+ *
+ */
+asynStatus pmacSetCommandBudget(const char *controller, int requestBytes, int replyBytes) {
+  pmacController *pC;
+  static const char *functionName = "pmacSetCommandBudget";
+
+  pC = (pmacController *) findAsynPortDriver(controller);
+  if (!pC) {
+    printf("%s:%s: Error port %s not found\n", driverName, functionName, controller);
+    return asynError;
+  }
+
+  return pC->setCommandBudget(requestBytes, replyBytes);
+}
+
+/**
+ * Clears the message round trip time and size histograms kept for each poll
+ * rate and for immediate commands.
+ *
+ * @param controller The Asyn port name for the PMAC controller.
+ *
+ */
+asynStatus pmacResetHistograms(const char *controller) {
+  pmacController *pC;
+  static const char *functionName = "pmacResetHistograms";
+
+  pC = (pmacController *) findAsynPortDriver(controller);
+  if (!pC) {
+    printf("%s:%s: Error port %s not found\n", driverName, functionName, controller);
+    return asynError;
+  }
+
+  return pC->resetHistograms();
+}
+
+/**
+ * Sets the rate at which the status of idle axes is polled.  An axis is
+ * idle once it has not been moving, and no axis demand has been sent, for
+ * a couple of seconds while no coordinate system program or trajectory scan
+ * is running.  Its status is then read only once every polls fast updates,
+ * it is read on every fast update again as soon as it becomes busy.
+ *
+ * @param controller The Asyn port name for the PMAC controller.
+ * @param polls The idle axis decimation factor, 1 (the default) reads every
+ * axis on every fast update.
+ *
+ */
+asynStatus pmacSetIdleAxisDecimation(const char *controller, int polls) {
+  pmacController *pC;
+  static const char *functionName = "pmacSetIdleAxisDecimation";
+
+  pC = (pmacController *) findAsynPortDriver(controller);
+  if (!pC) {
+    printf("%s:%s: Error port %s not found\n", driverName, functionName, controller);
+    return asynError;
+  }
+
+  return pC->setIdleAxisDecimation(polls);
+}
+
+/**
+ * Gives one of the controller's connection lanes its own low level port, so
+ * that trajectory streaming, for example, does not hold up status polling.
+ * The port must be a further session on the same Power PMAC, created in the
+ * startup script in the same way as the controller's own low level port.
+ *
+ * @param controller The Asyn port name for the PMAC controller.
+ * @param lane POLL (store polling), COMMAND (demands and other commands) or
+ * TRAJECTORY (trajectory scan buffer writes).
+ * @param port The Asyn port name of the additional low level port.
+ * @param addr The address on the low level port.
+ *
+ */
+asynStatus pmacSetConnectionPort(const char *controller, const char *lane, const char *port,
+                                 int addr) {
+  pmacController *pC;
+  static const char *functionName = "pmacSetConnectionPort";
+
+  pC = (pmacController *) findAsynPortDriver(controller);
+  if (!pC) {
+    printf("%s:%s: Error port %s not found\n", driverName, functionName, controller);
+    return asynError;
+  }
+
+  return pC->setConnectionPort(lane, port, addr);
+}
+
 asynStatus pmacMonitorVariables(const char *controller, const char *variablesString) {
   std::string variables = std::string(variablesString);
   pmacController *pC;
@@ -5076,6 +5649,71 @@ static void configpmacMonitorVariablesCallFunc(const iocshArgBuf *args) {
   pmacMonitorVariables(args[0].sval, args[1].sval);
 }
 
+/* pmacSetPipelineDepth */
+static const iocshArg pmacSetPipelineDepthArg0 = {"Controller port name", iocshArgString};
+static const iocshArg pmacSetPipelineDepthArg1 = {"Pipeline depth", iocshArgInt};
+static const iocshArg *const pmacSetPipelineDepthArgs[] = {&pmacSetPipelineDepthArg0,
+                                                           &pmacSetPipelineDepthArg1};
+static const iocshFuncDef configpmacSetPipelineDepth = {"pmacSetPipelineDepth", 2,
+                                                        pmacSetPipelineDepthArgs};
+
+static void configpmacSetPipelineDepthCallFunc(const iocshArgBuf *args) {
+  pmacSetPipelineDepth(args[0].sval, args[1].ival);
+}
+
+/* pmacSetCommandBudget */
+static const iocshArg pmacSetCommandBudgetArg0 = {"Controller port name", iocshArgString};
+static const iocshArg pmacSetCommandBudgetArg1 = {"Request bytes", iocshArgInt};
+static const iocshArg pmacSetCommandBudgetArg2 = {"Reply bytes", iocshArgInt};
+static const iocshArg *const pmacSetCommandBudgetArgs[] = {&pmacSetCommandBudgetArg0,
+                                                           &pmacSetCommandBudgetArg1,
+                                                           &pmacSetCommandBudgetArg2};
+static const iocshFuncDef configpmacSetCommandBudget = {"pmacSetCommandBudget", 3,
+                                                        pmacSetCommandBudgetArgs};
+
+static void configpmacSetCommandBudgetCallFunc(const iocshArgBuf *args) {
+  pmacSetCommandBudget(args[0].sval, args[1].ival, args[2].ival);
+}
+
+/* pmacResetHistograms */
+static const iocshArg pmacResetHistogramsArg0 = {"Controller port name", iocshArgString};
+static const iocshArg *const pmacResetHistogramsArgs[] = {&pmacResetHistogramsArg0};
+static const iocshFuncDef configpmacResetHistograms = {"pmacResetHistograms", 1,
+                                                       pmacResetHistogramsArgs};
+
+static void configpmacResetHistogramsCallFunc(const iocshArgBuf *args) {
+  pmacResetHistograms(args[0].sval);
+}
+
+/* pmacSetIdleAxisDecimation */
+static const iocshArg pmacSetIdleAxisDecimationArg0 = {"Controller port name", iocshArgString};
+static const iocshArg pmacSetIdleAxisDecimationArg1 = {"Polls", iocshArgInt};
+static const iocshArg *const pmacSetIdleAxisDecimationArgs[] = {&pmacSetIdleAxisDecimationArg0,
+                                                                &pmacSetIdleAxisDecimationArg1};
+static const iocshFuncDef configpmacSetIdleAxisDecimation = {"pmacSetIdleAxisDecimation", 2,
+                                                             pmacSetIdleAxisDecimationArgs};
+
+static void configpmacSetIdleAxisDecimationCallFunc(const iocshArgBuf *args) {
+  pmacSetIdleAxisDecimation(args[0].sval, args[1].ival);
+}
+
+/* pmacSetConnectionPort */
+static const iocshArg pmacSetConnectionPortArg0 = {"Controller port name", iocshArgString};
+static const iocshArg pmacSetConnectionPortArg1 = {"Lane (POLL, COMMAND or TRAJECTORY)",
+                                                   iocshArgString};
+static const iocshArg pmacSetConnectionPortArg2 = {"Low level port name", iocshArgString};
+static const iocshArg pmacSetConnectionPortArg3 = {"Low level port address", iocshArgInt};
+static const iocshArg *const pmacSetConnectionPortArgs[] = {&pmacSetConnectionPortArg0,
+                                                            &pmacSetConnectionPortArg1,
+                                                            &pmacSetConnectionPortArg2,
+                                                            &pmacSetConnectionPortArg3};
+static const iocshFuncDef configpmacSetConnectionPort = {"pmacSetConnectionPort", 4,
+                                                         pmacSetConnectionPortArgs};
+
+static void configpmacSetConnectionPortCallFunc(const iocshArgBuf *args) {
+  pmacSetConnectionPort(args[0].sval, args[1].sval, args[2].sval, args[3].ival);
+}
+
 static void pmacControllerRegister(void) {
   iocshRegister(&configpmacCreateController, configpmacCreateControllerCallFunc);
   iocshRegister(&configpmacAxis, configpmacAxisCallFunc);
@@ -5088,6 +5726,11 @@ static void pmacControllerRegister(void) {
   iocshRegister(&configpmacDebug, configpmacDebugCallFunc);
   iocshRegister(&configpmacNoCsVelocity, configpmacNoCsVelocityCallFunc);
   iocshRegister(&configMonitorVariables, configpmacMonitorVariablesCallFunc);
+  iocshRegister(&configpmacSetPipelineDepth, configpmacSetPipelineDepthCallFunc);
+  iocshRegister(&configpmacSetCommandBudget, configpmacSetCommandBudgetCallFunc);
+  iocshRegister(&configpmacResetHistograms, configpmacResetHistogramsCallFunc);
+  iocshRegister(&configpmacSetIdleAxisDecimation, configpmacSetIdleAxisDecimationCallFunc);
+  iocshRegister(&configpmacSetConnectionPort, configpmacSetConnectionPortCallFunc);
 }
 epicsExportRegistrar(pmacControllerRegister);
 
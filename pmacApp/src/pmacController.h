@@ -22,6 +22,7 @@
 #include "pmacHardwareTurbo.h"
 #include "pmacHardwarePower.h"
 #include "IntegerHashtable.h"
+#include "StringHashtable.h"
 
 #define PMAC_C_FirstParamString           "PMAC_C_FIRSTPARAM"
 #define PMAC_C_LastParamString            "PMAC_C_LASTPARAM"
@@ -52,6 +53,7 @@
 #define PMAC_C_DisablePollingString       "PMAC_C_DEBUG_POLL_OFF"
 
 #define PMAC_C_FastUpdateTimeString       "PMAC_C_FAST_UPDATE_TIME"
+#define PMAC_C_PollDecimationString       "PMAC_C_POLL_DECIMATION"
 
 #define PMAC_C_CpuNumCoresString          "PMAC_C_CPU_NUM_CORES"
 #define PMAC_C_CpuUsage0String            "PMAC_C_CPU_USAGE_0"
@@ -86,6 +88,10 @@
 #define PMAC_C_AveBytesWrittenString      "PMAC_C_AVE_BYTES_WRITE"
 #define PMAC_C_AveBytesReadString         "PMAC_C_AVE_BYTES_READ"
 #define PMAC_C_AveTimeString              "PMAC_C_AVE_TIME"
+#define PMAC_C_SubmitFailuresString       "PMAC_C_SUBMIT_FAILURES"
+// Message histogram summaries, e.g. PMAC_C_HIST_FAST_RTT_P99
+#define PMAC_C_HistogramString            "PMAC_C_HIST_%s_%s_%s"
+#define PMAC_HISTOGRAM_SUMMARIES          4
 
 #define PMAC_C_FastStoreString            "PMAC_C_FAST_STORE"
 #define PMAC_C_MediumStoreString          "PMAC_C_MEDIUM_STORE"
@@ -183,15 +189,36 @@
 #define PMAC_MAX_PARAMETERS 1000
 
 #define PMAC_MAX_CS 16
+// Status variables read by the medium update
+#define PMAC_MEDIUM_PLCS 32
+#define PMAC_MEDIUM_PROGS 16
+#define PMAC_MEDIUM_GPIO_BITS 16
 #define PMAC_MAX_CS_AXES 9
 
 #define PMAC_MAX_TRAJECTORY_POINTS 10000000
 
+// Points per trajectory write, a full write of Turbo PMAC words fits on one 255 character line
 #define PMAC_POINTS_PER_WRITE 17
 
 #define PMAC_MEDIUM_LOOP_TIME 2000
 #define PMAC_SLOW_LOOP_TIME   5000
 
+// The fast update is over budget when it takes more than PMAC_POLL_BUDGET_HIGH
+// of the poll period for PMAC_POLL_BUDGET_CYCLES polls in a row.  The low
+// priority fast variables are then read at about the medium loop rate until a
+// complete fast update takes less than PMAC_POLL_BUDGET_LOW of the period
+#define PMAC_POLL_BUDGET_HIGH   0.9
+#define PMAC_POLL_BUDGET_LOW    0.6
+#define PMAC_POLL_BUDGET_CYCLES 5
+
+// An axis is polled at the idle axis rate once it has not been moving, and
+// no axis demand has been sent, for PMAC_IDLE_AXIS_DELAY seconds
+#define PMAC_IDLE_AXIS_DELAY 2.0
+
+// While a trajectory buffer is filled the fast variables are still read at
+// least once every PMAC_FILL_STATUS_POLLS moving polls
+#define PMAC_FILL_STATUS_POLLS 4
+
 #define PMAC_PVT_TIME_MODE       "I42"   // PVT Time Control Mode (0=4,095 ms max time, 1=8,388,607 ms max time)
 
 #define PMAC_CPU_PHASE_INTR      "M70"   // Time between phase interrupts (CPU cycles/2)
@@ -243,10 +270,19 @@
 
 class pmacCSMonitor;
 
+// A PMAC_Vxx_ parameter, with the handle of its variable in the store it is
+// read from and the value type ('I', 'H', 'D' or 'S') to parse it as
+struct pmacVariableParam {
+    int handle;
+    int param;
+    char type;
+};
+
 class pmacCSController;
 
 class pmacController
-        : public asynMotorController, public pmacCallbackInterface, public pmacDebugger {
+        : public asynMotorController, public pmacCallbackInterface, public pmacCompletionInterface,
+          public pmacDebugger {
 
 public:
     pmacController(const char *portName, const char *lowLevelPortName, int lowLevelPortAddress,
@@ -260,16 +296,27 @@ public:
     void initAsynParams(void);
     void pollAllNow(void);
     void setupBrokerVariables(void);
+    void monitorLowPriorityVariable(const char *variable);
     void startPMACPolling();
     void setDebugLevel(int level, int axis, int csNo);
+    asynStatus setPipelineDepth(int depth);
+    asynStatus setCommandBudget(int requestBytes, int replyBytes);
+    asynStatus setIdleAxisDecimation(int polls);
+    asynStatus setConnectionPort(const char *lane, const char *port, int addr);
+    asynStatus resetHistograms();
 
     asynStatus drvUserCreate(asynUser *pasynUser, const char *drvInfo, const char **pptypeName, size_t *psize);
     asynStatus processDrvInfo(char *input, char *output);
     virtual void callback(pmacCommandStore *sPtr, int type);
+    virtual void completed(const char *command, const char *response, asynStatus status);
     asynStatus slowUpdate(pmacCommandStore *sPtr);
     asynStatus mediumUpdate(pmacCommandStore *sPtr);
+    asynStatus readMonitoredBit(pmacCommandStore *sPtr, int handle, const char *description,
+                                int *bit);
     asynStatus prefastUpdate(pmacCommandStore *sPtr);
     asynStatus fastUpdate(pmacCommandStore *sPtr);
+    void updateVariableParams(pmacCommandStore *sPtr,
+                              const std::vector<pmacVariableParam> &params);
     asynStatus parseIntegerVariable(const std::string &command,
                                     const std::string &response,
                                     const std::string &desc,
@@ -280,8 +327,11 @@ public:
                                     double &value);
 
     //asynStatus printConnectedStatus(void);
-    asynStatus immediateWriteRead(const char *command, char *response);
-    asynStatus axisWriteRead(const char *command, char *response);
+    asynStatus immediateWriteRead(const char *command, char *response,
+                                  int lane=pmacMessageBroker::PMAC_COMMAND_LANE);
+    asynStatus axisWriteRead(const char *command, char *response, bool priority=false);
+    asynStatus priorityWriteRead(const char *command, char *response);
+    asynStatus submitWriteRead(const char *command);
 
     /* These are the methods that we override */
     asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
@@ -328,7 +378,7 @@ public:
     asynStatus registerForCallbacks(pmacCallbackInterface *cbPtr, int type);
 
     // Add PMAC variable/status item to monitor
-    asynStatus monitorPMACVariable(int poll_speed, const char *var);
+    asynStatus monitorPMACVariable(int poll_speed, const char *var, int *handle = NULL);
 
     // Register a coordinate system with this controller
     asynStatus registerCS(pmacCSController *csPtr, const char *portName, int csNo);
@@ -353,10 +403,11 @@ public:
     asynStatus executeManualGroup();
     asynStatus updateCsAssignmentParameters();
     asynStatus copyCsReadbackToDemand(bool manual);
-    asynStatus tScanBuildProfileArray(double *positions, double *velocities, double *times, int axis, int numPoints);
-    asynStatus tScanCalculateVelocityArray(double *positions, double *velocities, double *times, int index);
+    asynStatus tScanAppendPoints(int numPoints);
     // asynStatus tScanBuildVelocityProfileArray(double *velocities, int axis, int numPoints);
     asynStatus tScanIncludedAxes(int *axisMask);
+    asynStatus allocateProfileAxis(int axis);
+    asynStatus setProfileAxisArray(double **arrays, int axis, epicsFloat64 *value, size_t nElements);
     void registerForLock(asynPortDriver *controller);
 
 protected:
@@ -386,6 +437,7 @@ protected:
     int PMAC_C_DebugCmd_;
     int PMAC_C_DisablePolling_;
     int PMAC_C_FastUpdateTime_;
+    int PMAC_C_PollDecimation_;
     int PMAC_C_CpuNumCores_;
     int PMAC_C_CpuUsage0_;
     int PMAC_C_CpuUsage1_;
@@ -479,6 +531,8 @@ protected:
     int PMAC_C_AveBytesWritten_;
     int PMAC_C_AveBytesRead_;
     int PMAC_C_AveTime_;
+    int PMAC_C_SubmitFailures_;
+    int PMAC_C_Histogram_[PMAC_STATS_CATEGORIES][PMAC_STATS_METRICS][PMAC_HISTOGRAM_SUMMARIES];
     int PMAC_C_FastStore_;
     int PMAC_C_MediumStore_;
     int PMAC_C_SlowStore_;
@@ -510,6 +564,8 @@ public:
 private:
     int connected_;
     int initialised_;
+    // Set up a new connection, every store is read before the next fast update
+    bool reprimeRequired_;
     int cid_;
     std::string cpu_;
     int cpuNumCores_;
@@ -518,10 +574,8 @@ private:
     pmacMessageBroker *pBroker_;
     pmacTrajectory *pTrajectory_;
     IntegerHashtable *pPortToCs_;
-    IntegerHashtable *pIntParams_;
-    IntegerHashtable *pHexParams_;
-    IntegerHashtable *pDoubleParams_;
-    IntegerHashtable *pStringParams_;
+    // The PMAC_Vxx_ parameters read from each store, indexed by store type
+    std::vector<pmacVariableParam> variableParams_[PMAC_STORE_TYPES];
     StringHashtable *pWriteParams_;
     pmacCSMonitor *pAxisZero;
     pmacCSController **pCSControllers_;
@@ -536,15 +590,26 @@ private:
     bool feedRatePoll_;
     double movingPollPeriod_;
     double idlePollPeriod_;
+    int pollOverBudgetCount_;
+    int pollUnderBudgetCount_;
+    int idleAxisDecimation_;
+    epicsTimeStamp lastDemandTime_;
     int i8_;
     int i7002_;
     bool csResetAllDemands;
     int csCount;
+    // Medium store handles of the PLC, motion program and GPIO status bits
+    int plcHandles_[PMAC_MEDIUM_PLCS];
+    int progHandles_[PMAC_MEDIUM_PROGS];
+    int gpioOutputHandles_[PMAC_MEDIUM_GPIO_BITS];
+    int gpioInputHandles_[PMAC_MEDIUM_GPIO_BITS];
+    bool gpioHandlesValid_;
 
 
     // Trajectory scan variables
     int pvtTimeMode_;
     bool profileInitialized_;
+    size_t profileCapacity_;        // Points held by each of the profile arrays below
     bool profileBuilt_;
     bool appendAvailable_;
     bool tScanShortScan_;           // Is the scan a short scan (< 3.0 seconds)
@@ -560,20 +625,32 @@ private:
     int tScanPmacBufferAddressA_;
     int tScanPmacBufferAddressB_;
     int tScanPmacBufferSize_;
+    double tScanFillDuration_;      // Motion time (s) of the points written by the last fill
     double tScanPmacProgVersion_;
+    // The arrays of each axis are allocated when the axis is first used
     double **eguProfilePositions_;  // 2D array of profile positions in EGU (1 array for each axis)
-    double **tScanPositions_;       // 2D array of profile positions (1 array for each axis)
     double **eguProfileVelocities_; // 2D array of profile velocities in EGU (1 array for each axis)
-    double **tScanVelocities_;      // 2D array of profile velocities (1 array for each axis)
     int *profileUser_;              // Array of profile user values
     int *profileVelMode_;           // Array of profile velocity modes
     epicsEventId startEventId_;
     epicsEventId stopEventId_;
 
-    asynStatus lowLevelWriteRead(const char *command, char *response);
+    asynStatus lowLevelWriteRead(const char *command, char *response,
+                                 int lane=pmacMessageBroker::PMAC_COMMAND_LANE);
 
     asynStatus updateStatistics();
 
+    asynStatus updateHistograms();
+
+    void checkPollBudget();
+
+    void updateSlicedStore(int type, double loopTime, epicsTimeStamp *passStart);
+
+    bool anyAxisMoving();
+
+    bool anyCSBusy();
+
+    void updateIdleAxes();
     asynStatus processDeferredMoves(void);
 
     //static class data members
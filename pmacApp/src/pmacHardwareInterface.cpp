@@ -18,3 +18,69 @@ pmacHardwareInterface::~pmacHardwareInterface() {
 void pmacHardwareInterface::registerController(pmacController *pController) {
   pC_ = pController;
 }
+
+/**
+ * Return the store handle of the status value for an axis.  The axis status is
+ * monitored by the axis itself, so the handle is looked up the first time the
+ * status is parsed and then reused for every subsequent poll.
+ *
+ * @param axis The axis number.
+ * @param sPtr The store holding the axis status.
+ * @return The handle, or -1 if the status is not yet in the store.
+ */
+int pmacHardwareInterface::getAxisStatusHandle(int axis, pmacCommandStore *sPtr) {
+  if (axis < 0) {
+    return -1;
+  }
+  if (axis >= (int) axisStatusHandles_.size()) {
+    axisStatusHandles_.resize(axis + 1, -1);
+  }
+  if (axisStatusHandles_[axis] < 0) {
+    axisStatusHandles_[axis] = sPtr->findHandle(this->getAxisStatusCmd(axis));
+  }
+  return axisStatusHandles_[axis];
+}
+
+/**
+ * Check whether any value parsed by parseAxisStatus has changed since the
+ * last callbacks, so that the axis can reuse its previously parsed status.
+ *
+ * @param axis The axis number.
+ * @param sPtr The store holding the axis status.
+ * @return true if the status must be parsed again.
+ */
+bool pmacHardwareInterface::axisStatusChanged(int axis, pmacCommandStore *sPtr) {
+  return sPtr->isDirty(this->getAxisStatusHandle(axis, sPtr));
+}
+
+/**
+ * @return The longest command line the hardware accepts, by default the
+ * longest the link can carry.
+ */
+int pmacHardwareInterface::getMaxCommandLength() {
+  return PMAC_MAX_LINE_LENGTH;
+}
+
+/**
+ * Add a run of consecutive points to an axis points command.  Hardware that
+ * can encode the run in one go overrides this, by default the points are
+ * added one at a time.
+ *
+ * @param axis_cmd The command being built.
+ * @param axis The axis, velocities are offset by the number of axes.
+ * @param pos The positions (or velocities) of the points.
+ * @param noOfPoints Number of points.
+ * @param buffSize Size of the PMAC trajectory buffer.
+ * @param firstVal True if the first point is the first in the command.
+ * @return asynError if any point cannot be encoded.
+ */
+asynStatus pmacHardwareInterface::addAxisPointsCmd(pmacCommandBuilder *axis_cmd, int axis,
+                                                   const double *pos, int noOfPoints,
+                                                   int buffSize, bool firstVal) {
+  asynStatus status = asynSuccess;
+  for (int index = 0; index < noOfPoints && status == asynSuccess; index++) {
+    status = this->addAxisPointCmd(axis_cmd, axis, pos[index], buffSize,
+                                   firstVal && index == 0);
+  }
+  return status;
+}
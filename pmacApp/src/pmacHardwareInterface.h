@@ -9,9 +9,11 @@
 #define PMACAPP_SRC_PMACHARDWAREINTERFACE_H_
 
 #include <string>
+#include <vector>
 #include "asynDriver.h"
 #include "pmacCommandStore.h"
 #include "pmacMessageBroker.h"
+#include "pmacCommandBuilder.h"
 
 struct globalStatus {
     int status_;
@@ -72,6 +74,8 @@ public:
 
     virtual asynStatus parseAxisStatus(int axis, pmacCommandStore *sPtr, axisStatus &status) = 0;
 
+    virtual bool axisStatusChanged(int axis, pmacCommandStore *sPtr);
+
     virtual asynStatus setupCSStatus(int csNo) = 0;
 
     virtual asynStatus parseCSStatus(int csNo, pmacCommandStore *sPtr, csStatus &status) = 0;
@@ -86,22 +90,36 @@ public:
 
     virtual std::string parseCSMappingResult(const std::string mappingResult) = 0;
 
-    virtual void startTrajectoryTimePointsCmd(char *user_cmd, char *time_cmd,
+    virtual int getMaxCommandLength();
+
+    virtual void startTrajectoryTimePointsCmd(pmacCommandBuilder *user_cmd,
+                                              pmacCommandBuilder *time_cmd,
                                               int addr) = 0;
 
-    virtual void addTrajectoryTimePointCmd(char *userCmd, char *timeCmd,
+    virtual void addTrajectoryTimePointCmd(pmacCommandBuilder *userCmd,
+                                           pmacCommandBuilder *timeCmd,
                                            int userFunc, int time,
                                            bool firstVal) = 0;
 
-    virtual void startAxisPointsCmd(char *axis_cmd, int axis, int addr, int buffSize, bool posCmd) = 0;
+    virtual void startAxisPointsCmd(pmacCommandBuilder *axis_cmd, int axis, int addr, int buffSize,
+                                    bool posCmd) = 0;
+
+    virtual asynStatus addAxisPointCmd(pmacCommandBuilder *axis_cmd, int axis, double pos,
+                                       int buffSize, bool firstVal) = 0;
 
-    virtual void addAxisPointCmd(char *axis_cmd, int axis, double pos, int buffSize,
-                                 bool firstVal) = 0;
+    virtual asynStatus addAxisPointsCmd(pmacCommandBuilder *axis_cmd, int axis, const double *pos,
+                                        int noOfPoints, int buffSize, bool firstVal);
 
     virtual std::string getCSEnableCommand(int csNo) = 0;
 
 protected:
+    int getAxisStatusHandle(int axis, pmacCommandStore *sPtr);
+
     pmacController *pC_;
+
+private:
+    // Fast store handles of the axis status values, indexed by axis number
+    std::vector<int> axisStatusHandles_;
 };
 
 #endif /* PMACAPP_SRC_PMACHARDWAREINTERFACE_H_ */
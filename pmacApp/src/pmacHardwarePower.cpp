@@ -5,6 +5,8 @@
  *      Author: gnx91527
  */
 
+#include <math.h>
+#include <float.h>
 #include "pmacHardwarePower.h"
 #include "pmacController.h"
 
@@ -137,22 +139,29 @@ asynStatus pmacHardwarePower::setupAxisStatus(int axis) {
   debug(DEBUG_TRACE, functionName, "Axis", axis);
   // Request coordinate system readback
   sprintf(var, AXIS_CS_NUMBER.c_str(), axis);
-  pC_->monitorPMACVariable(pmacMessageBroker::PMAC_FAST_READ, var);
+  if (axis >= (int) axisCSNumberHandles_.size()) {
+    axisCSNumberHandles_.resize(axis + 1, -1);
+  }
+  pC_->monitorPMACVariable(pmacMessageBroker::PMAC_FAST_READ, var, &axisCSNumberHandles_[axis]);
   return status;
 }
 
+int pmacHardwarePower::axisCSNumberHandle(int axis) {
+  if (axis < 0 || axis >= (int) axisCSNumberHandles_.size()) {
+    return -1;
+  }
+  return axisCSNumberHandles_[axis];
+}
+
 asynStatus
 pmacHardwarePower::parseAxisStatus(int axis, pmacCommandStore *sPtr, axisStatus &axStatus) {
   asynStatus status = asynSuccess;
   int nvals = 0;
   int dummyVal = 0;
-  std::string statusString = "";
-  std::string csString = "";
-  char var[16];
   static const char *functionName = "parseAxisStatus";
   char msg[47];
 
-  statusString = sPtr->readValue(this->getAxisStatusCmd(axis));
+  const std::string &statusString = sPtr->readValue(this->getAxisStatusHandle(axis, sPtr));
 
   // Response parsed for PowerPMAC
   debug(DEBUG_VARIABLE, functionName, "Status string", statusString);
@@ -205,8 +214,7 @@ pmacHardwarePower::parseAxisStatus(int axis, pmacCommandStore *sPtr, axisStatus
   }
 
   // Now read the coordinate system number for this axis
-  sprintf(var, AXIS_CS_NUMBER.c_str(), axis);
-  csString = sPtr->readValue(var);
+  const std::string &csString = sPtr->readValue(axisCSNumberHandle(axis));
   nvals = sscanf(csString.c_str(), "%d", &axStatus.currentCS_);
   if (nvals != 1) {
     debug(DEBUG_ERROR, functionName, "Failed to parse CS number", csString);
@@ -217,6 +225,12 @@ pmacHardwarePower::parseAxisStatus(int axis, pmacCommandStore *sPtr, axisStatus
   return status;
 }
 
+bool pmacHardwarePower::axisStatusChanged(int axis, pmacCommandStore *sPtr) {
+  // The coordinate system number is read separately from the status bits
+  return pmacHardwareInterface::axisStatusChanged(axis, sPtr) ||
+         sPtr->isDirty(axisCSNumberHandle(axis));
+}
+
 asynStatus pmacHardwarePower::setupCSStatus(int csNo) {
   asynStatus status = asynSuccess;
   char var[30];
@@ -340,61 +354,73 @@ std::string pmacHardwarePower::parseCSMappingResult(const std::string mappingRes
   return result;
 }
 
-void pmacHardwarePower::startTrajectoryTimePointsCmd(char *userCmd, char *timeCmd,
+void pmacHardwarePower::startTrajectoryTimePointsCmd(pmacCommandBuilder *userCmd,
+                                                     pmacCommandBuilder *timeCmd,
                                                      int addr) {
   static const char *functionName = "startTrajectoryTimePointsCmd";
 
   debug(DEBUG_FLOW, functionName, "addr %d", addr);
 
-  sprintf(userCmd, "Next_User(%d)=", addr);
-  sprintf(timeCmd, "Next_Time(%d)=", addr);
+  userCmd->clear();
+  userCmd->append("Next_User(%d)=", addr);
+  timeCmd->clear();
+  timeCmd->append("Next_Time(%d)=", addr);
 
 }
 
-void pmacHardwarePower::addTrajectoryTimePointCmd(char *userCmd, char *timeCmd,
+void pmacHardwarePower::addTrajectoryTimePointCmd(pmacCommandBuilder *userCmd,
+                                                  pmacCommandBuilder *timeCmd,
                                                   int userFunc, int time,
                                                   bool firstVal) {
   static const char *functionName = "addTrajectoryTimePointCmd";
 
-  debugf(DEBUG_FLOW, functionName, "userCmd %s\ntimeCmd %s\nvel %d, user %d, time %d",
-         userCmd, timeCmd, userFunc, time);
+  debugf(DEBUG_FLOW, functionName, "userCmd %s\ntimeCmd %s\nuser %d, time %d",
+         userCmd->getCommand(), timeCmd->getCommand(), userFunc, time);
 
   if(firstVal) {
-    sprintf(userCmd, "%s%d", userCmd, userFunc);
-    sprintf(timeCmd, "%s%d", timeCmd, time);
+    userCmd->append("%d", userFunc);
+    timeCmd->append("%d", time);
   }
   else {
-    sprintf(userCmd, "%s,%d", userCmd, userFunc);
-    sprintf(timeCmd, "%s,%d", timeCmd, time);
+    userCmd->append(",%d", userFunc);
+    timeCmd->append(",%d", time);
   }
 }
 
-void pmacHardwarePower::startAxisPointsCmd(char *axisCmd, int axis, int addr, int , bool posCmd ) {
+void pmacHardwarePower::startAxisPointsCmd(pmacCommandBuilder *axisCmd, int axis, int addr, int ,
+                                           bool posCmd ) {
   const char axes[] = "ABCUVWXYZ";
   static const char *functionName = "startAxisPointsCmd";
 
-  debugf(DEBUG_FLOW, functionName, "cmd %s, axis %d, addr %d", axisCmd, axis, addr);
+  debugf(DEBUG_FLOW, functionName, "cmd %s, axis %d, addr %d", axisCmd->getCommand(), axis, addr);
 
+  axisCmd->clear();
   if(posCmd) {
-    sprintf(axisCmd, "Next_%c(%d)=", axes[axis], addr);
+    axisCmd->append("Next_%c(%d)=", axes[axis], addr);
   } else {
-    sprintf(axisCmd, "Next_%c_Vel(%d)=", axes[axis], addr);
+    axisCmd->append("Next_%c_Vel(%d)=", axes[axis], addr);
   }
 }
 
-void pmacHardwarePower::addAxisPointCmd(char *axisCmd, int , double pos, int ,
-                                        bool firstVal) {
+asynStatus pmacHardwarePower::addAxisPointCmd(pmacCommandBuilder *axisCmd, int , double pos,
+                                              int , bool firstVal) {
   static const char *functionName = "addAxisPointCmd";
 
-  debugf(DEBUG_FLOW, functionName, "cmd %s, pos %f, firstval %d", axisCmd,
+  debugf(DEBUG_FLOW, functionName, "cmd %s, pos %f, firstval %d", axisCmd->getCommand(),
           pos, firstVal);
 
+  // Infinity and NaN would be written as text the PMAC cannot parse
+  if (!(fabs(pos) <= DBL_MAX)) {
+    debugf(DEBUG_ERROR, functionName, "Cannot write demand %f", pos);
+    return asynError;
+  }
   if(firstVal) {
-    sprintf(axisCmd, "%s%g", axisCmd, pos);
+    axisCmd->append("%g", pos);
   }
   else {
-    sprintf(axisCmd, "%s,%g", axisCmd, pos);
+    axisCmd->append(",%g", pos);
   }
+  return asynSuccess;
 }
 
 std::string pmacHardwarePower::getCSEnableCommand(int csNo) {
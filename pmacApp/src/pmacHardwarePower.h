@@ -29,6 +29,8 @@ public:
 
     asynStatus parseAxisStatus(int axis, pmacCommandStore *sPtr, axisStatus &axStatus);
 
+    bool axisStatusChanged(int axis, pmacCommandStore *sPtr);
+
     asynStatus setupCSStatus(int csNo);
 
     asynStatus parseCSStatus(int csNo, pmacCommandStore *sPtr, csStatus &coordStatus);
@@ -43,22 +45,30 @@ public:
 
     std::string parseCSMappingResult(const std::string mappingResult);
 
-    void startTrajectoryTimePointsCmd(char *user_cmd, char *time_cmd,
+    void startTrajectoryTimePointsCmd(pmacCommandBuilder *user_cmd,
+                                      pmacCommandBuilder *time_cmd,
                                       int addr);
 
-    void addTrajectoryTimePointCmd(char *userCmd, char *timeCmd,
+    void addTrajectoryTimePointCmd(pmacCommandBuilder *userCmd,
+                                   pmacCommandBuilder *timeCmd,
                                    int userFunc, int time,
                                    bool firstVal);
 
-    void startAxisPointsCmd(char *axis_cmd, int axis, int addr, int buffSize, bool posCmd);
+    void startAxisPointsCmd(pmacCommandBuilder *axis_cmd, int axis, int addr, int buffSize,
+                            bool posCmd);
 
-    void addAxisPointCmd(char *axis_cmd, int axis, double pos, int buffSize,
-                                 bool firstVal);
+    asynStatus addAxisPointCmd(pmacCommandBuilder *axis_cmd, int axis, double pos, int buffSize,
+                               bool firstVal);
 
     std::string getCSEnableCommand(int csNo);
 
 
 private:
+    int axisCSNumberHandle(int axis);
+
+    // Fast store handles of the axis coordinate system numbers, indexed by axis
+    std::vector<int> axisCSNumberHandles_;
+
     static const std::string GLOBAL_STATUS;
     static const std::string AXIS_STATUS;
     static const std::string AXIS_CS_NUMBER;
@@ -5,6 +5,8 @@
  *      Author: gnx91527
  */
 
+#include <math.h>
+#include <float.h>
 #include "pmacHardwareTurbo.h"
 #include "pmacController.h"
 
@@ -207,10 +209,9 @@ asynStatus
 pmacHardwareTurbo::parseAxisStatus(int axis, pmacCommandStore *sPtr, axisStatus &axStatus) {
   asynStatus status = asynSuccess;
   int nvals = 0;
-  std::string statusString = "";
   static const char *functionName = "parseAxisStatus";
 
-  statusString = sPtr->readValue(this->getAxisStatusCmd(axis));
+  const std::string &statusString = sPtr->readValue(this->getAxisStatusHandle(axis, sPtr));
 
   nvals = sscanf(statusString.c_str(), "%6x%6x", &axStatus.status24Bit1_, &axStatus.status24Bit2_);
   if (nvals != 2) {
@@ -363,43 +364,82 @@ std::string pmacHardwareTurbo::parseCSMappingResult(const std::string mappingRes
   return mappingResult;
 }
 
-void pmacHardwareTurbo::startTrajectoryTimePointsCmd(char *user_cmd, char *time_cmd,
+/**
+ * @return The longest command line the Turbo PMAC accepts.
+ */
+int pmacHardwareTurbo::getMaxCommandLength() {
+  return PMAC_TURBO_MAX_LINE_LENGTH;
+}
+
+void pmacHardwareTurbo::startTrajectoryTimePointsCmd(pmacCommandBuilder *user_cmd,
+                                                     pmacCommandBuilder *time_cmd,
                                                      int addr) {
   static const char *functionName = "startTrajectoryTimePointsCmd";
 
   debug(DEBUG_FLOW, functionName, "addr %d", addr);
 
-  sprintf(user_cmd, "WL:$%X", addr);
-  time_cmd[0] = 0;
+  user_cmd->clear();
+  user_cmd->append("WL:$%X", addr);
+  time_cmd->clear();
 }
 
-void pmacHardwareTurbo::addTrajectoryTimePointCmd(char *userCmd, char *timeCmd,
+void pmacHardwareTurbo::addTrajectoryTimePointCmd(pmacCommandBuilder *userCmd,
+                                                  pmacCommandBuilder *timeCmd,
                                                   int userFunc, int time,
                                                   bool ) {
   static const char *functionName = "addTrajectoryTimePointCmd";
 
   debugf(DEBUG_FLOW, functionName, "userCmd %s\ntimeCmd %s\nuser %d, time %d",
-         userCmd, timeCmd, userFunc, time);
+         userCmd->getCommand(), timeCmd->getCommand(), userFunc, time);
 
-  sprintf(userCmd, "%s,$%01X%06X", userCmd, userFunc, time);
-  timeCmd[0] = 0;
+  userCmd->append(",$%01X%06X", userFunc, time);
 }
 
-void pmacHardwareTurbo::startAxisPointsCmd(char *axisCmd, int axis, int addr, int buffSize, bool) {
+void pmacHardwareTurbo::startAxisPointsCmd(pmacCommandBuilder *axisCmd, int axis, int addr,
+                                           int buffSize, bool) {
   static const char *functionName = "startAxisPointsCmd";
 
-  debugf(DEBUG_FLOW, functionName, "cmd %s, axis %d, addr %d", axisCmd, axis, addr);
-  sprintf(axisCmd, "WL:$%X", addr + ((axis + 1) * buffSize));
+  debugf(DEBUG_FLOW, functionName, "cmd %s, axis %d, addr %d", axisCmd->getCommand(), axis, addr);
+  axisCmd->clear();
+  axisCmd->append("WL:$%X", addr + ((axis + 1) * buffSize));
 }
 
-void pmacHardwareTurbo::addAxisPointCmd(char *axisCmd, int , double pos, int ,
-        bool ) {
+asynStatus pmacHardwareTurbo::addAxisPointCmd(pmacCommandBuilder *axisCmd, int , double pos,
+                                              int , bool ) {
   int64_t ival = 0;
   static const char *functionName = "addAxisPointCmd";
 
-  debugf(DEBUG_FLOW, functionName, "cmd %s, pos %f", axisCmd, pos);
-  doubleToPMACFloat(pos, &ival);
-  sprintf(axisCmd, "%s,$%lX", axisCmd, (long) ival);
+  debugf(DEBUG_FLOW, functionName, "cmd %s, pos %f", axisCmd->getCommand(), pos);
+  if (doubleToPMACFloat(pos, &ival) != asynSuccess) {
+    debugf(DEBUG_ERROR, functionName, "Cannot encode demand %f", pos);
+    return asynError;
+  }
+  axisCmd->append(",$%llX", (long long) ival);
+  return asynSuccess;
+}
+
+asynStatus pmacHardwareTurbo::addAxisPointsCmd(pmacCommandBuilder *axisCmd, int ,
+                                               const double *pos, int noOfPoints, int , bool ) {
+  int64_t ival[PMAC_TURBO_ENCODE_BLOCK];
+  static const char *functionName = "addAxisPointsCmd";
+
+  debugf(DEBUG_FLOW, functionName, "cmd %s, points %d", axisCmd->getCommand(), noOfPoints);
+  for (int first = 0; first < noOfPoints; first += PMAC_TURBO_ENCODE_BLOCK) {
+    int count = noOfPoints - first;
+    if (count > PMAC_TURBO_ENCODE_BLOCK) {
+      count = PMAC_TURBO_ENCODE_BLOCK;
+    }
+    // A demand that cannot be encoded fails the command rather than being sent as zero
+    if (doublesToPMACFloats(&pos[first], count, ival) != asynSuccess) {
+      debugf(DEBUG_ERROR, functionName, "Cannot encode a demand between points %d and %d",
+             first, first + count - 1);
+      return asynError;
+    }
+    for (int index = 0; index < count; index++) {
+      axisCmd->append(",$%llX", (long long) ival[index]);
+    }
+  }
+  return asynSuccess;
 }
 
 std::string pmacHardwareTurbo::getCSEnableCommand(int csNo) {
@@ -412,70 +452,97 @@ std::string pmacHardwareTurbo::getCSEnableCommand(int csNo) {
 }
 
 
+/**
+ * Encode a value as a 48 bit PMAC floating point word.
+ *
+ * The top 36 bits hold the mantissa, normalised to [2^34, 2^35) and
+ * truncated, with negative values stored as its ones complement.  The bottom
+ * 12 bits hold the base 2 exponent offset by 0x800.
+ *
+ * @param value The value to encode, which must be finite.
+ * @param representation The encoded word.
+ * @return asynStatus
+ */
 asynStatus pmacHardwareTurbo::doubleToPMACFloat(double value, int64_t *representation) {
   asynStatus status = asynSuccess;
-  double absVal = value;
-  int negative = 0;
-  int exponent = 0;
-  double expVal = 0.0;
-  int64_t intVal = 0;
-  int64_t tVal = 0;
-  double mantissaVal = 0.0;
-  double maxMantissa = 34359738368.0;  // 0x800000000
   const char *functionName = "doubleToPMACFloat";
 
   debug(DEBUG_FLOW, functionName);
   debugf(DEBUG_VARIABLE, functionName, "Value : %20.10lf\n", value);
 
-  // Check for special case 0.0
-  if (absVal == 0.0) {
-    // Set value accordingly
-    tVal = 0x0;
-  } else {
-    // Check for a negative number, and get the absolute
-    if (absVal < 0.0) {
-      absVal = absVal * -1.0;
-      negative = 1;
-    }
-    expVal = absVal;
-    mantissaVal = absVal;
-
-    // Work out the exponent required to normalise
-    // Normalised should be between 1 and 2
-    while (expVal >= 2.0) {
-      expVal = expVal / 2.0;
-      exponent++;
-    }
-    while (expVal < 1.0) {
-      expVal = expVal * 2.0;
-      exponent--;
-    }
-    // Offset exponent to provide +-2048 range
-    exponent += 0x800;
+  status = encodePMACFloat(value, representation);
+  if (status != asynSuccess) {
+    debugf(DEBUG_ERROR, functionName, "Cannot encode %f as a PMAC float", value);
+  }
 
-    // Get the mantissa into correct format, this might not be
-    // the most efficient way to do this
-    while (mantissaVal < maxMantissa) {
-      mantissaVal *= 2.0;
-    }
-    mantissaVal = mantissaVal / 2.0;
-    // Get the integer representation for the altered mantissa
-    intVal = (int64_t) mantissaVal;
+  debugf(DEBUG_VARIABLE, functionName, "Prepared value: %12lX\n", (long) *representation);
+
+  return status;
+}
+
+/**
+ * Encode a run of values as 48 bit PMAC floating point words, in the same way
+ * as doubleToPMACFloat.
+ *
+ * @param values The values to encode, which must be finite.
+ * @param noOfValues Number of values.
+ * @param representations The encoded words.
+ * @return asynStatus
+ */
+asynStatus pmacHardwareTurbo::doublesToPMACFloats(const double *values, int noOfValues,
+                                                  int64_t *representations) {
+  asynStatus status = asynSuccess;
+  const char *functionName = "doublesToPMACFloats";
 
-    // If negative value then subtract altered mantissa from max
-    if (negative == 1) {
-      intVal = 0xFFFFFFFFFLL - intVal;
+  for (int index = 0; index < noOfValues; index++) {
+    if (encodePMACFloat(values[index], &representations[index]) != asynSuccess) {
+      debugf(DEBUG_ERROR, functionName, "Cannot encode %f as a PMAC float at %d",
+             values[index], index);
+      status = asynError;
     }
+  }
+
+  return status;
+}
+
+/**
+ * Encode one value without any logging, for doubleToPMACFloat and
+ * doublesToPMACFloats.  frexp gives the mantissa in [0.5, 1) and the exponent
+ * directly, so the cost does not depend on the magnitude of the value.
+ * Non-finite values are encoded as zero.
+ */
+asynStatus pmacHardwareTurbo::encodePMACFloat(double value, int64_t *representation) {
+  int exponent = 0;
+  int64_t intVal = 0;
+  double mantissaVal = 0.0;
 
-    // Shift the altered mantissa by 12 bits and then set those
-    // 12 bits to the offset exponent
-    tVal = intVal << 12;
-    tVal += exponent;
+  // Check for special case 0.0
+  if (value == 0.0) {
+    *representation = 0x0;
+    return asynSuccess;
+  }
+  // Not true of infinity or NaN
+  if (!(fabs(value) <= DBL_MAX)) {
+    *representation = 0x0;
+    return asynError;
+  }
+
+  // Scale the mantissa from [0.5, 1) to [2^34, 2^35), which is exact, and get
+  // the integer representation for it
+  mantissaVal = frexp(fabs(value), &exponent);
+  intVal = (int64_t) (mantissaVal * 34359738368.0);  // 0x800000000
+
+  // If negative value then subtract altered mantissa from max
+  if (value < 0.0) {
+    intVal = 0xFFFFFFFFFLL - intVal;
   }
 
-  *representation = tVal;
+  // The exponent normalises to [1, 2), offset to provide +-2048 range
+  exponent = exponent - 1 + 0x800;
 
-  debugf(DEBUG_VARIABLE, functionName, "Prepared value: %12lX\n", tVal);
+  // Shift the altered mantissa by 12 bits and then set those
+  // 12 bits to the offset exponent
+  *representation = (intVal << 12) + exponent;
 
-  return status;
+  return asynSuccess;
 }
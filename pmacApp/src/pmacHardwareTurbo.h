@@ -11,6 +11,11 @@
 #include "pmacHardwareInterface.h"
 #include "pmacDebugger.h"
 
+// Number of positions encoded at a time by addAxisPointsCmd
+#define PMAC_TURBO_ENCODE_BLOCK 32
+// Longest command line, set by the command buffer of the Turbo PMAC
+#define PMAC_TURBO_MAX_LINE_LENGTH 255
+
 class pmacHardwareTurbo : public pmacHardwareInterface, pmacDebugger {
 public:
     pmacHardwareTurbo();
@@ -43,23 +48,35 @@ public:
 
     std::string parseCSMappingResult(const std::string mappingResult);
 
-    void startTrajectoryTimePointsCmd(char *user_cmd, char *time_cmd,
+    int getMaxCommandLength();
+
+    void startTrajectoryTimePointsCmd(pmacCommandBuilder *user_cmd,
+                                      pmacCommandBuilder *time_cmd,
                                       int addr);
 
-    void addTrajectoryTimePointCmd(char *userCmd, char *timeCmd,
+    void addTrajectoryTimePointCmd(pmacCommandBuilder *userCmd,
+                                   pmacCommandBuilder *timeCmd,
                                    int userFunc, int time,
                                    bool firstVal);
 
-    void startAxisPointsCmd(char *axis_cmd, int axis, int addr, int buffSize, bool posCmd);
+    void startAxisPointsCmd(pmacCommandBuilder *axis_cmd, int axis, int addr, int buffSize,
+                            bool posCmd);
 
-    void addAxisPointCmd(char *axis_cmd, int axis, double pos, int buffSize,
-                                 bool firstVal);
+    asynStatus addAxisPointCmd(pmacCommandBuilder *axis_cmd, int axis, double pos, int buffSize,
+                               bool firstVal);
+
+    asynStatus addAxisPointsCmd(pmacCommandBuilder *axis_cmd, int axis, const double *pos,
+                                int noOfPoints, int buffSize, bool firstVal);
 
     std::string getCSEnableCommand(int csNo);
 
-private:
     asynStatus doubleToPMACFloat(double value, int64_t *representation);
 
+    asynStatus doublesToPMACFloats(const double *values, int noOfValues, int64_t *representations);
+
+private:
+    static asynStatus encodePMACFloat(double value, int64_t *representation);
+
     static const std::string GLOBAL_STATUS;
     static const std::string AXIS_STATUS;
     static const std::string CS_STATUS;
@@ -0,0 +1,125 @@
+/*
+ * pmacHistogram.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *
+ * Fixed size log-linear histogram used to record the distribution of PMAC
+ * message round trip times and sizes.
+ */
+
+#include "pmacHistogram.h"
+#include <string.h>
+
+pmacHistogram::pmacHistogram() {
+  this->reset();
+}
+
+pmacHistogram::~pmacHistogram() {
+}
+
+/**
+ * Add a value to the histogram.  Only one thread may record into a histogram.
+ *
+ * @param value The value to record.
+ */
+void pmacHistogram::record(epicsUInt32 value) {
+  buckets_[bucketIndex(value)]++;
+  count_++;
+  if (value > max_) {
+    max_ = value;
+  }
+}
+
+/**
+ * Clear all recorded values.  A value recorded at the same moment may be lost.
+ */
+void pmacHistogram::reset() {
+  memset(buckets_, 0, sizeof(buckets_));
+  count_ = 0;
+  max_ = 0;
+}
+
+epicsUInt32 pmacHistogram::readCount() {
+  return count_;
+}
+
+epicsUInt32 pmacHistogram::readMax() {
+  return max_;
+}
+
+/**
+ * Estimate a quantile of the recorded values.  The upper bound of the bucket
+ * holding the quantile is returned (limited to the maximum recorded), so the
+ * estimate never understates the value.
+ *
+ * @param quantile The quantile to estimate, between 0.0 and 1.0.
+ * @return The estimated value, or 0 if nothing has been recorded.
+ */
+epicsUInt32 pmacHistogram::readQuantile(double quantile) {
+  epicsUInt32 count = count_;
+  epicsUInt32 max = max_;
+  epicsUInt32 total = 0;
+  epicsUInt32 target = 0;
+
+  if (count == 0) {
+    return 0;
+  }
+  if (quantile <= 0.0) {
+    target = 1;
+  } else if (quantile >= 1.0) {
+    target = count;
+  } else {
+    // Rank of the quantile, rounded up
+    target = (epicsUInt32) (quantile * count);
+    if ((double) target < quantile * count) {
+      target++;
+    }
+  }
+  for (int index = 0; index < PMAC_HISTOGRAM_BUCKETS; index++) {
+    total += buckets_[index];
+    if (total >= target) {
+      epicsUInt32 bound = bucketUpperBound(index);
+      return bound < max ? bound : max;
+    }
+  }
+  return max;
+}
+
+/**
+ * Map a value onto its bucket.
+ *
+ * @param value The value.
+ * @return The index of the bucket holding the value.
+ */
+int pmacHistogram::bucketIndex(epicsUInt32 value) {
+  int exponent = 0;
+  if (value < PMAC_HISTOGRAM_LINEAR) {
+    return (int) value;
+  }
+  // Position of the most significant bit (at least 4 here)
+  for (epicsUInt32 shifted = value; shifted > 1; shifted >>= 1) {
+    exponent++;
+  }
+  int subBucket = (int) ((value >> (exponent - 3)) & (PMAC_HISTOGRAM_SUB_BUCKETS - 1));
+  return PMAC_HISTOGRAM_LINEAR + (exponent - 4) * PMAC_HISTOGRAM_SUB_BUCKETS + subBucket;
+}
+
+/**
+ * The largest value that maps onto a bucket.
+ *
+ * @param index The index of the bucket.
+ * @return The largest value held by the bucket.
+ */
+epicsUInt32 pmacHistogram::bucketUpperBound(int index) {
+  if (index < PMAC_HISTOGRAM_LINEAR) {
+    return (epicsUInt32) index;
+  }
+  int exponent = 4 + (index - PMAC_HISTOGRAM_LINEAR) / PMAC_HISTOGRAM_SUB_BUCKETS;
+  int subBucket = (index - PMAC_HISTOGRAM_LINEAR) % PMAC_HISTOGRAM_SUB_BUCKETS;
+  epicsUInt64 lower = ((epicsUInt64) (PMAC_HISTOGRAM_SUB_BUCKETS + subBucket)) << (exponent - 3);
+  epicsUInt64 upper = lower + (((epicsUInt64) 1) << (exponent - 3)) - 1;
+  if (upper > 0xFFFFFFFFu) {
+    upper = 0xFFFFFFFFu;
+  }
+  return (epicsUInt32) upper;
+}
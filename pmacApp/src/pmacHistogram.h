@@ -0,0 +1,50 @@
+/*
+ * pmacHistogram.h
+ *
+ *  Created on: 17 Oct 2026
+ *
+ * Fixed size log-linear histogram used to record the distribution of PMAC
+ * message round trip times and sizes.
+ */
+
+#ifndef PMACAPP_SRC_PMACHISTOGRAM_H_
+#define PMACAPP_SRC_PMACHISTOGRAM_H_
+
+#include "epicsTypes.h"
+
+// Values below PMAC_HISTOGRAM_LINEAR have a bucket each, above that every
+// power of two is split into PMAC_HISTOGRAM_SUB_BUCKETS buckets, so a
+// reported quantile is within 12.5% of the true value
+#define PMAC_HISTOGRAM_LINEAR 16
+#define PMAC_HISTOGRAM_SUB_BUCKETS 8
+#define PMAC_HISTOGRAM_BUCKETS 240
+
+class pmacHistogram {
+public:
+    pmacHistogram();
+
+    virtual ~pmacHistogram();
+
+    void record(epicsUInt32 value);
+
+    void reset();
+
+    epicsUInt32 readCount();
+
+    epicsUInt32 readMax();
+
+    epicsUInt32 readQuantile(double quantile);
+
+    static int bucketIndex(epicsUInt32 value);
+
+    static epicsUInt32 bucketUpperBound(int index);
+
+private:
+    // Updated only by the thread recording values, readers take no lock and
+    // may see a record part way through which only affects that one sample
+    epicsUInt32 buckets_[PMAC_HISTOGRAM_BUCKETS];
+    epicsUInt32 count_;
+    epicsUInt32 max_;
+};
+
+#endif /* PMACAPP_SRC_PMACHISTOGRAM_H_ */
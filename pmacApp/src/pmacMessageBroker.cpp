@@ -6,18 +6,71 @@
  */
 
 #include "pmacMessageBroker.h"
+#include <math.h>
+#include <ctype.h>
 
 const epicsUInt32  pmacMessageBroker::PMAC_MAXBUF_ = 1024;
 const epicsFloat64 pmacMessageBroker::PMAC_TIMEOUT_ = 2.0;
+const epicsFloat64 pmacMessageBroker::PMAC_MIN_TIMEOUT_ = 0.25;
+const epicsFloat64 pmacMessageBroker::PMAC_SLOW_TIMEOUT_ = 10.0;
+const int pmacMessageBroker::PMAC_POWER_REQUEST_BUDGET_ = 500;
+const int pmacMessageBroker::PMAC_POWER_REPLY_BUDGET_ = 1000;
+const int pmacMessageBroker::PMAC_MAX_SUBMITTED_ = 256;
+const double pmacMessageBroker::PMAC_RECONNECT_MIN_DELAY_ = 0.5;
+const double pmacMessageBroker::PMAC_RECONNECT_MAX_DELAY_ = 16.0;
+
+static void submitTaskC(void *drvPvt) {
+  pmacMessageBroker *pPvt = (pmacMessageBroker *) drvPvt;
+  pPvt->submitTask();
+}
+
+static void reconnectTaskC(void *drvPvt) {
+  pmacMessageBroker *pPvt = (pmacMessageBroker *) drvPvt;
+  pPvt->reconnectTask();
+}
+
+/**
+ * Commands that list or save the controller contents can take far longer
+ * than the round trip time measured for ordinary traffic.
+ * @param command The command to check.
+ * @return true if any word of the command is list or save.
+ */
+static bool isSlowCommand(const char *command) {
+  static const char *slowWords[] = {"list", "save"};
+  char word[8];
+  int length = 0;
+
+  for (const char *ptr = command;; ptr++) {
+    if (isalpha((unsigned char) *ptr)) {
+      if (length < (int) sizeof(word) - 1) {
+        word[length] = (char) tolower((unsigned char) *ptr);
+      }
+      length++;
+    } else {
+      if (length > 0 && length < (int) sizeof(word)) {
+        word[length] = '\0';
+        for (size_t index = 0; index < sizeof(slowWords) / sizeof(slowWords[0]); index++) {
+          if (strcmp(word, slowWords[index]) == 0) {
+            return true;
+          }
+        }
+      }
+      length = 0;
+      if (*ptr == '\0') {
+        break;
+      }
+    }
+  }
+  return false;
+}
 
 pmacMessageBroker::pmacMessageBroker(asynUser *pasynUser) :
         pmacDebugger("pmacMessageBroker"),
         disable_poll(false),
-        suppressStatus_(false),
-        suppressCounter_(0),
+        fastReadTime_(0.0),
         powerPMAC_(false),
         ownerAsynUser_(pasynUser),
-        lowLevelPortUser_(0),
+        priorityUser_(0),
         noOfMessages_(0),
         totalBytesWritten_(0),
         totalBytesRead_(0),
@@ -28,9 +81,14 @@ pmacMessageBroker::pmacMessageBroker(asynUser *pasynUser) :
         updateTime_(0.0),
         lock_count(0),
         connected_(false),
-        newConnection_(true)
+        newConnection_(true),
+        exiting_(false),
+        reconnectStarted_(false),
+        pipelineDepth_(1),
+        submitCount_(0),
+        sentCount_(0),
+        submitFailures_(0)
 {
-  epicsTimeGetCurrent(&this->writeTime_);
   epicsTimeGetCurrent(&this->startTime_);
   epicsTimeGetCurrent(&this->currentTime_);
   slowCallbacks_ = new pmacCallbackStore(pmacMessageBroker::PMAC_SLOW_READ);
@@ -38,11 +96,66 @@ pmacMessageBroker::pmacMessageBroker(asynUser *pasynUser) :
   fastCallbacks_ = new pmacCallbackStore(pmacMessageBroker::PMAC_FAST_READ);
   prefastCallbacks_ = new pmacCallbackStore(pmacMessageBroker::PMAC_PRE_FAST_READ);
 
+  // Request runs of consecutive variables using the Turbo PMAC range syntax,
+  // markAsPowerPMAC turns this off again
+  slowStore_.setRangeQueries(true);
+  mediumStore_.setRangeQueries(true);
+  fastStore_.setRangeQueries(true);
+  prefastStore_.setRangeQueries(true);
+
+  for (int type = 0; type < PMAC_STORE_TYPES; type++) {
+    sliceNext_[type] = 0;
+    sliceCount_[type] = 0;
+  }
+  for (int lane = 0; lane < PMAC_CONNECTION_LANES; lane++) {
+    laneUsers_[lane] = NULL;
+    laneOwnPort_[lane] = false;
+    estimators_[lane].setLimits(PMAC_MIN_TIMEOUT_, PMAC_TIMEOUT_);
+  }
+
   locks = (asynPortDriver **) malloc(
           MAX_REGISTERED_LOCKS * sizeof(asynPortDriver *));
+
+  // Create the thread that sends commands queued by submitWriteRead
+  submitEventId_ = epicsEventMustCreate(epicsEventEmpty);
+  reconnectEventId_ = epicsEventMustCreate(epicsEventEmpty);
+  submitDoneEventId_ = epicsEventMustCreate(epicsEventEmpty);
+  reconnectDoneEventId_ = epicsEventMustCreate(epicsEventEmpty);
+  epicsThreadCreate("PMACSubmit",
+                    epicsThreadPriorityMedium,
+                    epicsThreadGetStackSize(epicsThreadStackMedium),
+                    (EPICSTHREADFUNC) submitTaskC,
+                    this);
 }
 
 pmacMessageBroker::~pmacMessageBroker() {
+  bool reconnectStarted = false;
+
+  // Ask the submit and reconnect threads to exit, and wait for them to do so
+  connectionMutex_.lock();
+  exiting_ = true;
+  reconnectStarted = reconnectStarted_;
+  connectionMutex_.unlock();
+  epicsEventSignal(submitEventId_);
+  epicsEventMustWait(submitDoneEventId_);
+  if (reconnectStarted) {
+    epicsEventSignal(reconnectEventId_);
+    epicsEventMustWait(reconnectDoneEventId_);
+  }
+
+  this->disconnect();
+  for (size_t index = 0; index < flushEvents_.size(); index++) {
+    epicsEventDestroy(flushEvents_[index]);
+  }
+  epicsEventDestroy(submitEventId_);
+  epicsEventDestroy(reconnectEventId_);
+  epicsEventDestroy(submitDoneEventId_);
+  epicsEventDestroy(reconnectDoneEventId_);
+  delete slowCallbacks_;
+  delete mediumCallbacks_;
+  delete fastCallbacks_;
+  delete prefastCallbacks_;
+  free(locks);
 }
 
 asynStatus pmacMessageBroker::connect(const char *port, int addr) {
@@ -50,10 +163,105 @@ asynStatus pmacMessageBroker::connect(const char *port, int addr) {
   asynStatus status = asynSuccess;
   debug(DEBUG_FLOW, functionName, "Connecting to low level asynOctetSyncIO port", port);
 
-  //Connect our Asyn user to the low level port that is a parameter to this constructor
-  status = lowLevelPortConnect(port, addr, &lowLevelPortUser_, (char *) "\006", (char *) "\n");
+  // Each lane and the priority path has its own asyn user on the low level
+  // port, so that threads on different lanes never share one
+  for (int lane = 0; lane < PMAC_CONNECTION_LANES && status == asynSuccess; lane++) {
+    if (laneUsers_[lane] == NULL) {
+      status = lowLevelPortConnect(port, addr, &laneUsers_[lane], (char *) "\006", (char *) "\n");
+    }
+  }
+  if (status == asynSuccess && priorityUser_ == NULL) {
+    status = lowLevelPortConnect(port, addr, &priorityUser_, (char *) "\006", (char *) "\n");
+  }
+  if (status != asynSuccess) {
+    debug(DEBUG_ERROR, functionName, "Failed to connect to low level asynOctetSyncIO port", port);
+    this->disconnect();
+  } else {
+    // The first check is made here so that the controller can be set up
+    // during IOC startup, later ones by the reconnect thread
+    this->probeConnection();
+  }
+
+  // Create the thread that restores the connection whenever it is lost, once
+  // only however many times connect is called
+  connectionMutex_.lock();
+  bool startReconnect = !reconnectStarted_;
+  reconnectStarted_ = true;
+  connectionMutex_.unlock();
+  if (startReconnect) {
+    epicsThreadCreate("PMACReconnect",
+                      epicsThreadPriorityLow,
+                      epicsThreadGetStackSize(epicsThreadStackSmall),
+                      (EPICSTHREADFUNC) reconnectTaskC,
+                      this);
+  }
+  return status;
+}
+
+/**
+ * Give one of the connection lanes its own low level port, so that its
+ * traffic no longer waits behind the other lanes.  Only useful with a
+ * controller that accepts concurrent sessions (Power PMAC).  Priority
+ * commands follow the command lane to its port.
+ *
+ * @param lane PMAC_POLL_LANE, PMAC_COMMAND_LANE or PMAC_TRAJECTORY_LANE.
+ * @param port Name of the low level asyn port for the lane.
+ * @param addr Address on the low level port.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::connectLane(int lane, const char *port, int addr) {
+  static const char *functionName = "connectLane";
+  asynStatus status = asynSuccess;
+  asynUser *pasynUser = NULL;
+  asynUser *pPriorityUser = NULL;
+  asynUser *pOldUser = NULL;
+  asynUser *pOldPriorityUser = NULL;
+  char response[PMAC_MAXBUF_];
+  debug(DEBUG_FLOW, functionName, "Connecting lane to low level asynOctetSyncIO port", port);
+
+  if (lane < 0 || lane >= PMAC_CONNECTION_LANES) {
+    debug(DEBUG_ERROR, functionName, "Invalid connection lane", lane);
+    return asynError;
+  }
+  if (laneOwnPort_[lane]) {
+    debug(DEBUG_ERROR, functionName, "Connection lane already has a port", lane);
+    return asynError;
+  }
+
+  status = lowLevelPortConnect(port, addr, &pasynUser, (char *) "\006", (char *) "\n");
+  if (status == asynSuccess && lane == PMAC_COMMAND_LANE) {
+    status = lowLevelPortConnect(port, addr, &pPriorityUser, (char *) "\006", (char *) "\n");
+    if (status != asynSuccess) {
+      lowLevelPortDisconnect(pasynUser);
+    }
+  }
   if (status != asynSuccess) {
     debug(DEBUG_ERROR, functionName, "Failed to connect to low level asynOctetSyncIO port", port);
+    return status;
+  }
+
+  // Swap the users over between exchanges, then release the shared ones
+  laneMutex_[lane].lock();
+  pOldUser = laneUsers_[lane];
+  laneUsers_[lane] = pasynUser;
+  laneOwnPort_[lane] = true;
+  laneMutex_[lane].unlock();
+  if (pPriorityUser != NULL) {
+    priorityMutex_.lock();
+    pOldPriorityUser = priorityUser_;
+    priorityUser_ = pPriorityUser;
+    priorityMutex_.unlock();
+  }
+  if (pOldUser != NULL) {
+    lowLevelPortDisconnect(pOldUser);
+  }
+  if (pOldPriorityUser != NULL) {
+    lowLevelPortDisconnect(pOldPriorityUser);
+  }
+
+  if (powerPMAC_) {
+    // Each Power PMAC session keeps its own echo mode
+    this->lowLevelWriteRead("echo 7", response, PMAC_IMMEDIATE_STATS, lane);
   }
   return status;
 }
@@ -63,41 +271,176 @@ asynStatus pmacMessageBroker::disconnect() {
   asynStatus status = asynSuccess;
   debug(DEBUG_FLOW, functionName, "Disconnecting from low level asynOctetSyncIO port");
 
-  //Connect our Asyn user to the low level port that is a parameter to this constructor
-  status = lowLevelPortDisconnect(lowLevelPortUser_);
-  if (status != asynSuccess) {
-    debug(DEBUG_ERROR, functionName, "Failed to disconnect from low level asynOctetSyncIO port");
+  for (int lane = 0; lane < PMAC_CONNECTION_LANES; lane++) {
+    laneMutex_[lane].lock();
+    if (laneUsers_[lane] != NULL) {
+      if (lowLevelPortDisconnect(laneUsers_[lane]) != asynSuccess) {
+        debug(DEBUG_ERROR, functionName, "Failed to disconnect connection lane", lane);
+        status = asynError;
+      }
+      laneUsers_[lane] = NULL;
+    }
+    laneOwnPort_[lane] = false;
+    laneMutex_[lane].unlock();
+  }
+  priorityMutex_.lock();
+  if (priorityUser_ != NULL) {
+    if (lowLevelPortDisconnect(priorityUser_) != asynSuccess) {
+      debug(DEBUG_ERROR, functionName, "Failed to disconnect from low level asynOctetSyncIO port");
+      status = asynError;
+    }
+    priorityUser_ = NULL;
   }
+  priorityMutex_.unlock();
   return status;
 }
 
 /**
  * Utilty function to return the connected status of the low level asyn port.
- * @return asynStatus
+ * This never talks to the PMAC, the connection is restored in the background
+ * by the reconnect thread.
+ * @return asynStatus asynDisconnected while there is no connection.
  */
 asynStatus pmacMessageBroker::getConnectedStatus(int *connected, int *newConnection) {
   static const char *functionName = "getConnectedStatus";
+  debug(DEBUG_FLOW, functionName);
+  connectionMutex_.lock();
+  *connected = connected_;
+  *newConnection = newConnection_;
+  connectionMutex_.unlock();
+  return *connected ? asynSuccess : asynDisconnected;
+}
+
+/**
+ * Acknowledge a new connection once the controller has set it up.
+ */
+void pmacMessageBroker::clearNewConnection() {
+  connectionMutex_.lock();
+  newConnection_ = false;
+  connectionMutex_.unlock();
+}
+
+/**
+ * @return true while the link to the PMAC is up.
+ */
+bool pmacMessageBroker::isConnected() {
+  bool connected = false;
+  connectionMutex_.lock();
+  connected = connected_;
+  connectionMutex_.unlock();
+  return connected;
+}
+
+/**
+ * @return true once the destructor has asked the broker threads to exit.
+ */
+bool pmacMessageBroker::isExiting() {
+  bool exiting = false;
+  connectionMutex_.lock();
+  exiting = exiting_;
+  connectionMutex_.unlock();
+  return exiting;
+}
+
+/**
+ * Check for a connection to the PMAC by sending an empty command, since
+ * pasynManager->isConnected always reports True (is this because of the
+ * interpose layer?).  A restored connection is flagged as new so that the
+ * controller sets it up again.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::probeConnection() {
   asynStatus status = asynSuccess;
-  *connected = *newConnection = 0;
   char response[PMAC_MAXBUF_];
+  static const char *functionName = "probeConnection";
   debug(DEBUG_FLOW, functionName);
-  // pasynManager->isConnected always reports True (is this because of the
-  // interpose layer?) so send and receive a dummy message to check connection
-  if (!connected_)
-  {
-    newConnection_ = true;
-    status = this->lowLevelWriteRead("", response);
-    connected_ = status ==asynSuccess;
-    if (connected_){
-      debug(DEBUG_ERROR, "getConnectedStatus", "Connection to hardware restored");
+
+  connectionMutex_.lock();
+  newConnection_ = true;
+  connectionMutex_.unlock();
+  status = this->lowLevelWriteRead("", response);
+  if (status == asynSuccess && powerPMAC_) {
+    // Sessions on the other lanes have been restarted too
+    for (int lane = 0; lane < PMAC_CONNECTION_LANES && status == asynSuccess; lane++) {
+      if (laneOwnPort_[lane]) {
+        status = this->lowLevelWriteRead("echo 7", response, PMAC_IMMEDIATE_STATS, lane);
+      }
     }
   }
-  *connected = connected_;
-  *newConnection = newConnection_;
+  connectionMutex_.lock();
+  connected_ = status == asynSuccess;
+  connectionMutex_.unlock();
+  if (status == asynSuccess){
+    debug(DEBUG_ERROR, functionName, "Connection to hardware restored");
+  }
   return status;
 }
 
-asynStatus pmacMessageBroker::immediateWriteRead(const char *command, char *response, bool trace) {
+/**
+ * Body of the reconnect thread.  Sleeps until the connection is lost, then
+ * probes for it with an exponentially increasing delay between attempts so
+ * that a powered down controller costs little.  Exits when the destructor
+ * signals reconnectEventId_.
+ */
+void pmacMessageBroker::reconnectTask() {
+  double delay = PMAC_RECONNECT_MIN_DELAY_;
+
+  while (!this->isExiting()) {
+    if (this->isConnected()) {
+      delay = PMAC_RECONNECT_MIN_DELAY_;
+      epicsEventWaitWithTimeout(reconnectEventId_, PMAC_RECONNECT_MAX_DELAY_);
+    } else if (this->probeConnection() != asynSuccess) {
+      // Waiting on the event rather than sleeping lets the destructor wake us
+      epicsEventWaitWithTimeout(reconnectEventId_, delay);
+      delay *= 2.0;
+      if (delay > PMAC_RECONNECT_MAX_DELAY_) {
+        delay = PMAC_RECONNECT_MAX_DELAY_;
+      }
+    }
+  }
+  epicsEventSignal(reconnectDoneEventId_);
+}
+
+/**
+ * Mark the connection as lost following a failed exchange, and wake the
+ * reconnect thread.
+ * @param functionName Name of the function that failed, for the log.
+ */
+void pmacMessageBroker::connectionLost(const char *functionName) {
+  // the reconnect thread will restore the connected_ state
+  connectionMutex_.lock();
+  bool wasConnected = connected_;
+  connected_ = false;  newConnection_ = true;
+  connectionMutex_.unlock();
+  if (wasConnected){
+    debug(DEBUG_ERROR, functionName, "Connection to hardware lost");
+  }
+  epicsEventSignal(reconnectEventId_);
+}
+
+asynStatus pmacMessageBroker::immediateWriteRead(const char *command, char *response, bool trace,
+                                                 int lane) {
+  // Keep immediate commands in order with any submitted before them, which
+  // are only ever sent on the command lane
+  if (lane == PMAC_COMMAND_LANE) {
+    this->flushSubmitted();
+  }
+  return this->timedWriteRead(command, response, trace, PMAC_IMMEDIATE_STATS, lane);
+}
+
+/**
+ * Write a single command and read back the response, recording the exchange
+ * against one of the statistics categories.
+ *
+ * @param command The command to send.
+ * @param response Buffer for the response.
+ * @param trace If false only trace the command when DEBUG_PMAC_POLL is set.
+ * @param category The histogram category (store type or PMAC_IMMEDIATE_STATS).
+ * @param lane The connection lane to send the command on.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::timedWriteRead(const char *command, char *response, bool trace,
+                                             int category, int lane) {
   asynStatus status = asynDisconnected;
   static const char *functionName = "immediateWriteRead";
   // don't trace broker polling unless DEBUG_PMAC_POLL set, to avoid too much noise
@@ -108,32 +451,309 @@ asynStatus pmacMessageBroker::immediateWriteRead(const char *command, char *resp
   {
     debug(DEBUG_PMAC_POLL, "PMAC_POLL", "command", command);
   }
-  if (connected_) {
+  if (this->isConnected()) {
+    epicsTimeStamp start, end;
+    epicsTimeGetCurrent(&start);
     this->startTimer(DEBUG_TIMING, functionName);
-    status = this->lowLevelWriteRead(command, response);
+    status = this->lowLevelWriteRead(command, response, category, lane);
     this->stopTimer(DEBUG_TIMING, functionName, "PMAC write/read time");
+    if (lane == PMAC_TRAJECTORY_LANE && status == asynSuccess) {
+      // Measure the bandwidth available to trajectory fills
+      epicsTimeGetCurrent(&end);
+      scheduleMutex_.lock();
+      scheduler_.recordTransfer((int) (strlen(command) + strlen(response)),
+                                epicsTimeDiffInSeconds(&end, &start));
+      scheduleMutex_.unlock();
+    }
   }
   debug(DEBUG_PMAC_POLL, "PMAC_POLL", "response", response);
   return status;
 }
 
-asynStatus pmacMessageBroker::addReadVariable(int type, const char *variable) {
+/**
+ * Write a single stop, kill or abort command ahead of any queued traffic.
+ * The broker mutex is not taken, so the command never waits for a poll cycle
+ * to finish building or publishing; it waits only for whichever request or
+ * pipelined batch currently holds the low level port.  Commands still queued
+ * by submitWriteRead are discarded and counted as failed first, and any batch
+ * already being sent is waited for, so that none of them can follow the
+ * priority command to the PMAC.  Must not be called from a completion.
+ *
+ * @param command The command to send.
+ * @param response Buffer for the response.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::priorityWriteRead(const char *command, char *response) {
+  asynStatus status = asynDisconnected;
+  epicsTimeStamp requestTime;
+  static const char *functionName = "priorityWriteRead";
+
+  epicsTimeGetCurrent(&requestTime);
+  debug(DEBUG_PMAC | DEBUG_PMAC_POLL, "PMAC", "priority command", command);
+  response[0] = '\0';
+  // Queued writes must not reach the PMAC after a stop, kill or abort.  A
+  // batch the submit thread has already taken may not hold the port yet, so
+  // wait for it to be sent rather than overtake it
+  this->discardSubmitted();
+  this->flushSubmitted();
+  if (this->isConnected()) {
+    this->startTimer(DEBUG_TIMING, functionName);
+    status = this->lowLevelPriorityWriteRead(command, response, &requestTime);
+    this->stopTimer(DEBUG_TIMING, functionName, "PMAC priority write/read time");
+  }
+  debug(DEBUG_PMAC_POLL, "PMAC_POLL", "response", response);
+  return status;
+}
+
+/**
+ * Queue a command to be sent by the submit thread and return without waiting
+ * for the reply.  Queued commands are sent in order, pipelined up to the
+ * configured pipeline depth, so writes from many clients share the low level
+ * port rather than each waiting a full round trip for it.
+ *
+ * @param command The command to send.
+ * @param completion Notified with the reply once the command has been sent,
+ *                   may be NULL if the reply is not needed.
+ * @return asynStatus asynError if the queue is full.
+ */
+asynStatus pmacMessageBroker::submitWriteRead(const char *command,
+                                              pmacCompletionInterface *completion) {
+  asynStatus status = asynSuccess;
+  static const char *functionName = "submitWriteRead";
+
+  debug(DEBUG_PMAC, "PMAC", "submitted command", command);
+  if (!this->isConnected()) {
+    return asynDisconnected;
+  }
+
+  submitMutex_.lock();
+  if ((int) submitted_.size() >= PMAC_MAX_SUBMITTED_) {
+    status = asynError;
+  } else {
+    pmacSubmittedCommand submission;
+    submission.command = command;
+    submission.completion = completion;
+    submitted_.push_back(submission);
+    submitCount_++;
+  }
+  submitMutex_.unlock();
+
+  if (status == asynSuccess) {
+    epicsEventSignal(submitEventId_);
+  } else {
+    debug(DEBUG_ERROR, functionName, "Submit queue full, command not sent", command);
+  }
+  return status;
+}
+
+/**
+ * Wait until every command queued by submitWriteRead before this call has
+ * been sent and its reply read.  Commands queued later are not waited for.
+ * Must not be called from a completion.
+ */
+void pmacMessageBroker::flushSubmitted() {
+  pmacFlushWaiter waiter;
+
+  submitMutex_.lock();
+  if (sentCount_ == submitCount_) {
+    submitMutex_.unlock();
+    return;
+  }
+  // Each waiter has its own event, reused from earlier flushes
+  if (flushEvents_.empty()) {
+    waiter.event = epicsEventMustCreate(epicsEventEmpty);
+  } else {
+    waiter.event = flushEvents_.back();
+    flushEvents_.pop_back();
+  }
+  waiter.count = submitCount_;
+  flushWaiters_.push_back(waiter);
+  submitMutex_.unlock();
+
+  epicsEventMustWait(waiter.event);
+
+  submitMutex_.lock();
+  flushEvents_.push_back(waiter.event);
+  submitMutex_.unlock();
+}
+
+/**
+ * Read the number of commands queued by submitWriteRead that could not be
+ * sent or whose reply could not be read.
+ *
+ * @return The number of failed commands.
+ */
+int pmacMessageBroker::readSubmitFailures() {
+  int failures = 0;
+  submitMutex_.lock();
+  failures = submitFailures_;
+  submitMutex_.unlock();
+  return failures;
+}
+
+/**
+ * Remove every command still waiting in the submit queue, count them as
+ * failed and notify their completions with asynError.  A batch already taken
+ * by the submit thread is not affected.
+ */
+void pmacMessageBroker::discardSubmitted() {
+  static const char *functionName = "discardSubmitted";
+  std::deque<pmacSubmittedCommand> discarded;
+  char response[1] = "";
+
+  submitMutex_.lock();
+  discarded.swap(submitted_);
+  if (!discarded.empty()) {
+    // The discarded commands will never be sent, release any flush waiting on them
+    sentCount_ += (epicsUInt32) discarded.size();
+    submitFailures_ += (int) discarded.size();
+    this->wakeFlushWaiters();
+  }
+  submitMutex_.unlock();
+
+  for (size_t index = 0; index < discarded.size(); index++) {
+    debug(DEBUG_ERROR, functionName, "Submitted command discarded",
+          discarded[index].command.c_str());
+    if (discarded[index].completion != NULL) {
+      discarded[index].completion->completed(discarded[index].command.c_str(), response,
+                                             asynError);
+    }
+  }
+}
+
+/**
+ * Signal the flushes waiting for no more than the commands sent so far.
+ * Must be called with submitMutex_ held.
+ */
+void pmacMessageBroker::wakeFlushWaiters() {
+  for (size_t index = 0; index < flushWaiters_.size();) {
+    if ((epicsInt32) (sentCount_ - flushWaiters_[index].count) >= 0) {
+      epicsEventSignal(flushWaiters_[index].event);
+      flushWaiters_.erase(flushWaiters_.begin() + index);
+    } else {
+      index++;
+    }
+  }
+}
+
+/**
+ * Body of the submit thread.  Sends the queued commands in batches of up to
+ * the pipeline depth, then notifies each command's completion.  Exits when
+ * the destructor signals submitEventId_.
+ */
+void pmacMessageBroker::submitTask() {
+  pmacCompletionInterface *completions[PMAC_MAX_PIPELINE_DEPTH];
+  asynStatus status = asynSuccess;
+  int count = 0;
+
+  while (true) {
+    epicsEventMustWait(submitEventId_);
+    if (this->isExiting()) {
+      break;
+    }
+    do {
+      submitMutex_.lock();
+      count = 0;
+      while (count < pipelineDepth_ && !submitted_.empty()) {
+        submitCommands_[count] = submitted_.front().command;
+        completions[count] = submitted_.front().completion;
+        submitted_.pop_front();
+        count++;
+      }
+      submitMutex_.unlock();
+
+      if (count > 0) {
+        status = asynDisconnected;
+        for (int index = 0; index < count; index++) {
+          submitResponses_[index][0] = '\0';
+        }
+        if (this->isConnected()) {
+          status = this->lowLevelPipelinedWriteRead(submitCommands_, count, PMAC_IMMEDIATE_STATS,
+                                                    submitResponses_, PMAC_COMMAND_LANE);
+        }
+        for (int index = 0; index < count; index++) {
+          debug(DEBUG_PMAC_POLL, "PMAC_POLL", "response", submitResponses_[index]);
+          if (completions[index] != NULL) {
+            completions[index]->completed(submitCommands_[index].c_str(), submitResponses_[index],
+                                          status);
+          }
+        }
+        submitMutex_.lock();
+        sentCount_ += count;
+        if (status != asynSuccess) {
+          submitFailures_ += count;
+        }
+        this->wakeFlushWaiters();
+        submitMutex_.unlock();
+      }
+    } while (count > 0);
+  }
+  // Fail whatever is still queued so that no flush is left waiting
+  this->discardSubmitted();
+  epicsEventSignal(submitDoneEventId_);
+}
+
+/**
+ * Write a batch of commands before reading back any of the responses.  The
+ * responses are placed into pipelineResponses_ in the same order as the
+ * commands.  Must be called with the mutex held.
+ *
+ * @param commands Array of commands to send.
+ * @param count Number of commands (at most PMAC_MAX_PIPELINE_DEPTH).
+ * @param category The histogram category the exchanges are recorded against.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::pipelinedWriteRead(const std::string *commands, int count,
+                                                 int category) {
+  asynStatus status = asynDisconnected;
+  static const char *functionName = "pipelinedWriteRead";
+
+  for (int index = 0; index < count; index++) {
+    debug(DEBUG_PMAC_POLL, "PMAC_POLL", "command", commands[index].c_str());
+    pipelineResponses_[index][0] = '\0';
+  }
+  if (this->isConnected()) {
+    this->startTimer(DEBUG_TIMING, functionName);
+    status = this->lowLevelPipelinedWriteRead(commands, count, category, pipelineResponses_,
+                                              PMAC_POLL_LANE);
+    this->stopTimer(DEBUG_TIMING, functionName, "PMAC pipelined write/read time");
+  }
+  for (int index = 0; index < count; index++) {
+    debug(DEBUG_PMAC_POLL, "PMAC_POLL", "response", pipelineResponses_[index]);
+  }
+  return status;
+}
+
+/**
+ * Add a variable to one of the polled stores.
+ *
+ * @param type The store to add the variable to (PMAC_SLOW_READ etc).
+ * @param variable The PMAC variable to read.
+ * @param handle If not NULL, set to the handle of the variable within the
+ * store, which may be passed to pmacCommandStore::readValue in the callback.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::addReadVariable(int type, const char *variable, int *handle) {
   asynStatus status = asynSuccess;
+  int slot = -1;
 
   // Lock the mutex
   mutex_.lock();
 
   if (type == PMAC_SLOW_READ) {
-    slowStore_.addItem(variable);
+    slot = slowStore_.addItem(variable);
   } else if (type == PMAC_MEDIUM_READ) {
-    mediumStore_.addItem(variable);
+    slot = mediumStore_.addItem(variable);
   } else if (type == PMAC_FAST_READ) {
-    fastStore_.addItem(variable);
+    slot = fastStore_.addItem(variable);
   } else if (type == PMAC_PRE_FAST_READ) {
-    prefastStore_.addItem(variable);
+    slot = prefastStore_.addItem(variable);
   } else {
     status = asynError;
   }
+  if (handle != NULL) {
+    *handle = slot;
+  }
 
   // Unlock the mutex
   mutex_.unlock();
@@ -143,129 +763,581 @@ asynStatus pmacMessageBroker::addReadVariable(int type, const char *variable) {
 
 asynStatus pmacMessageBroker::updateVariables(int type) {
   static const char *functionName = "updateVariables";
-  char response[1024];
-  std::string cmd;
-  int noOfCmds = 0;
   epicsTimeStamp ts1, ts2;
+  pmacCommandStore *stores[2];
+  pmacCallbackStore *callbacks[2];
+  int storeCount = 0;
 
   // Keep a record of start time for the update
   epicsTimeGetCurrent(&ts1);
   // Lock the mutex
   mutex_.lock();
-  // Lock the registered locks for the Asyn Parameter Libraries
-  for(int i=0; i<lock_count; i++) {
+
+  startTimer(DEBUG_TIMING, functionName);
+
+  // Exchange with the PMAC holding only the mutex, the stores act as the
+  // staging area for the replies until the callbacks are made
+  if (!disable_poll) {
+    if (type == PMAC_FAST_READ) {
+      if (fastReadDue()) {
+        epicsTimeStamp readStart, readEnd;
+        epicsTimeGetCurrent(&readStart);
+        updateStore(&prefastStore_, PMAC_PRE_FAST_READ, "Prefast");
+        stores[storeCount] = &prefastStore_;
+        callbacks[storeCount++] = prefastCallbacks_;
+        updateStore(&fastStore_, PMAC_FAST_READ, "Fast");
+        stores[storeCount] = &fastStore_;
+        callbacks[storeCount++] = fastCallbacks_;
+        epicsTimeGetCurrent(&readEnd);
+        scheduleMutex_.lock();
+        fastReadTime_ = epicsTimeDiffInSeconds(&readEnd, &readStart);
+        scheduleMutex_.unlock();
+      }
+    } else if (type == PMAC_MEDIUM_READ && backgroundReadAllowed()) {
+      // A full update replaces any sliced update in progress
+      sliceCount_[PMAC_MEDIUM_READ] = 0;
+      updateStore(&mediumStore_, PMAC_MEDIUM_READ, "Medium");
+      stores[storeCount] = &mediumStore_;
+      callbacks[storeCount++] = mediumCallbacks_;
+    } else if (type == PMAC_SLOW_READ && backgroundReadAllowed()) {
+      sliceCount_[PMAC_SLOW_READ] = 0;
+      updateStore(&slowStore_, PMAC_SLOW_READ, "Slow");
+      stores[storeCount] = &slowStore_;
+      callbacks[storeCount++] = slowCallbacks_;
+    }
+  }
+
+  // Unlock the mutex
+  mutex_.unlock();
+
+  makeCallbacks(stores, callbacks, storeCount);
+  stopTimer(DEBUG_TIMING, functionName, "Time taken for updates");
+
+  // Record the end time for the update
+  epicsTimeGetCurrent(&ts2);
+  // Calculate the time taken to perform the update (and convert to ms)
+  updateTime_ = 1000.0 * epicsTimeDiffInSeconds(&ts2, &ts1);
+
+  return asynSuccess;
+}
+
+/**
+ * Read every store in one sweep, for example to bring all of the cached
+ * values up to date at once when a connection is restored.  The callbacks for
+ * all of the stores are made together once every store has been read.
+ *
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::updateAllVariables() {
+  static const char *functionName = "updateAllVariables";
+  pmacCommandStore *stores[PMAC_STORE_TYPES];
+  pmacCallbackStore *callbacks[PMAC_STORE_TYPES];
+  int storeCount = 0;
+
+  mutex_.lock();
+  startTimer(DEBUG_TIMING, functionName);
+  if (!disable_poll) {
+    // Any sliced updates in progress are replaced by the full ones
+    sliceCount_[PMAC_MEDIUM_READ] = 0;
+    sliceCount_[PMAC_SLOW_READ] = 0;
+    updateStore(&prefastStore_, PMAC_PRE_FAST_READ, "Prefast");
+    updateStore(&fastStore_, PMAC_FAST_READ, "Fast");
+    updateStore(&mediumStore_, PMAC_MEDIUM_READ, "Medium");
+    updateStore(&slowStore_, PMAC_SLOW_READ, "Slow");
+    stores[storeCount] = &prefastStore_;
+    callbacks[storeCount++] = prefastCallbacks_;
+    stores[storeCount] = &fastStore_;
+    callbacks[storeCount++] = fastCallbacks_;
+    stores[storeCount] = &mediumStore_;
+    callbacks[storeCount++] = mediumCallbacks_;
+    stores[storeCount] = &slowStore_;
+    callbacks[storeCount++] = slowCallbacks_;
+  }
+  mutex_.unlock();
+
+  makeCallbacks(stores, callbacks, storeCount);
+  stopTimer(DEBUG_TIMING, functionName, "Time taken for the full update");
+  return asynSuccess;
+}
+
+/**
+ * Read part of the medium or slow store, so that the cost of reading the
+ * whole store is spread over several fast polls rather than falling on one.
+ * Each pass reads every command string of the store once, and the callbacks
+ * are made when the pass is complete.
+ *
+ * @param type The store (PMAC_MEDIUM_READ or PMAC_SLOW_READ).
+ * @param progress The fraction of the pass (0.0 to 1.0) that should have
+ * been read by the end of this call.
+ * @param newPass True to start a new pass, any unfinished pass is completed first.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::updateVariablesSlice(int type, double progress, bool newPass) {
+  static const char *functionName = "updateVariablesSlice";
+  pmacCommandStore *store = findStore(type);
+  pmacCallbackStore *callbacks = findCallbacks(type);
+  const char *storeName = type == PMAC_MEDIUM_READ ? "Medium" : "Slow";
+  int storeCount = 0;
+  int target = 0;
+
+  if (type != PMAC_MEDIUM_READ && type != PMAC_SLOW_READ) {
+    debug(DEBUG_ERROR, functionName, "Only the medium and slow stores can be sliced", type);
+    return asynError;
+  }
+
+  mutex_.lock();
+  if (disable_poll || !backgroundReadAllowed()) {
+    sliceCount_[type] = 0;
+    mutex_.unlock();
+    return asynSuccess;
+  }
+  if (newPass) {
+    if (sliceCount_[type] > 0) {
+      // The previous pass has overrun its period, finish it before starting again
+      readCommandStrings(store, type, storeName, sliceNext_[type], sliceCount_[type]);
+      storeCount = 1;
+    }
+    // Repack only between passes, the command strings must not change part way
+    store->updateCommandStrings();
+    sliceNext_[type] = 0;
+    sliceCount_[type] = store->size() > 0 ? store->countPolledCommandStrings() : 0;
+  }
+  if (sliceCount_[type] > 0) {
+    target = (int) ceil(progress * sliceCount_[type]);
+    if (target > sliceCount_[type]) {
+      target = sliceCount_[type];
+    }
+    if (target > sliceNext_[type]) {
+      debugf(DEBUG_VARIABLE, functionName, "%s store slice %d to %d of %d", storeName,
+             sliceNext_[type], target, sliceCount_[type]);
+      readCommandStrings(store, type, storeName, sliceNext_[type], target);
+      sliceNext_[type] = target;
+    }
+    if (sliceNext_[type] >= sliceCount_[type]) {
+      sliceCount_[type] = 0;
+      storeCount = 1;
+    }
+  }
+  mutex_.unlock();
+
+  makeCallbacks(&store, &callbacks, storeCount);
+
+  return asynSuccess;
+}
+
+/**
+ * Make the callbacks for a set of updated stores.  Each callback can ask the
+ * store which values have changed since the previous callbacks (see
+ * pmacCommandStore::isDirty), the dirty sets are cleared afterwards.  Must be
+ * called without the mutex held.
+ *
+ * @param stores The updated stores.
+ * @param callbacks The callbacks registered for each store.
+ * @param count The number of stores.
+ */
+void pmacMessageBroker::makeCallbacks(pmacCommandStore **stores, pmacCallbackStore **callbacks,
+                                      int count) {
+  if (count == 0) {
+    return;
+  }
+  // Lock the registered locks for the Asyn Parameter Libraries only for the
+  // callbacks.  They are taken before the mutex, the same order as a driver
+  // thread writing to the PMAC while holding its own lock
+  for (int i = 0; i < lock_count; i++) {
     locks[i]->lock();
   }
+  mutex_.lock();
+  for (int i = 0; i < count; i++) {
+    // Empty stores are not polled so have nothing to report
+    if (stores[i]->size() > 0) {
+      callbacks[i]->callCallbacks(stores[i]);
+    }
+    // Every consumer has now seen the changes of this update
+    stores[i]->clearDirty();
+  }
+  mutex_.unlock();
+  // Unlock the registered locks for the Asyn Parameter Libraries
+  for (int i = 0; i < lock_count; i++) {
+    locks[i]->unlock();
+  }
+}
+
+/**
+ * Mark a polled variable as low priority.  Low priority variables are read
+ * less often when the store is decimated, see setDecimation.
+ *
+ * @param type The store holding the variable (PMAC_SLOW_READ etc).
+ * @param handle The handle returned by addReadVariable.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::setLowPriority(int type, int handle) {
+  asynStatus status = asynError;
+  pmacCommandStore *store = findStore(type);
+  if (store != NULL) {
+    mutex_.lock();
+    if (store->setLowPriority(handle, true) == 0) {
+      status = asynSuccess;
+    }
+    mutex_.unlock();
+  }
+  return status;
+}
+
+/**
+ * Read the low priority variables of a store only once every factor updates,
+ * the remaining variables are still read on every update.
+ *
+ * @param type The store (PMAC_SLOW_READ etc).
+ * @param factor The decimation factor, 1 to read every variable on every update.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::setDecimation(int type, int factor) {
+  pmacCommandStore *store = findStore(type);
+  if (store == NULL) {
+    return asynError;
+  }
+  mutex_.lock();
+  store->setDecimation(factor);
+  mutex_.unlock();
+  return asynSuccess;
+}
+
+int pmacMessageBroker::readDecimation(int type) {
+  int decimation = 1;
+  pmacCommandStore *store = findStore(type);
+  if (store != NULL) {
+    mutex_.lock();
+    decimation = store->readDecimation();
+    mutex_.unlock();
+  }
+  return decimation;
+}
+
+/**
+ * @param type The store (PMAC_SLOW_READ etc).
+ * @return true if the last update of the store read all of its variables,
+ * including any low priority variables.
+ */
+bool pmacMessageBroker::readUpdateComplete(int type) {
+  bool complete = true;
+  pmacCommandStore *store = findStore(type);
+  if (store != NULL) {
+    mutex_.lock();
+    complete = store->readUpdateComplete();
+    mutex_.unlock();
+  }
+  return complete;
+}
+
+/**
+ * Mark a set of polled variables as idle or busy.  Idle variables are only
+ * read every idle decimation updates, see setIdleDecimation.  Variables
+ * marked busy are read again from the next update.
+ *
+ * @param type The store holding the variables (PMAC_SLOW_READ etc).
+ * @param handles The handles returned by addReadVariable.
+ * @param count The number of handles.
+ * @param idle True to mark the variables as idle.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::setIdle(int type, const int *handles, int count, bool idle) {
+  asynStatus status = asynSuccess;
+  pmacCommandStore *store = findStore(type);
+  if (store == NULL) {
+    return asynError;
+  }
+  mutex_.lock();
+  for (int index = 0; index < count; index++) {
+    if (store->setIdle(handles[index], idle) != 0) {
+      status = asynError;
+    }
+  }
+  mutex_.unlock();
+  return status;
+}
+
+/**
+ * Read the idle variables of a store only once every factor updates.
+ *
+ * @param type The store (PMAC_SLOW_READ etc).
+ * @param factor The idle decimation factor, 1 to read idle variables on every update.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::setIdleDecimation(int type, int factor) {
+  pmacCommandStore *store = findStore(type);
+  if (store == NULL) {
+    return asynError;
+  }
+  mutex_.lock();
+  store->setIdleDecimation(factor);
+  mutex_.unlock();
+  return asynSuccess;
+}
+
+int pmacMessageBroker::readIdleCount(int type) {
+  int count = 0;
+  pmacCommandStore *store = findStore(type);
+  if (store != NULL) {
+    mutex_.lock();
+    count = store->countIdle();
+    mutex_.unlock();
+  }
+  return count;
+}
+
+std::string pmacMessageBroker::readLowPriorityList(int type) {
+  std::string list;
+  pmacCommandStore *store = findStore(type);
+  if (store != NULL) {
+    mutex_.lock();
+    list = store->getLowPriorityList();
+    mutex_.unlock();
+  }
+  return list;
+}
+
+pmacCallbackStore *pmacMessageBroker::findCallbacks(int type) {
+  if (type == PMAC_SLOW_READ) {
+    return slowCallbacks_;
+  } else if (type == PMAC_MEDIUM_READ) {
+    return mediumCallbacks_;
+  } else if (type == PMAC_FAST_READ) {
+    return fastCallbacks_;
+  } else if (type == PMAC_PRE_FAST_READ) {
+    return prefastCallbacks_;
+  }
+  return NULL;
+}
+
+pmacCommandStore *pmacMessageBroker::findStore(int type) {
+  if (type == PMAC_SLOW_READ) {
+    return &slowStore_;
+  } else if (type == PMAC_MEDIUM_READ) {
+    return &mediumStore_;
+  } else if (type == PMAC_FAST_READ) {
+    return &fastStore_;
+  } else if (type == PMAC_PRE_FAST_READ) {
+    return &prefastStore_;
+  }
+  return NULL;
+}
+
+/**
+ * Read every command string of a store from the PMAC and update the store with
+ * the replies.  The registered callbacks are made later by updateVariables.
+ * Must be called with the mutex held.
+ *
+ * @param store The command store to update.
+ * @param type The store type, used to record the message statistics.
+ * @param storeName Name of the store used for debugging.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::updateStore(pmacCommandStore *store, int type,
+                                          const char *storeName) {
+  if (store->size() == 0) {
+    return asynSuccess;
+  }
 
-  startTimer(DEBUG_TIMING, functionName);
+  // Repack using the reply sizes learned from previous updates
+  store->updateCommandStrings();
 
-  if (!disable_poll) {
-    if (type == PMAC_FAST_READ) {
-      if (suppressStatus_) {
-        suppressCounter_++;
-      }
-      if (!suppressStatus_ || suppressCounter_ % 4 == 0) {
-        if (prefastStore_.size() > 0) {
-          // Send the command string and read the response
-          noOfCmds = prefastStore_.countCommandStrings();
-          debug(DEBUG_VARIABLE, functionName, "Prefast Store command string count", noOfCmds);
-          for (int index = 0; index < noOfCmds; index++) {
-            cmd = prefastStore_.readCommandString(index);
-            if (cmd.length() > 0) {
-              this->immediateWriteRead(cmd.c_str(), response, false);
-              debug(DEBUG_VARIABLE, functionName, "PMAC reply string length", (int) strlen(response));
-              // Update the store with the response
-              prefastStore_.updateReply(cmd, response);
-            }
-          }
-          // Perform the necessary callbacks
-          prefastCallbacks_->callCallbacks(&prefastStore_);
-        }
-        if (fastStore_.size() > 0) {
-          // Send the command string and read the response
-          noOfCmds = fastStore_.countCommandStrings();
-          debug(DEBUG_VARIABLE, functionName, "Fast Store command string count", noOfCmds);
-          for (int index = 0; index < noOfCmds; index++) {
-            cmd = fastStore_.readCommandString(index);
-            if (cmd.length() > 0) {
-              this->immediateWriteRead(cmd.c_str(), response, false);
-              debug(DEBUG_VARIABLE, functionName, "PMAC reply string length", (int) strlen(response));
-              // Update the store with the response
-              fastStore_.updateReply(cmd, response);
-            }
-          }
-          // Perform the necessary callbacks
-          fastCallbacks_->callCallbacks(&fastStore_);
-        }
+  // Leave out the low priority (and idle) command strings on updates where
+  // the store is decimated
+  return readCommandStrings(store, type, storeName, 0, store->countPolledCommandStrings());
+}
+
+/**
+ * Read a range of the command strings of a store from the PMAC and update the
+ * store with the replies.
+ *
+ * Up to pipelineDepth_ command strings are written before the first reply is
+ * read, so a store spanning several command strings costs roughly one round
+ * trip rather than one round trip per command string.  Must be called with
+ * the mutex held.
+ *
+ * @param store The command store to update.
+ * @param type The store type, used to record the message statistics.
+ * @param storeName Name of the store used for debugging.
+ * @param first The index of the first command string to read.
+ * @param last One past the index of the last command string to read.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::readCommandStrings(pmacCommandStore *store, int type,
+                                                 const char *storeName, int first, int last) {
+  static const char *functionName = "readCommandStrings";
+  asynStatus status = asynSuccess;
+  char response[1024];
+  int cmdIndex[PMAC_MAX_PIPELINE_DEPTH];
+  int index = first;
+  int depth = 0;
+  int count = 0;
+
+  // The Power PMAC ssh port flushes the channel and consumes the command echo on
+  // every write so it can only ever have a single request outstanding
+  depth = powerPMAC_ ? 1 : pipelineDepth_;
+
+  // Variables added part way through a sliced update can repack the store
+  if (last > store->countCommandStrings()) {
+    last = store->countCommandStrings();
+  }
+
+  // Send the command strings and read the responses
+  debugf(DEBUG_VARIABLE, functionName, "%s Store command strings %d to %d", storeName, first,
+         last);
+  while (index < last) {
+    // Collect the next batch of non-empty command strings
+    count = 0;
+    while (count < depth && index < last) {
+      // Idle command strings are left out of most updates
+      if (!store->isCommandStringPolled(index)) {
+        index++;
+        continue;
       }
-    } else if (type == PMAC_MEDIUM_READ && !suppressStatus_) {
-      if (mediumStore_.size() > 0) {
-        // Send the command string and read the response
-        noOfCmds = mediumStore_.countCommandStrings();
-        for (int index = 0; index < noOfCmds; index++) {
-          cmd = mediumStore_.readCommandString(index);
-          if (cmd.length() > 0) {
-            this->immediateWriteRead(cmd.c_str(), response, false);
-            // Update the store with the response
-            mediumStore_.updateReply(cmd, response);
-          }
-        }
-        // Perform the necessary callbacks
-        mediumCallbacks_->callCallbacks(&mediumStore_);
+      pipelineCommands_[count] = store->readCommandString(index);
+      if (pipelineCommands_[count].length() > 0) {
+        cmdIndex[count] = index;
+        count++;
       }
-    } else if (type == PMAC_SLOW_READ && !suppressStatus_) {
-      if (slowStore_.size() > 0) {
-        // Send the command string and read the response
-        noOfCmds = slowStore_.countCommandStrings();
-        for (int index = 0; index < noOfCmds; index++) {
-          cmd = slowStore_.readCommandString(index);
-          if (cmd.length() > 0) {
-            this->immediateWriteRead(cmd.c_str(), response, false);
-            // Update the store with the response
-            slowStore_.updateReply(cmd, response);
-          }
-        }
-        // Perform the necessary callbacks
-        slowCallbacks_->callCallbacks(&slowStore_);
+      index++;
+    }
+    if (count == 1) {
+      response[0] = '\0';
+      status = this->timedWriteRead(pipelineCommands_[0].c_str(), response, false, type,
+                                    PMAC_POLL_LANE);
+      debug(DEBUG_VARIABLE, functionName, "PMAC reply string length", (int) strlen(response));
+      // Update the store with the response
+      store->updateReply(cmdIndex[0], response);
+    } else if (count > 1) {
+      status = this->pipelinedWriteRead(pipelineCommands_, count, type);
+      for (int cmd = 0; cmd < count; cmd++) {
+        debug(DEBUG_VARIABLE, functionName, "PMAC reply string length",
+              (int) strlen(pipelineResponses_[cmd]));
+        // Update the store with the response
+        store->updateReply(cmdIndex[cmd], pipelineResponses_[cmd]);
       }
     }
   }
-  stopTimer(DEBUG_TIMING, functionName, "Time taken for updates");
+  return status;
+}
 
-  // Unlock the mutex
-  mutex_.unlock();
-  // Unlock the registered locks for the Asyn Parameter Libraries
-  for(int i=0; i<lock_count; i++) {
-    locks[i]->unlock();
+/**
+ * Set the number of command strings that are sent to the PMAC before waiting
+ * for the first reply when updating a store.  A depth of 1 gives a strict
+ * write/read per command string.
+ *
+ * @param depth Number of command strings in flight (1 to PMAC_MAX_PIPELINE_DEPTH).
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::setPipelineDepth(int depth) {
+  static const char *functionName = "setPipelineDepth";
+
+  if (depth < 1 || depth > PMAC_MAX_PIPELINE_DEPTH) {
+    debug(DEBUG_ERROR, functionName, "Invalid pipeline depth", depth);
+    return asynError;
+  }
+  if (powerPMAC_ && depth > 1) {
+    debug(DEBUG_ERROR, functionName, "Pipelining is not supported by the Power PMAC ssh port");
   }
 
-  // Record the end time for the update
-  epicsTimeGetCurrent(&ts2);
-  // Calculate the time taken to perform the update (and convert to ms)
-  updateTime_ = 1000.0 * epicsTimeDiffInSeconds(&ts2, &ts1);
+  mutex_.lock();
+  pipelineDepth_ = depth;
+  mutex_.unlock();
 
   return asynSuccess;
 }
 
-asynStatus pmacMessageBroker::supressStatusReads() {
-  asynStatus status = asynSuccess;
-  // Lock the mutex
-  mutex_.lock();
-  suppressStatus_ = true;
-  suppressCounter_ = 0;
-  // Unlock the mutex
-  mutex_.unlock();
-  return status;
+int pmacMessageBroker::readPipelineDepth() {
+  return pipelineDepth_;
 }
 
-asynStatus pmacMessageBroker::reinstateStatusReads() {
-  asynStatus status = asynSuccess;
-  // Lock the mutex
-  mutex_.lock();
-  suppressStatus_ = false;
-  // Unlock the mutex
-  mutex_.unlock();
-  return status;
+/**
+ * Begin a trajectory buffer fill.  Until endTrajectoryFill is called the fast
+ * store is read only when the minimum status rate requires it or when the
+ * measured trajectory bandwidth shows there is time to spare before the PMAC
+ * needs the new points, and the medium and slow stores only in the latter case.
+ *
+ * @param points Number of points the fill will write.
+ * @param headroom Seconds until the PMAC needs the first new point, negative
+ *                 if the scan has not started.
+ * @param minStatusPeriod Longest time allowed between fast reads, in seconds.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::startTrajectoryFill(int points, double headroom,
+                                                  double minStatusPeriod) {
+  double now = schedulerTime();
+  scheduleMutex_.lock();
+  scheduler_.startFill(now, points, headroom, minStatusPeriod);
+  scheduleMutex_.unlock();
+  return asynSuccess;
+}
+
+/**
+ * Record progress through the current trajectory buffer fill.
+ * @param points Number of points written since the last call.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::trajectoryPointsWritten(int points) {
+  scheduleMutex_.lock();
+  scheduler_.pointsWritten(points);
+  scheduleMutex_.unlock();
+  return asynSuccess;
+}
+
+asynStatus pmacMessageBroker::endTrajectoryFill() {
+  scheduleMutex_.lock();
+  scheduler_.endFill();
+  scheduleMutex_.unlock();
+  return asynSuccess;
+}
+
+/**
+ * @return The measured trajectory write bandwidth in bytes per second.
+ */
+double pmacMessageBroker::readTrajectoryBandwidth() {
+  double bandwidth = 0.0;
+  scheduleMutex_.lock();
+  bandwidth = scheduler_.readBandwidth();
+  scheduleMutex_.unlock();
+  return bandwidth;
+}
+
+/**
+ * The clock used by the trajectory scheduler, in seconds since the broker
+ * was created.
+ */
+double pmacMessageBroker::schedulerTime() {
+  epicsTimeStamp now;
+  epicsTimeGetCurrent(&now);
+  return epicsTimeDiffInSeconds(&now, &this->startTime_);
+}
+
+/**
+ * Whether the fast stores should be read on this update.  A positive answer
+ * is taken as the read having been made.
+ */
+bool pmacMessageBroker::fastReadDue() {
+  double now = schedulerTime();
+  bool due = false;
+  scheduleMutex_.lock();
+  due = scheduler_.statusReadDue(now, fastReadTime_);
+  if (due) {
+    scheduler_.statusRead(now);
+  }
+  scheduleMutex_.unlock();
+  return due;
+}
+
+/**
+ * Whether the medium and slow stores may be read, which during a trajectory
+ * fill needs time to spare for a read the size of a fast read.
+ */
+bool pmacMessageBroker::backgroundReadAllowed() {
+  double now = schedulerTime();
+  bool allowed = false;
+  scheduleMutex_.lock();
+  allowed = scheduler_.hasSlack(now, fastReadTime_);
+  scheduleMutex_.unlock();
+  return allowed;
 }
 
 asynStatus pmacMessageBroker::registerForLocks(asynPortDriver *lockPtr) {
@@ -316,6 +1388,8 @@ asynStatus pmacMessageBroker::readStatistics(int *noOfMsgs,
                                              int *lastMsgBytesWritten,
                                              int *lastMsgBytesRead,
                                              int *lastMsgTime) {
+  // Read a consistent set, recordStatistics updates them together
+  statsMutex_.lock();
   *noOfMsgs = this->noOfMessages_;
   *totalBytesWritten = this->totalBytesWritten_;
   *totalBytesRead = this->totalBytesRead_;
@@ -323,9 +1397,47 @@ asynStatus pmacMessageBroker::readStatistics(int *noOfMsgs,
   *lastMsgBytesWritten = this->lastMsgBytesWritten_;
   *lastMsgBytesRead = this->lastMsgBytesRead_;
   *lastMsgTime = this->lastMsgTime_;
+  statsMutex_.unlock();
+  return asynSuccess;
+}
+
+/**
+ * Read the distribution of one of the message statistics.  The histograms are
+ * read without taking the mutex so that polling is never held up by a reader.
+ *
+ * @param category The store type (PMAC_SLOW_READ etc) or PMAC_IMMEDIATE_STATS.
+ * @param metric PMAC_STATS_RTT (in us), PMAC_STATS_REQUEST_BYTES or PMAC_STATS_REPLY_BYTES.
+ * @param p50 Set to the median.
+ * @param p90 Set to the 90th percentile.
+ * @param p99 Set to the 99th percentile.
+ * @param max Set to the largest value recorded.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::readHistogram(int category, int metric, int *p50, int *p90,
+                                            int *p99, int *max) {
+  if (category < 0 || category >= PMAC_STATS_CATEGORIES ||
+      metric < 0 || metric >= PMAC_STATS_METRICS) {
+    return asynError;
+  }
+  pmacHistogram &histogram = histograms_[category][metric];
+  *p50 = (int) histogram.readQuantile(0.5);
+  *p90 = (int) histogram.readQuantile(0.9);
+  *p99 = (int) histogram.readQuantile(0.99);
+  *max = (int) histogram.readMax();
   return asynSuccess;
 }
 
+/**
+ * Clear all of the message histograms.
+ */
+void pmacMessageBroker::resetHistograms() {
+  for (int category = 0; category < PMAC_STATS_CATEGORIES; category++) {
+    for (int metric = 0; metric < PMAC_STATS_METRICS; metric++) {
+      histograms_[category][metric].reset();
+    }
+  }
+}
+
 asynStatus pmacMessageBroker::readStoreSize(int type, int *size) {
   asynStatus status = asynSuccess;
 
@@ -379,8 +1491,49 @@ asynStatus pmacMessageBroker::report(int type) {
   return status;
 }
 
+/**
+ * Set the request and predicted reply byte budgets used to pack the variables
+ * of every store into command strings.
+ *
+ * @param requestBytes Maximum length of each command string.
+ * @param replyBytes Maximum predicted length of each reply.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::setCommandBudget(int requestBytes, int replyBytes) {
+  static const char *functionName = "setCommandBudget";
+  asynStatus status = asynSuccess;
+
+  // The whole reply must fit in the read buffer
+  if (replyBytes >= (int) PMAC_MAXBUF_) {
+    debug(DEBUG_ERROR, functionName, "Reply budget must be less than", (int) PMAC_MAXBUF_);
+    return asynError;
+  }
+
+  mutex_.lock();
+  if (slowStore_.setBudget(requestBytes, replyBytes) != 0 ||
+      mediumStore_.setBudget(requestBytes, replyBytes) != 0 ||
+      fastStore_.setBudget(requestBytes, replyBytes) != 0 ||
+      prefastStore_.setBudget(requestBytes, replyBytes) != 0) {
+    status = asynError;
+  }
+  mutex_.unlock();
+
+  return status;
+}
+
 void pmacMessageBroker::markAsPowerPMAC() {
   powerPMAC_ = true;
+  // gpascii accepts longer command lines than the Turbo PMAC, but the ssh
+  // driver reads the command echo back into a 512 byte buffer
+  setCommandBudget(PMAC_POWER_REQUEST_BUDGET_, PMAC_POWER_REPLY_BUDGET_);
+  // gpascii replies to range requests have not been verified, so request
+  // each variable individually
+  mutex_.lock();
+  slowStore_.setRangeQueries(false);
+  mediumStore_.setRangeQueries(false);
+  fastStore_.setRangeQueries(false);
+  prefastStore_.setRangeQueries(false);
+  mutex_.unlock();
 }
 
 /**
@@ -405,6 +1558,8 @@ asynStatus pmacMessageBroker::lowLevelPortConnect(const char *port, int addr, as
     asynPrint(this->ownerAsynUser_, ASYN_TRACE_ERROR,
               "pmacController::motorAxisAsynConnect: unable to connect to port %s\n",
               port);
+    //Set my low level pasynUser pointer to NULL
+    *ppasynUser = NULL;
     return status;
   }
   //Do I want to disconnect below? If the IP address comes up, will the driver recover
@@ -438,6 +1593,20 @@ asynStatus pmacMessageBroker::lowLevelPortConnect(const char *port, int addr, as
   return status;
 }
 
+/**
+ * Return the asynUser for a connection lane, on the broker's low level port
+ * unless the lane has been given its own with connectLane.  Must be called
+ * with the lane's mutex held, which is kept for the whole exchange since
+ * the exchange sets the timeout on the asynUser.
+ * @return The asynUser, NULL if the lane is invalid or not connected.
+ */
+asynUser *pmacMessageBroker::laneUser(int lane) {
+  if (lane >= 0 && lane < PMAC_CONNECTION_LANES) {
+    return laneUsers_[lane];
+  }
+  return NULL;
+}
+
 /**
  * Disconnect from the underlying low level Asyn port that is used for comms.
  * @param ppasynUser A pointer to the pasynUser structure used by the controller
@@ -457,69 +1626,446 @@ asynStatus pmacMessageBroker::lowLevelPortDisconnect(asynUser *ppasynUser) {
 }
 
 /**
- * Wrapper for asynOctetSyncIO write/read functions.
+ * Write a command and read back its response.  The low level port is held
+ * for the whole exchange, so that a reply waited for again after the
+ * adaptive timeout expires cannot be taken by another user of the port.
  * @param command - String command to send.
  * @response response - String response back.
+ * @param category - Histogram category the exchange is recorded against.
+ * @param lane - Connection lane to send the command on.
  */
-asynStatus pmacMessageBroker::lowLevelWriteRead(const char *command, char *response) {
+asynStatus pmacMessageBroker::lowLevelWriteRead(const char *command, char *response,
+                                                int category, int lane) {
   asynStatus status = asynSuccess;
+  asynUser *pasynUser = NULL;
+  epicsTimeStamp writeTime;
+  asynInterface *pasynInterface = NULL;
+  asynOctet *pasynOctet = NULL;
+  void *octetPvt = NULL;
   int eomReason = 0;
   size_t nwrite = 0;
   size_t nread = 0;
   static const char *functionName = "pmacMessageBroker::lowLevelWriteRead";
 
   asynPrint(this->ownerAsynUser_, ASYN_TRACE_FLOW, "%s\n", functionName);
-  epicsTimeGetCurrent(&this->writeTime_);
 
-  if (!lowLevelPortUser_) {
+  response[0] = '\0';
+  if (lane < 0 || lane >= PMAC_CONNECTION_LANES) {
+    return asynError;
+  }
+  laneMutex_[lane].lock();
+  pasynUser = laneUser(lane);
+  if (!pasynUser) {
+    laneMutex_[lane].unlock();
+    return asynError;
+  }
+
+  pasynInterface = pasynManager->findInterface(pasynUser, asynOctetType, 1);
+  if (!pasynInterface) {
+    laneMutex_[lane].unlock();
     return asynError;
   }
+  pasynOctet = (asynOctet *) pasynInterface->pinterface;
+  octetPvt = pasynInterface->drvPvt;
 
-  asynPrint(lowLevelPortUser_, ASYN_TRACEIO_DRIVER, "%s: command: %s\n", functionName, command);
+  status = pasynManager->queueLockPort(pasynUser);
+  if (status != asynSuccess) {
+    laneMutex_[lane].unlock();
+    return status;
+  }
+  pasynUser->timeout = exchangeTimeout(command, lane);
+  pasynOctet->flush(octetPvt, pasynUser);
+
+  asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: command: %s\n", functionName, command);
+  epicsTimeGetCurrent(&writeTime);
+  status = pasynOctet->write(octetPvt, pasynUser, command, strlen(command), &nwrite);
+  if (status == asynSuccess) {
+    status = readReply(pasynOctet, octetPvt, pasynUser, command, lane, true, &writeTime,
+                       response, &nread, &eomReason);
+    // If no bytes read and no eomReason then this is an error
+    if (nread == 0 && eomReason == 0) {
+      status = asynError;
+    }
+  }
 
-  status = pasynOctetSyncIO->writeRead(lowLevelPortUser_,
-                                       command,
-                                       strlen(command),
-                                       response,
-                                       PMAC_MAXBUF_,
-                                       PMAC_TIMEOUT_,
-                                       &nwrite,
-                                       &nread,
-                                       &eomReason);
+  pasynManager->queueUnlockPort(pasynUser);
 
-  // If no bytes read and no eomReason then this is an error
-  if (nread == 0 && eomReason == 0) {
-    status = asynError;
+  if (status != asynSuccess) {
+    connectionLost("lowLevelWriteRead");
+  } else {
+    // Replace any carriage returns with spaces
+    if (powerPMAC_) {
+      replace(response, '\n', ' ');
+    }
+    recordStatistics(command, response, category, &writeTime);
+  }
+
+  asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: response: %s\n", functionName, response);
+  laneMutex_[lane].unlock();
+
+  return status;
+}
+
+/**
+ * Read the reply to a command, with the low level port already held.  The
+ * adaptive timeout of a lane is only an estimate, so when it expires the
+ * timeout is backed off and the same reply waited for again.  The read fails
+ * only once a wait of PMAC_TIMEOUT_ (or the fixed timeout of a slow command)
+ * has expired, leaving the caller to declare the connection lost.
+ *
+ * @param pasynOctet The octet interface of the port.
+ * @param octetPvt The driver private data of the interface.
+ * @param pasynUser The asynUser holding the port, its timeout is used for the first wait.
+ * @param command The command whose reply is read.
+ * @param lane The connection lane, whose timeout estimate is updated.
+ * @param measure Whether a reply read in time is a round trip measurement.
+ * @param writeTime Time at which the command was written.
+ * @param response Buffer for the reply, of PMAC_MAXBUF_ characters.
+ * @param nread Set to the number of characters read.
+ * @param eomReason Set to the end of message reason of the last read.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::readReply(asynOctet *pasynOctet, void *octetPvt,
+                                        asynUser *pasynUser, const char *command, int lane,
+                                        bool measure, const epicsTimeStamp *writeTime,
+                                        char *response, size_t *nread, int *eomReason) {
+  asynStatus status = asynSuccess;
+  bool slow = isSlowCommand(command);
+  size_t more = 0;
+  static const char *functionName = "readReply";
+
+  *nread = 0;
+  while (true) {
+    more = 0;
+    *eomReason = 0;
+    status = pasynOctet->read(octetPvt, pasynUser, response + *nread,
+                              PMAC_MAXBUF_ - 1 - *nread, &more, eomReason);
+    *nread += more;
+    if (!slow && (measure || status == asynTimeout)) {
+      recordExchange(lane, status, writeTime);
+    }
+    if (status != asynTimeout || slow || pasynUser->timeout >= PMAC_TIMEOUT_) {
+      break;
+    }
+    // The timeout has been backed off by recordExchange, but make sure that
+    // each wait is longer than the last so that PMAC_TIMEOUT_ is reached
+    double timeout = exchangeTimeout(command, lane);
+    if (timeout <= pasynUser->timeout) {
+      timeout = pasynUser->timeout * 2.0;
+    }
+    pasynUser->timeout = timeout < PMAC_TIMEOUT_ ? timeout : PMAC_TIMEOUT_;
+    debug(DEBUG_TRACE, functionName, "Reply timed out, waiting again", command);
+  }
+  response[*nread] = '\0';
+  return status;
+}
+
+/**
+ * Pipelined version of lowLevelWriteRead.  The low level port is held for the
+ * whole exchange and all commands are written before the responses are read
+ * back in order, which relies on the port buffering any reply data that
+ * arrives ahead of the read for it (as pmacAsynIPPort and the EOS interpose
+ * layer do).
+ *
+ * @param commands Array of commands to send.
+ * @param count Number of commands (at most PMAC_MAX_PIPELINE_DEPTH).
+ * @param category Histogram category the exchanges are recorded against.
+ * @param responses Buffers for the responses, in the same order as the commands.
+ * @param lane Connection lane to send the commands on.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::lowLevelPipelinedWriteRead(const std::string *commands, int count,
+                                                         int category,
+                                                         char (*responses)[1024], int lane) {
+  asynStatus status = asynSuccess;
+  asynUser *pasynUser = NULL;
+  epicsTimeStamp writeTime;
+  asynInterface *pasynInterface = NULL;
+  asynOctet *pasynOctet = NULL;
+  void *octetPvt = NULL;
+  int eomReason = 0;
+  int sent = 0;
+  size_t nwrite = 0;
+  size_t nread = 0;
+  static const char *functionName = "pmacMessageBroker::lowLevelPipelinedWriteRead";
+
+  asynPrint(this->ownerAsynUser_, ASYN_TRACE_FLOW, "%s\n", functionName);
+
+  if (lane < 0 || lane >= PMAC_CONNECTION_LANES) {
+    return asynError;
+  }
+  laneMutex_[lane].lock();
+  pasynUser = laneUser(lane);
+  if (!pasynUser) {
+    laneMutex_[lane].unlock();
+    return asynError;
+  }
+
+  pasynInterface = pasynManager->findInterface(pasynUser, asynOctetType, 1);
+  if (!pasynInterface) {
+    laneMutex_[lane].unlock();
+    return asynError;
+  }
+  pasynOctet = (asynOctet *) pasynInterface->pinterface;
+  octetPvt = pasynInterface->drvPvt;
+
+  // Hold the port so that no other user can interleave with the batch
+  status = pasynManager->queueLockPort(pasynUser);
+  if (status != asynSuccess) {
+    laneMutex_[lane].unlock();
+    return status;
+  }
+  // Each read waits for one reply, so the batch shares a single timeout
+  pasynUser->timeout = 0.0;
+  for (int index = 0; index < count; index++) {
+    double timeout = exchangeTimeout(commands[index].c_str(), lane);
+    if (timeout > pasynUser->timeout) {
+      pasynUser->timeout = timeout;
+    }
+  }
+  pasynOctet->flush(octetPvt, pasynUser);
+
+  epicsTimeGetCurrent(&writeTime);
+  while (sent < count && status == asynSuccess) {
+    asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: command: %s\n", functionName,
+              commands[sent].c_str());
+    status = pasynOctet->write(octetPvt, pasynUser, commands[sent].c_str(),
+                               commands[sent].length(), &nwrite);
+    if (status == asynSuccess) {
+      sent++;
+    }
+  }
+
+  // Replies arrive in the same order as the commands were written
+  for (int index = 0; index < sent && status == asynSuccess; index++) {
+    // Only the first reply measures a round trip, the rest queued behind it
+    status = readReply(pasynOctet, octetPvt, pasynUser, commands[index].c_str(), lane,
+                       index == 0, &writeTime, responses[index], &nread, &eomReason);
+    // If no bytes read and no eomReason then this is an error
+    if (nread == 0 && eomReason == 0) {
+      status = asynError;
+    }
+    if (status == asynSuccess) {
+      recordStatistics(commands[index].c_str(), responses[index], category, &writeTime);
+      asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: response: %s\n", functionName,
+                responses[index]);
+    }
+  }
+
+  pasynManager->queueUnlockPort(pasynUser);
+  laneMutex_[lane].unlock();
+
+  if (status != asynSuccess) {
+    // Any replies not yet read cannot be trusted
+    for (int index = 0; index < count; index++) {
+      responses[index][0] = '\0';
+    }
+    connectionLost("lowLevelPipelinedWriteRead");
+  }
+
+  return status;
+}
+
+/**
+ * Priority version of lowLevelWriteRead.  pasynManager->lockPort takes the
+ * port directly rather than queueing behind the other users of the low level
+ * port, so the command is written as soon as the exchange in progress (if any)
+ * completes.  The time between the request and the write is recorded in the
+ * PMAC_STATS_LATENCY histogram of the priority category.
+ *
+ * @param command The command to send.
+ * @param response Buffer for the response.
+ * @param requestTime Time at which the command was requested.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::lowLevelPriorityWriteRead(const char *command, char *response,
+                                                        const epicsTimeStamp *requestTime) {
+  asynStatus status = asynSuccess;
+  asynUser *pasynUser = NULL;
+  epicsTimeStamp writeTime;
+  asynInterface *pasynInterface = NULL;
+  asynOctet *pasynOctet = NULL;
+  void *octetPvt = NULL;
+  int eomReason = 0;
+  size_t nwrite = 0;
+  size_t nread = 0;
+  static const char *functionName = "pmacMessageBroker::lowLevelPriorityWriteRead";
+
+  asynPrint(this->ownerAsynUser_, ASYN_TRACE_FLOW, "%s\n", functionName);
+
+  // The priority path has its own asyn user, shared only by priority commands
+  priorityMutex_.lock();
+  pasynUser = priorityUser_;
+  if (!pasynUser) {
+    priorityMutex_.unlock();
+    return asynError;
+  }
+
+  pasynInterface = pasynManager->findInterface(pasynUser, asynOctetType, 1);
+  if (!pasynInterface) {
+    priorityMutex_.unlock();
+    return asynError;
   }
+  pasynOctet = (asynOctet *) pasynInterface->pinterface;
+  octetPvt = pasynInterface->drvPvt;
 
+  status = pasynManager->lockPort(pasynUser);
   if (status != asynSuccess) {
-    // the next call to CheckConnectionStatus will restore the connected_ state
-    if (connected_){
-      debug(DEBUG_ERROR, "lowLevelWriteRead", "Connection to hardware lost");
+    priorityMutex_.unlock();
+    return status;
+  }
+  pasynUser->timeout = exchangeTimeout(command, PMAC_COMMAND_LANE);
+  pasynOctet->flush(octetPvt, pasynUser);
+
+  epicsTimeGetCurrent(&writeTime);
+  double latency = epicsTimeDiffInSeconds(&writeTime, requestTime);
+  if (latency < 0.0) {
+    latency = 0.0;
+  }
+  // Writers of the histograms are serialised by the statistics mutex
+  statsMutex_.lock();
+  histograms_[PMAC_PRIORITY_STATS][PMAC_STATS_LATENCY].record(
+      (epicsUInt32) (latency * 1000000.0));
+  statsMutex_.unlock();
+
+  asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: command: %s\n", functionName, command);
+  status = pasynOctet->write(octetPvt, pasynUser, command, strlen(command), &nwrite);
+  if (status == asynSuccess) {
+    status = readReply(pasynOctet, octetPvt, pasynUser, command, PMAC_COMMAND_LANE, true,
+                       &writeTime, response, &nread, &eomReason);
+    // If no bytes read and no eomReason then this is an error
+    if (nread == 0 && eomReason == 0) {
+      status = asynError;
     }
-    connected_ = false;  newConnection_ = true;
+  }
+
+  pasynManager->unlockPort(pasynUser);
+
+  if (status != asynSuccess) {
+    connectionLost("lowLevelPriorityWriteRead");
   } else {
     // Replace any carriage returns with spaces
     if (powerPMAC_) {
       replace(response, '\n', ' ');
     }
-    // Update statistics
-    this->noOfMessages_++;
-    this->totalBytesWritten_ += strlen(command);
-    this->totalBytesRead_ += strlen(response);
-    this->lastMsgBytesWritten_ = strlen(command);
-    this->lastMsgBytesRead_ = strlen(response);
-    epicsTimeGetCurrent(&this->currentTime_);
-    double elapsedTime = epicsTimeDiffInSeconds(&this->currentTime_, &this->writeTime_);
-    this->lastMsgTime_ = (int) (elapsedTime * 1000.0);
-    this->totalMsgTime_ += this->lastMsgTime_;
+    recordStatistics(command, response, PMAC_PRIORITY_STATS, &writeTime);
   }
 
-  asynPrint(lowLevelPortUser_, ASYN_TRACEIO_DRIVER, "%s: response: %s\n", functionName, response);
+  asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: response: %s\n", functionName, response);
+  priorityMutex_.unlock();
 
   return status;
 }
 
+/**
+ * Choose the read timeout for a command.  Ordinary commands use the timeout
+ * adapted to the round trip time of the lane, commands known to be slow a
+ * fixed, longer ceiling.
+ * @param command The command to be sent.
+ * @param lane The connection lane it is sent on.
+ * @return The timeout in seconds.
+ */
+double pmacMessageBroker::exchangeTimeout(const char *command, int lane) {
+  double timeout = PMAC_SLOW_TIMEOUT_;
+  if (!isSlowCommand(command)) {
+    timeoutMutex_.lock();
+    timeout = estimators_[lane].timeout();
+    timeoutMutex_.unlock();
+  }
+  return timeout;
+}
+
+/**
+ * Update the timeout estimate of a lane following an exchange.
+ * @param lane The connection lane used.
+ * @param status Status of the read, asynTimeout backs the timeout off.
+ * @param writeTime Time at which the command was written.
+ */
+void pmacMessageBroker::recordExchange(int lane, asynStatus status,
+                                       const epicsTimeStamp *writeTime) {
+  epicsTimeStamp now;
+  epicsTimeGetCurrent(&now);
+  timeoutMutex_.lock();
+  if (status == asynSuccess) {
+    estimators_[lane].recordRoundTrip(epicsTimeDiffInSeconds(&now, writeTime));
+  } else if (status == asynTimeout) {
+    estimators_[lane].recordTimeout();
+  }
+  timeoutMutex_.unlock();
+}
+
+/**
+ * Read the state of the timeout estimate for a connection lane.
+ * @param lane The connection lane.
+ * @param timeout The timeout in seconds the next exchange will use.
+ * @param srtt Smoothed round trip time in seconds, negative if not yet measured.
+ * @param rttvar Mean deviation of the round trip time in seconds.
+ * @param timeouts Number of exchanges that have timed out.
+ * @return asynStatus
+ */
+asynStatus pmacMessageBroker::readTimeouts(int lane, double *timeout, double *srtt,
+                                           double *rttvar, int *timeouts) {
+  if (lane < 0 || lane >= PMAC_CONNECTION_LANES) {
+    return asynError;
+  }
+  timeoutMutex_.lock();
+  *timeout = estimators_[lane].timeout();
+  *srtt = estimators_[lane].readSmoothedRoundTrip();
+  *rttvar = estimators_[lane].readRoundTripVariation();
+  *timeouts = estimators_[lane].readTimeoutCount();
+  timeoutMutex_.unlock();
+  return asynSuccess;
+}
+
+/**
+ * Copy out the timeouts that most recently expired on a connection lane.
+ * @param lane The connection lane.
+ * @param history Buffer for the timeouts in seconds, oldest first.
+ * @param max Size of the buffer.
+ * @return The number of timeouts copied.
+ */
+int pmacMessageBroker::readTimeoutHistory(int lane, double *history, int max) {
+  int count = 0;
+  if (lane >= 0 && lane < PMAC_CONNECTION_LANES) {
+    timeoutMutex_.lock();
+    count = estimators_[lane].readHistory(history, max);
+    timeoutMutex_.unlock();
+  }
+  return count;
+}
+
+/**
+ * Update the message statistics following a successful write/read.
+ * @param command - String command that was sent.
+ * @param response - String response that was received.
+ * @param category - Histogram category (store type or PMAC_IMMEDIATE_STATS).
+ * @param writeTime - Time at which the command was written.
+ */
+void pmacMessageBroker::recordStatistics(const char *command, const char *response,
+                                         int category, const epicsTimeStamp *writeTime) {
+  int bytesWritten = strlen(command);
+  int bytesRead = strlen(response);
+  statsMutex_.lock();
+  this->noOfMessages_++;
+  this->totalBytesWritten_ += bytesWritten;
+  this->totalBytesRead_ += bytesRead;
+  this->lastMsgBytesWritten_ = bytesWritten;
+  this->lastMsgBytesRead_ = bytesRead;
+  epicsTimeGetCurrent(&this->currentTime_);
+  double elapsedTime = epicsTimeDiffInSeconds(&this->currentTime_, writeTime);
+  this->lastMsgTime_ = (int) (elapsedTime * 1000.0);
+  this->totalMsgTime_ += this->lastMsgTime_;
+  if (category >= 0 && category < PMAC_STATS_CATEGORIES) {
+    if (elapsedTime < 0.0) {
+      elapsedTime = 0.0;
+    }
+    histograms_[category][PMAC_STATS_RTT].record((epicsUInt32) (elapsedTime * 1000000.0));
+    histograms_[category][PMAC_STATS_REQUEST_BYTES].record((epicsUInt32) bytesWritten);
+    histograms_[category][PMAC_STATS_REPLY_BYTES].record((epicsUInt32) bytesRead);
+  }
+  statsMutex_.unlock();
+}
+
 int pmacMessageBroker::replace(char *str, char ch1, char ch2) {
   int changes = 0;
   while (*str != '\0') {
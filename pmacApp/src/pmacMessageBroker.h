@@ -13,11 +13,42 @@
 #include "asynOctet.h"
 #include "asynOctetSyncIO.h"
 #include "epicsTime.h"
+#include "epicsEvent.h"
+#include "epicsThread.h"
 #include "pmacDebugger.h"
 #include "pmacCommandStore.h"
 #include "pmacCallbackStore.h"
 #include "pmacCallbackInterface.h"
+#include "pmacCompletionInterface.h"
+#include "pmacHistogram.h"
+#include "pmacTrajectoryScheduler.h"
+#include "pmacTimeoutEstimator.h"
 #include <string.h>
+#include <deque>
+#include <vector>
+
+#define PMAC_MAX_PIPELINE_DEPTH 8
+#define PMAC_STORE_TYPES 4
+#define PMAC_CONNECTION_LANES 3
+
+// Message histograms are kept for each store, for immediate commands and for
+// priority commands, each recording the round trip time, request size and
+// reply size (and for priority commands the latency before the write)
+#define PMAC_STATS_CATEGORIES 6
+#define PMAC_STATS_METRICS 4
+
+// A command queued by submitWriteRead, waiting for the submit thread
+struct pmacSubmittedCommand {
+    std::string command;
+    pmacCompletionInterface *completion;
+};
+
+// A thread in flushSubmitted, woken once the first count submitted commands
+// have been sent
+struct pmacFlushWaiter {
+    epicsUInt32 count;
+    epicsEventId event;
+};
 
 class pmacMessageBroker : public pmacDebugger {
 public:
@@ -33,6 +64,23 @@ public:
     static const epicsInt32 PMAC_MEDIUM_READ = 1;
     static const epicsInt32 PMAC_FAST_READ = 2;
     static const epicsInt32 PMAC_PRE_FAST_READ = 3;
+    // Histogram category for commands not made by polling one of the stores
+    static const epicsInt32 PMAC_IMMEDIATE_STATS = 4;
+    // Histogram category for stop, kill and abort commands sent on the priority lane
+    static const epicsInt32 PMAC_PRIORITY_STATS = 5;
+    // Histogram metrics, round trip time is recorded in microseconds
+    static const epicsInt32 PMAC_STATS_RTT = 0;
+    static const epicsInt32 PMAC_STATS_REQUEST_BYTES = 1;
+    static const epicsInt32 PMAC_STATS_REPLY_BYTES = 2;
+    // Time from a priority request to its write, in microseconds (priority lane only)
+    static const epicsInt32 PMAC_STATS_LATENCY = 3;
+    // Connection lanes.  A Power PMAC accepts several sessions, so each lane
+    // may be given its own low level port; lanes without one share the port
+    // the broker was connected to.  Store polling uses the poll lane, immediate,
+    // submitted and priority commands the command lane.
+    static const epicsInt32 PMAC_POLL_LANE = 0;
+    static const epicsInt32 PMAC_COMMAND_LANE = 1;
+    static const epicsInt32 PMAC_TRAJECTORY_LANE = 2;
 
     pmacMessageBroker(asynUser *pasynUser);
 
@@ -40,20 +88,68 @@ public:
 
     asynStatus connect(const char *port, int addr);
 
+    asynStatus connectLane(int lane, const char *port, int addr);
+
     asynStatus disconnect();
 
     asynStatus getConnectedStatus(int *connected, int *newConnection);
-    void  clearNewConnection(void) { newConnection_ = false; }
+    asynStatus probeConnection();
+    void reconnectTask();
+    void  clearNewConnection(void);
+
+    asynStatus immediateWriteRead(const char *command, char *response, bool trace=true,
+                                  int lane=PMAC_COMMAND_LANE);
+
+    asynStatus priorityWriteRead(const char *command, char *response);
+
+    asynStatus submitWriteRead(const char *command, pmacCompletionInterface *completion = NULL);
+
+    void flushSubmitted();
+
+    int readSubmitFailures();
+
+    void submitTask();
+
+    asynStatus addReadVariable(int type, const char *variable, int *handle = NULL);
+
+    asynStatus setLowPriority(int type, int handle);
+
+    asynStatus setDecimation(int type, int factor);
 
-    asynStatus immediateWriteRead(const char *command, char *response, bool trace=true);
+    int readDecimation(int type);
 
-    asynStatus addReadVariable(int type, const char *variable);
+    bool readUpdateComplete(int type);
+
+    std::string readLowPriorityList(int type);
+
+    asynStatus setIdle(int type, const int *handles, int count, bool idle);
+
+    asynStatus setIdleDecimation(int type, int factor);
+
+    int readIdleCount(int type);
 
     asynStatus updateVariables(int type);
 
-    asynStatus supressStatusReads();
+    asynStatus updateAllVariables();
+
+    asynStatus updateVariablesSlice(int type, double progress, bool newPass);
+
+    asynStatus setPipelineDepth(int depth);
+
+    int readPipelineDepth();
+
+    asynStatus startTrajectoryFill(int points, double headroom, double minStatusPeriod);
+
+    asynStatus trajectoryPointsWritten(int points);
+
+    asynStatus endTrajectoryFill();
+
+    double readTrajectoryBandwidth();
+
+    asynStatus readTimeouts(int lane, double *timeout, double *srtt, double *rttvar,
+                            int *timeouts);
 
-    asynStatus reinstateStatusReads();
+    int readTimeoutHistory(int lane, double *history, int max);
 
     asynStatus registerForUpdates(pmacCallbackInterface *cbPtr, int type);
 
@@ -69,10 +165,16 @@ public:
                               int *lastMsgBytesRead,
                               int *lastMsgTime);
 
+    asynStatus readHistogram(int category, int metric, int *p50, int *p90, int *p99, int *max);
+
+    void resetHistograms();
+
     asynStatus readStoreSize(int type, int *size);
 
     asynStatus report(int type);
 
+    asynStatus setCommandBudget(int requestBytes, int replyBytes);
+
     void markAsPowerPMAC();
 
     bool disable_poll;
@@ -84,21 +186,90 @@ private:
 
     asynStatus lowLevelPortDisconnect(asynUser *ppasynUser);
 
-    asynStatus lowLevelWriteRead(const char *command, char *response);
+    asynStatus lowLevelWriteRead(const char *command, char *response,
+                                 int category = PMAC_IMMEDIATE_STATS, int lane = PMAC_POLL_LANE);
+
+    asynStatus lowLevelPipelinedWriteRead(const std::string *commands, int count, int category,
+                                          char (*responses)[1024], int lane);
+
+    asynStatus lowLevelPriorityWriteRead(const char *command, char *response,
+                                         const epicsTimeStamp *requestTime);
+
+    asynStatus readReply(asynOctet *pasynOctet, void *octetPvt, asynUser *pasynUser,
+                         const char *command, int lane, bool measure,
+                         const epicsTimeStamp *writeTime, char *response, size_t *nread,
+                         int *eomReason);
+
+    asynStatus timedWriteRead(const char *command, char *response, bool trace, int category,
+                              int lane);
+
+    asynUser *laneUser(int lane);
+
+    void discardSubmitted();
+
+    void wakeFlushWaiters();
+
+    void connectionLost(const char *functionName);
+
+    bool isConnected();
+
+    bool isExiting();
+
+    double exchangeTimeout(const char *command, int lane);
+
+    void recordExchange(int lane, asynStatus status, const epicsTimeStamp *writeTime);
+
+    double schedulerTime();
+
+    bool fastReadDue();
+
+    bool backgroundReadAllowed();
+
+    asynStatus pipelinedWriteRead(const std::string *commands, int count, int category);
+
+    asynStatus updateStore(pmacCommandStore *store, int type, const char *storeName);
+
+    asynStatus readCommandStrings(pmacCommandStore *store, int type, const char *storeName,
+                                  int first, int last);
+
+    void makeCallbacks(pmacCommandStore **stores, pmacCallbackStore **callbacks, int count);
+
+    pmacCallbackStore *findCallbacks(int type);
+
+    pmacCommandStore *findStore(int type);
+
+    void recordStatistics(const char *command, const char *response, int category,
+                          const epicsTimeStamp *writeTime);
 
     int replace(char *str, char ch1, char ch2);
 
     // Mutex required for locking across threads
     epicsMutex mutex_;
 
-    // Status suppression
-    bool suppressStatus_;
-    int suppressCounter_;
+    // Sharing of the link between status reads and trajectory fills.
+    // scheduleMutex_ protects scheduler_ and fastReadTime_ (the duration of
+    // the last fast read in seconds)
+    epicsMutex scheduleMutex_;
+    pmacTrajectoryScheduler scheduler_;
+    double fastReadTime_;
+    // Read timeouts adapted to the round trip time measured on each lane,
+    // protected by timeoutMutex_
+    epicsMutex timeoutMutex_;
+    pmacTimeoutEstimator estimators_[PMAC_CONNECTION_LANES];
     // Power PMAC
     bool powerPMAC_;
 
     asynUser *ownerAsynUser_;
-    asynUser *lowLevelPortUser_;
+    // Each lane has its own asyn user, connected to the low level port given
+    // to connect unless laneOwnPort_ is set.  An exchange holds the lane's
+    // mutex, which also protects the lane's user against replacement by
+    // connectLane.  priorityUser_ is used only by priority commands, on the
+    // port of the command lane, and is protected by priorityMutex_
+    asynUser *laneUsers_[PMAC_CONNECTION_LANES];
+    bool laneOwnPort_[PMAC_CONNECTION_LANES];
+    epicsMutex laneMutex_[PMAC_CONNECTION_LANES];
+    asynUser *priorityUser_;
+    epicsMutex priorityMutex_;
 
     // Command storage
     pmacCommandStore slowStore_;
@@ -121,9 +292,11 @@ private:
     int lastMsgBytesWritten_;
     int lastMsgBytesRead_;
     int lastMsgTime_;
-    epicsTimeStamp writeTime_;
+    // Lanes record their exchanges concurrently
+    epicsMutex statsMutex_;
     epicsTimeStamp startTime_;
     epicsTimeStamp currentTime_;
+    pmacHistogram histograms_[PMAC_STATS_CATEGORIES][PMAC_STATS_METRICS];
 
     // Update time in ms
     double updateTime_;
@@ -131,12 +304,53 @@ private:
     // number of registered locks
     int lock_count;
 
-    // connection status;
+    // connection status, protected by connectionMutex_ together with the
+    // request for the submit and reconnect threads to exit
+    epicsMutex connectionMutex_;
     bool connected_;
     bool newConnection_;
+    bool exiting_;
+    bool reconnectStarted_;
+    // Signalled when the connection is lost, to wake the reconnect thread
+    epicsEventId reconnectEventId_;
+    // Signalled by the submit and reconnect threads as they exit
+    epicsEventId submitDoneEventId_;
+    epicsEventId reconnectDoneEventId_;
+
+    // Number of command strings kept in flight during a store update
+    int pipelineDepth_;
+    std::string pipelineCommands_[PMAC_MAX_PIPELINE_DEPTH];
+    char pipelineResponses_[PMAC_MAX_PIPELINE_DEPTH][1024];
+
+    // Commands queued by submitWriteRead.  submitMutex_ protects submitted_,
+    // the counts of commands submitted and sent (which wrap), the failure
+    // count and the flush waiters; the batch buffers are only used by the
+    // submit thread
+    epicsMutex submitMutex_;
+    epicsEventId submitEventId_;
+    std::deque<pmacSubmittedCommand> submitted_;
+    epicsUInt32 submitCount_;
+    epicsUInt32 sentCount_;
+    int submitFailures_;
+    std::vector<pmacFlushWaiter> flushWaiters_;
+    std::vector<epicsEventId> flushEvents_;
+    std::string submitCommands_[PMAC_MAX_PIPELINE_DEPTH];
+    char submitResponses_[PMAC_MAX_PIPELINE_DEPTH][1024];
+
+    // Progress through a sliced update, indexed by store type.  sliceCount_
+    // is the number of command strings in the pass, 0 when no pass is running
+    int sliceNext_[PMAC_STORE_TYPES];
+    int sliceCount_[PMAC_STORE_TYPES];
 
     static const epicsUInt32 PMAC_MAXBUF_;
     static const epicsFloat64 PMAC_TIMEOUT_;
+    static const epicsFloat64 PMAC_MIN_TIMEOUT_;
+    static const epicsFloat64 PMAC_SLOW_TIMEOUT_;
+    static const int PMAC_POWER_REQUEST_BUDGET_;
+    static const int PMAC_POWER_REPLY_BUDGET_;
+    static const int PMAC_MAX_SUBMITTED_;
+    static const double PMAC_RECONNECT_MIN_DELAY_;
+    static const double PMAC_RECONNECT_MAX_DELAY_;
 };
 
 #endif /* PMACAPP_SRC_PMACMESSAGEBROKER_H_ */
@@ -0,0 +1,126 @@
+/*
+ * pmacTimeoutEstimator.cpp
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "pmacTimeoutEstimator.h"
+#include <math.h>
+
+pmacTimeoutEstimator::pmacTimeoutEstimator() :
+        minTimeout_(0.1),
+        maxTimeout_(2.0),
+        srtt_(-1.0),
+        rttvar_(0.0),
+        backoff_(1.0),
+        timeoutCount_(0),
+        historyNext_(0),
+        historyCount_(0) {
+  for (int index = 0; index < PMAC_TIMEOUT_HISTORY; index++) {
+    history_[index] = 0.0;
+  }
+}
+
+pmacTimeoutEstimator::~pmacTimeoutEstimator() {
+}
+
+/**
+ * Set the range of the timeout.
+ *
+ * @param minTimeout Shortest timeout in seconds, however fast the link.
+ * @param maxTimeout Longest timeout in seconds, also used until a round trip
+ *                   has been measured.
+ */
+void pmacTimeoutEstimator::setLimits(double minTimeout, double maxTimeout) {
+  minTimeout_ = minTimeout;
+  maxTimeout_ = maxTimeout;
+}
+
+/**
+ * Record a successful exchange.  This also clears any backoff.
+ *
+ * @param seconds The round trip time of the exchange.
+ */
+void pmacTimeoutEstimator::recordRoundTrip(double seconds) {
+  if (seconds < 0.0) {
+    seconds = 0.0;
+  }
+  if (srtt_ < 0.0) {
+    srtt_ = seconds;
+    rttvar_ = seconds / 2.0;
+  } else {
+    rttvar_ = 0.75 * rttvar_ + 0.25 * fabs(srtt_ - seconds);
+    srtt_ = 0.875 * srtt_ + 0.125 * seconds;
+  }
+  backoff_ = 1.0;
+}
+
+/**
+ * Record an exchange that timed out, doubling the timeout for the next one.
+ */
+void pmacTimeoutEstimator::recordTimeout() {
+  history_[historyNext_] = timeout();
+  historyNext_ = (historyNext_ + 1) % PMAC_TIMEOUT_HISTORY;
+  if (historyCount_ < PMAC_TIMEOUT_HISTORY) {
+    historyCount_++;
+  }
+  timeoutCount_++;
+  if (timeout() < maxTimeout_) {
+    backoff_ *= 2.0;
+  }
+}
+
+/**
+ * @return The timeout in seconds to use for the next exchange.
+ */
+double pmacTimeoutEstimator::timeout() {
+  double value = maxTimeout_;
+  if (srtt_ >= 0.0) {
+    value = srtt_ + 4.0 * rttvar_;
+    if (value < minTimeout_) {
+      value = minTimeout_;
+    }
+    value *= backoff_;
+    if (value > maxTimeout_) {
+      value = maxTimeout_;
+    }
+  }
+  return value;
+}
+
+/**
+ * @return The smoothed round trip time in seconds, negative if none measured.
+ */
+double pmacTimeoutEstimator::readSmoothedRoundTrip() {
+  return srtt_;
+}
+
+/**
+ * @return The mean deviation of the round trip time in seconds.
+ */
+double pmacTimeoutEstimator::readRoundTripVariation() {
+  return rttvar_;
+}
+
+/**
+ * @return The number of exchanges that have timed out.
+ */
+int pmacTimeoutEstimator::readTimeoutCount() {
+  return timeoutCount_;
+}
+
+/**
+ * Copy out the most recent timeouts that expired, oldest first.
+ *
+ * @param timeouts Buffer for the timeouts, in seconds.
+ * @param max Size of the buffer.
+ * @return The number of timeouts copied.
+ */
+int pmacTimeoutEstimator::readHistory(double *timeouts, int max) {
+  int count = historyCount_ < max ? historyCount_ : max;
+  int first = (historyNext_ + PMAC_TIMEOUT_HISTORY - count) % PMAC_TIMEOUT_HISTORY;
+  for (int index = 0; index < count; index++) {
+    timeouts[index] = history_[(first + index) % PMAC_TIMEOUT_HISTORY];
+  }
+  return count;
+}
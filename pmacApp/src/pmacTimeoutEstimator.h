@@ -0,0 +1,55 @@
+/*
+ * pmacTimeoutEstimator.h
+ *
+ *  Created on: 17 Oct 2026
+ *
+ * Computes the read timeout for a connection from the measured round trip
+ * times, in the style of the TCP retransmission timeout (RFC 6298).  The
+ * timeout is the smoothed round trip time plus four times its mean deviation,
+ * doubled after each timeout and held between a floor and a ceiling.
+ */
+
+#ifndef PMACAPP_SRC_PMACTIMEOUTESTIMATOR_H_
+#define PMACAPP_SRC_PMACTIMEOUTESTIMATOR_H_
+
+// Number of recent timeouts kept for diagnosis
+#define PMAC_TIMEOUT_HISTORY 16
+
+class pmacTimeoutEstimator {
+public:
+    pmacTimeoutEstimator();
+
+    virtual ~pmacTimeoutEstimator();
+
+    void setLimits(double minTimeout, double maxTimeout);
+
+    void recordRoundTrip(double seconds);
+
+    void recordTimeout();
+
+    double timeout();
+
+    double readSmoothedRoundTrip();
+
+    double readRoundTripVariation();
+
+    int readTimeoutCount();
+
+    int readHistory(double *timeouts, int max);
+
+private:
+    double minTimeout_;
+    double maxTimeout_;
+    // Both in seconds, srtt_ is negative until the first round trip is measured
+    double srtt_;
+    double rttvar_;
+    // Multiplier applied after consecutive timeouts
+    double backoff_;
+    int timeoutCount_;
+    // Ring of the timeouts that expired, oldest first from historyNext_
+    double history_[PMAC_TIMEOUT_HISTORY];
+    int historyNext_;
+    int historyCount_;
+};
+
+#endif /* PMACAPP_SRC_PMACTIMEOUTESTIMATOR_H_ */
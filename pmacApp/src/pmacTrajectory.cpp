@@ -8,236 +8,467 @@
 #include "pmacTrajectory.h"
 
 pmacTrajectory::pmacTrajectory() : pmacDebugger("pmacTrajectory") {
-  noOfAxes_ = 9;
+  noOfAxes_ = PMAC_TRAJECTORY_AXES;
+  axisMask_ = PMAC_TRAJECTORY_ALL_AXES;
   totalNoOfPoints_ = 0;
   noOfValidPoints_ = 0;
-  profilePositions_ = NULL;
-  profileVelocities_ = NULL;
-  profileTimes_ = NULL;
-  profileUser_ = NULL;
-  profileVelMode_ = NULL;
   static const char *functionName = "pmacTrajectory";
 
   debug(DEBUG_FLOW, functionName);
 }
 
 pmacTrajectory::~pmacTrajectory() {
+  this->release();
+}
+
+/**
+ * Prepare the store for a new trajectory.  No storage is allocated here, it
+ * grows a chunk at a time as points are appended.
+ *
+ * @param noOfPoints Maximum number of points in the trajectory.
+ * @param axisMask Bitmap of the axes included in the trajectory, only these
+ *                 axes are stored.
+ * @return asynStatus
+ */
+asynStatus pmacTrajectory::initialise(int noOfPoints, int axisMask) {
+  asynStatus status = asynSuccess;
+  static const char *functionName = "initialise";
+
+  debug(DEBUG_TRACE, functionName, "Called with noOfPoints", noOfPoints);
+
+  if (noOfPoints < 0) {
+    debug(DEBUG_ERROR, functionName, "Invalid number of points", noOfPoints);
+    status = asynError;
+  }
+
+  // Release the storage of any previous trajectory
+  this->release();
+
+  // If all checks were successful then set the number of points in this scan
+  if (status == asynSuccess) {
+    axisMask_ = axisMask & PMAC_TRAJECTORY_ALL_AXES;
+    totalNoOfPoints_ = noOfPoints;
+  }
+
+  return status;
+}
+
+/**
+ * Allocate the storage for one chunk of points as a single block.
+ *
+ * @return The new chunk, or NULL if the memory could not be allocated.
+ */
+pmacTrajectoryChunk *pmacTrajectory::allocateChunk() {
   int axis = 0;
-  if (profilePositions_) {
-    for (axis = 0; axis < noOfAxes_; axis++) {
-      if (profilePositions_[axis]) {
-        free(profilePositions_[axis]);
-      }
+  int noOfStoredAxes = 0;
+  static const char *functionName = "allocateChunk";
+
+  for (axis = 0; axis < noOfAxes_; axis++) {
+    if ((1 << axis & axisMask_) > 0) {
+      noOfStoredAxes++;
     }
-    free(profilePositions_);
   }
 
-  if (profileVelocities_) {
-    for (axis = 0; axis < noOfAxes_; axis++) {
-      if (profileVelocities_[axis]) {
-        free(profileVelocities_[axis]);
-      }
+  size_t size = sizeof(pmacTrajectoryChunk) +
+                PMAC_TRAJECTORY_CHUNK_POINTS * (2 * noOfStoredAxes * sizeof(double) +
+                                                2 * sizeof(int));
+  pmacTrajectoryChunk *chunk = (pmacTrajectoryChunk *) malloc(size);
+  if (chunk == NULL) {
+    debug(DEBUG_ERROR, functionName, "Unable to allocate memory for the trajectory scan points");
+    return NULL;
+  }
+
+  // Carve the arrays out of the block, doubles first to keep them aligned
+  double *dPtr = (double *) (chunk + 1);
+  for (axis = 0; axis < noOfAxes_; axis++) {
+    chunk->positions[axis] = NULL;
+    chunk->velocities[axis] = NULL;
+    if ((1 << axis & axisMask_) > 0) {
+      chunk->positions[axis] = dPtr;
+      dPtr += PMAC_TRAJECTORY_CHUNK_POINTS;
+      chunk->velocities[axis] = dPtr;
+      dPtr += PMAC_TRAJECTORY_CHUNK_POINTS;
     }
-    free(profileVelocities_);
   }
+  chunk->times = (int *) dPtr;
+  chunk->user = chunk->times + PMAC_TRAJECTORY_CHUNK_POINTS;
 
-  if (profileTimes_) {
-    free(profileTimes_);
-  }
-  if (profileUser_) {
-    free(profileUser_);
-  }
-  if (profileVelMode_) {
-    free(profileVelMode_);
-  }
+  return chunk;
 }
 
-asynStatus pmacTrajectory::initialise(int noOfPoints) {
+asynStatus pmacTrajectory::append(double **positions, double **velocities, double *times, int *user,
+                                  int noOfPoints) {
   asynStatus status = asynSuccess;
+  pmacTrajectorySlice slice;
   int axis = 0;
-  static const char *functionName = "initialise";
+  int counter = 0;
+  static const char *functionName = "append";
 
   debug(DEBUG_TRACE, functionName, "Called with noOfPoints", noOfPoints);
 
-  // Initialise the position array
-  if (profilePositions_) {
-    for (axis = 0; axis < noOfAxes_; axis++) {
-      if (profilePositions_[axis]) {
-        free(profilePositions_[axis]);
+  // Copy the points into the free space after the valid points
+  while (counter < noOfPoints && status == asynSuccess) {
+    status = this->getAppendSlice(counter, noOfPoints - counter, &slice);
+    if (status == asynSuccess) {
+      // Memory copy the positions and velocities of the stored axes
+      for (axis = 0; axis < noOfAxes_; axis++) {
+        if ((1 << axis & axisMask_) > 0) {
+          memcpy(slice.positions[axis], &positions[axis][counter], (slice.count * sizeof(double)));
+          memcpy(slice.velocities[axis], &velocities[axis][counter],
+                 (slice.count * sizeof(double)));
+        }
       }
-    }
-    free(profilePositions_);
-  }
-  profilePositions_ = (double **) malloc(sizeof(double *) * noOfAxes_);
-  if (profilePositions_ == NULL) {
-    debug(DEBUG_ERROR, functionName, "Unable to allocate memory for the trajectory scan positions");
-    status = asynError;
-  }
-  if (status == asynSuccess) {
-    for (axis = 0; axis < noOfAxes_; axis++) {
-      profilePositions_[axis] = (double *) malloc(sizeof(double) * noOfPoints);
-      if (profilePositions_[axis] == NULL) {
-        debug(DEBUG_ERROR, functionName,
-              "Unable to allocate memory for the trajectory scan positions");
-        status = asynError;
+      // Copy the times and memory copy the user modes
+      for (int index = 0; index < slice.count; index++) {
+        slice.times[index] = (int) (times[counter + index]);
       }
+      memcpy(slice.user, &user[counter], (slice.count * sizeof(int)));
+      counter += slice.count;
     }
   }
 
-  // Initialise the velocity array
-  if (profileVelocities_) {
-    for (axis = 0; axis < noOfAxes_; axis++) {
-      if (profileVelocities_[axis]) {
-        free(profileVelocities_[axis]);
-      }
-    }
-    free(profileVelocities_);
-  }
-  profileVelocities_ = (double **) malloc(sizeof(double *) * noOfAxes_);
-  if (profileVelocities_ == NULL) {
-    debug(DEBUG_ERROR, functionName, "Unable to allocate memory for the trajectory scan velocities");
-    status = asynError;
-  }
+  // Check the points and set the number of valid points
   if (status == asynSuccess) {
-    for (axis = 0; axis < noOfAxes_; axis++) {
-      profileVelocities_[axis] = (double *) malloc(sizeof(double) * noOfPoints);
-      if (profileVelocities_[axis] == NULL) {
-        debug(DEBUG_ERROR, functionName,
-              "Unable to allocate memory for the trajectory scan velocities");
-        status = asynError;
-      }
-    }
+    status = this->commit(noOfPoints);
   }
 
-  // Initialise the time array
-  if (status == asynSuccess) {
-    if (profileTimes_) {
-      free(profileTimes_);
-    }
-    profileTimes_ = (int *) malloc(sizeof(int) * noOfPoints);
-    if (profileTimes_ == NULL) {
-      debug(DEBUG_ERROR, functionName, "Unable to allocate memory for the trajectory scan times");
-      status = asynError;
-    }
-  }
+  return status;
+}
 
-  // Initialise the user mode array
-  if (status == asynSuccess) {
-    if (profileUser_) {
-      free(profileUser_);
-    }
-    profileUser_ = (int *) malloc(sizeof(int) * noOfPoints);
-    if (profileUser_ == NULL) {
-      debug(DEBUG_ERROR, functionName,
-            "Unable to allocate memory for the trajectory scan user mode array");
-      status = asynError;
+/**
+ * Point a slice at a run of points within one chunk, which must exist.
+ */
+void pmacTrajectory::fillSlice(int index, int maxPoints, pmacTrajectorySlice *slice) {
+  pmacTrajectoryChunk *chunk = chunks_[index >> PMAC_TRAJECTORY_CHUNK_SHIFT];
+  int offset = index & (PMAC_TRAJECTORY_CHUNK_POINTS - 1);
+
+  slice->first = index;
+  slice->count = PMAC_TRAJECTORY_CHUNK_POINTS - offset;
+  if (slice->count > maxPoints) {
+    slice->count = maxPoints;
+  }
+  for (int axis = 0; axis < noOfAxes_; axis++) {
+    slice->positions[axis] = NULL;
+    slice->velocities[axis] = NULL;
+    if ((1 << axis & axisMask_) > 0) {
+      slice->positions[axis] = chunk->positions[axis] + offset;
+      slice->velocities[axis] = chunk->velocities[axis] + offset;
     }
   }
+  slice->times = chunk->times + offset;
+  slice->user = chunk->user + offset;
+}
 
-  // Initialise the velocity mode array
-  if (status == asynSuccess) {
-    if (profileVelMode_) {
-      free(profileVelMode_);
-    }
-    profileVelMode_ = (int *) malloc(sizeof(int) * noOfPoints);
-    if (profileVelMode_ == NULL) {
-      debug(DEBUG_ERROR, functionName,
-            "Unable to allocate memory for the trajectory scan velocity mode array");
-      status = asynError;
-    }
+/**
+ * Get direct access to a run of valid points, for reading them without a
+ * call per value.  The run ends at the end of the chunk holding the first
+ * point, so a slice may contain fewer points than requested.
+ *
+ * @param index Index of the first point.
+ * @param maxPoints Maximum number of points in the slice.
+ * @param slice Filled in with the arrays of the points.
+ * @return asynStatus
+ */
+asynStatus pmacTrajectory::getSlice(int index, int maxPoints, pmacTrajectorySlice *slice) {
+  static const char *functionName = "getSlice";
+
+  // Check the index is valid
+  if (index < 0 || index >= noOfValidPoints_ || maxPoints < 1) {
+    debug(DEBUG_ERROR, functionName, "Invalid index requested", index);
+    return asynError;
   }
+  if (maxPoints > noOfValidPoints_ - index) {
+    maxPoints = noOfValidPoints_ - index;
+  }
+  this->fillSlice(index, maxPoints, slice);
+  return asynSuccess;
+}
 
-  // If all allocation was successful then set the number of points in this scan
-  if (status == asynSuccess) {
-    totalNoOfPoints_ = noOfPoints;
-    noOfValidPoints_ = 0;
+/**
+ * Get direct access to the free space after the valid points, adding a chunk
+ * if needed, so that new points can be written (or converted) straight into
+ * the store.  The points become valid when they are committed.
+ *
+ * @param offset Offset of the first point from the end of the valid points.
+ * @param maxPoints Maximum number of points in the slice.
+ * @param slice Filled in with the arrays of the points.
+ * @return asynStatus
+ */
+asynStatus pmacTrajectory::getAppendSlice(int offset, int maxPoints, pmacTrajectorySlice *slice) {
+  int index = noOfValidPoints_ + offset;
+  static const char *functionName = "getAppendSlice";
+
+  // First check that we aren't being asked for more points that we have room for
+  if (offset < 0 || maxPoints < 1 || (index + maxPoints) > totalNoOfPoints_) {
+    debug(DEBUG_ERROR, functionName, "Not enough storage to append all of these points");
+    return asynError;
   }
 
-  return status;
+  // Add chunks as they are needed
+  while ((size_t) (index >> PMAC_TRAJECTORY_CHUNK_SHIFT) >= chunks_.size()) {
+    pmacTrajectoryChunk *chunk = this->allocateChunk();
+    if (chunk == NULL) {
+      return asynError;
+    }
+    chunks_.push_back(chunk);
+  }
+  this->fillSlice(index, maxPoints, slice);
+  return asynSuccess;
 }
 
-asynStatus pmacTrajectory::append(double **positions, double **velocities, double *times, int *user,
-                                  int noOfPoints) {
+/**
+ * Make points written through getAppendSlice valid, once their times and
+ * user modes have been checked.
+ *
+ * @param noOfPoints Number of points written after the valid points.
+ * @return asynStatus
+ */
+asynStatus pmacTrajectory::commit(int noOfPoints) {
   asynStatus status = asynSuccess;
-  int axis = 0;
+  pmacTrajectorySlice slice;
   int counter = 0;
-  static const char *functionName = "append";
-
-  debug(DEBUG_TRACE, functionName, "Called with noOfPoints", noOfPoints);
+  static const char *functionName = "commit";
 
   // First check that we aren't being asked to append more points that we have room for
-  if ((noOfValidPoints_ + noOfPoints) > totalNoOfPoints_) {
+  if (noOfPoints < 0 || (noOfValidPoints_ + noOfPoints) > totalNoOfPoints_ ||
+      ((noOfValidPoints_ + noOfPoints + PMAC_TRAJECTORY_CHUNK_POINTS - 1) >>
+       PMAC_TRAJECTORY_CHUNK_SHIFT) > (int) chunks_.size()) {
     debug(DEBUG_ERROR, functionName, "Not enough storage to append all of these points");
     status = asynError;
   }
 
-  // Check that the supplied times are not out of range (> 24 bit)
-  if (status == asynSuccess) {
-    counter = 0;
-    // Check for any invalid times
-    while (counter < noOfPoints && status == asynSuccess) {
+  while (counter < noOfPoints && status == asynSuccess) {
+    this->fillSlice(noOfValidPoints_ + counter, noOfPoints - counter, &slice);
+    for (int index = 0; index < slice.count && status == asynSuccess; index++) {
       // Profile times must be less than 24bit
-      if (((int) times[counter]) > 0xFFFFFF) {
-        debug(DEBUG_ERROR, functionName, "Invalid profile time value (> 24 bit)", times[counter]);
+      if (slice.times[index] > 0xFFFFFF) {
+        debug(DEBUG_ERROR, functionName, "Invalid profile time value (> 24 bit)",
+              slice.times[index]);
         status = asynError;
       }
-      counter++;
-    }
-  }
-
-  // Check that the supplied user mode values are not out of range (> 4 bit)
-  if (status == asynSuccess) {
-    counter = 0;
-    // Check for any invalid user mode values
-    while (counter < noOfPoints && status == asynSuccess) {
       // User mode values must be less than 4bit
-      if (user[counter] > 0xF) {
-        debug(DEBUG_ERROR, functionName, "Invalid user mode value (> 4 bit)", user[counter]);
+      if (slice.user[index] > 0xF) {
+        debug(DEBUG_ERROR, functionName, "Invalid user mode value (> 4 bit)", slice.user[index]);
         status = asynError;
       }
-      counter++;
     }
+    counter += slice.count;
   }
 
-  // Memory copy the positions into the correct locations
+  // Set the number of valid points
   if (status == asynSuccess) {
-    for (axis = 0; axis < noOfAxes_; axis++) {
-      double *pPtr = &profilePositions_[axis][noOfValidPoints_];
-      memcpy(pPtr, positions[axis], (noOfPoints * sizeof(double)));
-    }
+    noOfValidPoints_ += noOfPoints;
   }
 
-    // Memory copy the velocities into the correct locations
-  if (status == asynSuccess) {
-    for (axis = 0; axis < noOfAxes_; axis++) {
-      double *vPtr = &profileVelocities_[axis][noOfValidPoints_];
-      memcpy(vPtr, velocities[axis], (noOfPoints * sizeof(double)));
-    }
+  return status;
+}
+
+/**
+ * Convert positions or velocities from EGU to counts.  The values can be
+ * converted in place.
+ *
+ * @param egu Values in EGU.
+ * @param noOfPoints Number of values.
+ * @param offset Offset removed before scaling, 0.0 for velocities.
+ * @param resolution Size of one count in EGU.
+ * @param counts The converted values.
+ */
+void pmacTrajectory::convertToCounts(const double *egu, int noOfPoints, double offset,
+                                     double resolution, double *counts) {
+  for (int index = 0; index < noOfPoints; index++) {
+    counts[index] = (egu[index] - offset) / resolution;
   }
+}
 
-  // Copy the times into the correct locations
-  if (status == asynSuccess) {
-    int *tPtr = &profileTimes_[noOfValidPoints_];
-    for (counter = 0; counter < noOfPoints; counter++) {
-      *tPtr = (int) (times[counter]);
-      tPtr++;
+/**
+ * Calculate the velocities of a batch of points from the positions and times
+ * around them, according to the velocity mode of each point.
+ *
+ * Each run of points sharing a mode is calculated by a loop specialised for
+ * that mode with no branches in it, so that the compiler can vectorise it.
+ * Mode 1 depends on the velocity calculated for the point before, so those
+ * runs are calculated in order.
+ *
+ * The position and time after the last point are read, so the positions and
+ * times must hold noOfPoints + 1 values.
+ *
+ * @param positions Positions of the points.
+ * @param times Times from the point before to each point, in microseconds.
+ * @param modes Velocity mode of each point.
+ * @param noOfPoints Number of points.
+ * @param previousPosition Position of the point before the first.
+ * @param previousVelocity Velocity of the point before the first.
+ * @param velocities The calculated velocities, in position units per second.
+ * @param first Index of the first point in the scan, for error messages.
+ * @return asynStatus
+ */
+asynStatus pmacTrajectory::calculateVelocities(const double *positions, const double *times,
+                                               const int *modes, int noOfPoints,
+                                               double previousPosition, double previousVelocity,
+                                               double *velocities, int first) {
+  asynStatus status = asynSuccess;
+  int start = 0;
+  int end = 0;
+  int index = 0;
+
+  while (start < noOfPoints && status == asynSuccess) {
+    // Find the run of points with the same mode, kept short enough that the
+    // times checked are still in the cache when the velocities are calculated
+    end = start + 1;
+    while (end < noOfPoints && end - start < PMAC_TRAJECTORY_VELOCITY_BLOCK &&
+           modes[end] == modes[start]) {
+      end++;
     }
+    status = this->checkVelocityTimes(times, modes[start], start, end, first);
+    if (status == asynSuccess) {
+      if (start > 0) {
+        previousPosition = positions[start - 1];
+        previousVelocity = velocities[start - 1];
+      }
+      switch (modes[start]) {
+        // Average Previous -> Next
+        case 0:
+          velocities[start] = 1000000 / (times[start] + times[start + 1]) *
+                              (positions[start + 1] - previousPosition);
+          for (index = start + 1; index < end; index++) {
+            velocities[index] = 1000000 / (times[index] + times[index + 1]) *
+                                (positions[index + 1] - positions[index - 1]);
+          }
+          break;
+
+        // Real Previous -> Current
+        case 1:
+          for (index = start; index < end; index++) {
+            velocities[index] = 2.0 * (1000000 / times[index]) *
+                                (positions[index] - previousPosition) - previousVelocity;
+            previousPosition = positions[index];
+            previousVelocity = velocities[index];
+          }
+          break;
+
+        // Average Previous -> Current
+        case 2:
+          velocities[start] = 1000000 / times[start] * (positions[start] - previousPosition);
+          for (index = start + 1; index < end; index++) {
+            velocities[index] = 1000000 / times[index] * (positions[index] - positions[index - 1]);
+          }
+          break;
+
+        // Zero
+        case 3:
+          for (index = start; index < end; index++) {
+            velocities[index] = 0.0;
+          }
+          break;
+
+        // Average Current -> Next
+        case 4:
+          for (index = start; index < end; index++) {
+            velocities[index] = 1000000 / times[index + 1] * (positions[index + 1] - positions[index]);
+          }
+          break;
+      }
+    }
+    start = end;
   }
 
-  // Memory copy the user modes into the correct locations
-  if (status == asynSuccess) {
-    int *uPtr = &profileUser_[noOfValidPoints_];
-    memcpy(uPtr, user, (noOfPoints * sizeof(int)));
+  return status;
+}
+
+/**
+ * Check the times used to calculate the velocities of a run of points that
+ * share a velocity mode.  The bad times are counted without branching, and
+ * only searched for when there are some.
+ *
+ * @param times Times from the point before to each point.
+ * @param mode Velocity mode of the run.
+ * @param start Index of the first point of the run.
+ * @param end Index after the last point of the run.
+ * @param first Index of the first point in the scan, for error messages.
+ * @return asynStatus
+ */
+asynStatus pmacTrajectory::checkVelocityTimes(const double *times, int mode, int start, int end,
+                                              int first) {
+  asynStatus status = asynSuccess;
+  int invalid = 0;
+  int index = 0;
+  static const char *functionName = "checkVelocityTimes";
+
+  switch (mode) {
+    case 0:
+      for (index = start; index < end; index++) {
+        invalid += (times[index] <= 0) & (times[index + 1] <= 0);
+      }
+      for (index = start; index < end && invalid > 0; index++) {
+        if (times[index] <= 0 && times[index + 1] <= 0) {
+          debugf(DEBUG_ERROR, functionName, "Invalid times (%d and %d) at points %d and %d",
+                 (int) times[index], (int) times[index + 1], first + index, first + index + 1);
+          break;
+        }
+      }
+      break;
+
+    case 1:
+    case 2:
+      for (index = start; index < end; index++) {
+        invalid += (times[index] <= 0);
+      }
+      for (index = start; index < end && invalid > 0; index++) {
+        if (times[index] <= 0) {
+          debugf(DEBUG_ERROR, functionName, "Invalid time (%d) at point %d",
+                 (int) times[index], first + index);
+          break;
+        }
+      }
+      break;
+
+    case 3:
+      break;
+
+    case 4:
+      for (index = start; index < end; index++) {
+        invalid += (times[index + 1] <= 0);
+      }
+      for (index = start; index < end && invalid > 0; index++) {
+        if (times[index + 1] <= 0) {
+          debugf(DEBUG_ERROR, functionName, "Invalid time (%d) at point %d",
+                 (int) times[index + 1], first + index + 1);
+          break;
+        }
+      }
+      break;
+
+    default:
+      debugf(DEBUG_ERROR, functionName, "Invalid velocity mode (%d) at point %d",
+             mode, first + start);
+      invalid = 1;
+      break;
   }
 
-  // Set the number of valid points
-  if (status == asynSuccess) {
-    noOfValidPoints_ += noOfPoints;
+  if (invalid > 0) {
+    status = asynError;
   }
 
   return status;
 }
 
+/**
+ * Free the storage of the trajectory, once it has been executed or before a
+ * new one is built.
+ */
+void pmacTrajectory::release() {
+  static const char *functionName = "release";
+
+  debug(DEBUG_TRACE, functionName, "Releasing chunks", (int) chunks_.size());
+
+  for (size_t index = 0; index < chunks_.size(); index++) {
+    free(chunks_[index]);
+  }
+  chunks_.clear();
+  totalNoOfPoints_ = 0;
+  noOfValidPoints_ = 0;
+}
+
 int pmacTrajectory::getNoOfAxes() {
   static const char *functionName = "getNoOfAxes";
   debug(DEBUG_TRACE, functionName, "noOfAxes_", noOfAxes_);
@@ -256,6 +487,10 @@ int pmacTrajectory::getNoOfValidPoints() {
   return noOfValidPoints_;
 }
 
+int pmacTrajectory::getNoOfChunks() {
+  return (int) chunks_.size();
+}
+
 asynStatus pmacTrajectory::getTime(int index, int *time) {
   asynStatus status = asynSuccess;
   static const char *functionName = "readTime";
@@ -269,7 +504,8 @@ asynStatus pmacTrajectory::getTime(int index, int *time) {
   }
 
   if (status == asynSuccess) {
-    *time = profileTimes_[index];
+    pmacTrajectoryChunk *chunk = chunks_[index >> PMAC_TRAJECTORY_CHUNK_SHIFT];
+    *time = chunk->times[index & (PMAC_TRAJECTORY_CHUNK_POINTS - 1)];
   }
 
   return status;
@@ -288,7 +524,8 @@ asynStatus pmacTrajectory::getUserMode(int index, int *user) {
   }
 
   if (status == asynSuccess) {
-    *user = profileUser_[index];
+    pmacTrajectoryChunk *chunk = chunks_[index >> PMAC_TRAJECTORY_CHUNK_SHIFT];
+    *user = chunk->user[index & (PMAC_TRAJECTORY_CHUNK_POINTS - 1)];
   }
 
   return status;
@@ -301,8 +538,8 @@ asynStatus pmacTrajectory::getPosition(int axis, int index, double *position) {
   debug(DEBUG_TRACE, functionName, "Called with axis", axis);
   debug(DEBUG_TRACE, functionName, "Called with index", index);
 
-  // Check the axis is valid
-  if (axis < 0 || axis >= noOfAxes_) {
+  // Check the axis is valid and stored
+  if (axis < 0 || axis >= noOfAxes_ || (1 << axis & axisMask_) == 0) {
     debug(DEBUG_ERROR, functionName, "Invalid axis requested", axis);
     status = asynError;
   }
@@ -314,7 +551,8 @@ asynStatus pmacTrajectory::getPosition(int axis, int index, double *position) {
   }
 
   if (status == asynSuccess) {
-    *position = profilePositions_[axis][index];
+    pmacTrajectoryChunk *chunk = chunks_[index >> PMAC_TRAJECTORY_CHUNK_SHIFT];
+    *position = chunk->positions[axis][index & (PMAC_TRAJECTORY_CHUNK_POINTS - 1)];
   }
 
   return status;
@@ -326,8 +564,8 @@ asynStatus pmacTrajectory::getVelocity(int axis, int index, double *velocity) {
   debug(DEBUG_TRACE, functionName, "Called with axis", axis);
   debug(DEBUG_TRACE, functionName, "Called with index", index);
 
-  // Check the axis is valid
-  if (axis < 0 || axis >= noOfAxes_) {
+  // Check the axis is valid and stored
+  if (axis < 0 || axis >= noOfAxes_ || (1 << axis & axisMask_) == 0) {
     debug(DEBUG_ERROR, functionName, "Invalid axis requested", axis);
     status = asynError;
   }
@@ -338,7 +576,8 @@ asynStatus pmacTrajectory::getVelocity(int axis, int index, double *velocity) {
     status = asynError;
   }
   if (status == asynSuccess) {
-    *velocity = profileVelocities_[axis][index];
+    pmacTrajectoryChunk *chunk = chunks_[index >> PMAC_TRAJECTORY_CHUNK_SHIFT];
+    *velocity = chunk->velocities[axis][index & (PMAC_TRAJECTORY_CHUNK_POINTS - 1)];
   }
 
   return status;
@@ -347,14 +586,24 @@ asynStatus pmacTrajectory::getVelocity(int axis, int index, double *velocity) {
 
 void pmacTrajectory::report() {
   static const char *functionName = "report";
+  int time = 0;
+  int user = 0;
+  double position = 0.0;
   debug(DEBUG_ERROR, functionName, "totalNoOfPoints_", totalNoOfPoints_);
   debug(DEBUG_ERROR, functionName, "noOfValidPoints_", noOfValidPoints_);
+  debug(DEBUG_ERROR, functionName, "axisMask_", axisMask_);
+  debug(DEBUG_ERROR, functionName, "chunks", (int) chunks_.size());
   for (int index = 0; index < noOfValidPoints_; index++) {
     debug(DEBUG_ERROR, functionName, "INDEX", index);
-    debug(DEBUG_ERROR, functionName, "Time", profileTimes_[index]);
-    debug(DEBUG_ERROR, functionName, "User", profileUser_[index]);
-    debug(DEBUG_ERROR, functionName, "Velocity", profileVelMode_[index]);
-    debug(DEBUG_ERROR, functionName, "Axis[0]", profilePositions_[0][index]);
-    debug(DEBUG_ERROR, functionName, "Axis[1]", profilePositions_[1][index]);
+    getTime(index, &time);
+    debug(DEBUG_ERROR, functionName, "Time", time);
+    getUserMode(index, &user);
+    debug(DEBUG_ERROR, functionName, "User", user);
+    for (int axis = 0; axis < noOfAxes_; axis++) {
+      if ((1 << axis & axisMask_) > 0) {
+        getPosition(axis, index, &position);
+        debugf(DEBUG_ERROR, functionName, "Axis[%d] %f", axis, position);
+      }
+    }
   }
 }
@@ -9,24 +9,72 @@
 #define PMACAPP_SRC_PMACTRAJECTORY_H_
 
 #include <asynDriver.h>
+#include <vector>
 #include "pmacDebugger.h"
 
+#define PMAC_TRAJECTORY_AXES 9
+#define PMAC_TRAJECTORY_ALL_AXES 0x1FF
+
+// Points are stored in chunks, allocated as the trajectory grows
+#define PMAC_TRAJECTORY_CHUNK_SHIFT 14
+#define PMAC_TRAJECTORY_CHUNK_POINTS (1 << PMAC_TRAJECTORY_CHUNK_SHIFT)
+
+// Longest run of points calculated in one pass by calculateVelocities
+#define PMAC_TRAJECTORY_VELOCITY_BLOCK 256
+
+// A block of PMAC_TRAJECTORY_CHUNK_POINTS consecutive points.  Arrays are only
+// allocated for the axes in the trajectory axis mask, the others are NULL
+struct pmacTrajectoryChunk {
+    double *positions[PMAC_TRAJECTORY_AXES];
+    double *velocities[PMAC_TRAJECTORY_AXES];
+    int *times;
+    int *user;
+};
+
+// A run of consecutive points held in one chunk, giving direct access to the
+// stored arrays.  The arrays of axes that are not stored are NULL
+struct pmacTrajectorySlice {
+    int first;                      // Index of the first point
+    int count;                      // Number of points
+    double *positions[PMAC_TRAJECTORY_AXES];
+    double *velocities[PMAC_TRAJECTORY_AXES];
+    int *times;
+    int *user;
+};
+
 class pmacTrajectory : public pmacDebugger {
 public:
     pmacTrajectory();
 
     virtual ~pmacTrajectory();
 
-    asynStatus initialise(int noOfPoints);
+    asynStatus initialise(int noOfPoints, int axisMask = PMAC_TRAJECTORY_ALL_AXES);
 
     asynStatus append(double **positions, double **velocities, double *times, int *user, int noOfPoints);
 
+    asynStatus getSlice(int index, int maxPoints, pmacTrajectorySlice *slice);
+
+    asynStatus getAppendSlice(int offset, int maxPoints, pmacTrajectorySlice *slice);
+
+    asynStatus commit(int noOfPoints);
+
+    static void convertToCounts(const double *egu, int noOfPoints, double offset,
+                                double resolution, double *counts);
+
+    asynStatus calculateVelocities(const double *positions, const double *times, const int *modes,
+                                   int noOfPoints, double previousPosition,
+                                   double previousVelocity, double *velocities, int first);
+
+    void release();
+
     int getNoOfAxes();
 
     int getTotalNoOfPoints();
 
     int getNoOfValidPoints();
 
+    int getNoOfChunks();
+
     asynStatus getTime(int index, int *time);
 
     asynStatus getUserMode(int index, int *user);
@@ -38,14 +86,17 @@ public:
     void report();
 
 private:
+    pmacTrajectoryChunk *allocateChunk();
+
+    void fillSlice(int index, int maxPoints, pmacTrajectorySlice *slice);
+
+    asynStatus checkVelocityTimes(const double *times, int mode, int start, int end, int first);
+
     int noOfAxes_;
+    int axisMask_;                  // Bitmap of the axes that are stored
     int totalNoOfPoints_;           // Total number of points in the scan
     int noOfValidPoints_;           // Number of prepared points in the scan (based on delta times)
-    double **profilePositions_;     // 2D array of profile positions (1 array for each axis)
-    double **profileVelocities_;    // 2D array of profile velocities (1 array for each axis)
-    int *profileTimes_;             // Array of profile delta times for scan
-    int *profileUser_;              // Array of profile user values
-    int *profileVelMode_;           // Array of profile velocity modes
+    std::vector<pmacTrajectoryChunk *> chunks_;  // Storage for the valid points
 };
 
 #endif /* PMACAPP_SRC_PMACTRAJECTORY_H_ */
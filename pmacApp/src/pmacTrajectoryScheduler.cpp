@@ -0,0 +1,161 @@
+/*
+ * pmacTrajectoryScheduler.cpp
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "pmacTrajectoryScheduler.h"
+
+pmacTrajectoryScheduler::pmacTrajectoryScheduler() :
+        filling_(false),
+        fillStart_(0.0),
+        headroom_(-1.0),
+        minStatusPeriod_(0.0),
+        lastStatusRead_(0.0),
+        fillPoints_(0),
+        pointsWritten_(0),
+        fillBytes_(0),
+        bytesPerPoint_(0.0),
+        bandwidth_(0.0) {
+}
+
+pmacTrajectoryScheduler::~pmacTrajectoryScheduler() {
+}
+
+/**
+ * Begin a trajectory buffer fill.
+ *
+ * @param now The current time in seconds.
+ * @param points Number of points to be written by the fill.
+ * @param headroom Seconds until the PMAC needs the first of the new points,
+ *                 negative if the scan has not started.
+ * @param minStatusPeriod Longest time allowed between status reads.
+ */
+void pmacTrajectoryScheduler::startFill(double now, int points, double headroom,
+                                        double minStatusPeriod) {
+  filling_ = true;
+  fillStart_ = now;
+  headroom_ = headroom;
+  minStatusPeriod_ = minStatusPeriod;
+  fillPoints_ = points;
+  pointsWritten_ = 0;
+  fillBytes_ = 0;
+}
+
+/**
+ * Record progress through the fill.
+ *
+ * @param points Number of points written since the last call.
+ */
+void pmacTrajectoryScheduler::pointsWritten(int points) {
+  pointsWritten_ += points;
+}
+
+/**
+ * Record a completed trajectory write and update the bandwidth estimate,
+ * which is smoothed over recent writes.
+ *
+ * @param bytes Bytes written and read back.
+ * @param seconds Time taken for the exchange.
+ */
+void pmacTrajectoryScheduler::recordTransfer(int bytes, double seconds) {
+  if (seconds > 0.0 && bytes > 0) {
+    double bandwidth = (double) bytes / seconds;
+    if (bandwidth_ > 0.0) {
+      bandwidth_ = 0.75 * bandwidth_ + 0.25 * bandwidth;
+    } else {
+      bandwidth_ = bandwidth;
+    }
+  }
+  if (filling_) {
+    fillBytes_ += bytes;
+  }
+}
+
+/**
+ * End the fill, keeping its size per point for estimating the next one.
+ */
+void pmacTrajectoryScheduler::endFill() {
+  if (filling_ && pointsWritten_ > 0) {
+    bytesPerPoint_ = (double) fillBytes_ / (double) pointsWritten_;
+  }
+  filling_ = false;
+}
+
+bool pmacTrajectoryScheduler::isFilling() {
+  return filling_;
+}
+
+/**
+ * Estimate the time needed to write the rest of the fill.
+ *
+ * @return Seconds, or a negative value until the bandwidth has been measured.
+ */
+double pmacTrajectoryScheduler::estimateRemaining() {
+  double bytesPerPoint = bytesPerPoint_;
+  if (pointsWritten_ > 0 && fillBytes_ > 0) {
+    bytesPerPoint = (double) fillBytes_ / (double) pointsWritten_;
+  }
+  if (bandwidth_ <= 0.0 || bytesPerPoint <= 0.0) {
+    return -1.0;
+  }
+  int remaining = fillPoints_ - pointsWritten_;
+  if (remaining < 0) {
+    remaining = 0;
+  }
+  return remaining * bytesPerPoint / bandwidth_;
+}
+
+/**
+ * Whether a read taking readTime can be fitted into the fill without it
+ * finishing after the PMAC needs the points.  Always true outside a fill.
+ *
+ * @param now The current time in seconds.
+ * @param readTime Expected duration of the read in seconds.
+ */
+bool pmacTrajectoryScheduler::hasSlack(double now, double readTime) {
+  if (!filling_ || headroom_ < 0.0) {
+    return true;
+  }
+  double remaining = estimateRemaining();
+  if (remaining < 0.0) {
+    // Nothing measured yet, so make no promises
+    return false;
+  }
+  double slack = fillStart_ + headroom_ - now - remaining;
+  return slack > PMAC_SCHEDULER_SLACK_FACTOR * readTime;
+}
+
+/**
+ * Whether the fast status read should be made now: always outside a fill,
+ * and during a fill when the minimum status rate requires it or there is
+ * slack for it.
+ *
+ * @param now The current time in seconds.
+ * @param readTime Expected duration of the read in seconds.
+ */
+bool pmacTrajectoryScheduler::statusReadDue(double now, double readTime) {
+  if (!filling_) {
+    return true;
+  }
+  if (now - lastStatusRead_ >= minStatusPeriod_) {
+    return true;
+  }
+  return hasSlack(now, readTime);
+}
+
+/**
+ * Record that a fast status read has been made.
+ *
+ * @param now The current time in seconds.
+ */
+void pmacTrajectoryScheduler::statusRead(double now) {
+  lastStatusRead_ = now;
+}
+
+/**
+ * @return The smoothed trajectory write bandwidth in bytes per second.
+ */
+double pmacTrajectoryScheduler::readBandwidth() {
+  return bandwidth_;
+}
@@ -0,0 +1,62 @@
+/*
+ * pmacTrajectoryScheduler.h
+ *
+ *  Created on: 17 Oct 2026
+ *
+ * Decides when status reads may share the link with a trajectory buffer fill.
+ * Status is always read at a guaranteed minimum rate, and at the full poll
+ * rate whenever the measured write bandwidth shows that the fill will still
+ * complete before the PMAC runs out of points.
+ */
+
+#ifndef PMACAPP_SRC_PMACTRAJECTORYSCHEDULER_H_
+#define PMACAPP_SRC_PMACTRAJECTORYSCHEDULER_H_
+
+// A status read is only fitted into a fill when the spare time exceeds this
+// many times the duration of the read
+#define PMAC_SCHEDULER_SLACK_FACTOR 2.0
+
+class pmacTrajectoryScheduler {
+public:
+    pmacTrajectoryScheduler();
+
+    virtual ~pmacTrajectoryScheduler();
+
+    void startFill(double now, int points, double headroom, double minStatusPeriod);
+
+    void pointsWritten(int points);
+
+    void recordTransfer(int bytes, double seconds);
+
+    void endFill();
+
+    bool isFilling();
+
+    bool hasSlack(double now, double readTime);
+
+    bool statusReadDue(double now, double readTime);
+
+    void statusRead(double now);
+
+    double estimateRemaining();
+
+    double readBandwidth();
+
+private:
+    bool filling_;
+    // Times are in seconds, on the clock passed to startFill and statusRead
+    double fillStart_;
+    // Time from the start of the fill until the PMAC needs the new points,
+    // negative if there is no deadline (the scan has not started)
+    double headroom_;
+    double minStatusPeriod_;
+    double lastStatusRead_;
+    int fillPoints_;
+    int pointsWritten_;
+    int fillBytes_;
+    // Measured by previous fills, 0.0 until known
+    double bytesPerPoint_;
+    double bandwidth_;
+};
+
+#endif /* PMACAPP_SRC_PMACTRAJECTORYSCHEDULER_H_ */
@@ -21,9 +21,10 @@ MockPMACAsynDriver::MockPMACAsynDriver(const char *portName, double delay, int n
                  0)
 {
   delay_ = delay;
-  waitingForResponse_ = false;
+  pendingResponses_ = 0;
   response_ = "";
   only_once_ = false;
+  fail_writes_ = false;
 }
 
 MockPMACAsynDriver::~MockPMACAsynDriver()
@@ -37,7 +38,8 @@ asynStatus MockPMACAsynDriver::readOctet(asynUser *pasynUser,
                                          size_t *nActual,
                                          int *eomReason)
 {
-  if (waitingForResponse_){
+  // One response is returned for each write that has not yet been read back
+  if (pendingResponses_ > 0){
     if (!response_.empty()){
       strncpy(value, response_.c_str(), maxChars);
       if (response_.length() > maxChars){
@@ -50,8 +52,8 @@ asynStatus MockPMACAsynDriver::readOctet(asynUser *pasynUser,
     if(only_once_) {
       response_ = "";
     }
+    pendingResponses_--;
   }
-  waitingForResponse_ = false;
   return asynSuccess;
 }
 
@@ -62,7 +64,11 @@ asynStatus MockPMACAsynDriver::writeOctet(asynUser *pasynUser,
 {
   std::string input(value);
   writes_.push_back(input);
-  waitingForResponse_ = true;
+  // A failed write leaves nothing to read back, as if the link were down
+  if (fail_writes_){
+    return asynError;
+  }
+  pendingResponses_++;
   epicsThreadSleep(delay_);
   return asynSuccess;
 }
@@ -77,9 +83,19 @@ void MockPMACAsynDriver::setOnceOnly(void)
   only_once_ = true;
 }
 
+void MockPMACAsynDriver::setFailWrites(bool fail)
+{
+  this->lock();
+  fail_writes_ = fail;
+  this->unlock();
+}
+
 void MockPMACAsynDriver::clearStore()
 {
+  // Writes may arrive from the broker threads
+  this->lock();
   writes_.clear();
+  this->unlock();
 }
 
 bool MockPMACAsynDriver::checkForWrite(const std::string& item)
@@ -105,3 +121,11 @@ bool MockPMACAsynDriver::checkForWrite(const std::string& item, int index)
   return found;
 }
 
+int MockPMACAsynDriver::countWrites()
+{
+  int count = 0;
+  this->lock();
+  count = (int) writes_.size();
+  this->unlock();
+  return count;
+}
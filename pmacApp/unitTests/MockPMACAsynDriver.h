@@ -48,16 +48,19 @@ public:
 
   void setResponse(const std::string& response);
   void setOnceOnly();
+  void setFailWrites(bool fail);
   void clearStore();
   bool checkForWrite(const std::string& item);
   bool checkForWrite(const std::string& item, int index);
+  int countWrites();
 
 private:
-  bool waitingForResponse_;
+  int pendingResponses_;
   double delay_;
   std::vector<std::string> writes_;
   std::string response_;
   bool only_once_;
+  bool fail_writes_;
 
 };
 
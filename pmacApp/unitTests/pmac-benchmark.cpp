@@ -0,0 +1,262 @@
+/*
+ * pmac-benchmark.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *
+ * Times the trajectory velocity and position conversion kernels against the
+ * original point by point calculation, at 1M and 10M points, the command
+ * store reply parser against the original parser, and the controller update
+ * of the PMAC variable parameters read from each store.
+ */
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <tr1/memory>
+#include <epicsTime.h>
+#include <asynPortClient.h>
+
+#include "pmacTestingUtilities.h"
+#include "MockPMACAsynDriver.h"
+#include "pmacTrajectory.h"
+#include "pmacCommandStore.h"
+
+// Very naughty define to provide easy access to members for benchmarking
+#define private public
+#include "pmacController.h"
+
+// Number of times each calculation is repeated, the fastest is reported
+#define BENCHMARK_REPEATS 5
+
+static double fastest(double current, epicsTimeStamp *start)
+{
+  epicsTimeStamp end;
+  epicsTimeGetCurrent(&end);
+  double seconds = epicsTimeDiffInSeconds(&end, start);
+  return (current < 0.0 || seconds < current) ? seconds : current;
+}
+
+static void benchmark(pmacTrajectory *pTrajectory, int points, bool mixed)
+{
+  epicsTimeStamp start;
+  double referenceTime = -1.0;
+  double kernelTime = -1.0;
+  double originalConvertTime = -1.0;
+  double convertTime = -1.0;
+  int errors = 0;
+  std::vector<double> positions(points + 1);
+  std::vector<double> counts(points + 1);
+  std::vector<double> times(points + 1);
+  std::vector<int> modes(points + 1);
+  std::vector<double> expected(points);
+  std::vector<double> velocities(points);
+
+  fillVelocityTestPoints(&positions[0], &times[0], &modes[0], points);
+  if (!mixed) {
+    // A single run of average previous -> next, the usual case
+    for (int index = 0; index <= points; index++) {
+      modes[index] = 0;
+    }
+  }
+
+  for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+    epicsTimeGetCurrent(&start);
+    for (int index = 0; index < points; index++) {
+      counts[index] = (positions[index] - 0.5) / 0.001;
+    }
+    originalConvertTime = fastest(originalConvertTime, &start);
+
+    epicsTimeGetCurrent(&start);
+    pmacTrajectory::convertToCounts(&positions[0], points, 0.5, 0.001, &counts[0]);
+    convertTime = fastest(convertTime, &start);
+
+    epicsTimeGetCurrent(&start);
+    referenceVelocities(&positions[0], &times[0], &modes[0], points, 0.0, 0.0, &expected[0]);
+    referenceTime = fastest(referenceTime, &start);
+
+    epicsTimeGetCurrent(&start);
+    pTrajectory->calculateVelocities(&positions[0], &times[0], &modes[0], points, 0.0, 0.0,
+                                     &velocities[0], 0);
+    kernelTime = fastest(kernelTime, &start);
+  }
+
+  for (int index = 0; index < points; index++) {
+    if (velocities[index] != expected[index]) {
+      errors++;
+    }
+  }
+
+  printf("%9d points %-6s velocities %8.2f ms -> %8.2f ms (x%.1f)  "
+         "positions %8.2f ms -> %8.2f ms  mismatches %d\n",
+         points, mixed ? "mixed" : "mode 0", referenceTime * 1000.0, kernelTime * 1000.0,
+         referenceTime / kernelTime, originalConvertTime * 1000.0, convertTime * 1000.0, errors);
+}
+
+static void benchmarkReplies(int iterations)
+{
+  pmacCommandStore store;
+  StringHashtable table;
+  epicsTimeStamp start;
+  double legacyTime = -1.0;
+  double slotTime = -1.0;
+  int errors = 0;
+  char var[32];
+  std::string reply;
+
+  // A typical fast store command string for 10 axes
+  for (int axis = 1; axis <= 10; axis++) {
+    sprintf(var, "#%dP", axis);
+    store.addItem(var);
+    sprintf(var, "#%dF", axis);
+    store.addItem(var);
+    sprintf(var, "#%d?", axis);
+    store.addItem(var);
+    sprintf(var, "i%d24", axis);
+    store.addItem(var);
+  }
+  std::string cmdString = store.readCommandString(0);
+  size_t pos = 0;
+  for (int index = 0; index < store.size(); index++) {
+    size_t next = cmdString.find(" ", pos);
+    table.insert(cmdString.substr(pos, next - pos), "");
+    pos = next + 1;
+    snprintf(var, sizeof(var), "%d.%04d\r", 1000 + index, index);
+    reply += var;
+  }
+  reply += "\6";
+
+  for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+    epicsTimeGetCurrent(&start);
+    for (int loop = 0; loop < iterations; loop++) {
+      legacyUpdateReply(table, cmdString, reply);
+    }
+    legacyTime = fastest(legacyTime, &start);
+
+    epicsTimeGetCurrent(&start);
+    for (int loop = 0; loop < iterations; loop++) {
+      store.updateReply(0, reply.c_str());
+    }
+    slotTime = fastest(slotTime, &start);
+  }
+
+  pos = 0;
+  for (int index = 0; index < store.size(); index++) {
+    size_t next = cmdString.find(" ", pos);
+    std::string key = cmdString.substr(pos, next - pos);
+    if (store.readValue(key) != table.lookup(key)) {
+      errors++;
+    }
+    pos = next + 1;
+  }
+
+  printf("%9d replies (%d values) parser %8.2f ms -> %8.2f ms (x%.1f)  mismatches %d\n",
+         iterations, store.size(), legacyTime * 1000.0, slotTime * 1000.0,
+         legacyTime / slotTime, errors);
+}
+
+// Set every value of a store to a new value, as a poll where all have changed
+static void replyToStore(pmacCommandStore *store, int value)
+{
+  char valueStr[32];
+  sprintf(valueStr, "%d\r", value);
+  for (int index = 0; index < store->countCommandStrings(); index++) {
+    std::string cmd = store->readCommandString(index);
+    std::string reply;
+    for (size_t pos = 0; pos <= cmd.length(); pos = cmd.find(" ", pos) + 1) {
+      reply += valueStr;
+      if (cmd.find(" ", pos) == std::string::npos) {
+        break;
+      }
+    }
+    store->updateReply(index, (reply + "\6").c_str());
+  }
+}
+
+static void benchmarkVariableParams(int params, int iterations)
+{
+  static const char *speeds = "FMS";
+  static const int types[] = {pmacMessageBroker::PMAC_FAST_READ,
+                              pmacMessageBroker::PMAC_MEDIUM_READ,
+                              pmacMessageBroker::PMAC_SLOW_READ};
+  std::string mockport("MOCK");
+  std::string pmacport("PMAC");
+  epicsTimeStamp start;
+  double changedTime = -1.0;
+  double unchangedTime = -1.0;
+  int created = 0;
+  char drvInfo[32];
+
+  uniqueAsynPortName(mockport);
+  uniqueAsynPortName(pmacport);
+  MockPMACAsynDriver *pMock = new MockPMACAsynDriver(mockport.c_str(), 0.01, 1);
+  pMock->setResponse("\007ERR003\006");
+  pmacController *pPmac = new pmacController(pmacport.c_str(), mockport.c_str(), 0, 8, 0.2, 1.0);
+  pMock->setResponse("");
+
+  // Create the parameters as records do, through drvUserCreate, spread over
+  // the fast, medium and slow stores
+  for (int param = 0; param < params; param++) {
+    sprintf(drvInfo, "PMAC_V%c%c_P%d", param % 2 == 0 ? 'I' : 'D', speeds[param % 3],
+            1000 + param);
+    std::tr1::shared_ptr<asynInt32Client> pClient(
+        new asynInt32Client(pmacport.c_str(), 0, drvInfo));
+  }
+  for (int type = 0; type < 3; type++) {
+    created += (int) pPmac->variableParams_[types[type]].size();
+    pmacCommandStore *store = pPmac->pBroker_->findStore(types[type]);
+    // One reply value per key makes the replies simple to build
+    store->setRangeQueries(false);
+    replyToStore(store, 7);
+  }
+
+  for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+    // Every value changed since the last update
+    epicsTimeGetCurrent(&start);
+    for (int loop = 0; loop < iterations; loop++) {
+      for (int type = 0; type < 3; type++) {
+        pPmac->lock();
+        pPmac->updateVariableParams(pPmac->pBroker_->findStore(types[type]),
+                                    pPmac->variableParams_[types[type]]);
+        pPmac->unlock();
+      }
+    }
+    changedTime = fastest(changedTime, &start);
+
+    // Nothing changed since the last update
+    for (int type = 0; type < 3; type++) {
+      pPmac->pBroker_->findStore(types[type])->clearDirty();
+    }
+    epicsTimeGetCurrent(&start);
+    for (int loop = 0; loop < iterations; loop++) {
+      for (int type = 0; type < 3; type++) {
+        pPmac->lock();
+        pPmac->updateVariableParams(pPmac->pBroker_->findStore(types[type]),
+                                    pPmac->variableParams_[types[type]]);
+        pPmac->unlock();
+      }
+    }
+    unchangedTime = fastest(unchangedTime, &start);
+
+    for (int type = 0; type < 3; type++) {
+      replyToStore(pPmac->pBroker_->findStore(types[type]), repeat);
+    }
+  }
+
+  printf("%9d updates (%d parameters) all changed %8.2f ms  none changed %8.2f ms\n",
+         iterations, created, changedTime * 1000.0, unchangedTime * 1000.0);
+}
+
+int main()
+{
+  pmacTrajectory trajectory;
+
+  benchmark(&trajectory, 1000000, false);
+  benchmark(&trajectory, 1000000, true);
+  benchmark(&trajectory, 10000000, false);
+  benchmark(&trajectory, 10000000, true);
+
+  benchmarkReplies(100000);
+  benchmarkVariableParams(900, 1000);
+
+  return 0;
+}
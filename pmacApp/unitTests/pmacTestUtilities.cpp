@@ -6,6 +6,8 @@
  */
 
 #include "pmacTestingUtilities.h"
+#include <math.h>
+#include <vector>
 
 void uniqueAsynPortName(std::string& name)
 {
@@ -62,3 +64,153 @@ void process_mem_usage(double& vm_usage, double& resident_set)
    resident_set = rss * page_size_kb;
 }
 
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// fillVelocityTestPoints(double *, double *, int *, int) - fills arrays of
+// noOfPoints + 1 trajectory points with a smooth path, varying times, and
+// runs of every velocity mode from 1 to 49 points long.
+
+void fillVelocityTestPoints(double *positions, double *times, int *modes, int noOfPoints)
+{
+  int run = 0;
+  int mode = 0;
+  int remaining = 1;
+
+  for (int index = 0; index <= noOfPoints; index++) {
+    if (--remaining == 0) {
+      run++;
+      mode = run % 5;
+      remaining = 1 + (run * 37) % 49;
+    }
+    positions[index] = 10.0 * sin(index * 0.01) + index * 0.001;
+    times[index] = 1000 + (index * 7919) % 9000;
+    modes[index] = mode;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// referenceVelocities(...) - the original point by point velocity
+// calculation, to check the velocity kernels against.
+//
+// On an invalid time or mode, returns false
+
+bool referenceVelocities(const double *positions, const double *times, const int *modes,
+                         int noOfPoints, double previousPosition, double previousVelocity,
+                         double *velocities)
+{
+  double inverse_deltaTime = 0;
+  double deltaPos = 0.0;
+
+  for (int index = 0; index < noOfPoints; index++) {
+    if (index > 0) {
+      previousPosition = positions[index-1];
+      previousVelocity = velocities[index-1];
+    }
+    switch(modes[index]) {
+      // Average Previous -> Next
+      case 0:
+        if(times[index] <=  0 && times[index+1] <= 0) {
+          return false;
+        }
+        inverse_deltaTime = 1000000 / (times[index]+times[index+1]);
+        deltaPos = positions[index+1] - previousPosition;
+        velocities[index] = inverse_deltaTime * deltaPos;
+        break;
+
+      // Real Previous -> Current
+      case 1:
+        if(times[index] <=  0) {
+          return false;
+        }
+        inverse_deltaTime = 1000000 / (times[index]);
+        deltaPos = positions[index] - previousPosition;
+        velocities[index] = 2.0 * inverse_deltaTime * deltaPos - previousVelocity;
+        break;
+
+      // Average Previous -> Current
+      case 2:
+        if(times[index] <=  0) {
+          return false;
+        }
+        inverse_deltaTime = 1000000 / (times[index]);
+        deltaPos = positions[index] - previousPosition;
+        velocities[index] = inverse_deltaTime * deltaPos;
+        break;
+
+      // Zero
+      case 3:
+        velocities[index] = 0.0;
+        break;
+
+      // Average Current -> Next
+      case 4:
+        if(times[index+1] <= 0) {
+          return false;
+        }
+        inverse_deltaTime = 1000000 / (times[index+1]);
+        deltaPos = positions[index+1] - positions[index];
+        velocities[index] = inverse_deltaTime * deltaPos;
+        break;
+
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// referenceCountVelocities(...) - the original trajectory build, which
+// converted the EGU positions to counts one at a time and then calculated
+// the velocities from the positions in counts.  The previous position and
+// velocity are given in EGU.
+//
+// On an invalid time or mode, returns false
+
+bool referenceCountVelocities(const double *positions, const double *times, const int *modes,
+                              int noOfPoints, double offset, double resolution,
+                              double previousPosition, double previousVelocity,
+                              double *velocities)
+{
+  std::vector<double> counts(noOfPoints + 1);
+
+  for (int index = 0; index <= noOfPoints; index++) {
+    counts[index] = (positions[index] - offset) / resolution;
+  }
+  return referenceVelocities(&counts[0], times, modes, noOfPoints,
+                             (previousPosition - offset) / resolution,
+                             previousVelocity / resolution, velocities);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// legacyUpdateReply(StringHashtable &, const std::string &, const std::string &)
+// - the reply parser used before the command store pre-resolved its slots.
+// Stores each value of the reply against the matching key of the command,
+// for keys already present in the table.
+
+void legacyUpdateReply(StringHashtable &table, const std::string &cmd, const std::string &reply)
+{
+  std::string keys = cmd;
+  std::string data = reply;
+  int running = 1;
+  while (data.find("\r") != std::string::npos && running == 1) {
+    std::string val = data.substr(0, data.find("\r"));
+    data = data.substr(data.find("\r") + 1);
+    if (keys.find(" ") != std::string::npos) {
+      std::string key = keys.substr(0, keys.find(" "));
+      keys = keys.substr(keys.find(" ") + 1);
+      if (table.hasKey(key)) {
+        table.insert(key, val);
+      }
+    } else {
+      if (table.hasKey(keys)) {
+        table.insert(keys, val);
+      }
+      running = 0;
+    }
+  }
+}
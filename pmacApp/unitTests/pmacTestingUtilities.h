@@ -15,8 +15,19 @@
 #include <unistd.h>
 #include <ios>
 
+#include "StringHashtable.h"
+
 void uniqueAsynPortName(std::string& name);
 void process_mem_usage(double& vm_usage, double& resident_set);
+void fillVelocityTestPoints(double *positions, double *times, int *modes, int noOfPoints);
+bool referenceVelocities(const double *positions, const double *times, const int *modes,
+                         int noOfPoints, double previousPosition, double previousVelocity,
+                         double *velocities);
+bool referenceCountVelocities(const double *positions, const double *times, const int *modes,
+                              int noOfPoints, double offset, double resolution,
+                              double previousPosition, double previousVelocity,
+                              double *velocities);
+void legacyUpdateReply(StringHashtable &table, const std::string &cmd, const std::string &reply);
 
 
 
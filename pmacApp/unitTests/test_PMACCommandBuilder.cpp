@@ -0,0 +1,101 @@
+/*
+ * test_PMACCommandBuilder.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *
+ */
+
+
+#include <stdio.h>
+
+
+#include "boost/test/unit_test.hpp"
+
+#include <string>
+#include <string.h>
+
+#include "pmacTestingUtilities.h"
+#include "pmacCommandBuilder.h"
+
+
+struct PMACCommandBuilderFixture
+{
+};
+
+BOOST_FIXTURE_TEST_SUITE(PMACCommandBuilderTest, PMACCommandBuilderFixture)
+
+BOOST_AUTO_TEST_CASE(test_PMACCommandBuilderAppend)
+{
+  pmacCommandBuilder builder;
+
+  BOOST_CHECK_EQUAL(builder.getLength(), 0);
+  BOOST_CHECK_EQUAL(std::string(builder.getCommand()), "");
+
+  // Appends are added to the end and the length is tracked
+  BOOST_CHECK_EQUAL(builder.append("WL:$%X", 0x30000), asynSuccess);
+  BOOST_CHECK_EQUAL(builder.append(",$%01X%06X", 1, 1000), asynSuccess);
+  BOOST_CHECK_EQUAL(builder.append(",%g", 1.5), asynSuccess);
+  BOOST_CHECK_EQUAL(std::string(builder.getCommand()), "WL:$30000,$10003E8,1.5");
+  BOOST_CHECK_EQUAL(builder.getLength(), (int) strlen(builder.getCommand()));
+  BOOST_CHECK(!builder.hasOverflowed());
+
+  // Clearing starts a new line
+  builder.clear();
+  BOOST_CHECK_EQUAL(builder.getLength(), 0);
+  BOOST_CHECK_EQUAL(builder.append("Next_A(%d)=", 10), asynSuccess);
+  BOOST_CHECK_EQUAL(std::string(builder.getCommand()), "Next_A(10)=");
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACCommandBuilderOverflow)
+{
+  pmacCommandBuilder builder;
+  builder.setMaxLength(10);
+
+  // Exactly the maximum fits
+  BOOST_CHECK_EQUAL(builder.append("12345"), asynSuccess);
+  BOOST_CHECK_EQUAL(builder.append("67890"), asynSuccess);
+  BOOST_CHECK_EQUAL(builder.getLength(), 10);
+  BOOST_CHECK(!builder.hasOverflowed());
+
+  // One more is refused, and the line is left as it was rather than truncated
+  BOOST_CHECK_EQUAL(builder.append("X"), asynError);
+  BOOST_CHECK(builder.hasOverflowed());
+  BOOST_CHECK_EQUAL(std::string(builder.getCommand()), "1234567890");
+  BOOST_CHECK_EQUAL(builder.getLength(), 10);
+
+  // Once overflowed nothing more is added, even if it would fit
+  builder.clear();
+  BOOST_CHECK_EQUAL(builder.append("123456"), asynSuccess);
+  BOOST_CHECK_EQUAL(builder.append("7890X"), asynError);
+  BOOST_CHECK_EQUAL(builder.append("7"), asynError);
+  BOOST_CHECK_EQUAL(std::string(builder.getCommand()), "123456");
+
+  // Clearing resets the overflow
+  builder.clear();
+  BOOST_CHECK(!builder.hasOverflowed());
+  BOOST_CHECK_EQUAL(builder.append("7"), asynSuccess);
+
+  // The maximum cannot be raised past what the link can carry
+  builder.setMaxLength(PMAC_MAX_LINE_LENGTH + 100);
+  builder.clear();
+  for (int index = 0; index < PMAC_MAX_LINE_LENGTH; index++) {
+    builder.append("x");
+  }
+  BOOST_CHECK(!builder.hasOverflowed());
+  BOOST_CHECK_EQUAL(builder.append("x"), asynError);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACCommandBuilderLong)
+{
+  pmacCommandBuilder builder;
+
+  // Filling a line is linear, each value lands after the last
+  for (int index = 0; index < 100; index++) {
+    BOOST_CHECK_EQUAL(builder.append(",%d", index % 10), asynSuccess);
+  }
+  BOOST_CHECK_EQUAL(builder.getLength(), 200);
+  BOOST_CHECK_EQUAL(std::string(builder.getCommand()).substr(0, 8), ",0,1,2,3");
+  BOOST_CHECK_EQUAL(std::string(builder.getCommand()).substr(192), ",6,7,8,9");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
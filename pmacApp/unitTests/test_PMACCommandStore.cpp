@@ -19,6 +19,7 @@
 
 #include "StringHashtable.h"
 #include "pmacCommandStore.h"
+#include "pmacTestingUtilities.h"
 
 struct PMACCommandStoreFixture
 {
@@ -137,4 +138,425 @@ BOOST_AUTO_TEST_CASE(test_PMACCommandStore)
 
 }
 
+BOOST_AUTO_TEST_CASE(test_PMACCommandStoreHandles)
+{
+  int h1 = store.addItem("#1P");
+  int h2 = store.addItem("#1F");
+  int h3 = store.addItem("#1?");
+
+  // Handles are distinct, stable and can be found by key
+  BOOST_CHECK(h1 != h2 && h2 != h3 && h1 != h3);
+  BOOST_CHECK_EQUAL(store.addItem("#1P"), h1);
+  BOOST_CHECK_EQUAL(store.findHandle("#1F"), h2);
+  BOOST_CHECK_EQUAL(store.findHandle("#2P"), -1);
+  BOOST_CHECK_EQUAL(store.readKey(h3), "#1?");
+
+  store.updateReply(store.readCommandString(0), "10.5\r-0.25\r880000008400\r\6");
+  BOOST_CHECK_EQUAL(store.readValue(h1), "10.5");
+  BOOST_CHECK_EQUAL(store.readValue(h2), "-0.25");
+  BOOST_CHECK_EQUAL(store.readValue(h3), "880000008400");
+  BOOST_CHECK_EQUAL(store.readValue(h1), store.readValue("#1P"));
+
+  // Adding more keys does not move existing handles
+  store.addItem("#2P");
+  BOOST_CHECK_EQUAL(store.findHandle("#1P"), h1);
+  BOOST_CHECK_EQUAL(store.readValue(h2), "-0.25");
+
+  // Invalid handles read as empty
+  BOOST_CHECK_EQUAL(store.readValue(-1), "");
+  BOOST_CHECK_EQUAL(store.readValue(1000), "");
+  BOOST_CHECK_EQUAL(store.readKey(-1), "");
+}
+
+// Build a reply to a command string from a reply for each key
+static std::string typedReply(const std::string &cmd, const std::string &intValue)
+{
+  std::string reply;
+  size_t pos = 0;
+  while (pos < cmd.length()) {
+    size_t next = cmd.find(" ", pos);
+    if (next == std::string::npos) {
+      next = cmd.length();
+    }
+    std::string key = cmd.substr(pos, next - pos);
+    if (key == "P100") {
+      reply += intValue + "\r";
+    } else if (key == "#1P") {
+      reply += "-12.75\r";
+    } else if (key == "i124") {
+      reply += "$820401\r";
+    } else {
+      reply += "PowerPC\r";
+    }
+    pos = next + 1;
+  }
+  return reply + "\6";
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACCommandStoreTypedValues)
+{
+  epicsInt64 intVal = 0;
+  double dblVal = 0.0;
+  int hInt = store.addItem("P100");
+  int hDbl = store.addItem("#1P");
+  int hHex = store.addItem("i124");
+  int hStr = store.addItem("Sys.CPU");
+  std::string cmd = store.readCommandString(0);
+
+  // Nothing parses before the first reply
+  BOOST_CHECK_EQUAL(store.readParseStatus(hInt), 0);
+  BOOST_CHECK(!store.readInteger(hInt, intVal));
+
+  store.updateReply(cmd, typedReply(cmd, "42"));
+  BOOST_CHECK(store.readInteger(hInt, intVal));
+  BOOST_CHECK_EQUAL(intVal, 42);
+  BOOST_CHECK(store.readDouble(hInt, dblVal));
+  BOOST_CHECK_EQUAL(dblVal, 42.0);
+
+  // Matches sscanf: "%d" of a double takes the integer part
+  BOOST_CHECK(store.readDouble(hDbl, dblVal));
+  BOOST_CHECK_EQUAL(dblVal, -12.75);
+  BOOST_CHECK(store.readInteger(hDbl, intVal));
+  BOOST_CHECK_EQUAL(intVal, -12);
+  BOOST_CHECK(!store.readHex(hDbl, intVal));
+
+  BOOST_CHECK_EQUAL(store.readParseStatus(hHex), PMAC_PARSED_HEX);
+  BOOST_CHECK(store.readHex(hHex, intVal));
+  BOOST_CHECK_EQUAL(intVal, 0x820401);
+  BOOST_CHECK(!store.readInteger(hHex, intVal));
+  BOOST_CHECK_EQUAL(intVal, 0);
+
+  BOOST_CHECK_EQUAL(store.readParseStatus(hStr), 0);
+  BOOST_CHECK_EQUAL(store.readValue(hStr), "PowerPC");
+
+  // A changed value is parsed again
+  store.updateReply(cmd, typedReply(cmd, "43"));
+  BOOST_CHECK(store.readInteger(hInt, intVal));
+  BOOST_CHECK_EQUAL(intVal, 43);
+  BOOST_CHECK(!store.readDouble(-1, dblVal));
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACCommandStoreRanges)
+{
+  char var[16];
+  store.setRangeQueries(true);
+
+  // A run of consecutive M variables, a short run and some unrelated items
+  for (int index = 5000; index < 5032; index++) {
+    sprintf(var, "M%d", index);
+    store.addItem(var);
+  }
+  store.addItem("&2Q81");
+  store.addItem("&2Q82");
+  store.addItem("#1P");
+  store.addItem("M05");
+  BOOST_CHECK_EQUAL(store.size(), 36);
+  BOOST_CHECK_EQUAL(store.countCommandStrings(), 1);
+
+  std::string cmdString = store.readCommandString(0);
+  BOOST_CHECK_NE(cmdString.find("M5000..5031"), std::string::npos);
+  BOOST_CHECK_EQUAL(cmdString.find("M5001"), std::string::npos);
+  BOOST_CHECK_NE(cmdString.find("&2Q81"), std::string::npos);
+  BOOST_CHECK_NE(cmdString.find("&2Q82"), std::string::npos);
+  BOOST_CHECK_NE(cmdString.find("#1P"), std::string::npos);
+  BOOST_CHECK_NE(cmdString.find("M05"), std::string::npos);
+
+  // Build the reply in the order of the expanded keys
+  std::vector<std::string> keys;
+  std::string reply;
+  size_t start = 0;
+  while (start < cmdString.length()) {
+    size_t end = cmdString.find(" ", start);
+    if (end == std::string::npos) {
+      end = cmdString.length();
+    }
+    std::string token = cmdString.substr(start, end - start);
+    if (token == "M5000..5031") {
+      for (int index = 5000; index < 5032; index++) {
+        sprintf(var, "M%d", index);
+        keys.push_back(var);
+      }
+    } else {
+      keys.push_back(token);
+    }
+    start = end + 1;
+  }
+  BOOST_CHECK_EQUAL(keys.size(), 36);
+  for (size_t index = 0; index < keys.size(); index++) {
+    sprintf(var, "%d\r", (int) index);
+    reply += var;
+  }
+  BOOST_CHECK_EQUAL(store.updateReply(cmdString, reply), 0);
+  for (size_t index = 0; index < keys.size(); index++) {
+    sprintf(var, "%d", (int) index);
+    BOOST_CHECK_EQUAL(store.readValue(keys[index]), var);
+  }
+
+  // A run that does not fit in one command string is split across two
+  for (int index = 100; index < 150; index++) {
+    sprintf(var, "P%d", index);
+    store.addItem(var);
+  }
+  BOOST_CHECK_EQUAL(store.countCommandStrings(), 2);
+  std::string allCmds = store.readCommandString(0) + " " + store.readCommandString(1);
+  BOOST_CHECK_EQUAL(allCmds.find("P100 "), std::string::npos);
+  BOOST_CHECK_NE(allCmds.find("P100.."), std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACCommandStoreBudget)
+{
+  char var[16];
+  std::string reply;
+
+  // Out of range budgets are rejected
+  BOOST_CHECK_EQUAL(store.setBudget(0, 100), -1);
+  BOOST_CHECK_EQUAL(store.setBudget(1024, 100), -1);
+  BOOST_CHECK_EQUAL(store.setBudget(100, 0), -1);
+
+  // With no reply history each value is predicted to be 25 bytes
+  BOOST_CHECK_EQUAL(store.setBudget(1000, 100), 0);
+  for (int index = 1; index <= 8; index++) {
+    sprintf(var, "AA%d", index);
+    store.addItem(var);
+  }
+  BOOST_CHECK_EQUAL(store.countCommandStrings(), 2);
+
+  // Once the replies are known to be short everything fits in one string
+  for (int cmd = 0; cmd < 2; cmd++) {
+    reply = "1\r1\r1\r1\r\6";
+    store.updateReply(store.readCommandString(cmd), reply);
+  }
+  BOOST_CHECK_EQUAL(store.countCommandStrings(), 2);
+  store.updateCommandStrings();
+  BOOST_CHECK_EQUAL(store.countCommandStrings(), 1);
+  BOOST_CHECK_EQUAL(store.readCommandString(0).length(), 31);
+
+  // A longer reply than expected causes the key to be repacked
+  store.updateReply(store.readCommandString(0), std::string(95, '9') + "\r\6");
+  store.updateCommandStrings();
+  BOOST_CHECK_EQUAL(store.countCommandStrings(), 2);
+
+  // The request budget limits the length of each command string
+  BOOST_CHECK_EQUAL(store.setBudget(8, 1000), 0);
+  BOOST_CHECK_EQUAL(store.countCommandStrings(), 4);
+  for (int cmd = 0; cmd < store.countCommandStrings(); cmd++) {
+    BOOST_CHECK_LE(store.readCommandString(cmd).length(), 8);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACCommandStoreDecimation)
+{
+  char var[16];
+  int lowPriority[2];
+
+  // Low priority keys are packed into their own command string at the end
+  BOOST_CHECK_EQUAL(store.setBudget(1000, 1000), 0);
+  for (int index = 1; index <= 6; index++) {
+    sprintf(var, "AA%d", index);
+    store.addItem(var);
+  }
+  lowPriority[0] = store.addItem("Sys.BgDeltaTime");
+  lowPriority[1] = store.addItem("M70");
+  BOOST_CHECK_EQUAL(store.countCommandStrings(), 1);
+  BOOST_CHECK_EQUAL(store.setLowPriority(lowPriority[0], true), 0);
+  BOOST_CHECK_EQUAL(store.setLowPriority(lowPriority[1], true), 0);
+  BOOST_CHECK_EQUAL(store.setLowPriority(1000, true), -1);
+  BOOST_CHECK_EQUAL(store.countCommandStrings(), 2);
+  BOOST_CHECK(store.readCommandString(0).find("AA1") != std::string::npos);
+  BOOST_CHECK(store.readCommandString(0).find("M70") == std::string::npos);
+  BOOST_CHECK(store.readCommandString(1).find("M70") != std::string::npos);
+  BOOST_CHECK(store.readCommandString(1).find("Sys.BgDeltaTime") != std::string::npos);
+  BOOST_CHECK(store.getLowPriorityList().find("M70") != std::string::npos);
+
+  // Without decimation every command string is polled
+  BOOST_CHECK_EQUAL(store.readDecimation(), 1);
+  BOOST_CHECK_EQUAL(store.countPolledCommandStrings(), 2);
+  BOOST_CHECK(store.readUpdateComplete());
+
+  // Decimated, the low priority string is polled once every 3 updates
+  store.setDecimation(3);
+  BOOST_CHECK_EQUAL(store.readDecimation(), 3);
+  int complete = 0;
+  for (int update = 0; update < 9; update++) {
+    int count = store.countPolledCommandStrings();
+    if (store.readUpdateComplete()) {
+      BOOST_CHECK_EQUAL(count, 2);
+      complete++;
+    } else {
+      BOOST_CHECK_EQUAL(count, 1);
+    }
+  }
+  BOOST_CHECK_EQUAL(complete, 3);
+
+  // Restored
+  store.setDecimation(1);
+  BOOST_CHECK_EQUAL(store.countPolledCommandStrings(), 2);
+  BOOST_CHECK_EQUAL(store.setLowPriority(lowPriority[0], false), 0);
+  BOOST_CHECK_EQUAL(store.setLowPriority(lowPriority[1], false), 0);
+  BOOST_CHECK_EQUAL(store.countCommandStrings(), 1);
+  BOOST_CHECK_EQUAL(store.getLowPriorityList(), "");
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACCommandStoreIdle)
+{
+  int handles[2][4];
+  char var[16];
+
+  BOOST_CHECK_EQUAL(store.setBudget(1000, 1000), 0);
+  for (int axis = 0; axis < 2; axis++) {
+    sprintf(var, "#%dP", axis + 1);
+    handles[axis][0] = store.addItem(var);
+    sprintf(var, "#%dF", axis + 1);
+    handles[axis][1] = store.addItem(var);
+    sprintf(var, "i%d24", axis + 1);
+    handles[axis][2] = store.addItem(var);
+    sprintf(var, "#%d?", axis + 1);
+    handles[axis][3] = store.addItem(var);
+  }
+  int lowPriority = store.addItem("M70");
+  BOOST_CHECK_EQUAL(store.setLowPriority(lowPriority, true), 0);
+  BOOST_CHECK_EQUAL(store.countCommandStrings(), 2);
+
+  // Marking an axis idle only flags a repack for the next update
+  for (int item = 0; item < 4; item++) {
+    BOOST_CHECK_EQUAL(store.setIdle(handles[1][item], true), 0);
+  }
+  BOOST_CHECK_EQUAL(store.setIdle(1000, true), -1);
+  BOOST_CHECK_EQUAL(store.countIdle(), 4);
+  BOOST_CHECK_EQUAL(store.countCommandStrings(), 2);
+  store.updateCommandStrings();
+  BOOST_CHECK_EQUAL(store.countCommandStrings(), 3);
+  BOOST_CHECK(store.readCommandString(0).find("#1P") != std::string::npos);
+  BOOST_CHECK(store.readCommandString(0).find("#2P") == std::string::npos);
+  BOOST_CHECK(store.readCommandString(1).find("#2P") != std::string::npos);
+  BOOST_CHECK(store.readCommandString(1).find("i224") != std::string::npos);
+  BOOST_CHECK(store.readCommandString(2).find("M70") != std::string::npos);
+
+  // Handles survive the repack
+  store.updateReply(store.readCommandString(1), "1\r2\r3\r4\r\6");
+  BOOST_CHECK(!store.readValue(handles[1][0]).empty());
+
+  // Without idle decimation every command string is polled
+  BOOST_CHECK_EQUAL(store.countPolledCommandStrings(), 3);
+  BOOST_CHECK(store.isCommandStringPolled(1));
+
+  // The idle command string is polled once every 4 updates, independently
+  // of the low priority decimation
+  store.setIdleDecimation(4);
+  store.setDecimation(2);
+  BOOST_CHECK_EQUAL(store.readIdleDecimation(), 4);
+  int idlePolls = 0;
+  int lowPolls = 0;
+  for (int update = 0; update < 8; update++) {
+    int count = store.countPolledCommandStrings();
+    BOOST_CHECK(store.isCommandStringPolled(0));
+    if (store.isCommandStringPolled(1)) {
+      idlePolls++;
+    }
+    if (count == 3) {
+      BOOST_CHECK(store.isCommandStringPolled(2));
+      lowPolls++;
+    }
+  }
+  BOOST_CHECK_EQUAL(idlePolls, 2);
+  BOOST_CHECK_EQUAL(lowPolls, 4);
+
+  // A busy axis moves back to the first command string on the next update
+  for (int item = 0; item < 4; item++) {
+    BOOST_CHECK_EQUAL(store.setIdle(handles[1][item], false), 0);
+  }
+  store.updateCommandStrings();
+  BOOST_CHECK_EQUAL(store.countIdle(), 0);
+  BOOST_CHECK_EQUAL(store.countCommandStrings(), 2);
+  BOOST_CHECK(store.readCommandString(0).find("#2P") != std::string::npos);
+  store.countPolledCommandStrings();
+  BOOST_CHECK(store.isCommandStringPolled(0));
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACCommandStoreDirty)
+{
+  int h1 = store.addItem("#1P");
+  int h2 = store.addItem("#1F");
+  int h3 = store.addItem("#1?");
+
+  // Newly added keys are dirty until the callbacks have seen them
+  BOOST_CHECK(store.anyDirty());
+  BOOST_CHECK(store.isDirty(h1) && store.isDirty(h2) && store.isDirty(h3));
+  store.clearDirty();
+  BOOST_CHECK(!store.anyDirty());
+  BOOST_CHECK(!store.isDirty(h1));
+  BOOST_CHECK_EQUAL(store.readDirtySlots().size(), 0);
+
+  // Only the values that change are dirty
+  store.updateReply(store.readCommandString(0), "10.5\r-0.25\r880000008400\r\6");
+  BOOST_CHECK_EQUAL(store.readDirtySlots().size(), 3);
+  store.clearDirty();
+  store.updateReply(store.readCommandString(0), "10.5\r-0.5\r880000008400\r\6");
+  BOOST_CHECK(!store.isDirty(h1));
+  BOOST_CHECK(store.isDirty(h2));
+  BOOST_CHECK(!store.isDirty(h3));
+  BOOST_CHECK_EQUAL(store.readDirtySlots().size(), 1);
+  BOOST_CHECK_EQUAL(store.readDirtySlots()[0], h2);
+
+  // A value that changes twice before the callbacks is listed once
+  store.updateReply(store.readCommandString(0), "10.5\r-0.75\r880000008400\r\6");
+  BOOST_CHECK_EQUAL(store.readDirtySlots().size(), 1);
+  store.clearDirty();
+
+  // Identical replies leave the store clean
+  store.updateReply(store.readCommandString(0), "10.5\r-0.75\r880000008400\r\6");
+  BOOST_CHECK(!store.anyDirty());
+
+  // A second consumer of an existing key must see its value
+  BOOST_CHECK_EQUAL(store.addItem("#1P"), h1);
+  BOOST_CHECK(store.isDirty(h1));
+  store.clearDirty();
+
+  // Unresolved handles are always treated as changed
+  BOOST_CHECK(store.isDirty(-1));
+  BOOST_CHECK(store.isDirty(1000));
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACCommandStoreLegacyReply)
+{
+  StringHashtable table;
+  char var[32];
+  std::string reply;
+
+  // A typical fast store command string for 10 axes
+  for (int axis = 1; axis <= 10; axis++) {
+    sprintf(var, "#%dP", axis);
+    store.addItem(var);
+    sprintf(var, "#%dF", axis);
+    store.addItem(var);
+    sprintf(var, "#%d?", axis);
+    store.addItem(var);
+    sprintf(var, "i%d24", axis);
+    store.addItem(var);
+  }
+  BOOST_CHECK_EQUAL(store.countCommandStrings(), 1);
+  std::string cmdString = store.readCommandString(0);
+  size_t pos = 0;
+  for (int index = 0; index < store.size(); index++) {
+    size_t next = cmdString.find(" ", pos);
+    table.insert(cmdString.substr(pos, next - pos), "");
+    pos = next + 1;
+    snprintf(var, sizeof(var), "%d.%04d\r", 1000 + index, index);
+    reply += var;
+  }
+  reply += "\6";
+
+  legacyUpdateReply(table, cmdString, reply);
+  store.updateReply(0, reply.c_str());
+
+  // The pre-resolved slots must parse the reply as the original parser did
+  pos = 0;
+  for (int index = 0; index < store.size(); index++) {
+    size_t next = cmdString.find(" ", pos);
+    std::string key = cmdString.substr(pos, next - pos);
+    BOOST_CHECK_EQUAL(store.readValue(key), table.lookup(key));
+    pos = next + 1;
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -19,6 +19,7 @@
 #include <iostream>
 #include <fstream>
 
+#include <math.h>
 #include <asynPortClient.h>
 
 #include "pmacTestingUtilities.h"
@@ -27,6 +28,7 @@
 // Very naughty define to provide easy access to members for testing
 #define private public
 #include "pmacController.h"
+#include "pmacHardwareTurbo.h"
 
 
 struct PMACControllerFixture
@@ -123,6 +125,68 @@ BOOST_AUTO_TEST_CASE(test_PMACController)
 
 }
 
+BOOST_AUTO_TEST_CASE(test_PMACControllerTrajectoryFill)
+{
+  int user[10];
+  double times[10];
+  double *pos[9];
+  double *vel[9];
+
+  pPmac->checkConnection();
+  BOOST_CHECK_EQUAL(pPmac->connected_, 1);
+  // Fill a Turbo PMAC buffer whatever the mock reported as the controller type
+  delete pPmac->pHardware_;
+  pPmac->pHardware_ = new pmacHardwareTurbo();
+  pPmac->pHardware_->registerController(pPmac);
+
+  // Ten points of axis A, the sixth position cannot be encoded
+  for (int axis = 0; axis < 9; axis++) {
+    pos[axis] = (double *) malloc(sizeof(double) * 10);
+    vel[axis] = (double *) malloc(sizeof(double) * 10);
+    for (int index = 0; index < 10; index++) {
+      pos[axis][index] = (double) index;
+      vel[axis][index] = 1.0;
+    }
+  }
+  for (int index = 0; index < 10; index++) {
+    user[index] = 0;
+    times[index] = 1000.0;
+  }
+  pos[0][5] = nan("");
+  BOOST_CHECK_EQUAL(pPmac->pTrajectory_->initialise(10), asynSuccess);
+  BOOST_CHECK_EQUAL(pPmac->pTrajectory_->append(pos, vel, times, user, 10), asynSuccess);
+  pPmac->tScanAxisMask_ = 1;
+  pPmac->tScanNumPoints_ = 10;
+  pPmac->tScanPointCtr_ = 0;
+  pPmac->tScanExecuting_ = 0;
+  pPmac->tScanPmacBufferSize_ = 100;
+  pPmac->tScanPmacBufferAddressA_ = 0x30000;
+  pPmac->tScanPmacBufferAddressB_ = 0x30064;
+
+  // A demand that cannot be encoded fails the fill before anything is
+  // written, and no fill count is sent to the PMAC
+  pMock->clearStore();
+  pMock->setResponse("");
+  BOOST_CHECK_EQUAL(pPmac->sendTrajectoryDemands(PMAC_TRAJ_BUFFER_A), asynError);
+  BOOST_CHECK_EQUAL(pPmac->tScanPointCtr_, 0);
+  BOOST_CHECK_EQUAL(pMock->countWrites(), 0);
+  BOOST_CHECK_EQUAL(pMock->checkForWrite("M4044=0"), false);
+
+  // With every demand valid the points are counted and the fill count sent
+  pos[0][5] = 5.0;
+  BOOST_CHECK_EQUAL(pPmac->pTrajectory_->initialise(10), asynSuccess);
+  BOOST_CHECK_EQUAL(pPmac->pTrajectory_->append(pos, vel, times, user, 10), asynSuccess);
+  pMock->clearStore();
+  BOOST_CHECK_EQUAL(pPmac->sendTrajectoryDemands(PMAC_TRAJ_BUFFER_A), asynSuccess);
+  BOOST_CHECK_EQUAL(pPmac->tScanPointCtr_, 10);
+  BOOST_CHECK_EQUAL(pMock->checkForWrite("M4044=10"), true);
+
+  for (int axis = 0; axis < 9; axis++) {
+    free(pos[axis]);
+    free(vel[axis]);
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 
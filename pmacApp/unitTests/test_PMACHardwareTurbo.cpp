@@ -0,0 +1,244 @@
+/*
+ * test_PMACHardwareTurbo.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *
+ */
+
+
+#include <stdio.h>
+
+
+#include "boost/test/unit_test.hpp"
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "pmacTestingUtilities.h"
+#include "pmacHardwareTurbo.h"
+#include "pmacController.h"
+
+// The original encoder, which normalises by repeated halving and doubling.
+// It is only valid for finite values below 2^36 in magnitude
+static int64_t referencePMACFloat(double value)
+{
+  double absVal = value;
+  int negative = 0;
+  int exponent = 0;
+  double expVal = 0.0;
+  int64_t intVal = 0;
+  int64_t tVal = 0;
+  double mantissaVal = 0.0;
+  double maxMantissa = 34359738368.0;  // 0x800000000
+
+  if (absVal == 0.0) {
+    tVal = 0x0;
+  } else {
+    if (absVal < 0.0) {
+      absVal = absVal * -1.0;
+      negative = 1;
+    }
+    expVal = absVal;
+    mantissaVal = absVal;
+    while (expVal >= 2.0) {
+      expVal = expVal / 2.0;
+      exponent++;
+    }
+    while (expVal < 1.0) {
+      expVal = expVal * 2.0;
+      exponent--;
+    }
+    exponent += 0x800;
+    while (mantissaVal < maxMantissa) {
+      mantissaVal *= 2.0;
+    }
+    mantissaVal = mantissaVal / 2.0;
+    intVal = (int64_t) mantissaVal;
+    if (negative == 1) {
+      intVal = 0xFFFFFFFFFLL - intVal;
+    }
+    tVal = intVal << 12;
+    tVal += exponent;
+  }
+  return tVal;
+}
+
+// Decode a PMAC float word back into a double
+static double decodePMACFloat(int64_t word)
+{
+  int64_t mantissa = word >> 12;
+  int exponent = (int) (word & 0xFFF) - 0x800;
+
+  if (mantissa >= 0x800000000LL) {
+    mantissa = -(0xFFFFFFFFFLL - mantissa);
+  }
+  return ldexp((double) mantissa, exponent - 34);
+}
+
+struct PMACHardwareTurboFixture
+{
+  pmacHardwareTurbo turbo;
+  int mismatches;
+
+  PMACHardwareTurboFixture() : mismatches(0)
+  {
+  }
+
+  // Encode a value and its negative, counting any difference from the original
+  void compare(double value)
+  {
+    int64_t word = 0;
+    for (int sign = 0; sign < 2; sign++) {
+      if (turbo.doubleToPMACFloat(value, &word) != asynSuccess ||
+          word != referencePMACFloat(value)) {
+        printf("Mismatch for %.17g: %llX expected %llX\n", value, (long long) word,
+               (long long) referencePMACFloat(value));
+        mismatches++;
+      }
+      value = -value;
+    }
+  }
+};
+
+BOOST_FIXTURE_TEST_SUITE(PMACHardwareTurboTest, PMACHardwareTurboFixture)
+
+BOOST_AUTO_TEST_CASE(test_PMACHardwareTurboFloatEdgeCases)
+{
+  int64_t word = 0;
+
+  // Zero, of either sign
+  BOOST_CHECK_EQUAL(turbo.doubleToPMACFloat(0.0, &word), asynSuccess);
+  BOOST_CHECK_EQUAL(word, 0);
+  BOOST_CHECK_EQUAL(turbo.doubleToPMACFloat(-0.0, &word), asynSuccess);
+  BOOST_CHECK_EQUAL(word, 0);
+
+  // Known encodings
+  BOOST_CHECK_EQUAL(turbo.doubleToPMACFloat(1.0, &word), asynSuccess);
+  BOOST_CHECK_EQUAL(word, 0x400000000800LL);
+  BOOST_CHECK_EQUAL(turbo.doubleToPMACFloat(-1.0, &word), asynSuccess);
+  BOOST_CHECK_EQUAL(word, 0xBFFFFFFFF800LL);
+  BOOST_CHECK_EQUAL(turbo.doubleToPMACFloat(0.5, &word), asynSuccess);
+  BOOST_CHECK_EQUAL(word, 0x4000000007FFLL);
+
+  // Denormals, the smallest normal and the limits of the original encoder
+  compare(4.9406564584124654e-324);
+  compare(DBL_MIN);
+  compare(DBL_MIN / 3.0);
+  compare(nextafter(DBL_MIN, 0.0));
+  compare(34359738368.0);
+  compare(68719476735.0);
+  compare(nextafter(68719476736.0, 0.0));
+  BOOST_CHECK_EQUAL(mismatches, 0);
+
+  // Infinity and NaN cannot be encoded
+  BOOST_CHECK_EQUAL(turbo.doubleToPMACFloat(HUGE_VAL, &word), asynError);
+  BOOST_CHECK_EQUAL(turbo.doubleToPMACFloat(-HUGE_VAL, &word), asynError);
+  BOOST_CHECK_EQUAL(turbo.doubleToPMACFloat(nan(""), &word), asynError);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACHardwareTurboFloatExhaustive)
+{
+  // Every binary exponent the original encoder handles, at powers of two,
+  // either side of them and at a spread of mantissas truncated differently
+  for (int exponent = -1074; exponent < 36; exponent++) {
+    double power = ldexp(1.0, exponent);
+    compare(power);
+    compare(nextafter(power, 0.0));
+    compare(nextafter(power, HUGE_VAL));
+    for (int step = 1; step < 64; step++) {
+      compare(power * (1.0 + step / 64.0));
+      compare(power * (1.0 + step / 3.0e10));
+    }
+  }
+  BOOST_CHECK_EQUAL(mismatches, 0);
+
+  // Positions as they come from a trajectory
+  for (int index = 0; index < 100000; index++) {
+    compare((index - 50000) * 12.3456789);
+    compare(sin(index) * 1.0e6);
+  }
+  BOOST_CHECK_EQUAL(mismatches, 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACHardwareTurboFloatLarge)
+{
+  int64_t word = 0;
+
+  // The original encoder overflows the mantissa from 2^36, every magnitude
+  // must now decode to the value truncated to 35 bits
+  for (int exponent = 36; exponent < 1024; exponent++) {
+    double value = ldexp(1.0 + 1.0 / 3.0, exponent);
+    if (value > DBL_MAX) {
+      value = DBL_MAX;
+    }
+    BOOST_CHECK_EQUAL(turbo.doubleToPMACFloat(value, &word), asynSuccess);
+    BOOST_CHECK((word >> 12) >= 0x400000000LL && (word >> 12) < 0x800000000LL);
+    BOOST_CHECK_CLOSE(decodePMACFloat(word), value, 1e-8);
+    BOOST_CHECK_EQUAL(turbo.doubleToPMACFloat(-value, &word), asynSuccess);
+    BOOST_CHECK_CLOSE(decodePMACFloat(word), -value, 1e-8);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACHardwareTurboFloatBatch)
+{
+  double values[100];
+  int64_t words[100];
+  int64_t word = 0;
+  pmacCommandBuilder single;
+  pmacCommandBuilder batch;
+
+  for (int index = 0; index < 100; index++) {
+    values[index] = (index - 50) * 1.5e-3;
+  }
+
+  // The batch gives the same words as one at a time
+  BOOST_CHECK_EQUAL(turbo.doublesToPMACFloats(values, 100, words), asynSuccess);
+  for (int index = 0; index < 100; index++) {
+    turbo.doubleToPMACFloat(values[index], &word);
+    BOOST_CHECK_EQUAL(words[index], word);
+  }
+
+  // And so the same command, across more than one encoding block
+  turbo.startAxisPointsCmd(&single, 0, 0x10, 1000, true);
+  turbo.startAxisPointsCmd(&batch, 0, 0x10, 1000, true);
+  for (int index = 0; index < 20; index++) {
+    BOOST_CHECK_EQUAL(turbo.addAxisPointCmd(&single, 0, values[index], 1000, index == 0),
+                      asynSuccess);
+  }
+  BOOST_CHECK_EQUAL(turbo.addAxisPointsCmd(&batch, 0, values, 20, 1000, true), asynSuccess);
+  BOOST_CHECK_EQUAL(std::string(batch.getCommand()), std::string(single.getCommand()));
+  BOOST_CHECK_EQUAL(std::string(batch.getCommand()).substr(0, 9), "WL:$3F8,$");
+
+  // A value that cannot be encoded fails the batch, and the command rather
+  // than being written as zero
+  values[42] = HUGE_VAL;
+  BOOST_CHECK_EQUAL(turbo.doublesToPMACFloats(values, 100, words), asynError);
+  BOOST_CHECK_EQUAL(turbo.addAxisPointsCmd(&batch, 0, values, 100, 1000, false), asynError);
+  BOOST_CHECK_EQUAL(turbo.addAxisPointCmd(&single, 0, values[42], 1000, false), asynError);
+  BOOST_CHECK_EQUAL(turbo.addAxisPointCmd(&single, 0, nan(""), 1000, false), asynError);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACHardwareTurboLineLength)
+{
+  double values[PMAC_POINTS_PER_WRITE];
+  pmacCommandBuilder command;
+
+  command.setMaxLength(turbo.getMaxCommandLength());
+
+  // A full write of the widest words at the highest address fits on a line
+  for (int index = 0; index < PMAC_POINTS_PER_WRITE; index++) {
+    values[index] = -1.0e-300;
+  }
+  turbo.startAxisPointsCmd(&command, 2 * PMAC_MAX_CS_AXES, 0xFFFFF, 0x1000, true);
+  BOOST_CHECK_EQUAL(turbo.addAxisPointsCmd(&command, 0, values, PMAC_POINTS_PER_WRITE, 0x1000,
+                                           true), asynSuccess);
+  BOOST_CHECK(!command.hasOverflowed());
+
+  // But more than that is refused
+  turbo.addAxisPointsCmd(&command, 0, values, 2, 0x1000, false);
+  BOOST_CHECK(command.hasOverflowed());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,97 @@
+/*
+ * test_PMACHistogram.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *
+ */
+
+
+#include <stdio.h>
+
+
+#include "boost/test/unit_test.hpp"
+
+#include <string.h>
+#include <stdint.h>
+
+#include "pmacTestingUtilities.h"
+#include "pmacHistogram.h"
+
+
+struct PMACHistogramFixture
+{
+};
+
+BOOST_FIXTURE_TEST_SUITE(PMACHistogramTest, PMACHistogramFixture)
+
+BOOST_AUTO_TEST_CASE(test_PMACHistogramBuckets)
+{
+  // Small values have a bucket each
+  for (epicsUInt32 value = 0; value < PMAC_HISTOGRAM_LINEAR; value++) {
+    BOOST_CHECK_EQUAL(pmacHistogram::bucketIndex(value), (int) value);
+    BOOST_CHECK_EQUAL(pmacHistogram::bucketUpperBound((int) value), value);
+  }
+
+  // Every value lies within its bucket and bucket indexes never decrease
+  int lastIndex = 0;
+  for (epicsUInt32 value = 1; value < 1000000; value += 7) {
+    int index = pmacHistogram::bucketIndex(value);
+    BOOST_REQUIRE(index >= lastIndex);
+    BOOST_REQUIRE(index < PMAC_HISTOGRAM_BUCKETS);
+    BOOST_REQUIRE(value <= pmacHistogram::bucketUpperBound(index));
+    if (index > 0) {
+      BOOST_REQUIRE(value > pmacHistogram::bucketUpperBound(index - 1));
+    }
+    // Upper bound is within 12.5% of the value
+    BOOST_REQUIRE(pmacHistogram::bucketUpperBound(index) - value <= value / 8);
+    lastIndex = index;
+  }
+
+  // The full range fits
+  BOOST_CHECK_EQUAL(pmacHistogram::bucketIndex(0xFFFFFFFFu), PMAC_HISTOGRAM_BUCKETS - 1);
+  BOOST_CHECK_EQUAL(pmacHistogram::bucketUpperBound(PMAC_HISTOGRAM_BUCKETS - 1), 0xFFFFFFFFu);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACHistogramQuantiles)
+{
+  pmacHistogram h;
+
+  // Nothing recorded
+  BOOST_CHECK_EQUAL(h.readCount(), 0u);
+  BOOST_CHECK_EQUAL(h.readQuantile(0.5), 0u);
+  BOOST_CHECK_EQUAL(h.readMax(), 0u);
+
+  // 1 to 1000
+  for (epicsUInt32 value = 1; value <= 1000; value++) {
+    h.record(value);
+  }
+  BOOST_CHECK_EQUAL(h.readCount(), 1000u);
+  BOOST_CHECK_EQUAL(h.readMax(), 1000u);
+  epicsUInt32 p50 = h.readQuantile(0.5);
+  epicsUInt32 p90 = h.readQuantile(0.9);
+  epicsUInt32 p99 = h.readQuantile(0.99);
+  BOOST_CHECK(p50 >= 500 && p50 <= 500 + 500 / 8);
+  BOOST_CHECK(p90 >= 900 && p90 <= 900 + 900 / 8);
+  BOOST_CHECK(p99 >= 990 && p99 <= 1000);
+  BOOST_CHECK_EQUAL(h.readQuantile(1.0), 1000u);
+  BOOST_CHECK_EQUAL(h.readQuantile(0.0), 1u);
+
+  // A single outlier shows up in the max and p99 but not the median
+  pmacHistogram h2;
+  for (int index = 0; index < 99; index++) {
+    h2.record(200);
+  }
+  h2.record(50000);
+  BOOST_CHECK_EQUAL(h2.readMax(), 50000u);
+  BOOST_CHECK(h2.readQuantile(0.5) >= 200 && h2.readQuantile(0.5) < 225);
+  BOOST_CHECK(h2.readQuantile(0.99) < 225);
+  BOOST_CHECK_EQUAL(h2.readQuantile(0.999), 50000u);
+
+  // Reset
+  h.reset();
+  BOOST_CHECK_EQUAL(h.readCount(), 0u);
+  BOOST_CHECK_EQUAL(h.readMax(), 0u);
+  BOOST_CHECK_EQUAL(h.readQuantile(0.99), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
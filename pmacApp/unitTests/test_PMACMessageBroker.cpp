@@ -63,6 +63,30 @@ public:
   }
 };
 
+class TestCompletion : public pmacCompletionInterface
+{
+public:
+  TestCompletion()
+  {
+    succeeded_ = 0;
+    failed_ = 0;
+  };
+
+  ~TestCompletion(){};
+
+  int succeeded_;
+  int failed_;
+
+  void completed(const char *command, const char *response, asynStatus status)
+  {
+    if (status == asynSuccess) {
+      succeeded_++;
+    } else {
+      failed_++;
+    }
+  }
+};
+
 BOOST_FIXTURE_TEST_SUITE(PMACMessageBrokerTest, PMACMessageBrokerFixture)
 
 BOOST_AUTO_TEST_CASE(test_PMACMessageBroker)
@@ -193,4 +217,301 @@ BOOST_AUTO_TEST_CASE(test_PMACMessageBroker)
 
 }
 
+BOOST_AUTO_TEST_CASE(test_PMACMessageBrokerPipeline)
+{
+  int connected = 0;
+  int newConnection = 0;
+  int noOfMsgs = 0;
+  int totalBytesWritten = 0;
+  int totalBytesRead = 0;
+  int totalMsgTime = 0;
+  int lastMsgBytesWritten = 0;
+  int lastMsgBytesRead = 0;
+  int lastMsgTime = 0;
+  char var[16];
+
+  // Connect to the mock driver
+  BOOST_CHECK_EQUAL(pMB->connect(mockport.c_str(), 0), asynSuccess);
+  pMock->setResponse("OK");
+  BOOST_CHECK_NO_THROW(pMB->getConnectedStatus(&connected, &newConnection));
+  BOOST_CHECK_EQUAL(connected, 1);
+
+  // Check the pipeline depth limits
+  BOOST_CHECK_EQUAL(pMB->readPipelineDepth(), 1);
+  BOOST_CHECK_EQUAL(pMB->setPipelineDepth(0), asynError);
+  BOOST_CHECK_EQUAL(pMB->setPipelineDepth(PMAC_MAX_PIPELINE_DEPTH + 1), asynError);
+  BOOST_CHECK_EQUAL(pMB->setPipelineDepth(4), asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->readPipelineDepth(), 4);
+
+  // Add enough variables to require more than one command string (not
+  // named like PMAC variables so that they are not merged into ranges)
+  for (int index = 0; index < 50; index++) {
+    sprintf(var, "VAR%d", index);
+    BOOST_CHECK_EQUAL(pMB->addReadVariable(pmacMessageBroker::PMAC_FAST_READ, var), asynSuccess);
+  }
+  TestCallback *cbPtr = new TestCallback();
+  BOOST_CHECK_NO_THROW(pMB->registerForUpdates(cbPtr, pmacMessageBroker::PMAC_FAST_READ));
+
+  pMock->clearStore();
+  pMock->setResponse("7\r");
+  BOOST_CHECK_EQUAL(pMB->readStatistics(&noOfMsgs,
+                                        &totalBytesWritten,
+                                        &totalBytesRead,
+                                        &totalMsgTime,
+                                        &lastMsgBytesWritten,
+                                        &lastMsgBytesRead,
+                                        &lastMsgTime), asynSuccess);
+  int startMsgs = noOfMsgs;
+  BOOST_CHECK_NO_THROW(pMB->updateVariables(pmacMessageBroker::PMAC_FAST_READ));
+
+  // Both command strings must have been written, in order, and each reply
+  // matched back to its own command string
+  std::string cmd0 = cbPtr->sPtr_->readCommandString(0);
+  std::string cmd1 = cbPtr->sPtr_->readCommandString(1);
+  BOOST_CHECK_EQUAL(pMock->checkForWrite(cmd0, 0), true);
+  BOOST_CHECK_EQUAL(pMock->checkForWrite(cmd1, 1), true);
+  BOOST_CHECK_EQUAL(cbPtr->sPtr_->readValue(cmd0.substr(0, cmd0.find(" "))), "7");
+  BOOST_CHECK_EQUAL(cbPtr->sPtr_->readValue(cmd1.substr(0, cmd1.find(" "))), "7");
+
+  BOOST_CHECK_EQUAL(pMB->readStatistics(&noOfMsgs,
+                                        &totalBytesWritten,
+                                        &totalBytesRead,
+                                        &totalMsgTime,
+                                        &lastMsgBytesWritten,
+                                        &lastMsgBytesRead,
+                                        &lastMsgTime), asynSuccess);
+  BOOST_CHECK_EQUAL(noOfMsgs - startMsgs, 2);
+  BOOST_CHECK_EQUAL(lastMsgBytesRead, 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACMessageBrokerSlices)
+{
+  int connected = 0;
+  int newConnection = 0;
+  int noOfMsgs = 0;
+  int totalBytesWritten = 0;
+  int totalBytesRead = 0;
+  int totalMsgTime = 0;
+  int lastMsgBytesWritten = 0;
+  int lastMsgBytesRead = 0;
+  int lastMsgTime = 0;
+  char var[16];
+
+  // Connect to the mock driver
+  BOOST_CHECK_EQUAL(pMB->connect(mockport.c_str(), 0), asynSuccess);
+  pMock->setResponse("OK");
+  BOOST_CHECK_NO_THROW(pMB->getConnectedStatus(&connected, &newConnection));
+  BOOST_CHECK_EQUAL(connected, 1);
+
+  // Only the medium and slow stores can be sliced
+  BOOST_CHECK_EQUAL(pMB->updateVariablesSlice(pmacMessageBroker::PMAC_FAST_READ, 1.0, true),
+                    asynError);
+
+  // Enough variables for three command strings
+  for (int index = 0; index < 100; index++) {
+    sprintf(var, "VAR%d", index);
+    BOOST_CHECK_EQUAL(pMB->addReadVariable(pmacMessageBroker::PMAC_MEDIUM_READ, var), asynSuccess);
+  }
+  TestCallback *cbPtr = new TestCallback();
+  BOOST_CHECK_NO_THROW(pMB->registerForUpdates(cbPtr, pmacMessageBroker::PMAC_MEDIUM_READ));
+
+  pMock->clearStore();
+  pMock->setResponse("7\r");
+  BOOST_CHECK_EQUAL(pMB->readStatistics(&noOfMsgs, &totalBytesWritten, &totalBytesRead,
+                                        &totalMsgTime, &lastMsgBytesWritten,
+                                        &lastMsgBytesRead, &lastMsgTime), asynSuccess);
+  int startMsgs = noOfMsgs;
+
+  // A fifth of the way through the pass one command string is read and no
+  // callback is made until the whole store has been read
+  BOOST_CHECK_EQUAL(pMB->updateVariablesSlice(pmacMessageBroker::PMAC_MEDIUM_READ, 0.2, true),
+                    asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->readStatistics(&noOfMsgs, &totalBytesWritten, &totalBytesRead,
+                                        &totalMsgTime, &lastMsgBytesWritten,
+                                        &lastMsgBytesRead, &lastMsgTime), asynSuccess);
+  BOOST_CHECK_EQUAL(noOfMsgs - startMsgs, 1);
+  BOOST_CHECK(cbPtr->sPtr_ == 0);
+
+  // No further command strings are due yet
+  BOOST_CHECK_EQUAL(pMB->updateVariablesSlice(pmacMessageBroker::PMAC_MEDIUM_READ, 0.3, false),
+                    asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->readStatistics(&noOfMsgs, &totalBytesWritten, &totalBytesRead,
+                                        &totalMsgTime, &lastMsgBytesWritten,
+                                        &lastMsgBytesRead, &lastMsgTime), asynSuccess);
+  BOOST_CHECK_EQUAL(noOfMsgs - startMsgs, 1);
+
+  // Complete the pass
+  BOOST_CHECK_EQUAL(pMB->updateVariablesSlice(pmacMessageBroker::PMAC_MEDIUM_READ, 1.5, false),
+                    asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->readStatistics(&noOfMsgs, &totalBytesWritten, &totalBytesRead,
+                                        &totalMsgTime, &lastMsgBytesWritten,
+                                        &lastMsgBytesRead, &lastMsgTime), asynSuccess);
+  BOOST_CHECK_EQUAL(noOfMsgs - startMsgs, 3);
+  BOOST_CHECK(cbPtr->sPtr_ != 0);
+  for (int cmd = 0; cmd < 3; cmd++) {
+    BOOST_CHECK_EQUAL(pMock->checkForWrite(cbPtr->sPtr_->readCommandString(cmd), cmd), true);
+  }
+
+  // Nothing more is read until the next pass, which finishes an overrun pass
+  BOOST_CHECK_EQUAL(pMB->updateVariablesSlice(pmacMessageBroker::PMAC_MEDIUM_READ, 1.0, false),
+                    asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->updateVariablesSlice(pmacMessageBroker::PMAC_MEDIUM_READ, 0.1, true),
+                    asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->updateVariablesSlice(pmacMessageBroker::PMAC_MEDIUM_READ, 0.1, true),
+                    asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->readStatistics(&noOfMsgs, &totalBytesWritten, &totalBytesRead,
+                                        &totalMsgTime, &lastMsgBytesWritten,
+                                        &lastMsgBytesRead, &lastMsgTime), asynSuccess);
+  BOOST_CHECK_EQUAL(noOfMsgs - startMsgs, 7);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACMessageBrokerSubmit)
+{
+  int connected = 0;
+  int newConnection = 0;
+  char command[16];
+  char response[1024];
+  TestCompletion completion;
+
+  // Commands cannot be queued without a connection
+  BOOST_CHECK_EQUAL(pMB->submitWriteRead("P4001=1", &completion), asynDisconnected);
+
+  // Connect to the mock driver
+  BOOST_CHECK_EQUAL(pMB->connect(mockport.c_str(), 0), asynSuccess);
+  pMock->setResponse("OK");
+  BOOST_CHECK_NO_THROW(pMB->getConnectedStatus(&connected, &newConnection));
+  BOOST_CHECK_EQUAL(connected, 1);
+
+  // Submitted commands reach the PMAC before a later immediate command
+  pMock->clearStore();
+  pMock->setResponse("\r");
+  BOOST_CHECK_EQUAL(pMB->submitWriteRead("P4001=1", &completion), asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->submitWriteRead("P4002=2", &completion), asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->submitWriteRead("P4003=3"), asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->immediateWriteRead("P4001", response), asynSuccess);
+  BOOST_CHECK_EQUAL(pMock->countWrites(), 4);
+  BOOST_CHECK_EQUAL(pMock->checkForWrite("P4001=1", 0), true);
+  BOOST_CHECK_EQUAL(pMock->checkForWrite("P4002=2", 1), true);
+  BOOST_CHECK_EQUAL(pMock->checkForWrite("P4003=3", 2), true);
+  BOOST_CHECK_EQUAL(pMock->checkForWrite("P4001", 3), true);
+  BOOST_CHECK_EQUAL(completion.succeeded_, 2);
+  BOOST_CHECK_EQUAL(completion.failed_, 0);
+  BOOST_CHECK_EQUAL(pMB->readSubmitFailures(), 0);
+
+  // Nothing is queued, so a flush returns at once
+  BOOST_CHECK_NO_THROW(pMB->flushSubmitted());
+
+  // A flush waits for every command submitted before it
+  pMock->clearStore();
+  BOOST_CHECK_EQUAL(pMB->setPipelineDepth(4), asynSuccess);
+  for (int index = 0; index < 6; index++) {
+    sprintf(command, "P%d=%d", 4010 + index, index);
+    BOOST_CHECK_EQUAL(pMB->submitWriteRead(command, &completion), asynSuccess);
+  }
+  pMB->flushSubmitted();
+  BOOST_CHECK_EQUAL(pMock->countWrites(), 6);
+  BOOST_CHECK_EQUAL(pMock->checkForWrite("P4010=0", 0), true);
+  BOOST_CHECK_EQUAL(pMock->checkForWrite("P4015=5", 5), true);
+  BOOST_CHECK_EQUAL(completion.succeeded_, 8);
+  BOOST_CHECK_EQUAL(pMB->readSubmitFailures(), 0);
+
+  // A priority command discards the commands still queued, and fails them,
+  // so that none of them follows it to the PMAC.  With one command sent per
+  // exchange the submit thread cannot have emptied the queue yet
+  pMock->clearStore();
+  BOOST_CHECK_EQUAL(pMB->setPipelineDepth(1), asynSuccess);
+  for (int index = 0; index < 5; index++) {
+    sprintf(command, "P%d=%d", 4020 + index, index);
+    BOOST_CHECK_EQUAL(pMB->submitWriteRead(command, &completion), asynSuccess);
+  }
+  BOOST_CHECK_EQUAL(pMB->priorityWriteRead("#*k", response), asynSuccess);
+  pMB->flushSubmitted();
+  int failures = pMB->readSubmitFailures();
+  BOOST_CHECK_GT(failures, 0);
+  BOOST_CHECK_EQUAL(completion.failed_, failures);
+  BOOST_CHECK_EQUAL(completion.succeeded_, 8 + 5 - failures);
+  BOOST_CHECK_EQUAL(pMock->countWrites(), 5 - failures + 1);
+  BOOST_CHECK_EQUAL(pMock->checkForWrite("#*k", 5 - failures), true);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACMessageBrokerLanes)
+{
+  int connected = 0;
+  int newConnection = 0;
+  char response[1024];
+  int pollLane = pmacMessageBroker::PMAC_POLL_LANE;
+  int commandLane = pmacMessageBroker::PMAC_COMMAND_LANE;
+  int trajectoryLane = pmacMessageBroker::PMAC_TRAJECTORY_LANE;
+
+  // Connect to the mock driver, each lane through its own asyn user
+  BOOST_CHECK_EQUAL(pMB->connect(mockport.c_str(), 0), asynSuccess);
+  pMock->setResponse("OK");
+  BOOST_CHECK_NO_THROW(pMB->getConnectedStatus(&connected, &newConnection));
+  BOOST_CHECK_EQUAL(connected, 1);
+
+  // Every lane and the priority path can exchange with the PMAC
+  pMock->clearStore();
+  BOOST_CHECK_EQUAL(pMB->immediateWriteRead("P1", response, true, pollLane), asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->immediateWriteRead("P2", response, true, commandLane), asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->immediateWriteRead("P3", response, true, trajectoryLane), asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->priorityWriteRead("#1j/", response), asynSuccess);
+  BOOST_CHECK_EQUAL(pMock->countWrites(), 4);
+  BOOST_CHECK_EQUAL(pMock->checkForWrite("#1j/", 3), true);
+
+  // A lane moved to its own port replaces its shared asyn user, once only
+  BOOST_CHECK_EQUAL(pMB->connectLane(PMAC_CONNECTION_LANES, mockport.c_str(), 0), asynError);
+  BOOST_CHECK_EQUAL(pMB->connectLane(commandLane, mockport.c_str(), 0), asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->connectLane(commandLane, mockport.c_str(), 0), asynError);
+  pMock->clearStore();
+  BOOST_CHECK_EQUAL(pMB->immediateWriteRead("P2", response, true, commandLane), asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->priorityWriteRead("#1j/", response), asynSuccess);
+  BOOST_CHECK_EQUAL(pMock->countWrites(), 2);
+
+  BOOST_CHECK_EQUAL(pMB->disconnect(), asynSuccess);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACMessageBrokerReconnect)
+{
+  int connected = 0;
+  int newConnection = 0;
+  char response[1024];
+
+  // Connecting again must not start a second reconnect thread
+  BOOST_CHECK_EQUAL(pMB->connect(mockport.c_str(), 0), asynSuccess);
+  BOOST_CHECK_EQUAL(pMB->connect(mockport.c_str(), 0), asynSuccess);
+  pMock->setResponse("OK");
+  BOOST_CHECK_NO_THROW(pMB->getConnectedStatus(&connected, &newConnection));
+  BOOST_CHECK_EQUAL(connected, 1);
+  pMB->clearNewConnection();
+
+  // A failed exchange marks the connection as lost
+  pMock->setFailWrites(true);
+  BOOST_CHECK_EQUAL(pMB->immediateWriteRead("P1", response), asynError);
+  pMock->clearStore();
+  BOOST_CHECK_EQUAL(pMB->getConnectedStatus(&connected, &newConnection), asynDisconnected);
+  BOOST_CHECK_EQUAL(connected, 0);
+  BOOST_CHECK_EQUAL(newConnection, 1);
+
+  // The reconnect thread probes at once, then after 0.5 s and a further 1 s,
+  // so three seconds see three probes rather than one every 0.5 s
+  epicsThreadSleep(3.0);
+  int probes = pMock->countWrites();
+  BOOST_CHECK_GE(probes, 2);
+  BOOST_CHECK_LE(probes, 4);
+  BOOST_CHECK_EQUAL(pMock->checkForWrite(""), true);
+
+  // The next probe, 2 s after the last, restores the connection
+  pMock->setFailWrites(false);
+  for (int wait = 0; wait < 50 && connected == 0; wait++) {
+    epicsThreadSleep(0.1);
+    pMB->getConnectedStatus(&connected, &newConnection);
+  }
+  BOOST_CHECK_EQUAL(connected, 1);
+  BOOST_CHECK_EQUAL(newConnection, 1);
+
+  // The destructor stops both broker threads
+  delete pMB;
+  pMB = NULL;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
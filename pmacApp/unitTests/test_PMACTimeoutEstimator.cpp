@@ -0,0 +1,123 @@
+/*
+ * test_PMACTimeoutEstimator.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *
+ */
+
+
+#include <stdio.h>
+
+
+#include "boost/test/unit_test.hpp"
+
+#include "pmacTestingUtilities.h"
+#include "pmacTimeoutEstimator.h"
+
+
+struct PMACTimeoutEstimatorFixture
+{
+};
+
+BOOST_FIXTURE_TEST_SUITE(PMACTimeoutEstimatorTest, PMACTimeoutEstimatorFixture)
+
+BOOST_AUTO_TEST_CASE(test_PMACTimeoutEstimatorInitial)
+{
+  pmacTimeoutEstimator e;
+  double history[PMAC_TIMEOUT_HISTORY];
+
+  // Until a round trip is measured the ceiling is used
+  e.setLimits(0.25, 2.0);
+  BOOST_CHECK_CLOSE(e.timeout(), 2.0, 1e-9);
+  BOOST_CHECK(e.readSmoothedRoundTrip() < 0.0);
+  BOOST_CHECK_EQUAL(e.readTimeoutCount(), 0);
+  BOOST_CHECK_EQUAL(e.readHistory(history, PMAC_TIMEOUT_HISTORY), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACTimeoutEstimatorRoundTrip)
+{
+  pmacTimeoutEstimator e;
+  e.setLimits(0.01, 2.0);
+
+  // First sample, srtt = R, rttvar = R/2, timeout = R + 4R/2
+  e.recordRoundTrip(0.1);
+  BOOST_CHECK_CLOSE(e.readSmoothedRoundTrip(), 0.1, 1e-9);
+  BOOST_CHECK_CLOSE(e.readRoundTripVariation(), 0.05, 1e-9);
+  BOOST_CHECK_CLOSE(e.timeout(), 0.3, 1e-9);
+
+  // Second sample follows the RFC 6298 gains
+  e.recordRoundTrip(0.2);
+  BOOST_CHECK_CLOSE(e.readRoundTripVariation(), 0.75 * 0.05 + 0.25 * 0.1, 1e-9);
+  BOOST_CHECK_CLOSE(e.readSmoothedRoundTrip(), 0.875 * 0.1 + 0.125 * 0.2, 1e-9);
+
+  // A steady link converges towards its round trip time
+  for (int index = 0; index < 200; index++) {
+    e.recordRoundTrip(0.002);
+  }
+  BOOST_CHECK_CLOSE(e.readSmoothedRoundTrip(), 0.002, 1.0);
+  BOOST_CHECK_CLOSE(e.timeout(), 0.01, 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACTimeoutEstimatorLimits)
+{
+  pmacTimeoutEstimator e;
+  e.setLimits(0.25, 2.0);
+
+  // Never below the floor
+  e.recordRoundTrip(0.001);
+  BOOST_CHECK_CLOSE(e.timeout(), 0.25, 1e-9);
+
+  // Never above the ceiling
+  e.recordRoundTrip(5.0);
+  BOOST_CHECK_CLOSE(e.timeout(), 2.0, 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACTimeoutEstimatorBackoff)
+{
+  pmacTimeoutEstimator e;
+  double history[PMAC_TIMEOUT_HISTORY];
+  e.setLimits(0.25, 2.0);
+  e.recordRoundTrip(0.001);
+
+  // Each timeout doubles the next one, up to the ceiling
+  e.recordTimeout();
+  BOOST_CHECK_CLOSE(e.timeout(), 0.5, 1e-9);
+  e.recordTimeout();
+  BOOST_CHECK_CLOSE(e.timeout(), 1.0, 1e-9);
+  e.recordTimeout();
+  BOOST_CHECK_CLOSE(e.timeout(), 2.0, 1e-9);
+  e.recordTimeout();
+  BOOST_CHECK_CLOSE(e.timeout(), 2.0, 1e-9);
+  BOOST_CHECK_EQUAL(e.readTimeoutCount(), 4);
+
+  // The history holds the timeouts that expired, oldest first
+  BOOST_CHECK_EQUAL(e.readHistory(history, PMAC_TIMEOUT_HISTORY), 4);
+  BOOST_CHECK_CLOSE(history[0], 0.25, 1e-9);
+  BOOST_CHECK_CLOSE(history[1], 0.5, 1e-9);
+  BOOST_CHECK_CLOSE(history[2], 1.0, 1e-9);
+  BOOST_CHECK_CLOSE(history[3], 2.0, 1e-9);
+
+  // A reply clears the backoff
+  e.recordRoundTrip(0.001);
+  BOOST_CHECK_CLOSE(e.timeout(), 0.25, 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACTimeoutEstimatorHistoryWraps)
+{
+  pmacTimeoutEstimator e;
+  double history[PMAC_TIMEOUT_HISTORY];
+  e.setLimits(0.25, 2.0);
+
+  for (int index = 0; index < PMAC_TIMEOUT_HISTORY + 3; index++) {
+    e.recordRoundTrip(0.001 * (index + 1));
+    e.recordTimeout();
+  }
+  BOOST_CHECK_EQUAL(e.readTimeoutCount(), PMAC_TIMEOUT_HISTORY + 3);
+  BOOST_CHECK_EQUAL(e.readHistory(history, PMAC_TIMEOUT_HISTORY), PMAC_TIMEOUT_HISTORY);
+
+  // Only the most recent are returned when the buffer is short
+  BOOST_CHECK_EQUAL(e.readHistory(history, 2), 2);
+  BOOST_CHECK_CLOSE(history[1], e.timeout() / 2.0, 1e-9);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
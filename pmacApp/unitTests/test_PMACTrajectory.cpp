@@ -18,7 +18,10 @@
 #include <tr1/memory>
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <math.h>
 
+#include "pmacTestingUtilities.h"
 #include "pmacTrajectory.h"
 
 struct PMACTrajectoryFixture
@@ -147,6 +150,236 @@ BOOST_AUTO_TEST_CASE(test_PMACTrajectory)
 
 }
 
+BOOST_AUTO_TEST_CASE(test_PMACTrajectoryChunks)
+{
+  int points = PMAC_TRAJECTORY_CHUNK_POINTS + 100;
+  int *user = (int *)malloc(sizeof(int) * points);
+  double *time = (double *)malloc(sizeof(double) * points);
+  double *pos[9];
+  double *vel[9];
+  for (int axis = 0; axis < 9; axis++){
+    pos[axis] = NULL;
+    vel[axis] = NULL;
+  }
+  // Only axes 1 and 3 are in the scan, the others are not supplied
+  for (int axis = 1; axis <= 3; axis += 2){
+    pos[axis] = (double *)malloc(sizeof(double) * points);
+    vel[axis] = (double *)malloc(sizeof(double) * points);
+    for (int index = 0; index < points; index++){
+      pos[axis][index] = (double)(axis * 1000000 + index);
+      vel[axis][index] = (double)(-axis * 1000000 - index);
+    }
+  }
+  for (int index = 0; index < points; index++){
+    user[index] = index % 16;
+    time[index] = (double)index;
+  }
+
+  // Nothing is allocated until points are appended
+  BOOST_CHECK_EQUAL(trajectory.initialise(10000000, 0xA), asynSuccess);
+  BOOST_CHECK_EQUAL(trajectory.getTotalNoOfPoints(), 10000000);
+  BOOST_CHECK_EQUAL(trajectory.getNoOfChunks(), 0);
+
+  // Appends that cross a chunk boundary
+  BOOST_CHECK_EQUAL(trajectory.append(pos, vel, time, user, 10), asynSuccess);
+  BOOST_CHECK_EQUAL(trajectory.getNoOfChunks(), 1);
+  double *posOffset[9];
+  double *velOffset[9];
+  for (int axis = 0; axis < 9; axis++){
+    posOffset[axis] = pos[axis] ? pos[axis] + 10 : NULL;
+    velOffset[axis] = vel[axis] ? vel[axis] + 10 : NULL;
+  }
+  BOOST_CHECK_EQUAL(trajectory.append(posOffset, velOffset, time + 10, user + 10, points - 10),
+                    asynSuccess);
+  BOOST_CHECK_EQUAL(trajectory.getNoOfValidPoints(), points);
+  BOOST_CHECK_EQUAL(trajectory.getNoOfChunks(), 2);
+
+  // Values either side of the boundary are intact
+  int timeVal;
+  int userVal;
+  double positionVal;
+  double velocityVal;
+  for (int index = PMAC_TRAJECTORY_CHUNK_POINTS - 2; index < PMAC_TRAJECTORY_CHUNK_POINTS + 2; index++){
+    BOOST_CHECK_EQUAL(trajectory.getTime(index, &timeVal), asynSuccess);
+    BOOST_CHECK_EQUAL(timeVal, index);
+    BOOST_CHECK_EQUAL(trajectory.getUserMode(index, &userVal), asynSuccess);
+    BOOST_CHECK_EQUAL(userVal, index % 16);
+    BOOST_CHECK_EQUAL(trajectory.getPosition(3, index, &positionVal), asynSuccess);
+    BOOST_CHECK_EQUAL(positionVal, 3000000 + index);
+    BOOST_CHECK_EQUAL(trajectory.getVelocity(1, index, &velocityVal), asynSuccess);
+    BOOST_CHECK_EQUAL(velocityVal, -1000000 - index);
+  }
+  BOOST_CHECK_EQUAL(trajectory.getPosition(1, points - 1, &positionVal), asynSuccess);
+  BOOST_CHECK_EQUAL(positionVal, 1000000 + points - 1);
+
+  // Axes outside of the mask are not stored
+  BOOST_CHECK_EQUAL(trajectory.getPosition(0, 5, &positionVal), asynError);
+  BOOST_CHECK_EQUAL(trajectory.getVelocity(2, 5, &velocityVal), asynError);
+
+  // Releasing frees the points
+  trajectory.release();
+  BOOST_CHECK_EQUAL(trajectory.getNoOfChunks(), 0);
+  BOOST_CHECK_EQUAL(trajectory.getNoOfValidPoints(), 0);
+  BOOST_CHECK_EQUAL(trajectory.getTotalNoOfPoints(), 0);
+  BOOST_CHECK_EQUAL(trajectory.getTime(0, &timeVal), asynError);
+
+  for (int axis = 1; axis <= 3; axis += 2){
+    free(pos[axis]);
+    free(vel[axis]);
+  }
+  free(time);
+  free(user);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACTrajectorySlices)
+{
+  pmacTrajectorySlice slice;
+  int points = PMAC_TRAJECTORY_CHUNK_POINTS + 10;
+  int offset = 0;
+
+  BOOST_CHECK_EQUAL(trajectory.initialise(points, 0x4), asynSuccess);
+
+  // Write points straight into the store, the first slice ends with the chunk
+  BOOST_CHECK_EQUAL(trajectory.getAppendSlice(0, points, &slice), asynSuccess);
+  BOOST_CHECK_EQUAL(slice.first, 0);
+  BOOST_CHECK_EQUAL(slice.count, PMAC_TRAJECTORY_CHUNK_POINTS);
+  BOOST_CHECK(slice.positions[0] == NULL);
+  BOOST_CHECK(slice.positions[2] != NULL);
+  while (offset < points){
+    BOOST_CHECK_EQUAL(trajectory.getAppendSlice(offset, points - offset, &slice), asynSuccess);
+    for (int index = 0; index < slice.count; index++){
+      slice.positions[2][index] = (double)(offset + index) / 2.0;
+      slice.velocities[2][index] = 1.0;
+      slice.times[index] = 1000;
+      slice.user[index] = 1;
+    }
+    offset += slice.count;
+  }
+  BOOST_CHECK_EQUAL(slice.count, 10);
+
+  // Nothing is valid until committed
+  BOOST_CHECK_EQUAL(trajectory.getNoOfValidPoints(), 0);
+  BOOST_CHECK_EQUAL(trajectory.getSlice(0, 1, &slice), asynError);
+  BOOST_CHECK_EQUAL(trajectory.commit(points), asynSuccess);
+  BOOST_CHECK_EQUAL(trajectory.getNoOfValidPoints(), points);
+
+  // Read back a run that crosses the chunk boundary
+  BOOST_CHECK_EQUAL(trajectory.getSlice(PMAC_TRAJECTORY_CHUNK_POINTS - 2, 5, &slice), asynSuccess);
+  BOOST_CHECK_EQUAL(slice.count, 2);
+  BOOST_CHECK_EQUAL(slice.positions[2][1], (PMAC_TRAJECTORY_CHUNK_POINTS - 1) / 2.0);
+  BOOST_CHECK_EQUAL(trajectory.getSlice(slice.first + slice.count, 5, &slice), asynSuccess);
+  BOOST_CHECK_EQUAL(slice.first, PMAC_TRAJECTORY_CHUNK_POINTS);
+  BOOST_CHECK_EQUAL(slice.count, 5);
+  BOOST_CHECK_EQUAL(slice.positions[2][0], PMAC_TRAJECTORY_CHUNK_POINTS / 2.0);
+
+  // A slice never runs past the valid points or the storage
+  BOOST_CHECK_EQUAL(trajectory.getSlice(points - 1, 100, &slice), asynSuccess);
+  BOOST_CHECK_EQUAL(slice.count, 1);
+  BOOST_CHECK_EQUAL(trajectory.getAppendSlice(0, 1, &slice), asynError);
+
+  // Invalid times and user values are rejected on commit
+  BOOST_CHECK_EQUAL(trajectory.initialise(10, 0x4), asynSuccess);
+  BOOST_CHECK_EQUAL(trajectory.getAppendSlice(0, 10, &slice), asynSuccess);
+  for (int index = 0; index < 10; index++){
+    slice.times[index] = 1000;
+    slice.user[index] = 0;
+  }
+  slice.times[4] = 0x1000000;
+  BOOST_CHECK_EQUAL(trajectory.commit(10), asynError);
+  slice.times[4] = 1000;
+  slice.user[9] = 0x10;
+  BOOST_CHECK_EQUAL(trajectory.commit(10), asynError);
+  slice.user[9] = 0xF;
+  BOOST_CHECK_EQUAL(trajectory.commit(10), asynSuccess);
+  BOOST_CHECK_EQUAL(trajectory.getNoOfValidPoints(), 10);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACTrajectoryVelocities)
+{
+  int points = 20000;
+  int errors = 0;
+  std::vector<double> positions(points + 1);
+  std::vector<double> times(points + 1);
+  std::vector<int> modes(points + 1);
+  std::vector<double> expected(points);
+  std::vector<double> velocities(points);
+
+  fillVelocityTestPoints(&positions[0], &times[0], &modes[0], points);
+
+  // Every mode, in runs of many lengths, gives the same result as the original calculation
+  BOOST_CHECK(referenceVelocities(&positions[0], &times[0], &modes[0], points, -1.0, 2.0,
+                                  &expected[0]));
+  BOOST_CHECK_EQUAL(trajectory.calculateVelocities(&positions[0], &times[0], &modes[0], points,
+                                                   -1.0, 2.0, &velocities[0], 0), asynSuccess);
+  for (int index = 0; index < points; index++){
+    if (velocities[index] != expected[index]){
+      errors++;
+    }
+  }
+  BOOST_CHECK_EQUAL(errors, 0);
+
+  // Calculating in two parts, carrying the last point over, gives the same result
+  BOOST_CHECK_EQUAL(trajectory.calculateVelocities(&positions[0], &times[0], &modes[0], 777,
+                                                   -1.0, 2.0, &velocities[0], 0), asynSuccess);
+  BOOST_CHECK_EQUAL(trajectory.calculateVelocities(&positions[777], &times[777], &modes[777],
+                                                   points - 777, positions[776], velocities[776],
+                                                   &velocities[777], 777), asynSuccess);
+  errors = 0;
+  for (int index = 0; index < points; index++){
+    if (velocities[index] != expected[index]){
+      errors++;
+    }
+  }
+  BOOST_CHECK_EQUAL(errors, 0);
+
+  // Calculating in EGU and then scaling, as the build does, matches the
+  // original calculation in counts to within rounding
+  double maxDifference = 0.0;
+  BOOST_CHECK(referenceCountVelocities(&positions[0], &times[0], &modes[0], points, 0.5, 0.001,
+                                       -1.0, 2.0, &expected[0]));
+  pmacTrajectory::convertToCounts(&velocities[0], points, 0.0, 0.001, &velocities[0]);
+  for (int index = 0; index < points; index++){
+    double difference = fabs(velocities[index] - expected[index]) / (1.0 + fabs(expected[index]));
+    if (difference > maxDifference){
+      maxDifference = difference;
+    }
+  }
+  BOOST_CHECK_SMALL(maxDifference, 1e-8);
+
+  // Bad times are found anywhere in a run, and bad modes are rejected
+  for (int mode = 0; mode < 5; mode++){
+    for (int index = 0; index < 10; index++){
+      modes[index] = mode;
+    }
+    times[5] = 0.0;
+    times[6] = mode == 0 ? 0.0 : 1000.0;
+    BOOST_CHECK_EQUAL(trajectory.calculateVelocities(&positions[0], &times[0], &modes[0], 10,
+                                                     0.0, 0.0, &velocities[0], 0),
+                      mode == 3 ? asynSuccess : asynError);
+    times[5] = 1000.0;
+    times[6] = 1000.0;
+    BOOST_CHECK_EQUAL(trajectory.calculateVelocities(&positions[0], &times[0], &modes[0], 10,
+                                                     0.0, 0.0, &velocities[0], 0), asynSuccess);
+  }
+  modes[3] = 5;
+  BOOST_CHECK_EQUAL(trajectory.calculateVelocities(&positions[0], &times[0], &modes[0], 10,
+                                                   0.0, 0.0, &velocities[0], 0), asynError);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACTrajectoryConvertToCounts)
+{
+  double egu[5] = {-1.0, 0.0, 0.5, 2.0, 1000.25};
+  double counts[5];
+
+  // The same as converting one position at a time, and can be done in place
+  pmacTrajectory::convertToCounts(egu, 5, 0.5, 0.001, counts);
+  for (int index = 0; index < 5; index++){
+    BOOST_CHECK_EQUAL(counts[index], (egu[index] - 0.5) / 0.001);
+  }
+  pmacTrajectory::convertToCounts(counts, 5, 0.0, 4.0, counts);
+  BOOST_CHECK_EQUAL(counts[3], 1500.0 / 4.0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 
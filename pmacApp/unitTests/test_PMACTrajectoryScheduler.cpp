@@ -0,0 +1,114 @@
+/*
+ * test_PMACTrajectoryScheduler.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *
+ */
+
+
+#include <stdio.h>
+
+
+#include "boost/test/unit_test.hpp"
+
+#include "pmacTestingUtilities.h"
+#include "pmacTrajectoryScheduler.h"
+
+
+struct PMACTrajectorySchedulerFixture
+{
+};
+
+BOOST_FIXTURE_TEST_SUITE(PMACTrajectorySchedulerTest, PMACTrajectorySchedulerFixture)
+
+BOOST_AUTO_TEST_CASE(test_PMACTrajectorySchedulerIdle)
+{
+  pmacTrajectoryScheduler s;
+
+  // Outside a fill every read is allowed
+  BOOST_CHECK(!s.isFilling());
+  BOOST_CHECK(s.statusReadDue(0.0, 0.01));
+  BOOST_CHECK(s.hasSlack(0.0, 0.01));
+
+  // With no deadline (scan not started) reads carry on during the fill
+  s.startFill(1.0, 100, -1.0, 0.4);
+  BOOST_CHECK(s.isFilling());
+  BOOST_CHECK(s.statusReadDue(1.05, 0.01));
+  s.endFill();
+  BOOST_CHECK(!s.isFilling());
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACTrajectorySchedulerMinimumRate)
+{
+  pmacTrajectoryScheduler s;
+
+  // Nothing measured yet, so only the guaranteed minimum rate applies
+  s.statusRead(0.0);
+  s.startFill(0.0, 1000, 1.0, 0.4);
+  BOOST_CHECK(s.estimateRemaining() < 0.0);
+  BOOST_CHECK(!s.statusReadDue(0.1, 0.01));
+  BOOST_CHECK(!s.statusReadDue(0.39, 0.01));
+  BOOST_CHECK(s.statusReadDue(0.4, 0.01));
+  s.statusRead(0.4);
+  BOOST_CHECK(!s.statusReadDue(0.5, 0.01));
+  BOOST_CHECK(s.statusReadDue(0.8, 0.01));
+  // Medium and slow reads wait for the fill
+  BOOST_CHECK(!s.hasSlack(0.5, 0.01));
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACTrajectorySchedulerBandwidth)
+{
+  pmacTrajectoryScheduler s;
+
+  // 10000 bytes/s, smoothed
+  s.recordTransfer(1000, 0.1);
+  BOOST_CHECK_CLOSE(s.readBandwidth(), 10000.0, 0.001);
+  s.recordTransfer(2000, 0.1);
+  BOOST_CHECK_CLOSE(s.readBandwidth(), 12500.0, 0.001);
+  // Failed or instantaneous exchanges do not change the estimate
+  s.recordTransfer(1000, 0.0);
+  BOOST_CHECK_CLOSE(s.readBandwidth(), 12500.0, 0.001);
+}
+
+BOOST_AUTO_TEST_CASE(test_PMACTrajectorySchedulerHeadroom)
+{
+  pmacTrajectoryScheduler s;
+  s.statusRead(0.0);
+
+  // A first fill (no deadline) measures 100 bytes per point at 10000 bytes/s
+  s.startFill(0.0, 100, -1.0, 0.4);
+  s.recordTransfer(5000, 0.5);
+  s.pointsWritten(50);
+  s.recordTransfer(5000, 0.5);
+  s.pointsWritten(50);
+  s.endFill();
+  BOOST_CHECK_CLOSE(s.readBandwidth(), 10000.0, 0.001);
+
+  // 100 points take 1 second to write; with 3 seconds of headroom there is
+  // time for full rate reads
+  s.startFill(10.0, 100, 3.0, 0.4);
+  BOOST_CHECK_CLOSE(s.estimateRemaining(), 1.0, 0.001);
+  BOOST_CHECK(s.statusReadDue(10.1, 0.05));
+  s.statusRead(10.1);
+  BOOST_CHECK(s.statusReadDue(10.2, 0.05));
+  BOOST_CHECK(s.hasSlack(10.2, 0.05));
+
+  // Half written, 0.5 s of writing left, only 0.55 s before the deadline,
+  // which is too little for a 0.05 s read
+  s.recordTransfer(5000, 0.5);
+  s.pointsWritten(50);
+  BOOST_CHECK_CLOSE(s.estimateRemaining(), 0.5, 0.001);
+  s.statusRead(12.4);
+  BOOST_CHECK(!s.hasSlack(12.45, 0.05));
+  BOOST_CHECK(!s.statusReadDue(12.45, 0.05));
+  // ... but the minimum rate is still kept
+  BOOST_CHECK(s.statusReadDue(12.8, 0.05));
+  s.endFill();
+
+  // A fill that is already late never has slack
+  s.startFill(20.0, 100, 0.0, 0.4);
+  s.statusRead(20.0);
+  BOOST_CHECK(!s.statusReadDue(20.1, 0.001));
+}
+
+BOOST_AUTO_TEST_SUITE_END()